@@ -0,0 +1,6387 @@
+#include "persimmon.h"
+#ifndef PERSIMMON_INTERNAL_H
+#define PERSIMMON_INTERNAL_H
+
+#include <string.h>
+
+/* Trie Geometry */
+
+#define PERSIMM_BITS 5
+#define PERSIMM_WIDTH (1 << PERSIMM_BITS) /* 2^5 = 32 */
+#define PERSIMM_MASK (PERSIMM_WIDTH - 1) /* 31, or 0x1f */
+
+/* The public header promises callers one shard per root slot. */
+typedef char persimm_split_ways_match[PERSIMM_SPLIT_WAYS == PERSIMM_WIDTH ? 1 : -1];
+
+/* Private Types */
+
+typedef struct persimm_vector_node persimm_vector_node_t;
+typedef struct persimm_list_cell persimm_list_cell_t;
+typedef struct persimm_hamt_node persimm_hamt_node_t;
+
+/* Allocation */
+
+/* Core-only tests replace allocation so that every failure path can be
+ * exercised. Normal builds continue to call the C allocator directly. */
+#if defined(PERSIMM_TEST_ALLOC)
+void *persimm_test_calloc(size_t count, size_t size);
+void persimm_test_free(void *ptr);
+#define calloc persimm_test_calloc
+#define free persimm_test_free
+#endif
+
+static inline bool persimm_size_add(size_t a, size_t b, size_t *result) {
+    if (a > SIZE_MAX - b) return false;
+    *result = a + b;
+    return true;
+}
+
+static inline bool persimm_size_mul(size_t a, size_t b, size_t *result) {
+    if (0 != a && b > SIZE_MAX / a) return false;
+    *result = a * b;
+    return true;
+}
+
+/*
+ * Shared by the implementation of each structure. Not installed and not part
+ * of the library's interface.
+ */
+
+/* Atomics */
+
+/*
+ * Reference counts are manipulated with acquire/release ordering so that a node
+ * dropping to zero on one thread sees every write made through the references
+ * that preceded it. Increments can be relaxed: the caller already holds a
+ * reference, so the node cannot be freed underneath it.
+ *
+ * PERSIMM_RC_INC and PERSIMM_RC_DEC both evaluate to the count as it was
+ * before the operation, following the C11 fetch functions. PERSIMM_RC_PEEK and
+ * PERSIMM_RC_PUT read and write the count with no ordering at all, which is
+ * all a count no other thread can see needs, and PERSIMM_RC_STORE writes it
+ * with release ordering. PERSIMM_RC_CAS replaces the count
+ * with `desired` only if it still holds `expected`, and otherwise loads what
+ * it does hold into `expected`, following the C11 compare-exchange.
+ *
+ * The PERSIMM_PTR macros do the same for a pointer that is published to
+ * readers: stores release, loads acquire, and PERSIMM_PTR_CAS is a strong
+ * compare-exchange that never fails spuriously. PERSIMM_FENCE is a full
+ * barrier, for the few places a store must be visible before a later load.
+ *
+ * Defining PERSIMM_SINGLE_THREADED skips the atomic backends altogether, for a
+ * host that never lets a structure leave the thread that made it.
+ */
+
+#if defined(PERSIMM_SINGLE_THREADED)
+
+/* Left to the plain counts below. */
+
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+
+#include <stdatomic.h>
+typedef _Atomic size_t persimm_refcount_t;
+#define PERSIMM_RC_ATOMIC 1
+#define PERSIMM_RC_SET(rc, v) atomic_init(&(rc), (size_t)(v))
+#define PERSIMM_RC_LOAD(rc) atomic_load_explicit(&(rc), memory_order_acquire)
+#define PERSIMM_RC_INC(rc) atomic_fetch_add_explicit(&(rc), 1, memory_order_relaxed)
+#define PERSIMM_RC_DEC(rc) atomic_fetch_sub_explicit(&(rc), 1, memory_order_acq_rel)
+#define PERSIMM_RC_PEEK(rc) atomic_load_explicit(&(rc), memory_order_relaxed)
+#define PERSIMM_RC_PUT(rc, v) atomic_store_explicit(&(rc), (size_t)(v), memory_order_relaxed)
+#define PERSIMM_RC_STORE(rc, v) atomic_store_explicit(&(rc), (size_t)(v), memory_order_release)
+#define PERSIMM_RC_CAS(rc, expected, desired)                                         \
+    atomic_compare_exchange_weak_explicit(&(rc), &(expected), (size_t)(desired),      \
+                                          memory_order_acq_rel, memory_order_acquire)
+typedef _Atomic(void *) persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) atomic_init(&(p), (void *)(v))
+#define PERSIMM_PTR_LOAD(p) atomic_load_explicit(&(p), memory_order_acquire)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    atomic_compare_exchange_strong_explicit(&(p), &(expected), (void *)(desired),     \
+                                            memory_order_acq_rel, memory_order_acquire)
+#define PERSIMM_FENCE() atomic_thread_fence(memory_order_seq_cst)
+
+#elif defined(__GNUC__) || defined(__clang__)
+
+typedef size_t persimm_refcount_t;
+#define PERSIMM_RC_ATOMIC 1
+#define PERSIMM_RC_SET(rc, v) __atomic_store_n(&(rc), (size_t)(v), __ATOMIC_RELAXED)
+#define PERSIMM_RC_LOAD(rc) __atomic_load_n(&(rc), __ATOMIC_ACQUIRE)
+#define PERSIMM_RC_INC(rc) __atomic_fetch_add(&(rc), 1, __ATOMIC_RELAXED)
+#define PERSIMM_RC_DEC(rc) __atomic_fetch_sub(&(rc), 1, __ATOMIC_ACQ_REL)
+#define PERSIMM_RC_PEEK(rc) __atomic_load_n(&(rc), __ATOMIC_RELAXED)
+#define PERSIMM_RC_PUT(rc, v) __atomic_store_n(&(rc), (size_t)(v), __ATOMIC_RELAXED)
+#define PERSIMM_RC_STORE(rc, v) __atomic_store_n(&(rc), (size_t)(v), __ATOMIC_RELEASE)
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    __atomic_compare_exchange_n(&(rc), &(expected), (size_t)(desired), true,           \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+typedef void *persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) __atomic_store_n(&(p), (void *)(v), __ATOMIC_RELAXED)
+#define PERSIMM_PTR_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    __atomic_compare_exchange_n(&(p), &(expected), (void *)(desired), false,           \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define PERSIMM_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#elif defined(_WIN32)
+
+#include <windows.h>
+typedef volatile size_t persimm_refcount_t;
+#define PERSIMM_RC_ATOMIC 1
+#define PERSIMM_RC_SET(rc, v) ((rc) = (size_t)(v))
+#if defined(_WIN64)
+#define PERSIMM_RC_LOAD(rc) ((size_t)InterlockedCompareExchange64((volatile LONG64 *)&(rc), 0, 0))
+#define PERSIMM_RC_INC(rc) ((size_t)InterlockedIncrement64((volatile LONG64 *)&(rc)) - 1)
+#define PERSIMM_RC_DEC(rc) ((size_t)InterlockedDecrement64((volatile LONG64 *)&(rc)) + 1)
+#define PERSIMM_RC_SWAP(rc, expected, desired)                                         \
+    ((size_t)InterlockedCompareExchange64((volatile LONG64 *)&(rc), (LONG64)(desired), \
+                                          (LONG64)(expected)))
+#else
+#define PERSIMM_RC_LOAD(rc) ((size_t)InterlockedCompareExchange((volatile LONG *)&(rc), 0, 0))
+#define PERSIMM_RC_INC(rc) ((size_t)InterlockedIncrement((volatile LONG *)&(rc)) - 1)
+#define PERSIMM_RC_DEC(rc) ((size_t)InterlockedDecrement((volatile LONG *)&(rc)) + 1)
+#define PERSIMM_RC_SWAP(rc, expected, desired)                                         \
+    ((size_t)InterlockedCompareExchange((volatile LONG *)&(rc), (LONG)(desired),       \
+                                        (LONG)(expected)))
+#endif
+#define PERSIMM_RC_PEEK(rc) ((size_t)(rc))
+#define PERSIMM_RC_PUT(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_STORE(rc, v) (MemoryBarrier(), (rc) = (size_t)(v))
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    (PERSIMM_RC_SWAP(rc, expected, desired) == (expected)                             \
+         ? true : ((expected) = PERSIMM_RC_LOAD(rc), false))
+typedef void *volatile persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) ((p) = (void *)(v))
+#define PERSIMM_PTR_LOAD(p) InterlockedCompareExchangePointer(&(p), NULL, NULL)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    (InterlockedCompareExchangePointer(&(p), (void *)(desired), (expected)) == (expected) \
+         ? true : ((expected) = PERSIMM_PTR_LOAD(p), false))
+#define PERSIMM_FENCE() MemoryBarrier()
+
+#endif
+
+/* Without atomics, or without wanting them. */
+#if !defined(PERSIMM_RC_ATOMIC)
+
+typedef size_t persimm_refcount_t;
+#define PERSIMM_RC_ATOMIC 0
+#define PERSIMM_RC_SET(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_LOAD(rc) (rc)
+#define PERSIMM_RC_INC(rc) ((rc)++)
+#define PERSIMM_RC_DEC(rc) ((rc)--)
+#define PERSIMM_RC_PEEK(rc) (rc)
+#define PERSIMM_RC_PUT(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_STORE(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    ((rc) == (expected) ? ((rc) = (size_t)(desired), true) : ((expected) = (rc), false))
+typedef void *persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) ((p) = (void *)(v))
+#define PERSIMM_PTR_LOAD(p) (p)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    ((p) == (expected) ? ((p) = (void *)(desired), true) : ((expected) = (p), false))
+#define PERSIMM_FENCE() ((void)0)
+
+#endif
+
+/*
+ * Said once per turn of a loop that waits on another thread, so that a
+ * spinning core gives way to its hyperthread sibling and saves power. Where
+ * the compiler offers no hint the loop simply spins.
+ */
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define PERSIMM_RELAX() _mm_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define PERSIMM_RELAX() __builtin_ia32_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+#define PERSIMM_RELAX() __asm__ __volatile__("yield")
+#else
+#define PERSIMM_RELAX() ((void)0)
+#endif
+
+/*
+ * A count no real number of references can reach, marking storage that has
+ * been frozen. It is written once, before any other thread can see the
+ * storage, and never changes again, so a relaxed read of it is enough to
+ * skip the atomic that would otherwise follow.
+ */
+#define PERSIMM_RC_IMMORTAL SIZE_MAX
+
+/*
+ * The counts of a local collection's storage, which only ever moves between
+ * clones on one thread, step with a plain load and store where a shared one
+ * pays for a locked instruction. Both return the count as it was, as the
+ * macros do, and both leave an immortal count alone. Since that count is
+ * never 1, a caller that frees on 1 never frees frozen storage and a caller
+ * that updates in place on 1 always copies it.
+ */
+static inline size_t persimm_rc_inc(persimm_refcount_t *rc, bool local) {
+    size_t count = PERSIMM_RC_PEEK(*rc);
+    if (PERSIMM_RC_IMMORTAL == count) return count;
+    if (!local) return PERSIMM_RC_INC(*rc);
+    PERSIMM_RC_PUT(*rc, count + 1);
+    return count;
+}
+
+static inline size_t persimm_rc_dec(persimm_refcount_t *rc, bool local) {
+    size_t count = PERSIMM_RC_PEEK(*rc);
+    if (PERSIMM_RC_IMMORTAL == count) return count;
+    if (!local) return PERSIMM_RC_DEC(*rc);
+    PERSIMM_RC_PUT(*rc, count - 1);
+    return count;
+}
+
+/* Returns false if the count was already immortal, so walks can stop there. */
+static inline bool persimm_rc_freeze(persimm_refcount_t *rc) {
+    if (PERSIMM_RC_IMMORTAL == PERSIMM_RC_PEEK(*rc)) return false;
+    PERSIMM_RC_PUT(*rc, PERSIMM_RC_IMMORTAL);
+    return true;
+}
+
+/* Alignment */
+
+/*
+ * Never read from. It exists so that a flexible array member declared with it
+ * inherits the widest fundamental alignment, which lets one allocation hold
+ * either pointers or arbitrary element bytes.
+ */
+typedef union {
+    long long as_long_long;
+    long double as_long_double;
+    void *as_pointer;
+} persimm_align_t;
+
+/*
+ * C99 has no _Alignof, so the alignment is recovered from where a member lands
+ * after a single char. A HAMT node holds entries and child pointers in one
+ * allocation and rounds the boundary between them up to this.
+ */
+typedef struct {
+    char pad;
+    persimm_align_t value;
+} persimm_align_probe_t;
+
+#define PERSIMM_ALIGNMENT (offsetof(persimm_align_probe_t, value))
+#define PERSIMM_ALIGN_UP(n) (((n) + PERSIMM_ALIGNMENT - 1) & ~(PERSIMM_ALIGNMENT - 1))
+
+/* Bit Counting */
+
+/*
+ * A HAMT node turns a bitmap into an array index by counting the bits below
+ * the one it is looking at, so this sits on the hot path of every lookup.
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define PERSIMM_POPCOUNT(x) ((uint32_t)__builtin_popcount((unsigned int)(x)))
+
+#else
+
+static inline uint32_t persimm_popcount(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0f0f0f0fu;
+    return (x * 0x01010101u) >> 24;
+}
+
+#define PERSIMM_POPCOUNT(x) persimm_popcount(x)
+
+#endif
+
+/* Elements */
+
+static inline void persimm_elem_retain(const persimm_elem_ops *ops, void *ctx,
+                                       const void *slot) {
+    if (NULL != ops && NULL != ops->retain) ops->retain(slot, ctx);
+}
+
+static inline void persimm_elem_release(const persimm_elem_ops *ops, void *ctx,
+                                        const void *slot) {
+    if (NULL != ops && NULL != ops->release) ops->release(slot, ctx);
+}
+
+static inline bool persimm_elem_hashes(const persimm_elem_ops *ops) {
+    return NULL != ops && NULL != ops->hash;
+}
+
+/* Tracing */
+
+/*
+ * Claims a node for tracing in `epoch`, returning false when it was already
+ * traced in that epoch. Epoch zero is tracing in full: it claims every node
+ * and records nothing, so a full trace never writes to a node.
+ */
+static inline bool persimm_trace_claim(uint32_t *traced, uint32_t epoch) {
+    if (0 == epoch) return true;
+    if (*traced == epoch) return false;
+    *traced = epoch;
+    return true;
+}
+
+/*
+ * A HAMT node's stamp sits in padding it already had, but a vector node's or
+ * list cell's would push its elements out by a whole alignment step, which a
+ * host that never traces should not pay for. Those record epochs only when
+ * PERSIMM_TRACE_EPOCHS is defined, and otherwise claim every node as a full
+ * trace does.
+ */
+#if defined(PERSIMM_TRACE_EPOCHS)
+#define PERSIMM_TRACE_CLAIM(node, epoch) persimm_trace_claim(&(node)->traced, (epoch))
+#else
+#define PERSIMM_TRACE_CLAIM(node, epoch) ((void)(node), (void)(epoch), true)
+#endif
+
+/* Executors */
+
+/* Runs `tasks` calls of `fn` through `executor`, or in order here when it is NULL. */
+void persimm_executor_run(const persimm_executor *executor, size_t tasks, persimm_task_fn fn,
+                          void *arg);
+
+/* Node Sets */
+
+/*
+ * The storage one version reaches, gathered so that a walk of another can tell
+ * which of its nodes the first already holds. Open addressing over pointers,
+ * doubling whenever it is half full. A zeroed set is empty and ready for use.
+ */
+typedef struct {
+    const void **slots;
+    size_t capacity;
+    size_t count;
+} persimm_node_set_t;
+
+persimm_status persimm_node_set_add(persimm_node_set_t *set, const void *node);
+bool persimm_node_set_has(const persimm_node_set_t *set, const void *node);
+void persimm_node_set_free(persimm_node_set_t *set);
+
+/* Operation Counters */
+
+/*
+ * The counters behind persimm_stats_snapshot, one set per thread. Every count
+ * goes through these macros so that a build without PERSIMM_STATS carries no
+ * trace of them. C99 has no thread-local storage of its own, so each compiler
+ * is asked for it in its own words.
+ */
+#if defined(PERSIMM_STATS)
+
+#if defined(_MSC_VER)
+#define PERSIMM_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define PERSIMM_THREAD_LOCAL _Thread_local
+#else
+#define PERSIMM_THREAD_LOCAL __thread
+#endif
+
+extern PERSIMM_THREAD_LOCAL persimm_op_stats persimm_stats_local;
+
+#define PERSIMM_COUNT(kind, field) ((void)(persimm_stats_local.kind.field++))
+#define PERSIMM_COUNT_N(kind, field, n) ((void)(persimm_stats_local.kind.field += (n)))
+
+#else
+
+#define PERSIMM_COUNT(kind, field) ((void)0)
+#define PERSIMM_COUNT_N(kind, field, n) ((void)0)
+
+#endif
+
+/* Hashing */
+
+/*
+ * The structural hashes cached in trie nodes are sums, so that a node's can be
+ * corrected by what one path copy changed rather than recomputed. Each term is
+ * put through this finaliser first (MurmurHash3's), which spreads a change in
+ * any input bit across the whole word and keeps sums of similar terms apart.
+ */
+static inline uint32_t persimm_hash_mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* FNV-1a over a run of bytes, the hash used wherever the host supplies none. */
+static inline uint32_t persimm_hash_bytes(const void *bytes, size_t size) {
+    const unsigned char *byte = (const unsigned char *)bytes;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= byte[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Folds a collection's count into its structural hash, so that sizes differ too. */
+static inline uint32_t persimm_hash_finish(uint32_t hash, size_t count) {
+    return persimm_hash_mix(hash ^ persimm_hash_mix((uint32_t)count + 0x9e3779b9u));
+}
+
+/* Hash Array Mapped Tries */
+
+/*
+ * The CHAMP trie behind both the map and the set, implemented in
+ * persimmon_hamt.c. A set is a trie whose layout gives entries no value, so
+ * neither public face needs any part of this beyond passing it along.
+ *
+ * Everything here works on a root pointer rather than a structure, which is
+ * what lets persimm_map_t and persimm_set_t stay distinct types over one
+ * implementation without either of them casting to the other.
+ */
+typedef struct {
+    persimm_entry_layout layout;
+    const persimm_elem_ops *value_ops;
+    const persimm_key_ops *key_ops;
+    uint32_t (*hash)(const void *key, size_t key_size, void *ctx);
+    bool (*equals)(const void *key_a, const void *key_b, size_t key_size, void *ctx);
+    void *value_ctx;
+    void *key_ctx;
+    /* Counts references with plain arithmetic, as the collection's `local` says. */
+    bool local;
+} persimm_hamt_t;
+
+/*
+ * Resolves `key_ops` against the byte defaults once, so that no lookup has to
+ * test for a NULL callback on its way down the trie.
+ */
+void persimm_hamt_config(persimm_hamt_t *hamt, const persimm_entry_layout *layout,
+                         const persimm_elem_ops *value_ops, void *value_ctx,
+                         const persimm_key_ops *key_ops, void *key_ctx, bool local);
+
+bool persimm_hamt_layout_valid(const persimm_entry_layout *layout);
+
+void persimm_hamt_retain(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
+
+void persimm_hamt_release(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
+
+/* Makes every node reachable from `root` immortal. */
+void persimm_hamt_freeze(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
+
+/*
+ * Returns the entry whose key matches, or NULL. The key is the first
+ * `key_size` bytes of an entry, so the result is also a pointer to the stored
+ * key, and the value sits `value_offset` bytes further along.
+ */
+const void *persimm_hamt_ref(persimm_hamt_node_t *root, const void *key,
+                             const persimm_hamt_t *hamt);
+
+/*
+ * Stores `entry`, replacing only the value when the key is already present so
+ * that the key first stored is the key the trie keeps. `*added` reports
+ * whether the entry count grew. On failure `*root` is left as it was.
+ */
+persimm_status persimm_hamt_assoc(persimm_hamt_node_t **root, const void *entry,
+                                  const persimm_hamt_t *hamt, bool immutable, bool *added);
+
+persimm_status persimm_hamt_dissoc(persimm_hamt_node_t **root, const void *key,
+                                   const persimm_hamt_t *hamt, bool immutable, bool *removed);
+
+/*
+ * Builds a trie from `count` entries laid out `layout.entry_size` apart,
+ * allocating each node once at its final size. The result is the trie storing
+ * them one at a time would have produced: of a repeated key the first is kept
+ * and the last value wins. `*built` reports how many distinct keys it holds.
+ * On failure `*root` is NULL and nothing is left allocated.
+ */
+persimm_status persimm_hamt_build(persimm_hamt_node_t **root, const void *entries,
+                                  size_t count, const persimm_hamt_t *hamt, size_t *built);
+
+/* Builds as persimm_hamt_build does, the root's slots built as tasks on `executor`. */
+persimm_status persimm_hamt_parallel_build(persimm_hamt_node_t **root, const void *entries,
+                                           size_t count, const persimm_hamt_t *hamt,
+                                           const persimm_executor *executor, size_t *built);
+
+/*
+ * Stores `count` entries laid out `layout.entry_size` apart, or removes the
+ * entries for `count` keys laid out `layout.key_size` apart, as doing so one
+ * at a time would, but descending the trie once for the whole batch so that
+ * each node it reaches is copied at most once. Nodes are never changed in
+ * place. `*added` and `*removed` report how far the entry count moved. On
+ * failure `*root` is left as it was.
+ */
+persimm_status persimm_hamt_assoc_many(persimm_hamt_node_t **root, const void *entries,
+                                       size_t count, const persimm_hamt_t *hamt,
+                                       size_t *added);
+
+persimm_status persimm_hamt_dissoc_many(persimm_hamt_node_t **root, const void *keys,
+                                        size_t count, const persimm_hamt_t *hamt,
+                                        size_t *removed);
+
+/*
+ * Walks the trie once, calling `fn` with each entry. persimm_hamt_next follows
+ * the same order, so a host may drive iteration either way and see the same
+ * sequence.
+ */
+void persimm_hamt_foreach(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                          persimm_visit_fn fn, void *ctx);
+
+/*
+ * Visits or folds every entry as foreach does, but split into tasks run
+ * through `executor`, each of which numbers its entries from zero. Without an
+ * executor they walk the trie in order on the calling thread.
+ */
+persimm_status persimm_hamt_parallel_foreach(persimm_hamt_node_t *root,
+                                             const persimm_hamt_t *hamt, persimm_visit_fn fn,
+                                             void *ctx, const persimm_executor *executor);
+
+persimm_status persimm_hamt_parallel_reduce(persimm_hamt_node_t *root,
+                                            const persimm_hamt_t *hamt, persimm_fold_fn fold,
+                                            persimm_combine_fn combine, const void *identity,
+                                            size_t acc_size, void *ctx,
+                                            const persimm_executor *executor, void *result);
+
+/*
+ * Returns the entry after the one `key` belongs to, the first entry when `key`
+ * is NULL, or NULL at the end. This descends by hash rather than resuming from
+ * a cursor, so it costs the depth of the trie and needs nothing kept between
+ * calls, which is what lets a shared trie be iterated from several places.
+ */
+const void *persimm_hamt_next(persimm_hamt_node_t *root, const void *key,
+                              const persimm_hamt_t *hamt);
+
+void persimm_hamt_trace(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
+
+/* Traces as persimm_hamt_trace does, skipping each node already traced in `epoch`. */
+void persimm_hamt_trace_epoch(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              uint32_t epoch);
+
+/*
+ * Splits a trie by the slot each key takes in the root, leaving in `roots[i]`
+ * a trie of the keys in slot `i`, or NULL, and in `counts[i]` how many it
+ * holds. Both arrays have PERSIMM_WIDTH places. Joining takes `count` roots,
+ * any of them NULL, and builds the one trie holding them all, returning
+ * PERSIMM_ERR_INVALID when two of them use the same slot in the root. Each
+ * copies the root alone and shares everything below it, though a split counts
+ * the keys under each slot. On failure nothing is left allocated.
+ */
+persimm_status persimm_hamt_split(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                  persimm_hamt_node_t **roots, size_t *counts);
+
+persimm_status persimm_hamt_join(persimm_hamt_node_t *const *roots, size_t count,
+                                 const persimm_hamt_t *hamt, persimm_hamt_node_t **dest);
+
+/*
+ * Returns the structural hash the root carries: a sum over every entry of its
+ * key's hash mixed with its value's, which any two tries holding equal entries
+ * agree on however they were built. Zero for an empty trie.
+ */
+uint32_t persimm_hamt_hash(persimm_hamt_node_t *root);
+
+/*
+ * Adds the trie's nodes to `stats` as persimm_map_memory_stats describes.
+ * Gathering puts every node reachable from `root` into `nodes`, and the delta
+ * adds to `bytes` the size of each node reachable from `root` that `nodes`
+ * does not hold, skipping whatever lies beneath a node it does.
+ */
+void persimm_hamt_memory_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               persimm_memory_stats *stats);
+
+persimm_status persimm_hamt_memory_gather(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                          persimm_node_set_t *nodes);
+
+void persimm_hamt_memory_delta(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               const persimm_node_set_t *nodes, size_t *bytes);
+
+/* Fills `stats` as persimm_map_shape_stats describes. */
+void persimm_hamt_shape_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              persimm_shape_stats *stats);
+
+#endif /* end of include guard */
+#include <stdlib.h>
+
+/*
+ * The pieces every structure shares. The structures themselves each live in
+ * their own translation unit.
+ */
+
+/* Status Codes */
+
+const char *persimm_status_string(persimm_status status) {
+    switch (status) {
+        case PERSIMM_OK: return "ok";
+        case PERSIMM_ERR_ALLOC: return "out of memory";
+        case PERSIMM_ERR_BOUNDS: return "index out of bounds";
+        case PERSIMM_ERR_INVALID: return "invalid argument";
+        case PERSIMM_ERR_CORRUPT: return "corrupt structure";
+        default: return "unknown error";
+    }
+}
+
+/* Reference Counting */
+
+bool persimm_has_atomic_refcounts(void) {
+    return PERSIMM_RC_ATOMIC ? true : false;
+}
+
+/* Tracing */
+
+/*
+ * Counted the way reference counts are, so that threads never share an epoch.
+ * The count is cut to 32 bits, so epochs wrap as persimmon.h describes.
+ */
+static persimm_refcount_t persimm_trace_epochs;
+
+uint32_t persimm_trace_epoch_begin(void) {
+    uint32_t epoch;
+    do {
+        epoch = (uint32_t)(PERSIMM_RC_INC(persimm_trace_epochs) + 1);
+    } while (0 == epoch);
+    return epoch;
+}
+
+/* Operation Counters */
+
+#if defined(PERSIMM_STATS)
+PERSIMM_THREAD_LOCAL persimm_op_stats persimm_stats_local;
+#endif
+
+bool persimm_stats_snapshot(persimm_op_stats *dest) {
+#if defined(PERSIMM_STATS)
+    *dest = persimm_stats_local;
+    return true;
+#else
+    memset(dest, 0, sizeof(*dest));
+    return false;
+#endif
+}
+
+void persimm_stats_reset(void) {
+#if defined(PERSIMM_STATS)
+    memset(&persimm_stats_local, 0, sizeof(persimm_stats_local));
+#endif
+}
+
+/* Executors */
+
+/* A single task gains nothing from a pool, so it never leaves the calling thread. */
+void persimm_executor_run(const persimm_executor *executor, size_t tasks, persimm_task_fn fn,
+                          void *arg) {
+    if (NULL == executor || NULL == executor->run || tasks < 2) {
+        for (size_t i = 0; i < tasks; i++) fn(arg, i);
+        return;
+    }
+    executor->run(executor->ctx, tasks, fn, arg);
+}
+
+/* Node Sets */
+
+static size_t persimm_node_set_slot(const void *node, size_t capacity) {
+    uintptr_t bits = (uintptr_t)node;
+    bits ^= bits >> 17;
+    bits *= (uintptr_t)0x9e3779b97f4a7c15ull;
+    return (size_t)(bits ^ (bits >> 29)) & (capacity - 1);
+}
+
+static void persimm_node_set_place(const void **slots, size_t capacity, const void *node) {
+    size_t slot = persimm_node_set_slot(node, capacity);
+    while (NULL != slots[slot]) slot = (slot + 1) & (capacity - 1);
+    slots[slot] = node;
+}
+
+persimm_status persimm_node_set_add(persimm_node_set_t *set, const void *node) {
+    if (persimm_node_set_has(set, node)) return PERSIMM_OK;
+
+    if (2 * (set->count + 1) > set->capacity) {
+        size_t capacity = 0 == set->capacity ? 64 : 2 * set->capacity;
+        if (capacity > SIZE_MAX / (2 * sizeof(void *))) return PERSIMM_ERR_ALLOC;
+        const void **slots = calloc(capacity, sizeof(void *));
+        if (NULL == slots) return PERSIMM_ERR_ALLOC;
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (NULL != set->slots[i]) persimm_node_set_place(slots, capacity, set->slots[i]);
+        }
+        free((void *)set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    persimm_node_set_place(set->slots, set->capacity, node);
+    set->count++;
+    return PERSIMM_OK;
+}
+
+bool persimm_node_set_has(const persimm_node_set_t *set, const void *node) {
+    if (0 == set->capacity) return false;
+    size_t slot = persimm_node_set_slot(node, set->capacity);
+    while (NULL != set->slots[slot]) {
+        if (node == set->slots[slot]) return true;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+void persimm_node_set_free(persimm_node_set_t *set) {
+    free((void *)set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Types */
+
+typedef enum {
+    PERSIMM_VECTOR_NODE_INNER,
+    PERSIMM_VECTOR_NODE_LEAF
+} persimm_vector_node_type;
+
+struct persimm_vector_node {
+    persimm_vector_node_type kind;
+    uint32_t hash; // the elements beneath, weighted by position, when the ops can hash
+    persimm_refcount_t ref_count;
+#if defined(PERSIMM_TRACE_EPOCHS)
+    uint32_t traced; // the last epoch the node was traced in
+#endif
+    persimm_align_t data[];
+};
+
+static persimm_status persimm_vector_push_in_place(persimm_vector_t *vector,
+                                                   const void *elem, bool immutable);
+static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, size_t index,
+                                                     const void *elem, bool immutable);
+
+/* Element Access */
+
+static persimm_vector_node_t **persimm_vector_node_children(persimm_vector_node_t *node) {
+    return (persimm_vector_node_t **)node->data;
+}
+
+static void *persimm_vector_node_slot(persimm_vector_node_t *node, size_t index, size_t elem_size) {
+    return (unsigned char *)node->data + (index * elem_size);
+}
+
+/* Hashing */
+
+/*
+ * A vector's structural hash is a polynomial in its element hashes, the
+ * element at index i weighted by BASE^i. A leaf keeps the sum over its own
+ * slots and an inner node the sum of its children's, each weighted by where
+ * that child's span begins within the node's. Changing one element therefore
+ * moves every node on its path by the same difference times a known weight,
+ * which a path copy can apply on its way back without reading anything else.
+ * Arithmetic is modulo 2^32 and BASE is odd, so no weight is ever zero.
+ */
+#define PERSIMM_VECTOR_HASH_BASE 16777619u
+
+static bool persimm_vector_hashes(const persimm_vector_t *vector) {
+    return persimm_elem_hashes(vector->ops);
+}
+
+static uint32_t persimm_vector_elem_hash(const persimm_vector_t *vector, const void *slot) {
+    PERSIMM_COUNT(vector, hash_calls);
+    return vector->ops->hash(slot, vector->ctx);
+}
+
+static uint32_t persimm_vector_weight(size_t position) {
+    uint32_t weight = 1;
+    uint32_t base = PERSIMM_VECTOR_HASH_BASE;
+    while (position > 0) {
+        if (position & 1) weight *= base;
+        base *= base;
+        position >>= 1;
+    }
+    return weight;
+}
+
+/* Where `index` falls within the span of the node it passes through at `level`. */
+static size_t persimm_vector_span_offset(size_t index, size_t level) {
+    size_t bits = level + PERSIMM_BITS;
+    if (bits >= sizeof(size_t) * CHAR_BIT) return index;
+    return index & (((size_t)1 << bits) - 1);
+}
+
+/* Deinitialising */
+
+/*
+ * `live` is the number of leaf slots holding elements. Every leaf in the trie
+ * is full by construction, so only the tail is ever partial and only its owner
+ * knows how partial it is.
+ */
+static void persimm_vector_node_release(persimm_vector_node_t *node, size_t live, size_t elem_size,
+                                 const persimm_elem_ops *ops, void *ctx, bool local) {
+    if (NULL == node) return;
+
+    if (persimm_rc_dec(&node->ref_count, local) > 1) return;
+
+    if (node->kind == PERSIMM_VECTOR_NODE_INNER) {
+        persimm_vector_node_t **children = persimm_vector_node_children(node);
+        for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+            if (NULL == children[i]) continue;
+            persimm_vector_node_release(children[i], PERSIMM_WIDTH, elem_size, ops, ctx, local);
+            children[i] = NULL;
+        }
+    } else {
+        PERSIMM_COUNT_N(vector, releases, live);
+        if (NULL != ops && NULL != ops->release) {
+            for (size_t i = 0; i < live; i++) {
+                ops->release(persimm_vector_node_slot(node, i, elem_size), ctx);
+            }
+        }
+    }
+
+    PERSIMM_COUNT(vector, node_frees);
+    free(node);
+}
+
+void persimm_vector_deinit(persimm_vector_t *vector) {
+    persimm_vector_node_release(vector->root, PERSIMM_WIDTH, vector->elem_size, vector->ops,
+                                vector->ctx, vector->local);
+    persimm_vector_node_release(vector->tail, vector->tail_count, vector->elem_size, vector->ops,
+                                vector->ctx, vector->local);
+    vector->root = NULL;
+    vector->tail = NULL;
+    vector->count = 0;
+    vector->tail_count = 0;
+}
+
+/* Initialising */
+
+static bool persimm_vector_node_bytes(persimm_vector_node_type kind, size_t elem_size,
+                                      size_t *bytes) {
+    size_t stride = (kind == PERSIMM_VECTOR_NODE_INNER) ? sizeof(persimm_vector_node_t *)
+                                                        : elem_size;
+    size_t data_bytes;
+    return persimm_size_mul(PERSIMM_WIDTH, stride, &data_bytes) &&
+           persimm_size_add(offsetof(struct persimm_vector_node, data), data_bytes, bytes);
+}
+
+static persimm_vector_node_t *persimm_vector_node_new(persimm_vector_node_type kind,
+                                                      size_t elem_size) {
+    size_t bytes;
+    if (!persimm_vector_node_bytes(kind, elem_size, &bytes)) return NULL;
+    persimm_vector_node_t *node = calloc(1, bytes);
+    if (NULL == node) return NULL;
+    PERSIMM_COUNT(vector, node_allocs);
+    node->kind = kind;
+    PERSIMM_RC_SET(node->ref_count, 1);
+    return node;
+}
+
+/*
+ * Returns a node the caller owns exclusively, consuming the reference it passed
+ * in. When that reference was already the only one the node is returned as-is.
+ * Returns NULL, leaving `node` untouched, if the copy could not be allocated.
+ */
+static persimm_vector_node_t *persimm_vector_node_make_unique(const persimm_vector_t *vector,
+                                                              persimm_vector_node_t *node,
+                                                              size_t live) {
+    if (PERSIMM_RC_LOAD(node->ref_count) == 1) {
+        PERSIMM_COUNT(vector, in_place_edits);
+        return node;
+    }
+
+    size_t elem_size = vector->elem_size;
+    const persimm_elem_ops *ops = vector->ops;
+    void *ctx = vector->ctx;
+
+    persimm_vector_node_t *copy = persimm_vector_node_new(node->kind, elem_size);
+    if (NULL == copy) return NULL;
+    PERSIMM_COUNT(vector, path_copies);
+    copy->hash = node->hash;
+
+    if (node->kind == PERSIMM_VECTOR_NODE_INNER) {
+        persimm_vector_node_t **children = persimm_vector_node_children(node);
+        persimm_vector_node_t **copies = persimm_vector_node_children(copy);
+        for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+            copies[i] = children[i];
+            if (NULL != copies[i]) persimm_rc_inc(&copies[i]->ref_count, vector->local);
+        }
+    } else {
+        memcpy(copy->data, node->data, PERSIMM_WIDTH * elem_size);
+        PERSIMM_COUNT_N(vector, retains, live);
+        for (size_t i = 0; i < live; i++) {
+            persimm_elem_retain(ops, ctx, persimm_vector_node_slot(copy, i, elem_size));
+        }
+    }
+
+    persimm_vector_node_release(node, live, elem_size, ops, ctx, vector->local);
+
+    return copy;
+}
+
+persimm_status persimm_vector_init(persimm_vector_t *vector, size_t elem_size,
+                                   const persimm_elem_ops *ops, void *ctx) {
+    vector->shift = 0;
+    vector->count = 0;
+    vector->tail_count = 0;
+    vector->elem_size = elem_size;
+    vector->ops = ops;
+    vector->ctx = ctx;
+    vector->local = false;
+    vector->root = NULL;
+    vector->tail = NULL;
+
+    if (0 == elem_size) return PERSIMM_ERR_INVALID;
+
+    vector->tail = persimm_vector_node_new(PERSIMM_VECTOR_NODE_LEAF, elem_size);
+    if (NULL == vector->tail) return PERSIMM_ERR_ALLOC;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_vector_clone(const persimm_vector_t *src, persimm_vector_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->shift = src->shift;
+    dest->count = src->count;
+    dest->tail_count = src->tail_count;
+    dest->elem_size = src->elem_size;
+    dest->ops = src->ops;
+    dest->ctx = src->ctx;
+    dest->local = src->local;
+    dest->root = src->root;
+    if (NULL != dest->root) persimm_rc_inc(&dest->root->ref_count, dest->local);
+    dest->tail = src->tail;
+    if (NULL != dest->tail) persimm_rc_inc(&dest->tail->ref_count, dest->local);
+    return PERSIMM_OK;
+}
+
+/* Borrowing */
+
+void persimm_vector_borrow(const persimm_vector_t *src, persimm_vector_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_vector_t *persimm_vector_view(const persimm_vector_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_vector_make_local(persimm_vector_t *vector) {
+    vector->local = true;
+}
+
+void persimm_vector_share(persimm_vector_t *vector) {
+    vector->local = false;
+}
+
+/* Stops at a node already immortal, whose subtree an earlier freeze reached. */
+static void persimm_vector_node_freeze(persimm_vector_node_t *node) {
+    if (NULL == node || !persimm_rc_freeze(&node->ref_count)) return;
+    if (node->kind != PERSIMM_VECTOR_NODE_INNER) return;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_vector_node_freeze(children[i]);
+}
+
+void persimm_vector_freeze(persimm_vector_t *vector) {
+    persimm_vector_node_freeze(vector->root);
+    persimm_vector_node_freeze(vector->tail);
+}
+
+/* Transients */
+
+persimm_status persimm_vector_to_transient(const persimm_vector_t *src,
+                                           persimm_vector_transient_t *transient) {
+    persimm_status status = persimm_vector_clone(src, &transient->value);
+    if (PERSIMM_OK != status) return status;
+    transient->active = true;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_vector_transient_init(persimm_vector_transient_t *transient,
+                                             size_t elem_size,
+                                             const persimm_elem_ops *ops, void *ctx) {
+    persimm_status status = persimm_vector_init(&transient->value, elem_size, ops, ctx);
+    transient->active = PERSIMM_OK == status;
+    return status;
+}
+
+void persimm_vector_transient_deinit(persimm_vector_transient_t *transient) {
+    persimm_vector_deinit(&transient->value);
+    transient->active = false;
+}
+
+persimm_status persimm_vector_transient_push(persimm_vector_transient_t *transient,
+                                             const void *elem) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_vector_push_in_place(&transient->value, elem, true);
+}
+
+persimm_status persimm_vector_transient_update(persimm_vector_transient_t *transient,
+                                               size_t index, const void *elem) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_vector_update_in_place(&transient->value, index, elem, true);
+}
+
+persimm_status persimm_vector_transient_persist(persimm_vector_transient_t *transient,
+                                                persimm_vector_t *dest) {
+    if (&transient->value == dest) return PERSIMM_ERR_INVALID;
+    if (!transient->active) {
+        memset(dest, 0, sizeof(*dest));
+        return PERSIMM_ERR_INVALID;
+    }
+
+    *dest = transient->value;
+    memset(&transient->value, 0, sizeof(transient->value));
+    transient->active = false;
+    return PERSIMM_OK;
+}
+
+/* Accessing */
+
+const void *persimm_vector_at(const persimm_vector_t *vector, size_t index) {
+    if (index >= vector->count) return NULL;
+
+    size_t tail_offset = vector->count - vector->tail_count;
+    if (index >= tail_offset) {
+        return persimm_vector_node_slot(vector->tail, index - tail_offset, vector->elem_size);
+    }
+
+    persimm_vector_node_t *node = vector->root;
+    for (size_t level = vector->shift; level > 0; level -= PERSIMM_BITS) {
+        if (NULL == node) return NULL;
+        node = persimm_vector_node_children(node)[(index >> level) & PERSIMM_MASK];
+    }
+    if (NULL == node) return NULL;
+
+    return persimm_vector_node_slot(node, index & PERSIMM_MASK, vector->elem_size);
+}
+
+/* Inserting */
+
+static void persimm_elem_store(const persimm_vector_t *vector, void *slot, const void *elem) {
+    memcpy(slot, elem, vector->elem_size);
+    PERSIMM_COUNT(vector, retains);
+    persimm_elem_retain(vector->ops, vector->ctx, slot);
+}
+
+/*
+ * Grafts a full tail into the trie, growing the root by one level first if
+ * there is no longer room beneath it. `old_count` is the vector's count before
+ * the push that displaced the tail.
+ */
+static persimm_status persimm_vector_graft(persimm_vector_t *vector, persimm_vector_node_t *tail,
+                                           size_t old_count, bool immutable) {
+    if (old_count == PERSIMM_WIDTH) {
+        vector->root = tail;
+        return PERSIMM_OK;
+    }
+
+    if ((old_count >> PERSIMM_BITS) > ((size_t)1 << vector->shift)) {
+        persimm_vector_node_t *root = persimm_vector_node_new(PERSIMM_VECTOR_NODE_INNER,
+                                                              vector->elem_size);
+        if (NULL == root) return PERSIMM_ERR_ALLOC;
+        persimm_vector_node_children(root)[0] = vector->root;
+        root->hash = vector->root->hash;
+        vector->root = root;
+        vector->shift += PERSIMM_BITS;
+    } else if (immutable) {
+        persimm_vector_node_t *root =
+            persimm_vector_node_make_unique(vector, vector->root, PERSIMM_WIDTH);
+        if (NULL == root) return PERSIMM_ERR_ALLOC;
+        vector->root = root;
+    }
+
+    size_t index = old_count - PERSIMM_WIDTH;
+    persimm_vector_node_t *node = vector->root;
+    for (size_t level = vector->shift; level > PERSIMM_BITS; level -= PERSIMM_BITS) {
+        size_t curr_index = (index >> level) & PERSIMM_MASK;
+        persimm_vector_node_t *child = persimm_vector_node_children(node)[curr_index];
+        if (NULL == child) {
+            child = persimm_vector_node_new(PERSIMM_VECTOR_NODE_INNER, vector->elem_size);
+            if (NULL == child) return PERSIMM_ERR_ALLOC;
+        } else if (immutable) {
+            child = persimm_vector_node_make_unique(vector, child, PERSIMM_WIDTH);
+            if (NULL == child) return PERSIMM_ERR_ALLOC;
+        }
+        persimm_vector_node_children(node)[curr_index] = child;
+        node = child;
+    }
+    persimm_vector_node_children(node)[(index >> PERSIMM_BITS) & PERSIMM_MASK] = tail;
+
+    /* Hashes move only once the whole path is in place, so a failed graft
+       leaves every node's hash true to what is beneath it. */
+    if (persimm_vector_hashes(vector)) {
+        node = vector->root;
+        for (size_t level = vector->shift; level > 0; level -= PERSIMM_BITS) {
+            node->hash += tail->hash * persimm_vector_weight(persimm_vector_span_offset(index,
+                                                                                        level));
+            node = persimm_vector_node_children(node)[(index >> level) & PERSIMM_MASK];
+        }
+    }
+
+    return PERSIMM_OK;
+}
+
+static persimm_status persimm_vector_push_in_place(persimm_vector_t *vector, const void *elem,
+                                                   bool immutable) {
+    if (NULL == vector->tail) return PERSIMM_ERR_CORRUPT;
+
+    if (vector->tail_count < PERSIMM_WIDTH) {
+        if (immutable) {
+            persimm_vector_node_t *tail =
+                persimm_vector_node_make_unique(vector, vector->tail, vector->tail_count);
+            if (NULL == tail) return PERSIMM_ERR_ALLOC;
+            vector->tail = tail;
+        }
+        void *slot = persimm_vector_node_slot(vector->tail, vector->tail_count,
+                                              vector->elem_size);
+        persimm_elem_store(vector, slot, elem);
+        if (persimm_vector_hashes(vector)) {
+            vector->tail->hash += persimm_vector_elem_hash(vector, slot) *
+                                  persimm_vector_weight(vector->tail_count);
+        }
+        vector->tail_count++;
+        vector->count++;
+        return PERSIMM_OK;
+    }
+
+    persimm_vector_node_t *tail = persimm_vector_node_new(PERSIMM_VECTOR_NODE_LEAF,
+                                                          vector->elem_size);
+    if (NULL == tail) return PERSIMM_ERR_ALLOC;
+
+    persimm_vector_node_t *old_tail = vector->tail;
+    persimm_status status = persimm_vector_graft(vector, old_tail, vector->count, immutable);
+    if (PERSIMM_OK != status) {
+        PERSIMM_COUNT(vector, node_frees);
+        free(tail);
+        return status;
+    }
+
+    vector->tail = tail;
+    vector->tail_count = 0;
+    persimm_elem_store(vector, persimm_vector_node_slot(tail, 0, vector->elem_size), elem);
+    if (persimm_vector_hashes(vector)) {
+        tail->hash = persimm_vector_elem_hash(vector, persimm_vector_node_slot(tail, 0,
+                                                                               vector->elem_size));
+    }
+    vector->tail_count = 1;
+    vector->count++;
+
+    return PERSIMM_OK;
+}
+
+static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, size_t index,
+                                                     const void *elem, bool immutable) {
+    if (index >= vector->count) return PERSIMM_ERR_BOUNDS;
+
+    size_t tail_offset = vector->count - vector->tail_count;
+    if (index >= tail_offset) {
+        if (immutable) {
+            persimm_vector_node_t *tail =
+                persimm_vector_node_make_unique(vector, vector->tail, vector->tail_count);
+            if (NULL == tail) return PERSIMM_ERR_ALLOC;
+            vector->tail = tail;
+        }
+        void *slot = persimm_vector_node_slot(vector->tail, index - tail_offset, vector->elem_size);
+        if (elem == slot) return PERSIMM_OK;
+        uint32_t delta = persimm_vector_hashes(vector) ? persimm_vector_elem_hash(vector, elem) -
+                                                             persimm_vector_elem_hash(vector, slot)
+                                                       : 0;
+        PERSIMM_COUNT(vector, releases);
+        persimm_elem_release(vector->ops, vector->ctx, slot);
+        persimm_elem_store(vector, slot, elem);
+        vector->tail->hash += delta * persimm_vector_weight(index - tail_offset);
+        return PERSIMM_OK;
+    }
+
+    if (NULL == vector->root) return PERSIMM_ERR_CORRUPT;
+
+    if (immutable) {
+        persimm_vector_node_t *root =
+            persimm_vector_node_make_unique(vector, vector->root, PERSIMM_WIDTH);
+        if (NULL == root) return PERSIMM_ERR_ALLOC;
+        vector->root = root;
+    }
+
+    persimm_vector_node_t *node = vector->root;
+    for (size_t level = vector->shift; level > 0; level -= PERSIMM_BITS) {
+        size_t curr_index = (index >> level) & PERSIMM_MASK;
+        persimm_vector_node_t *child = persimm_vector_node_children(node)[curr_index];
+        if (NULL == child) return PERSIMM_ERR_CORRUPT;
+        if (immutable) {
+            child = persimm_vector_node_make_unique(vector, child, PERSIMM_WIDTH);
+            if (NULL == child) return PERSIMM_ERR_ALLOC;
+            persimm_vector_node_children(node)[curr_index] = child;
+        }
+        node = child;
+    }
+
+    void *slot = persimm_vector_node_slot(node, index & PERSIMM_MASK, vector->elem_size);
+    if (elem == slot) return PERSIMM_OK;
+    uint32_t delta = persimm_vector_hashes(vector) ? persimm_vector_elem_hash(vector, elem) -
+                                                         persimm_vector_elem_hash(vector, slot)
+                                                   : 0;
+    PERSIMM_COUNT(vector, releases);
+    persimm_elem_release(vector->ops, vector->ctx, slot);
+    persimm_elem_store(vector, slot, elem);
+
+    if (0 != delta) {
+        node = vector->root;
+        for (size_t level = vector->shift;; level -= PERSIMM_BITS) {
+            node->hash += delta * persimm_vector_weight(persimm_vector_span_offset(index, level));
+            if (0 == level) break;
+            node = persimm_vector_node_children(node)[(index >> level) & PERSIMM_MASK];
+        }
+    }
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_vector_push(const persimm_vector_t *src, const void *elem,
+                                   persimm_vector_t *dest) {
+    persimm_status status = persimm_vector_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_vector_push_in_place(dest, elem, true);
+    if (PERSIMM_OK != status) persimm_vector_deinit(dest);
+    return status;
+}
+
+persimm_status persimm_vector_update(const persimm_vector_t *src, size_t index,
+                                     const void *elem, persimm_vector_t *dest) {
+    persimm_status status = persimm_vector_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_vector_update_in_place(dest, index, elem, true);
+    if (PERSIMM_OK != status) persimm_vector_deinit(dest);
+    return status;
+}
+
+/* Without a clone the vector's own references are the only ones, so the nodes
+   it alone reaches pass make_unique's check and are written where they are. */
+persimm_status persimm_vector_push_owned(persimm_vector_t *vector, const void *elem) {
+    return persimm_vector_push_in_place(vector, elem, true);
+}
+
+persimm_status persimm_vector_update_owned(persimm_vector_t *vector, size_t index,
+                                           const void *elem) {
+    return persimm_vector_update_in_place(vector, index, elem, true);
+}
+
+/* Traversing */
+
+static void persimm_vector_node_foreach(persimm_vector_node_t *node, size_t elem_size,
+                                        size_t *index, size_t limit, persimm_visit_fn fn,
+                                        void *ctx) {
+    if (NULL == node || *index >= limit) return;
+
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) {
+        for (size_t i = 0; i < PERSIMM_WIDTH && *index < limit; i++) {
+            fn(persimm_vector_node_slot(node, i, elem_size), *index, ctx);
+            (*index)++;
+        }
+        return;
+    }
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH && *index < limit; i++) {
+        persimm_vector_node_foreach(children[i], elem_size, index, limit, fn, ctx);
+    }
+}
+
+void persimm_vector_foreach(const persimm_vector_t *vector, persimm_visit_fn fn, void *ctx) {
+    size_t index = 0;
+    size_t tail_offset = vector->count - vector->tail_count;
+
+    persimm_vector_node_foreach(vector->root, vector->elem_size, &index, tail_offset, fn, ctx);
+
+    for (size_t i = 0; i < vector->tail_count; i++) {
+        fn(persimm_vector_node_slot(vector->tail, i, vector->elem_size), tail_offset + i, ctx);
+    }
+}
+
+/* Parallel Traversal */
+
+/*
+ * Work is split at inner-node boundaries, so that every task owns whole
+ * leaves and no two tasks touch one node. The split starts at the root's
+ * children and moves a level down while that leaves fewer tasks than a node
+ * has slots, which keeps a shallow vector from running on a handful of
+ * threads. The tail is short and handled on the calling thread.
+ */
+
+typedef struct {
+    const persimm_vector_t *src;
+    /* The level of the nodes each task takes, and how many elements precede the tail. */
+    size_t level;
+    size_t limit;
+    void *ctx;
+    /* Reducing: one accumulator per task. */
+    persimm_fold_fn fold;
+    unsigned char *accs;
+    size_t acc_size;
+    /* Mapping: one new subtree per task, and the vector the subtrees are for. */
+    persimm_transform_fn transform;
+    const persimm_vector_t *dest;
+    persimm_vector_node_t **nodes;
+    persimm_status *statuses;
+} persimm_vector_split_t;
+
+static size_t persimm_vector_split_tasks(size_t limit, size_t level) {
+    size_t span_bits = level + PERSIMM_BITS;
+    if (span_bits >= sizeof(size_t) * CHAR_BIT) return 1;
+    return (limit + ((size_t)1 << span_bits) - 1) >> span_bits;
+}
+
+/* Picks the level to split at and returns how many tasks that makes, zero with no trie. */
+static size_t persimm_vector_split_plan(const persimm_vector_t *vector, size_t *level) {
+    size_t limit = vector->count - vector->tail_count;
+    *level = vector->shift;
+    if (NULL == vector->root || 0 == limit) return 0;
+
+    size_t tasks = persimm_vector_split_tasks(limit, *level);
+    while (tasks < PERSIMM_WIDTH && *level > 0) {
+        *level -= PERSIMM_BITS;
+        tasks = persimm_vector_split_tasks(limit, *level);
+    }
+    return tasks;
+}
+
+static size_t persimm_vector_split_start(const persimm_vector_split_t *split, size_t task) {
+    return task << (split->level + PERSIMM_BITS);
+}
+
+static persimm_vector_node_t *persimm_vector_split_node(const persimm_vector_split_t *split,
+                                                        size_t start) {
+    persimm_vector_node_t *node = split->src->root;
+    for (size_t level = split->src->shift; level > split->level; level -= PERSIMM_BITS) {
+        node = persimm_vector_node_children(node)[(start >> level) & PERSIMM_MASK];
+    }
+    return node;
+}
+
+typedef struct {
+    persimm_fold_fn fold;
+    void *acc;
+    void *ctx;
+} persimm_vector_fold_t;
+
+static void persimm_vector_fold_visit(const void *slot, size_t index, void *ctx) {
+    persimm_vector_fold_t *fold = ctx;
+    fold->fold(fold->acc, slot, index, fold->ctx);
+}
+
+static void persimm_vector_reduce_task(void *arg, size_t task) {
+    persimm_vector_split_t *split = arg;
+    size_t start = persimm_vector_split_start(split, task);
+    persimm_vector_fold_t fold = { split->fold, split->accs + task * split->acc_size,
+                                   split->ctx };
+    size_t index = start;
+    persimm_vector_node_foreach(persimm_vector_split_node(split, start), split->src->elem_size,
+                                &index, split->limit, persimm_vector_fold_visit, &fold);
+}
+
+persimm_status persimm_vector_parallel_reduce(const persimm_vector_t *vector,
+                                              persimm_fold_fn fold, persimm_combine_fn combine,
+                                              const void *identity, size_t acc_size, void *ctx,
+                                              const persimm_executor *executor, void *result) {
+    if (vector->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    memcpy(result, identity, acc_size);
+
+    persimm_vector_split_t split = { vector, 0, vector->count - vector->tail_count, ctx,
+                                     fold, NULL, acc_size, NULL, NULL, NULL, NULL };
+    size_t tasks = persimm_vector_split_plan(vector, &split.level);
+    persimm_vector_fold_t direct = { fold, result, ctx };
+
+    if (NULL == executor || tasks < 2) {
+        persimm_vector_foreach(vector, persimm_vector_fold_visit, &direct);
+        return PERSIMM_OK;
+    }
+
+    split.accs = calloc(tasks, acc_size);
+    if (NULL == split.accs) return PERSIMM_ERR_ALLOC;
+    for (size_t i = 0; i < tasks; i++) memcpy(split.accs + i * acc_size, identity, acc_size);
+
+    persimm_executor_run(executor, tasks, persimm_vector_reduce_task, &split);
+
+    for (size_t i = 0; i < tasks; i++) combine(result, split.accs + i * acc_size, ctx);
+    for (size_t i = 0; i < vector->tail_count; i++) {
+        fold(result, persimm_vector_node_slot(vector->tail, i, vector->elem_size),
+             split.limit + i, ctx);
+    }
+
+    free(split.accs);
+    return PERSIMM_OK;
+}
+
+/*
+ * Transforms `live` elements of a leaf into a fresh one for `dest`, hashing
+ * as it goes. Returns NULL with `*status` set if the transform failed or the
+ * leaf could not be allocated, leaving nothing behind.
+ */
+static persimm_vector_node_t *persimm_vector_leaf_map(const persimm_vector_split_t *split,
+                                                      persimm_vector_node_t *leaf, size_t start,
+                                                      size_t live, persimm_status *status) {
+    const persimm_vector_t *src = split->src;
+    const persimm_vector_t *dest = split->dest;
+    persimm_vector_node_t *node = persimm_vector_node_new(PERSIMM_VECTOR_NODE_LEAF,
+                                                          dest->elem_size);
+    if (NULL == node) {
+        *status = PERSIMM_ERR_ALLOC;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < live; i++) {
+        void *slot = persimm_vector_node_slot(node, i, dest->elem_size);
+        *status = split->transform(persimm_vector_node_slot(leaf, i, src->elem_size), start + i,
+                                   slot, split->ctx);
+        if (PERSIMM_OK != *status) {
+            persimm_vector_node_release(node, i, dest->elem_size, dest->ops, dest->ctx, false);
+            return NULL;
+        }
+        PERSIMM_COUNT(vector, retains);
+        persimm_elem_retain(dest->ops, dest->ctx, slot);
+        if (persimm_vector_hashes(dest)) {
+            node->hash += persimm_vector_elem_hash(dest, slot) * persimm_vector_weight(i);
+        }
+    }
+    return node;
+}
+
+/*
+ * Maps the subtree at `level` whose span starts at `start`. Above the split
+ * level it stitches in the subtrees the tasks made instead of descending, so
+ * the same walk serves a task and the calling thread that joins them.
+ */
+static persimm_vector_node_t *persimm_vector_node_map(persimm_vector_split_t *split,
+                                                      persimm_vector_node_t *node, size_t level,
+                                                      size_t start, bool joining,
+                                                      persimm_status *status) {
+    if (0 == level) return persimm_vector_leaf_map(split, node, start, PERSIMM_WIDTH, status);
+
+    const persimm_vector_t *dest = split->dest;
+    persimm_vector_node_t *copy = persimm_vector_node_new(PERSIMM_VECTOR_NODE_INNER,
+                                                          dest->elem_size);
+    if (NULL == copy) {
+        *status = PERSIMM_ERR_ALLOC;
+        return NULL;
+    }
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    persimm_vector_node_t **copies = persimm_vector_node_children(copy);
+    size_t step = (size_t)1 << level;
+    for (size_t i = 0; i < PERSIMM_WIDTH && start + i * step < split->limit; i++) {
+        size_t child_start = start + i * step;
+        persimm_vector_node_t *child;
+        if (joining && level - PERSIMM_BITS == split->level) {
+            size_t task = child_start >> level;
+            child = split->nodes[task];
+            split->nodes[task] = NULL;
+        } else {
+            child = persimm_vector_node_map(split, children[i], level - PERSIMM_BITS,
+                                            child_start, joining, status);
+            if (NULL == child) {
+                persimm_vector_node_release(copy, PERSIMM_WIDTH, dest->elem_size, dest->ops,
+                                            dest->ctx, false);
+                return NULL;
+            }
+        }
+        copies[i] = child;
+        copy->hash += child->hash * persimm_vector_weight(i * step);
+    }
+    return copy;
+}
+
+static void persimm_vector_map_task(void *arg, size_t task) {
+    persimm_vector_split_t *split = arg;
+    size_t start = persimm_vector_split_start(split, task);
+    split->nodes[task] = persimm_vector_node_map(split, persimm_vector_split_node(split, start),
+                                                 split->level, start, false,
+                                                 &split->statuses[task]);
+}
+
+persimm_status persimm_vector_parallel_map(const persimm_vector_t *src,
+                                           persimm_transform_fn transform, void *ctx,
+                                           size_t elem_size, const persimm_elem_ops *ops,
+                                           void *ops_ctx, const persimm_executor *executor,
+                                           persimm_vector_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->shift = 0;
+    dest->count = 0;
+    dest->tail_count = 0;
+    dest->elem_size = elem_size;
+    dest->ops = ops;
+    dest->ctx = ops_ctx;
+    dest->local = false;
+    dest->root = NULL;
+    dest->tail = NULL;
+    if (src->local || 0 == elem_size) return PERSIMM_ERR_INVALID;
+
+    persimm_vector_split_t split = { src, 0, src->count - src->tail_count, ctx,
+                                     NULL, NULL, 0, transform, dest, NULL, NULL };
+    size_t tasks = persimm_vector_split_plan(src, &split.level);
+    persimm_status status = PERSIMM_OK;
+
+    persimm_vector_node_t *root = NULL;
+    if (tasks > 0) {
+        split.nodes = calloc(tasks, sizeof(persimm_vector_node_t *));
+        split.statuses = calloc(tasks, sizeof(persimm_status));
+        if (NULL == split.nodes || NULL == split.statuses) status = PERSIMM_ERR_ALLOC;
+    }
+    if (PERSIMM_OK == status && tasks > 0) {
+        persimm_executor_run(executor, tasks, persimm_vector_map_task, &split);
+        for (size_t i = 0; i < tasks && PERSIMM_OK == status; i++) status = split.statuses[i];
+        if (PERSIMM_OK == status && split.level == src->shift) {
+            root = split.nodes[0];
+            split.nodes[0] = NULL;
+        } else if (PERSIMM_OK == status) {
+            root = persimm_vector_node_map(&split, src->root, src->shift, 0, true, &status);
+        }
+    }
+    for (size_t i = 0; NULL != split.nodes && i < tasks; i++) {
+        persimm_vector_node_release(split.nodes[i], PERSIMM_WIDTH, elem_size, ops, ops_ctx,
+                                    false);
+    }
+    free(split.nodes);
+    free(split.statuses);
+
+    persimm_vector_node_t *tail = NULL;
+    if (PERSIMM_OK == status) {
+        tail = persimm_vector_leaf_map(&split, src->tail, split.limit, src->tail_count,
+                                       &status);
+    }
+    if (PERSIMM_OK != status) {
+        persimm_vector_node_release(root, PERSIMM_WIDTH, elem_size, ops, ops_ctx, false);
+        return status;
+    }
+
+    dest->shift = src->shift;
+    dest->count = src->count;
+    dest->tail_count = src->tail_count;
+    dest->root = root;
+    dest->tail = tail;
+    return PERSIMM_OK;
+}
+
+/* Comparing */
+
+/*
+ * One comparison of two vectors. A NULL `visit` is a question of whether
+ * anything differs at all, so the walk stops at the first difference rather
+ * than reporting it.
+ */
+typedef struct {
+    size_t elem_size;
+    persimm_elem_eq_fn equals;
+    persimm_diff_fn visit;
+    void *ctx;
+    bool differs;
+} persimm_vector_diff_t;
+
+/* Returns whether the walk should carry on. */
+static bool persimm_vector_diff_slots(persimm_vector_diff_t *diff, const void *slot_a,
+                                      const void *slot_b, size_t index) {
+    if (NULL != slot_a && NULL != slot_b) {
+        if (slot_a == slot_b) return true;
+        if (NULL == diff->equals) {
+            if (0 == memcmp(slot_a, slot_b, diff->elem_size)) return true;
+        } else {
+            PERSIMM_COUNT(vector, equals_calls);
+            if (diff->equals(slot_a, slot_b, diff->elem_size, diff->ctx)) return true;
+        }
+    }
+    diff->differs = true;
+    if (NULL == diff->visit) return false;
+    diff->visit(slot_a, slot_b, index, diff->ctx);
+    return true;
+}
+
+/*
+ * Compares two nodes standing at the same level over the same indices, below
+ * `limit`. Both tries hold every index under the limit, so neither side can
+ * run out of children before the other does.
+ */
+static bool persimm_vector_node_diff(persimm_vector_diff_t *diff, persimm_vector_node_t *a,
+                                     persimm_vector_node_t *b, size_t level, size_t base,
+                                     size_t limit) {
+    if (a == b || NULL == a || NULL == b) return true;
+
+    if (0 == level) {
+        for (size_t i = 0; i < PERSIMM_WIDTH && base + i < limit; i++) {
+            if (!persimm_vector_diff_slots(diff, persimm_vector_node_slot(a, i, diff->elem_size),
+                                           persimm_vector_node_slot(b, i, diff->elem_size),
+                                           base + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    persimm_vector_node_t **children_a = persimm_vector_node_children(a);
+    persimm_vector_node_t **children_b = persimm_vector_node_children(b);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        size_t child_base = base + (i << level);
+        if (child_base >= limit) break;
+        if (!persimm_vector_node_diff(diff, children_a[i], children_b[i], level - PERSIMM_BITS,
+                                      child_base, limit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The tries are compared node against node up to where the shorter one's tail
+ * begins. A vector's shape follows from its count alone, so below that point
+ * the two tries agree on where every index lives once the taller root has been
+ * walked down its leftmost edge to the height of the shorter. What remains is
+ * at most a tail's worth of elements plus whatever one vector has beyond the
+ * other, and those are read by index.
+ */
+static void persimm_vector_walk_diff(const persimm_vector_t *a, const persimm_vector_t *b,
+                                     persimm_vector_diff_t *diff) {
+    size_t tail_offset_a = a->count - a->tail_count;
+    size_t tail_offset_b = b->count - b->tail_count;
+    size_t limit = tail_offset_a < tail_offset_b ? tail_offset_a : tail_offset_b;
+
+    if (limit > 0) {
+        persimm_vector_node_t *root_a = a->root;
+        persimm_vector_node_t *root_b = b->root;
+        size_t level = a->shift < b->shift ? a->shift : b->shift;
+        for (size_t l = a->shift; l > level && NULL != root_a; l -= PERSIMM_BITS) {
+            root_a = persimm_vector_node_children(root_a)[0];
+        }
+        for (size_t l = b->shift; l > level && NULL != root_b; l -= PERSIMM_BITS) {
+            root_b = persimm_vector_node_children(root_b)[0];
+        }
+        if (!persimm_vector_node_diff(diff, root_a, root_b, level, 0, limit)) return;
+    }
+
+    size_t shorter = a->count < b->count ? a->count : b->count;
+    size_t longer = a->count < b->count ? b->count : a->count;
+    size_t index = limit;
+    if (tail_offset_a == tail_offset_b && a->tail == b->tail) index = shorter;
+
+    for (; index < longer; index++) {
+        if (!persimm_vector_diff_slots(diff, persimm_vector_at(a, index),
+                                       persimm_vector_at(b, index), index)) {
+            return;
+        }
+    }
+}
+
+bool persimm_vector_equals(const persimm_vector_t *a, const persimm_vector_t *b,
+                           persimm_elem_eq_fn elem_eq, void *ctx) {
+    if (a == b) return true;
+    if (a->elem_size != b->elem_size || a->count != b->count) return false;
+    if (persimm_vector_hashes(a) && a->ops == b->ops && a->ctx == b->ctx &&
+        persimm_vector_hash(a) != persimm_vector_hash(b)) {
+        return false;
+    }
+
+    persimm_vector_diff_t diff = { a->elem_size, elem_eq, NULL, ctx, false };
+    persimm_vector_walk_diff(a, b, &diff);
+    return !diff.differs;
+}
+
+persimm_status persimm_vector_diff(const persimm_vector_t *a, const persimm_vector_t *b,
+                                   persimm_elem_eq_fn elem_eq, persimm_diff_fn visit,
+                                   void *ctx) {
+    if (a->elem_size != b->elem_size || NULL == visit) return PERSIMM_ERR_INVALID;
+    if (a == b) return PERSIMM_OK;
+
+    persimm_vector_diff_t diff = { a->elem_size, elem_eq, visit, ctx, false };
+    persimm_vector_walk_diff(a, b, &diff);
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+typedef struct {
+    size_t elem_size;
+    uint32_t hash;
+    uint32_t weight;
+} persimm_vector_hash_walk_t;
+
+static void persimm_vector_hash_visit(const void *slot, size_t index, void *ctx) {
+    (void) index;
+    persimm_vector_hash_walk_t *walk = (persimm_vector_hash_walk_t *)ctx;
+    walk->hash += persimm_hash_bytes(slot, walk->elem_size) * walk->weight;
+    walk->weight *= PERSIMM_VECTOR_HASH_BASE;
+}
+
+uint32_t persimm_vector_hash(const persimm_vector_t *vector) {
+    if (persimm_vector_hashes(vector)) {
+        size_t tail_offset = vector->count - vector->tail_count;
+        uint32_t hash = (NULL != vector->root) ? vector->root->hash : 0;
+        if (NULL != vector->tail) {
+            hash += vector->tail->hash * persimm_vector_weight(tail_offset);
+        }
+        return persimm_hash_finish(hash, vector->count);
+    }
+
+    persimm_vector_hash_walk_t walk = { vector->elem_size, 0, 1 };
+    persimm_vector_foreach(vector, persimm_vector_hash_visit, &walk);
+    return persimm_hash_finish(walk.hash, vector->count);
+}
+
+/* Tracing */
+
+/*
+ * Every leaf in the trie is full, and an inner node's children past the last
+ * index it covers are NULL, so only the tail needs to be told how many of its
+ * slots are live.
+ */
+static void persimm_vector_node_trace(const persimm_vector_t *vector,
+                                      persimm_vector_node_t *node, size_t live,
+                                      uint32_t epoch) {
+    if (NULL == node || !PERSIMM_TRACE_CLAIM(node, epoch)) return;
+
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) {
+        for (size_t i = 0; i < live; i++) {
+            vector->ops->trace(persimm_vector_node_slot(node, i, vector->elem_size),
+                               vector->ctx);
+        }
+        return;
+    }
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_trace(vector, children[i], PERSIMM_WIDTH, epoch);
+    }
+}
+
+void persimm_vector_trace(const persimm_vector_t *vector) {
+    persimm_vector_trace_epoch(vector, 0);
+}
+
+void persimm_vector_trace_epoch(const persimm_vector_t *vector, uint32_t epoch) {
+    if (NULL == vector->ops || NULL == vector->ops->trace) return;
+    persimm_vector_node_trace(vector, vector->root, PERSIMM_WIDTH, epoch);
+    persimm_vector_node_trace(vector, vector->tail, vector->tail_count, epoch);
+}
+
+/* Memory Statistics */
+
+static void persimm_vector_node_stats(persimm_vector_node_t *node, size_t live, size_t elem_size,
+                                      bool exclusive, persimm_memory_stats *stats) {
+    if (NULL == node) return;
+
+    size_t bytes = 0;
+    persimm_vector_node_bytes(node->kind, elem_size, &bytes);
+    exclusive = exclusive && 1 == PERSIMM_RC_PEEK(node->ref_count);
+    if (exclusive) {
+        stats->exclusive_bytes += bytes;
+    } else {
+        stats->shared_bytes += bytes;
+    }
+
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) {
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+        stats->elem_bytes += live * elem_size;
+        return;
+    }
+
+    stats->branch_nodes++;
+    stats->branch_bytes += bytes;
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_stats(children[i], PERSIMM_WIDTH, elem_size, exclusive, stats);
+    }
+}
+
+void persimm_vector_memory_stats(const persimm_vector_t *vector, persimm_memory_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    persimm_vector_node_stats(vector->root, PERSIMM_WIDTH, vector->elem_size, true, stats);
+    persimm_vector_node_stats(vector->tail, vector->tail_count, vector->elem_size, true, stats);
+}
+
+/* Whatever lies beneath a node already gathered has been gathered too. */
+static persimm_status persimm_vector_node_gather(persimm_vector_node_t *node,
+                                                persimm_node_set_t *nodes) {
+    if (NULL == node || persimm_node_set_has(nodes, node)) return PERSIMM_OK;
+
+    persimm_status status = persimm_node_set_add(nodes, node);
+    if (PERSIMM_OK != status || node->kind == PERSIMM_VECTOR_NODE_LEAF) return status;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH && PERSIMM_OK == status; i++) {
+        status = persimm_vector_node_gather(children[i], nodes);
+    }
+    return status;
+}
+
+static void persimm_vector_node_delta(persimm_vector_node_t *node, size_t elem_size,
+                                      const persimm_node_set_t *nodes, size_t *bytes) {
+    if (NULL == node || persimm_node_set_has(nodes, node)) return;
+
+    size_t size = 0;
+    persimm_vector_node_bytes(node->kind, elem_size, &size);
+    *bytes += size;
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) return;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_delta(children[i], elem_size, nodes, bytes);
+    }
+}
+
+persimm_status persimm_vector_memory_delta(const persimm_vector_t *a, const persimm_vector_t *b,
+                                           size_t *bytes) {
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_vector_node_gather(a->root, &nodes);
+    if (PERSIMM_OK == status) status = persimm_vector_node_gather(a->tail, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_vector_node_delta(b->root, b->elem_size, &nodes, bytes);
+        persimm_vector_node_delta(b->tail, b->elem_size, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A persistent list is a singly linked chain of reference counted cells. Two
+ * lists share every cell from their first common element onwards, so consing
+ * onto a list costs one cell however long the list is.
+ */
+
+/* Types */
+
+struct persimm_list_cell {
+    persimm_refcount_t ref_count;
+    persimm_list_cell_t *next;
+#if defined(PERSIMM_TRACE_EPOCHS)
+    uint32_t traced; // the last epoch the cell was traced in
+#endif
+    persimm_align_t data[];
+};
+
+/* Element Access */
+
+static void *persimm_list_cell_slot(persimm_list_cell_t *cell) {
+    return (void *)cell->data;
+}
+
+/* Deinitialising */
+
+/*
+ * Walks the chain rather than recursing down it. A list is as long as the
+ * host cares to make it, and a release that recursed would run out of stack
+ * long before the list ran out of cells.
+ */
+static void persimm_list_cell_release(persimm_list_cell_t *cell, const persimm_elem_ops *ops,
+                                      void *ctx, bool local) {
+    while (NULL != cell) {
+        if (persimm_rc_dec(&cell->ref_count, local) > 1) return;
+
+        persimm_list_cell_t *next = cell->next;
+        PERSIMM_COUNT(list, releases);
+        persimm_elem_release(ops, ctx, persimm_list_cell_slot(cell));
+        PERSIMM_COUNT(list, node_frees);
+        free(cell);
+        cell = next;
+    }
+}
+
+void persimm_list_deinit(persimm_list_t *list) {
+    persimm_list_cell_release(list->head, list->ops, list->ctx, list->local);
+    list->head = NULL;
+    list->count = 0;
+}
+
+/* Initialising */
+
+static persimm_list_cell_t *persimm_list_cell_new(size_t elem_size) {
+    size_t bytes;
+    if (!persimm_size_add(offsetof(struct persimm_list_cell, data), elem_size, &bytes)) return NULL;
+    persimm_list_cell_t *cell = calloc(1, bytes);
+    if (NULL == cell) return NULL;
+    PERSIMM_COUNT(list, node_allocs);
+    PERSIMM_RC_SET(cell->ref_count, 1);
+    return cell;
+}
+
+persimm_status persimm_list_init(persimm_list_t *list, size_t elem_size,
+                                 const persimm_elem_ops *ops, void *ctx) {
+    list->count = 0;
+    list->generation = 0;
+    list->elem_size = elem_size;
+    list->ops = ops;
+    list->ctx = ctx;
+    list->local = false;
+    list->head = NULL;
+
+    if (0 == elem_size) return PERSIMM_ERR_INVALID;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_list_clone(const persimm_list_t *src, persimm_list_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->count = src->count;
+    dest->generation = src->generation;
+    dest->elem_size = src->elem_size;
+    dest->ops = src->ops;
+    dest->ctx = src->ctx;
+    dest->local = src->local;
+    dest->head = src->head;
+    if (NULL != dest->head) persimm_rc_inc(&dest->head->ref_count, dest->local);
+    return PERSIMM_OK;
+}
+
+/* Borrowing */
+
+void persimm_list_borrow(const persimm_list_t *src, persimm_list_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_list_t *persimm_list_view(const persimm_list_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_list_make_local(persimm_list_t *list) {
+    list->local = true;
+}
+
+void persimm_list_share(persimm_list_t *list) {
+    list->local = false;
+}
+
+/* Walks the chain for the reason release does, stopping where an earlier freeze did. */
+void persimm_list_freeze(persimm_list_t *list) {
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        if (!persimm_rc_freeze(&cell->ref_count)) return;
+    }
+}
+
+/* Accessing */
+
+const void *persimm_list_first(const persimm_list_t *list) {
+    if (NULL == list->head) return NULL;
+    return persimm_list_cell_slot(list->head);
+}
+
+const void *persimm_list_at(const persimm_list_t *list, size_t index) {
+    if (index >= list->count) return NULL;
+
+    persimm_list_cell_t *cell = list->head;
+    for (size_t i = 0; i < index; i++) {
+        if (NULL == cell) return NULL;
+        cell = cell->next;
+    }
+    if (NULL == cell) return NULL;
+
+    return persimm_list_cell_slot(cell);
+}
+
+void persimm_list_cursor_reset(persimm_list_cursor_t *cursor) {
+    cursor->list = NULL;
+    cursor->generation = 0;
+    cursor->index = 0;
+    cursor->cell = NULL;
+}
+
+const void *persimm_list_at_from(const persimm_list_t *list, persimm_list_cursor_t *cursor,
+                                 size_t index) {
+    if (index >= list->count) return NULL;
+
+    persimm_list_cell_t *cell = list->head;
+    size_t position = 0;
+
+    /* The generation notices changes even when a run of operations restores
+       the old count. */
+    if (NULL != cursor->cell &&
+        cursor->list == list &&
+        cursor->generation == list->generation &&
+        cursor->index <= index) {
+        cell = cursor->cell;
+        position = cursor->index;
+    }
+
+    for (; position < index; position++) {
+        if (NULL == cell) return NULL;
+        cell = cell->next;
+    }
+    if (NULL == cell) return NULL;
+
+    cursor->list = list;
+    cursor->generation = list->generation;
+    cursor->index = index;
+    cursor->cell = cell;
+
+    return persimm_list_cell_slot(cell);
+}
+
+/* Inserting */
+
+static persimm_status persimm_list_cons_in_place(persimm_list_t *list, const void *elem) {
+    persimm_list_cell_t *cell = persimm_list_cell_new(list->elem_size);
+    if (NULL == cell) return PERSIMM_ERR_ALLOC;
+
+    memcpy(persimm_list_cell_slot(cell), elem, list->elem_size);
+    PERSIMM_COUNT(list, retains);
+    persimm_elem_retain(list->ops, list->ctx, persimm_list_cell_slot(cell));
+
+    /* The list's reference to its old head becomes the new cell's. */
+    cell->next = list->head;
+    list->head = cell;
+    list->count++;
+    list->generation++;
+
+    return PERSIMM_OK;
+}
+
+/* Removing */
+
+static persimm_status persimm_list_rest_in_place(persimm_list_t *list) {
+    if (NULL == list->head) return PERSIMM_ERR_BOUNDS;
+
+    persimm_list_cell_t *head = list->head;
+    persimm_list_cell_t *next = head->next;
+
+    /* Take a reference to the new head before letting go of the old one, or
+       releasing the old head could take the rest of the chain with it. */
+    if (NULL != next) persimm_rc_inc(&next->ref_count, list->local);
+    persimm_list_cell_release(head, list->ops, list->ctx, list->local);
+
+    list->head = next;
+    list->count--;
+    list->generation++;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_list_cons(const persimm_list_t *src, const void *elem,
+                                 persimm_list_t *dest) {
+    persimm_status status = persimm_list_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_list_cons_in_place(dest, elem);
+    if (PERSIMM_OK != status) persimm_list_deinit(dest);
+    return status;
+}
+
+persimm_status persimm_list_rest(const persimm_list_t *src, persimm_list_t *dest) {
+    persimm_status status = persimm_list_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_list_rest_in_place(dest);
+    if (PERSIMM_OK != status) persimm_list_deinit(dest);
+    return status;
+}
+
+persimm_status persimm_list_cons_owned(persimm_list_t *list, const void *elem) {
+    return persimm_list_cons_in_place(list, elem);
+}
+
+persimm_status persimm_list_rest_owned(persimm_list_t *list) {
+    return persimm_list_rest_in_place(list);
+}
+
+/* Traversing */
+
+void persimm_list_foreach(const persimm_list_t *list, persimm_visit_fn fn, void *ctx) {
+    size_t index = 0;
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        fn(persimm_list_cell_slot(cell), index, ctx);
+        index++;
+    }
+}
+
+/* Tracing */
+
+void persimm_list_trace(const persimm_list_t *list) {
+    persimm_list_trace_epoch(list, 0);
+}
+
+/*
+ * A cell is only ever traced on the way down the chain from some head, so one
+ * already traced in this epoch had every cell after it traced too.
+ */
+void persimm_list_trace_epoch(const persimm_list_t *list, uint32_t epoch) {
+    if (NULL == list->ops || NULL == list->ops->trace) return;
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        if (!PERSIMM_TRACE_CLAIM(cell, epoch)) return;
+        list->ops->trace(persimm_list_cell_slot(cell), list->ctx);
+    }
+}
+
+/* Memory Statistics */
+
+void persimm_list_memory_stats(const persimm_list_t *list, persimm_memory_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    size_t bytes = offsetof(struct persimm_list_cell, data) + list->elem_size;
+
+    bool exclusive = true;
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        exclusive = exclusive && 1 == PERSIMM_RC_PEEK(cell->ref_count);
+        if (exclusive) {
+            stats->exclusive_bytes += bytes;
+        } else {
+            stats->shared_bytes += bytes;
+        }
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+        stats->elem_bytes += list->elem_size;
+    }
+}
+
+/* The first cell of `b` that `a` holds starts the tail the two share. */
+persimm_status persimm_list_memory_delta(const persimm_list_t *a, const persimm_list_t *b,
+                                         size_t *bytes) {
+    *bytes = 0;
+
+    persimm_node_set_t cells = { NULL, 0, 0 };
+    persimm_status status = PERSIMM_OK;
+    for (persimm_list_cell_t *cell = a->head; NULL != cell && PERSIMM_OK == status;
+         cell = cell->next) {
+        status = persimm_node_set_add(&cells, cell);
+    }
+
+    if (PERSIMM_OK == status) {
+        size_t size = offsetof(struct persimm_list_cell, data) + b->elem_size;
+        for (persimm_list_cell_t *cell = b->head;
+             NULL != cell && !persimm_node_set_has(&cells, cell); cell = cell->next) {
+            *bytes += size;
+        }
+    }
+
+    persimm_node_set_free(&cells);
+    return status;
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A CHAMP trie: a hash array mapped trie in the form Steindorfer and Vinju
+ * described, shared by the map and the set.
+ *
+ * Five bits of a key's hash pick a slot at each level. A node carries two
+ * bitmaps rather than the one Clojure's map uses: `datamap` marks the slots
+ * holding an entry and `nodemap` the slots holding a child. Clojure tells the
+ * two apart by storing a null in the key half of a pair, which is not open to
+ * a core whose keys are opaque bytes and so have no value to reserve.
+ *
+ * The second bitmap also buys a canonical shape. A subtree is never a child
+ * when it could be a single inline entry, which `dissoc` maintains by pulling
+ * a collapsed child back into its parent. Two tries holding the same keys
+ * therefore have the same shape however they were built, so a map that reached
+ * its contents by adding and removing entries iterates in the same order as
+ * one that was handed them.
+ *
+ * Keys whose hashes are equal in all 32 bits cannot be separated by any depth,
+ * so they share a collision node instead: a flat run of entries carrying the
+ * hash they have in common. A collision node is the one exception to the
+ * paragraph above. Its entries sit in the order they arrived, and since keys
+ * are opaque there is no order to sort them into, so two tries can hold one
+ * group of fully colliding keys in different orders. Anything a host derives
+ * from a whole map, a hash above all, must therefore not depend on the order
+ * its entries come out in.
+ *
+ * Every node also carries a structural hash of what lies beneath it, the sum
+ * of one mixed term per entry. Addition is commutative, so a collision node's
+ * order does not reach it, and it is exact under subtraction, so a path copy
+ * corrects each node it makes by what changed rather than rereading the rest.
+ * The root's is then a hash of the whole trie at no cost to read.
+ */
+
+/* Types */
+
+typedef enum {
+    PERSIMM_HAMT_BITMAP,
+    PERSIMM_HAMT_COLLISION
+} persimm_hamt_node_type;
+
+struct persimm_hamt_node {
+    persimm_refcount_t ref_count;
+    uint32_t kind;
+    uint32_t datamap; // bitmap: the slots holding an entry. collision: how many entries
+    uint32_t nodemap; // bitmap: the slots holding a child. collision: zero
+    uint32_t hash;    // collision: the hash every entry shares. bitmap: unused
+    uint32_t merkle;  // the sum of persimm_hamt_term over every entry beneath
+    uint32_t traced;  // the last epoch the node was traced in
+    persimm_align_t data[];
+};
+
+/*
+ * A node holds its entries and then its children in one allocation, with the
+ * boundary rounded up so that both regions land on an address either can use.
+ */
+
+static uint32_t persimm_hamt_data_count(persimm_hamt_node_t *node) {
+    return (PERSIMM_HAMT_COLLISION == node->kind) ? node->datamap
+                                                  : PERSIMM_POPCOUNT(node->datamap);
+}
+
+static uint32_t persimm_hamt_child_count(persimm_hamt_node_t *node) {
+    return PERSIMM_POPCOUNT(node->nodemap);
+}
+
+static void *persimm_hamt_entry(persimm_hamt_node_t *node, uint32_t index, size_t entry_size) {
+    return (unsigned char *)node->data + ((size_t)index * entry_size);
+}
+
+static persimm_hamt_node_t **persimm_hamt_children(persimm_hamt_node_t *node, size_t entry_size) {
+    size_t bytes = (size_t)persimm_hamt_data_count(node) * entry_size;
+    return (persimm_hamt_node_t **)((unsigned char *)node->data + PERSIMM_ALIGN_UP(bytes));
+}
+
+/* Bitmaps */
+
+static uint32_t persimm_hamt_bit(uint32_t hash, size_t shift) {
+    return (uint32_t)1 << ((hash >> shift) & PERSIMM_MASK);
+}
+
+static uint32_t persimm_hamt_data_index(persimm_hamt_node_t *node, uint32_t bit) {
+    return PERSIMM_POPCOUNT(node->datamap & (bit - 1));
+}
+
+static uint32_t persimm_hamt_child_index(persimm_hamt_node_t *node, uint32_t bit) {
+    return PERSIMM_POPCOUNT(node->nodemap & (bit - 1));
+}
+
+/*
+ * Canonical form: only the root may hold a lone entry and nothing else. When a
+ * removal leaves any other node in that state its parent inlines the entry.
+ */
+static bool persimm_hamt_is_single(persimm_hamt_node_t *node) {
+    return 1 == persimm_hamt_data_count(node) && 0 == persimm_hamt_child_count(node);
+}
+
+/* Keys */
+
+static uint32_t persimm_hamt_byte_hash(const void *key, size_t key_size, void *ctx) {
+    (void) ctx;
+    return persimm_hash_bytes(key, key_size);
+}
+
+static bool persimm_hamt_byte_equals(const void *key_a, const void *key_b, size_t key_size,
+                                     void *ctx) {
+    (void) ctx;
+    return 0 == memcmp(key_a, key_b, key_size);
+}
+
+void persimm_hamt_config(persimm_hamt_t *hamt, const persimm_entry_layout *layout,
+                         const persimm_elem_ops *value_ops, void *value_ctx,
+                         const persimm_key_ops *key_ops, void *key_ctx, bool local) {
+    hamt->layout = *layout;
+    hamt->value_ops = value_ops;
+    hamt->key_ops = key_ops;
+    hamt->hash = (NULL != key_ops && NULL != key_ops->hash) ? key_ops->hash
+                                                            : persimm_hamt_byte_hash;
+    hamt->equals = (NULL != key_ops && NULL != key_ops->equals) ? key_ops->equals
+                                                                : persimm_hamt_byte_equals;
+    hamt->value_ctx = value_ctx;
+    hamt->key_ctx = key_ctx;
+    hamt->local = local;
+}
+
+bool persimm_hamt_layout_valid(const persimm_entry_layout *layout) {
+    if (0 == layout->key_size || 0 == layout->entry_size) return false;
+    if (layout->key_size > layout->entry_size) return false;
+    if (0 == layout->value_size) return true;
+    if (layout->value_offset < layout->key_size) return false;
+    if (layout->value_offset > layout->entry_size) return false;
+    return layout->value_size <= layout->entry_size - layout->value_offset;
+}
+
+static uint32_t persimm_hamt_hash_of(const persimm_hamt_t *hamt, const void *key) {
+    PERSIMM_COUNT(hamt, hash_calls);
+    return hamt->hash(key, hamt->layout.key_size, hamt->key_ctx);
+}
+
+static bool persimm_hamt_keys_equal(const persimm_hamt_t *hamt, const void *key_a,
+                                    const void *key_b) {
+    PERSIMM_COUNT(hamt, equals_calls);
+    return hamt->equals(key_a, key_b, hamt->layout.key_size, hamt->key_ctx);
+}
+
+/* Entries */
+
+/*
+ * An entry's key and value are managed separately. A set's entries have no
+ * value.
+ */
+
+static void *persimm_hamt_value(const persimm_hamt_t *hamt, void *entry) {
+    return (unsigned char *)entry + hamt->layout.value_offset;
+}
+
+static const void *persimm_hamt_value_const(const persimm_hamt_t *hamt, const void *entry) {
+    return (const unsigned char *)entry + hamt->layout.value_offset;
+}
+
+/*
+ * An entry's share of the structural hash. `hash` is its key's, which every
+ * caller already has to hand. A value counts only when the host can hash it;
+ * otherwise maps differing only in their values share a hash, which is still
+ * sound since equal maps are all a hash has to agree on.
+ */
+static uint32_t persimm_hamt_term(const persimm_hamt_t *hamt, uint32_t hash, const void *entry) {
+    uint32_t value = 0;
+    if (hamt->layout.value_size > 0 && persimm_elem_hashes(hamt->value_ops)) {
+        PERSIMM_COUNT(hamt, hash_calls);
+        value = hamt->value_ops->hash(persimm_hamt_value_const(hamt, entry), hamt->value_ctx);
+    }
+    return persimm_hash_mix(hash ^ persimm_hash_mix(value + 0x9e3779b9u));
+}
+
+static void persimm_hamt_entry_retain(const persimm_hamt_t *hamt, void *entry) {
+    PERSIMM_COUNT(hamt, retains);
+    if (NULL != hamt->key_ops && NULL != hamt->key_ops->retain) {
+        hamt->key_ops->retain(entry, hamt->key_ctx);
+    }
+    if (hamt->layout.value_size > 0) {
+        persimm_elem_retain(hamt->value_ops, hamt->value_ctx,
+                            persimm_hamt_value(hamt, entry));
+    }
+}
+
+static void persimm_hamt_entry_release(const persimm_hamt_t *hamt, void *entry) {
+    PERSIMM_COUNT(hamt, releases);
+    if (NULL != hamt->key_ops && NULL != hamt->key_ops->release) {
+        hamt->key_ops->release(entry, hamt->key_ctx);
+    }
+    if (hamt->layout.value_size > 0) {
+        persimm_elem_release(hamt->value_ops, hamt->value_ctx,
+                             persimm_hamt_value(hamt, entry));
+    }
+}
+
+/* Deinitialising */
+
+void persimm_hamt_retain(persimm_hamt_node_t *root, const persimm_hamt_t *hamt) {
+    if (NULL != root) persimm_rc_inc(&root->ref_count, hamt->local);
+}
+
+void persimm_hamt_release(persimm_hamt_node_t *node, const persimm_hamt_t *hamt) {
+    if (NULL == node) return;
+    if (persimm_rc_dec(&node->ref_count, hamt->local) > 1) return;
+
+    size_t entry_size = hamt->layout.entry_size;
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) {
+        persimm_hamt_entry_release(hamt, persimm_hamt_entry(node, i, entry_size));
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_release(children[i], hamt);
+    }
+
+    PERSIMM_COUNT(hamt, node_frees);
+    free(node);
+}
+
+/*
+ * A node already immortal heads a subtree an earlier freeze reached, so the
+ * walk goes no further into it.
+ */
+void persimm_hamt_freeze(persimm_hamt_node_t *node, const persimm_hamt_t *hamt) {
+    if (NULL == node || !persimm_rc_freeze(&node->ref_count)) return;
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, hamt->layout.entry_size);
+    for (uint32_t i = 0; i < child_count; i++) persimm_hamt_freeze(children[i], hamt);
+}
+
+/* Initialising */
+
+static bool persimm_hamt_node_bytes(uint32_t data_count, uint32_t child_count,
+                                    size_t entry_size, size_t *size) {
+    size_t bytes;
+    if (!persimm_size_mul((size_t)data_count, entry_size, &bytes)) return false;
+
+    if (child_count > 0) {
+        if (bytes > SIZE_MAX - (PERSIMM_ALIGNMENT - 1)) return false;
+        bytes = PERSIMM_ALIGN_UP(bytes);
+
+        size_t child_bytes;
+        if (!persimm_size_mul((size_t)child_count, sizeof(persimm_hamt_node_t *), &child_bytes) ||
+            !persimm_size_add(bytes, child_bytes, &bytes)) {
+            return false;
+        }
+    }
+
+    return persimm_size_add(offsetof(struct persimm_hamt_node, data), bytes, size);
+}
+
+static persimm_hamt_node_t *persimm_hamt_node_new(uint32_t kind, uint32_t data_count,
+                                                  uint32_t child_count, size_t entry_size) {
+    size_t bytes;
+    if (!persimm_hamt_node_bytes(data_count, child_count, entry_size, &bytes)) return NULL;
+    persimm_hamt_node_t *node = calloc(1, bytes);
+    if (NULL == node) return NULL;
+
+    node->kind = kind;
+    PERSIMM_RC_SET(node->ref_count, 1);
+    PERSIMM_COUNT(hamt, node_allocs);
+
+    return node;
+}
+
+/*
+ * Each of the six that follow consumes the caller's reference to `node` and
+ * returns a node the caller owns, which may be `node` itself when it was
+ * uniquely held and the change fitted in place. They return NULL and leave
+ * `node` untouched if the copy could not be allocated.
+ *
+ * A copy retains every element it takes over before the original is released,
+ * so a host that reference counts never sees an element's count reach zero
+ * while the trie still holds it.
+ */
+
+typedef enum {
+    PERSIMM_HAMT_CHILD_KEEP,    // every child carries over
+    PERSIMM_HAMT_CHILD_REPLACE, // `child` stands in for the one at `at`
+    PERSIMM_HAMT_CHILD_INSERT,  // `child` takes slot `at` and the rest shift up
+    PERSIMM_HAMT_CHILD_REMOVE   // the child at `at` is left behind
+} persimm_hamt_child_edit;
+
+/*
+ * Copies `from`'s children into `to` with one slot changed, retaining each
+ * child that carries over. A `child` passed in arrives with a reference `to`
+ * takes over, so it is not retained again. `to` must already carry the bitmaps
+ * it will end up with, since they are what say where its children begin.
+ */
+static void persimm_hamt_copy_children(persimm_hamt_node_t *from, persimm_hamt_node_t *to,
+                                       persimm_hamt_child_edit edit, uint32_t at,
+                                       persimm_hamt_node_t *child,
+                                       const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t count = persimm_hamt_child_count(from);
+    persimm_hamt_node_t **source = persimm_hamt_children(from, entry_size);
+    persimm_hamt_node_t **dest = persimm_hamt_children(to, entry_size);
+    PERSIMM_COUNT(hamt, path_copies);
+
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == at) {
+            if (PERSIMM_HAMT_CHILD_REMOVE == edit) continue;
+            if (PERSIMM_HAMT_CHILD_REPLACE == edit) {
+                dest[out++] = child;
+                continue;
+            }
+            if (PERSIMM_HAMT_CHILD_INSERT == edit) dest[out++] = child;
+        }
+        dest[out] = source[i];
+        persimm_rc_inc(&dest[out]->ref_count, hamt->local);
+        out++;
+    }
+
+    /* An insert past the last child has nothing to fall in front of. */
+    if (PERSIMM_HAMT_CHILD_INSERT == edit && at >= count) dest[out] = child;
+}
+
+/*
+ * Replaces the value of the entry at `index`, keeping the key already stored.
+ * `hash` is the key's.
+ */
+static persimm_hamt_node_t *persimm_hamt_with_value(persimm_hamt_node_t *node, uint32_t index,
+                                                    const void *entry, uint32_t hash,
+                                                    const persimm_hamt_t *hamt, bool immutable) {
+    size_t entry_size = hamt->layout.entry_size;
+    size_t value_size = hamt->layout.value_size;
+
+    /* A set's entries are keys alone, so one already present is unchanged. */
+    if (0 == value_size) return node;
+
+    void *held = persimm_hamt_entry(node, index, entry_size);
+    uint32_t delta = persimm_hamt_term(hamt, hash, entry) - persimm_hamt_term(hamt, hash, held);
+
+    if (!immutable && 1 == PERSIMM_RC_LOAD(node->ref_count)) {
+        void *slot = persimm_hamt_value(hamt, held);
+        void *replacement = persimm_hamt_value(hamt, (void *)entry);
+        if (replacement == slot) return node;
+        node->merkle += delta;
+        persimm_elem_release(hamt->value_ops, hamt->value_ctx, slot);
+        memcpy(slot, replacement, value_size);
+        persimm_elem_retain(hamt->value_ops, hamt->value_ctx, slot);
+        PERSIMM_COUNT(hamt, releases);
+        PERSIMM_COUNT(hamt, retains);
+        PERSIMM_COUNT(hamt, in_place_edits);
+        return node;
+    }
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count, child_count,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = node->datamap;
+    copy->nodemap = node->nodemap;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle + delta;
+
+    memcpy(copy->data, node->data, (size_t)data_count * entry_size);
+    /* The new value displaces the old before anything retains it, so the old
+       one is only ever released with the node it came from. */
+    memcpy(persimm_hamt_value(hamt, persimm_hamt_entry(copy, index, entry_size)),
+           persimm_hamt_value(hamt, (void *)entry), value_size);
+    for (uint32_t i = 0; i < data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/*
+ * Adds an entry whose key hashes to `hash` at `index`, marking `bit` in the
+ * datamap of a bitmap node.
+ */
+static persimm_hamt_node_t *persimm_hamt_with_entry(persimm_hamt_node_t *node, uint32_t bit,
+                                                    uint32_t index, const void *entry,
+                                                    uint32_t hash, const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+
+    if (UINT32_MAX == data_count) return NULL;
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count + 1, child_count,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = (PERSIMM_HAMT_COLLISION == node->kind) ? node->datamap + 1
+                                                           : (node->datamap | bit);
+    copy->nodemap = node->nodemap;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle + persimm_hamt_term(hamt, hash, entry);
+
+    memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
+           (size_t)index * entry_size);
+    memcpy(persimm_hamt_entry(copy, index, entry_size), entry, entry_size);
+    memcpy(persimm_hamt_entry(copy, index + 1, entry_size),
+           persimm_hamt_entry(node, index, entry_size),
+           (size_t)(data_count - index) * entry_size);
+
+    for (uint32_t i = 0; i <= data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/*
+ * Drops the entry at `index`, whose key hashes to `hash`, clearing `bit` in the
+ * datamap of a bitmap node.
+ */
+static persimm_hamt_node_t *persimm_hamt_without_entry(persimm_hamt_node_t *node, uint32_t bit,
+                                                       uint32_t index, uint32_t hash,
+                                                       const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count - 1, child_count,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = (PERSIMM_HAMT_COLLISION == node->kind) ? node->datamap - 1
+                                                           : (node->datamap & ~bit);
+    copy->nodemap = node->nodemap;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle -
+                   persimm_hamt_term(hamt, hash, persimm_hamt_entry(node, index, entry_size));
+
+    memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
+           (size_t)index * entry_size);
+    memcpy(persimm_hamt_entry(copy, index, entry_size),
+           persimm_hamt_entry(node, index + 1, entry_size),
+           (size_t)(data_count - index - 1) * entry_size);
+
+    for (uint32_t i = 0; i + 1 < data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/* Points slot `index` at `child`, taking over the caller's reference to it. */
+static persimm_hamt_node_t *persimm_hamt_with_child(persimm_hamt_node_t *node, uint32_t index,
+                                                    persimm_hamt_node_t *child,
+                                                    const persimm_hamt_t *hamt, bool immutable) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (!immutable && 1 == PERSIMM_RC_LOAD(node->ref_count)) {
+        persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+        persimm_hamt_node_t *old = children[index];
+        node->merkle += child->merkle - old->merkle;
+        children[index] = child;
+        persimm_hamt_release(old, hamt);
+        PERSIMM_COUNT(hamt, in_place_edits);
+        return node;
+    }
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count, child_count,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = node->datamap;
+    copy->nodemap = node->nodemap;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle + child->merkle -
+                   persimm_hamt_children(node, entry_size)[index]->merkle;
+
+    memcpy(copy->data, node->data, (size_t)data_count * entry_size);
+    for (uint32_t i = 0; i < data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REPLACE, index, child, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/*
+ * Turns the entry in slot `bit`, whose key hashes to `hash`, into the child
+ * that now holds it and one more.
+ */
+static persimm_hamt_node_t *persimm_hamt_promote(persimm_hamt_node_t *node, uint32_t bit,
+                                                 uint32_t hash, persimm_hamt_node_t *child,
+                                                 const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+    uint32_t data_index = persimm_hamt_data_index(node, bit);
+    uint32_t child_index = persimm_hamt_child_index(node, bit);
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count - 1, child_count + 1,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = node->datamap & ~bit;
+    copy->nodemap = node->nodemap | bit;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle + child->merkle -
+                   persimm_hamt_term(hamt, hash, persimm_hamt_entry(node, data_index, entry_size));
+
+    memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
+           (size_t)data_index * entry_size);
+    memcpy(persimm_hamt_entry(copy, data_index, entry_size),
+           persimm_hamt_entry(node, data_index + 1, entry_size),
+           (size_t)(data_count - data_index - 1) * entry_size);
+
+    for (uint32_t i = 0; i + 1 < data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_INSERT, child_index, child, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/*
+ * Pulls `entry` out of the child in slot `bit` and inlines it in the child's
+ * place. `term` is the entry's share of the structural hash.
+ */
+static persimm_hamt_node_t *persimm_hamt_demote(persimm_hamt_node_t *node, uint32_t bit,
+                                                const void *entry, uint32_t term,
+                                                const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+    uint32_t data_index = PERSIMM_POPCOUNT((node->datamap | bit) & (bit - 1));
+    uint32_t child_index = persimm_hamt_child_index(node, bit);
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(node->kind, data_count + 1, child_count - 1,
+                                                      entry_size);
+    if (NULL == copy) return NULL;
+    copy->datamap = node->datamap | bit;
+    copy->nodemap = node->nodemap & ~bit;
+    copy->hash = node->hash;
+    copy->merkle = node->merkle + term -
+                   persimm_hamt_children(node, entry_size)[child_index]->merkle;
+
+    memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
+           (size_t)data_index * entry_size);
+    memcpy(persimm_hamt_entry(copy, data_index, entry_size), entry, entry_size);
+    memcpy(persimm_hamt_entry(copy, data_index + 1, entry_size),
+           persimm_hamt_entry(node, data_index, entry_size),
+           (size_t)(data_count - data_index) * entry_size);
+
+    /* The inlined entry is retained here, while the child that held it is
+       still alive, and only then does the caller let that child go. */
+    for (uint32_t i = 0; i <= data_count; i++) {
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
+    }
+
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REMOVE, child_index, NULL, hamt);
+    persimm_hamt_release(node, hamt);
+
+    return copy;
+}
+
+/*
+ * Builds the subtree holding two entries whose keys differ, copying and
+ * retaining both. Equal hashes cannot be told apart at any depth and so go
+ * straight to a collision node; otherwise the two must part at or before the
+ * level that reads the topmost bits, which bounds the recursion.
+ */
+static persimm_hamt_node_t *persimm_hamt_merge(size_t shift, const void *entry_a, uint32_t hash_a,
+                                               const void *entry_b, uint32_t hash_b,
+                                               const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t merkle = persimm_hamt_term(hamt, hash_a, entry_a) +
+                      persimm_hamt_term(hamt, hash_b, entry_b);
+    persimm_hamt_node_t *node;
+
+    if (hash_a == hash_b) {
+        node = persimm_hamt_node_new(PERSIMM_HAMT_COLLISION, 2, 0, entry_size);
+        if (NULL == node) return NULL;
+        node->datamap = 2;
+        node->hash = hash_a;
+        node->merkle = merkle;
+        memcpy(persimm_hamt_entry(node, 0, entry_size), entry_a, entry_size);
+        memcpy(persimm_hamt_entry(node, 1, entry_size), entry_b, entry_size);
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 0, entry_size));
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 1, entry_size));
+        return node;
+    }
+
+    uint32_t bit_a = persimm_hamt_bit(hash_a, shift);
+    uint32_t bit_b = persimm_hamt_bit(hash_b, shift);
+
+    if (bit_a == bit_b) {
+        persimm_hamt_node_t *child = persimm_hamt_merge(shift + PERSIMM_BITS, entry_a, hash_a,
+                                                        entry_b, hash_b, hamt);
+        if (NULL == child) return NULL;
+        node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+        if (NULL == node) {
+            persimm_hamt_release(child, hamt);
+            return NULL;
+        }
+        node->nodemap = bit_a;
+        node->merkle = merkle;
+        persimm_hamt_children(node, entry_size)[0] = child;
+        return node;
+    }
+
+    node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 2, 0, entry_size);
+    if (NULL == node) return NULL;
+    node->datamap = bit_a | bit_b;
+    node->merkle = merkle;
+
+    /* Entries sit in bit order, so the lower slot takes the first place. */
+    const void *first = (bit_a < bit_b) ? entry_a : entry_b;
+    const void *second = (bit_a < bit_b) ? entry_b : entry_a;
+    memcpy(persimm_hamt_entry(node, 0, entry_size), first, entry_size);
+    memcpy(persimm_hamt_entry(node, 1, entry_size), second, entry_size);
+    persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 0, entry_size));
+    persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 1, entry_size));
+
+    return node;
+}
+
+/* Accessing */
+
+const void *persimm_hamt_ref(persimm_hamt_node_t *root, const void *key,
+                             const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t hash = persimm_hamt_hash_of(hamt, key);
+    persimm_hamt_node_t *node = root;
+    size_t shift = 0;
+
+    while (NULL != node) {
+        if (PERSIMM_HAMT_COLLISION == node->kind) {
+            if (node->hash != hash) return NULL;
+            PERSIMM_COUNT(hamt, collision_scans);
+            for (uint32_t i = 0; i < node->datamap; i++) {
+                void *entry = persimm_hamt_entry(node, i, entry_size);
+                if (persimm_hamt_keys_equal(hamt, key, entry)) return entry;
+            }
+            return NULL;
+        }
+
+        uint32_t bit = persimm_hamt_bit(hash, shift);
+
+        if (node->datamap & bit) {
+            void *entry = persimm_hamt_entry(node, persimm_hamt_data_index(node, bit), entry_size);
+            return persimm_hamt_keys_equal(hamt, key, entry) ? entry : NULL;
+        }
+
+        if (node->nodemap & bit) {
+            node = persimm_hamt_children(node, entry_size)[persimm_hamt_child_index(node, bit)];
+            shift += PERSIMM_BITS;
+            continue;
+        }
+
+        return NULL;
+    }
+
+    return NULL;
+}
+
+/* Inserting */
+
+/*
+ * Consumes the reference to `node` and returns the node its parent should
+ * hold, or NULL if an allocation failed, in which case `node` is untouched.
+ */
+static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, size_t shift,
+                                                    uint32_t hash, const void *entry,
+                                                    const persimm_hamt_t *hamt, bool immutable,
+                                                    bool *added) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        if (node->hash == hash) {
+            PERSIMM_COUNT(hamt, collision_scans);
+            for (uint32_t i = 0; i < node->datamap; i++) {
+                if (persimm_hamt_keys_equal(hamt, entry, persimm_hamt_entry(node, i, entry_size))) {
+                    return persimm_hamt_with_value(node, i, entry, hash, hamt, immutable);
+                }
+            }
+            *added = true;
+            return persimm_hamt_with_entry(node, 0, node->datamap, entry, hash, hamt);
+        }
+
+        /* Another hash cannot belong here, so the collision node gains a
+           parent that separates the two and the insert starts again there. */
+        persimm_hamt_node_t *parent = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+        if (NULL == parent) return NULL;
+        parent->nodemap = persimm_hamt_bit(node->hash, shift);
+        parent->merkle = node->merkle;
+        persimm_hamt_children(parent, entry_size)[0] = node;
+        persimm_hamt_node_t *result =
+            persimm_hamt_node_assoc(parent, shift, hash, entry, hamt, immutable, added);
+        if (NULL == result) {
+            /* The caller still owns node when the operation fails. Parent's
+             * temporary reference was a transfer only if the update commits. */
+            PERSIMM_COUNT(hamt, node_frees);
+            free(parent);
+        }
+        return result;
+    }
+
+    uint32_t bit = persimm_hamt_bit(hash, shift);
+
+    if (node->datamap & bit) {
+        uint32_t index = persimm_hamt_data_index(node, bit);
+        void *existing = persimm_hamt_entry(node, index, entry_size);
+
+        if (persimm_hamt_keys_equal(hamt, entry, existing)) {
+            return persimm_hamt_with_value(node, index, entry, hash, hamt, immutable);
+        }
+
+        uint32_t existing_hash = persimm_hamt_hash_of(hamt, existing);
+        persimm_hamt_node_t *child = persimm_hamt_merge(shift + PERSIMM_BITS, existing,
+                                                        existing_hash, entry, hash, hamt);
+        if (NULL == child) return NULL;
+
+        persimm_hamt_node_t *result = persimm_hamt_promote(node, bit, existing_hash, child, hamt);
+        if (NULL == result) {
+            persimm_hamt_release(child, hamt);
+            return NULL;
+        }
+
+        *added = true;
+        return result;
+    }
+
+    if (node->nodemap & bit) {
+        uint32_t index = persimm_hamt_child_index(node, bit);
+        persimm_hamt_node_t *child = persimm_hamt_children(node, entry_size)[index];
+        persimm_rc_inc(&child->ref_count, hamt->local);
+
+        persimm_hamt_node_t *updated = persimm_hamt_node_assoc(child, shift + PERSIMM_BITS, hash,
+                                                               entry, hamt, immutable, added);
+        if (NULL == updated) {
+            persimm_hamt_release(child, hamt);
+            return NULL;
+        }
+
+        persimm_hamt_node_t *result =
+            persimm_hamt_with_child(node, index, updated, hamt, immutable);
+        if (NULL == result) persimm_hamt_release(updated, hamt);
+        return result;
+    }
+
+    *added = true;
+    return persimm_hamt_with_entry(node, bit, persimm_hamt_data_index(node, bit), entry, hash,
+                                   hamt);
+}
+
+persimm_status persimm_hamt_assoc(persimm_hamt_node_t **root, const void *entry,
+                                  const persimm_hamt_t *hamt, bool immutable, bool *added) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t hash = persimm_hamt_hash_of(hamt, entry);
+
+    *added = false;
+
+    if (NULL == *root) {
+        persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 1, 0, entry_size);
+        if (NULL == node) return PERSIMM_ERR_ALLOC;
+        node->datamap = persimm_hamt_bit(hash, 0);
+        node->merkle = persimm_hamt_term(hamt, hash, entry);
+        memcpy(persimm_hamt_entry(node, 0, entry_size), entry, entry_size);
+        persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 0, entry_size));
+        *root = node;
+        *added = true;
+        return PERSIMM_OK;
+    }
+
+    persimm_hamt_node_t *updated = persimm_hamt_node_assoc(*root, 0, hash, entry, hamt, immutable,
+                                                           added);
+    if (NULL == updated) return PERSIMM_ERR_ALLOC;
+
+    *root = updated;
+
+    return PERSIMM_OK;
+}
+
+/* Removing */
+
+/*
+ * Consumes the reference to `node` and returns the node its parent should
+ * hold, or NULL if an allocation failed. A node that is not the root always
+ * keeps at least one slot, so only the root can come back empty.
+ */
+static persimm_hamt_node_t *persimm_hamt_node_dissoc(persimm_hamt_node_t *node, size_t shift,
+                                                     uint32_t hash, const void *key,
+                                                     const persimm_hamt_t *hamt, bool immutable,
+                                                     bool *removed) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        if (node->hash != hash) return node;
+        PERSIMM_COUNT(hamt, collision_scans);
+        for (uint32_t i = 0; i < node->datamap; i++) {
+            if (persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, i, entry_size))) {
+                *removed = true;
+                return persimm_hamt_without_entry(node, 0, i, hash, hamt);
+            }
+        }
+        return node;
+    }
+
+    uint32_t bit = persimm_hamt_bit(hash, shift);
+
+    if (node->datamap & bit) {
+        uint32_t index = persimm_hamt_data_index(node, bit);
+        if (!persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, index, entry_size))) {
+            return node;
+        }
+        *removed = true;
+        return persimm_hamt_without_entry(node, bit, index, hash, hamt);
+    }
+
+    if (node->nodemap & bit) {
+        uint32_t index = persimm_hamt_child_index(node, bit);
+        persimm_hamt_node_t *child = persimm_hamt_children(node, entry_size)[index];
+        persimm_rc_inc(&child->ref_count, hamt->local);
+
+        persimm_hamt_node_t *updated = persimm_hamt_node_dissoc(child, shift + PERSIMM_BITS, hash,
+                                                                key, hamt, immutable, removed);
+        if (NULL == updated) {
+            persimm_hamt_release(child, hamt);
+            return NULL;
+        }
+        if (!*removed) {
+            persimm_hamt_release(updated, hamt);
+            return node;
+        }
+
+        /* Canonical form again: a child left holding one entry and nothing
+           else belongs inline, and that may cascade the whole way up. */
+        if (persimm_hamt_is_single(updated)) {
+            persimm_hamt_node_t *result =
+                persimm_hamt_demote(node, bit, persimm_hamt_entry(updated, 0, entry_size),
+                                    updated->merkle, hamt);
+            persimm_hamt_release(updated, hamt);
+            return result;
+        }
+
+        persimm_hamt_node_t *result =
+            persimm_hamt_with_child(node, index, updated, hamt, immutable);
+        if (NULL == result) persimm_hamt_release(updated, hamt);
+        return result;
+    }
+
+    return node;
+}
+
+persimm_status persimm_hamt_dissoc(persimm_hamt_node_t **root, const void *key,
+                                   const persimm_hamt_t *hamt, bool immutable, bool *removed) {
+    *removed = false;
+
+    if (NULL == *root) return PERSIMM_OK;
+
+    uint32_t hash = persimm_hamt_hash_of(hamt, key);
+    persimm_hamt_node_t *updated = persimm_hamt_node_dissoc(*root, 0, hash, key, hamt, immutable,
+                                                            removed);
+    if (NULL == updated) return PERSIMM_ERR_ALLOC;
+
+    if (0 == persimm_hamt_data_count(updated) && 0 == persimm_hamt_child_count(updated)) {
+        persimm_hamt_release(updated, hamt);
+        updated = NULL;
+    }
+
+    *root = updated;
+
+    return PERSIMM_OK;
+}
+
+/* Building */
+
+/*
+ * A bulk build hashes every input once up front and from then on works only
+ * with these. `key` is the input whose key the trie keeps and `value` the one
+ * whose value it keeps, which differ only when a key arrives more than once.
+ * An item marked `existing` stands for an entry a trie already holds, which a
+ * batch meets when it updates one.
+ */
+typedef struct {
+    const unsigned char *key;
+    const unsigned char *value;
+    uint32_t hash;
+    bool existing;
+} persimm_hamt_item_t;
+
+/*
+ * Allocates room for `count + spare` items and fills the first `count` from
+ * inputs laid out `stride` bytes apart, hashing each. The spare room is left
+ * for the caller.
+ */
+static persimm_hamt_item_t *persimm_hamt_items_new(const void *inputs, size_t count,
+                                                   size_t stride, size_t spare,
+                                                   const persimm_hamt_t *hamt) {
+    size_t total;
+    size_t bytes;
+    if (!persimm_size_add(count, spare, &total) ||
+        !persimm_size_mul(total, sizeof(persimm_hamt_item_t), &bytes)) {
+        return NULL;
+    }
+
+    persimm_hamt_item_t *items = calloc(1, bytes);
+    if (NULL == items) return NULL;
+
+    const unsigned char *input = (const unsigned char *)inputs;
+    for (size_t i = 0; i < count; i++) {
+        items[i].key = input + (i * stride);
+        items[i].value = items[i].key;
+        items[i].hash = persimm_hamt_hash_of(hamt, items[i].key);
+    }
+
+    return items;
+}
+
+static uint32_t persimm_hamt_chunk(uint32_t hash, size_t shift) {
+    return (hash >> shift) & PERSIMM_MASK;
+}
+
+/*
+ * Sorts `items` by the slot each takes at `shift`, in place, and records where
+ * each slot's run begins. This is a radix sort one digit at a time, the digit
+ * being the one the trie itself reads at this level, so sorting the next level
+ * down happens inside each run as the build reaches it and no second buffer is
+ * ever needed.
+ */
+static void persimm_hamt_partition(persimm_hamt_item_t *items, size_t count, size_t shift,
+                                   size_t starts[PERSIMM_WIDTH + 1]) {
+    size_t next[PERSIMM_WIDTH];
+
+    memset(starts, 0, sizeof(size_t) * (PERSIMM_WIDTH + 1));
+    for (size_t i = 0; i < count; i++) starts[persimm_hamt_chunk(items[i].hash, shift) + 1]++;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        starts[slot + 1] += starts[slot];
+        next[slot] = starts[slot];
+    }
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        while (next[slot] < starts[slot + 1]) {
+            size_t at = next[slot];
+            uint32_t home = persimm_hamt_chunk(items[at].hash, shift);
+            if (home == slot) {
+                next[slot]++;
+                continue;
+            }
+            persimm_hamt_item_t moving = items[at];
+            items[at] = items[next[home]];
+            items[next[home]++] = moving;
+        }
+    }
+}
+
+/* Existing entries come first, in the order the trie holds them, then inputs as they arrived. */
+static bool persimm_hamt_item_before(const persimm_hamt_item_t *a, const persimm_hamt_item_t *b) {
+    if (a->existing != b->existing) return a->existing;
+    return a->key < b->key;
+}
+
+/*
+ * Settles a run of items sharing one hash: puts them back in the order they
+ * arrived, which partitioning does not keep, then folds each repeated key into
+ * its first appearance. The first key stays and the last value wins, which is
+ * exactly what storing the inputs one after another would have produced.
+ * Returns how many distinct keys remain at the front of the run.
+ */
+static size_t persimm_hamt_settle(persimm_hamt_item_t *items, size_t count,
+                                  const persimm_hamt_t *hamt) {
+    for (size_t i = 1; i < count; i++) {
+        persimm_hamt_item_t moving = items[i];
+        size_t j = i;
+        for (; j > 0 && persimm_hamt_item_before(&moving, &items[j - 1]); j--) {
+            items[j] = items[j - 1];
+        }
+        items[j] = moving;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t match = 0;
+        while (match < kept && !persimm_hamt_keys_equal(hamt, items[i].key, items[match].key)) {
+            match++;
+        }
+        if (match < kept) {
+            items[match].value = items[i].value;
+        } else {
+            items[kept++] = items[i];
+        }
+    }
+
+    return kept;
+}
+
+static bool persimm_hamt_same_hash(const persimm_hamt_item_t *items, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        if (items[i].hash != items[0].hash) return false;
+    }
+    return true;
+}
+
+static void persimm_hamt_item_store(const persimm_hamt_t *hamt, void *slot,
+                                    const persimm_hamt_item_t *item) {
+    memcpy(slot, item->key, hamt->layout.entry_size);
+    if (hamt->layout.value_size > 0 && item->value != item->key) {
+        memcpy(persimm_hamt_value(hamt, slot), persimm_hamt_value_const(hamt, item->value),
+               hamt->layout.value_size);
+    }
+    persimm_hamt_entry_retain(hamt, slot);
+}
+
+static persimm_hamt_node_t *persimm_hamt_collision_build(const persimm_hamt_item_t *items,
+                                                         size_t count,
+                                                         const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (count > UINT32_MAX) return NULL;
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_COLLISION, (uint32_t)count, 0,
+                                                      entry_size);
+    if (NULL == node) return NULL;
+    node->datamap = (uint32_t)count;
+    node->hash = items[0].hash;
+    for (size_t i = 0; i < count; i++) {
+        persimm_hamt_item_store(hamt, persimm_hamt_entry(node, (uint32_t)i, entry_size),
+                                &items[i]);
+        node->merkle += persimm_hamt_term(hamt, items[i].hash, items[i].value);
+    }
+
+    return node;
+}
+
+/*
+ * What one slot of a node comes to once a build or a batch has passed through
+ * it. A slot left alone, or whose subtree came back unchanged, keeps what it
+ * held; otherwise it ends up empty, holding an entry, or holding a child made
+ * for it. Settling every slot before the node is allocated is what lets the
+ * node be allocated once, at its final size.
+ */
+typedef enum {
+    PERSIMM_HAMT_SLOT_KEEP,
+    PERSIMM_HAMT_SLOT_EMPTY,
+    PERSIMM_HAMT_SLOT_ENTRY,
+    PERSIMM_HAMT_SLOT_CHILD
+} persimm_hamt_slot_kind;
+
+typedef struct {
+    persimm_hamt_slot_kind kind;
+    persimm_hamt_item_t entry;  // ENTRY: what the slot stores
+    persimm_hamt_node_t *child; // CHILD: a node the slot takes over
+    uint32_t merkle;            // ENTRY or CHILD: the slot's share of the structural hash
+    uint32_t held;              // the share of an entry the slot held before, if it held one
+} persimm_hamt_slot_t;
+
+static void persimm_hamt_slots_release(persimm_hamt_slot_t slots[PERSIMM_WIDTH],
+                                       const persimm_hamt_t *hamt) {
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        if (PERSIMM_HAMT_SLOT_CHILD == slots[slot].kind) {
+            persimm_hamt_release(slots[slot].child, hamt);
+        }
+    }
+}
+
+/*
+ * Makes the node `slots` describe in place of `from`, which may be NULL when
+ * there was nothing before. A kept slot carries over what `from` holds there,
+ * retained for the new node. When every slot was kept `*out` keeps `from`
+ * itself; when nothing is left it is empty; and below the root a lone entry is
+ * handed up for the parent to inline rather than given a node of its own.
+ * Returns false if the allocation failed, having released the children made
+ * for the slots.
+ */
+static bool persimm_hamt_finish(persimm_hamt_node_t *from, persimm_hamt_slot_t slots[PERSIMM_WIDTH],
+                                size_t shift, const persimm_hamt_t *hamt,
+                                persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t datamap = 0;
+    uint32_t nodemap = 0;
+    uint32_t merkle = (NULL != from) ? from->merkle : 0;
+    bool changed = false;
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_slot_kind kind = slots[slot].kind;
+
+        /* The structural hash moves by what each settled slot gave up and took on. */
+        if (PERSIMM_HAMT_SLOT_KEEP != kind && NULL != from) {
+            if (from->datamap & bit) merkle -= slots[slot].held;
+            if (from->nodemap & bit) {
+                persimm_hamt_node_t **old = persimm_hamt_children(from, entry_size);
+                merkle -= old[persimm_hamt_child_index(from, bit)]->merkle;
+            }
+        }
+        if (PERSIMM_HAMT_SLOT_ENTRY == kind || PERSIMM_HAMT_SLOT_CHILD == kind) {
+            merkle += slots[slot].merkle;
+        }
+
+        switch (kind) {
+        case PERSIMM_HAMT_SLOT_KEEP:
+            if (NULL != from) {
+                datamap |= from->datamap & bit;
+                nodemap |= from->nodemap & bit;
+            }
+            break;
+        case PERSIMM_HAMT_SLOT_EMPTY:
+            changed = changed || (NULL != from && 0 != ((from->datamap | from->nodemap) & bit));
+            break;
+        case PERSIMM_HAMT_SLOT_ENTRY:
+            datamap |= bit;
+            changed = true;
+            break;
+        case PERSIMM_HAMT_SLOT_CHILD:
+            nodemap |= bit;
+            changed = true;
+            break;
+        }
+    }
+
+    if (NULL != from && !changed) {
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+
+    if (0 == datamap && 0 == nodemap) {
+        out->kind = PERSIMM_HAMT_SLOT_EMPTY;
+        return true;
+    }
+
+    if (shift > 0 && 0 == nodemap && 1 == PERSIMM_POPCOUNT(datamap)) {
+        size_t slot = 0;
+        while (0 == (datamap & ((uint32_t)1 << slot))) slot++;
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        if (PERSIMM_HAMT_SLOT_KEEP == slots[slot].kind) {
+            const unsigned char *entry = persimm_hamt_entry(
+                from, persimm_hamt_data_index(from, (uint32_t)1 << slot), entry_size);
+            out->entry.key = entry;
+            out->entry.value = entry;
+            out->entry.existing = true;
+        } else {
+            out->entry = slots[slot].entry;
+        }
+        out->merkle = merkle;
+        return true;
+    }
+
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP,
+                                                      PERSIMM_POPCOUNT(datamap),
+                                                      PERSIMM_POPCOUNT(nodemap), entry_size);
+    if (NULL == node) {
+        persimm_hamt_slots_release(slots, hamt);
+        return false;
+    }
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->merkle = merkle;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    uint32_t data_index = 0;
+    uint32_t child_index = 0;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        bool kept = PERSIMM_HAMT_SLOT_KEEP == slots[slot].kind;
+
+        if (datamap & bit) {
+            void *entry = persimm_hamt_entry(node, data_index++, entry_size);
+            if (kept) {
+                memcpy(entry,
+                       persimm_hamt_entry(from, persimm_hamt_data_index(from, bit), entry_size),
+                       entry_size);
+                persimm_hamt_entry_retain(hamt, entry);
+            } else {
+                persimm_hamt_item_store(hamt, entry, &slots[slot].entry);
+            }
+        } else if (nodemap & bit) {
+            persimm_hamt_node_t *child = slots[slot].child;
+            if (kept) {
+                child = persimm_hamt_children(from, entry_size)[persimm_hamt_child_index(from, bit)];
+                persimm_rc_inc(&child->ref_count, hamt->local);
+            }
+            children[child_index++] = child;
+        }
+    }
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = node;
+    out->merkle = merkle;
+    return true;
+}
+
+static persimm_hamt_node_t *persimm_hamt_node_build(persimm_hamt_item_t *items, size_t count,
+                                                    size_t shift, const persimm_hamt_t *hamt,
+                                                    size_t *built);
+
+/*
+ * Settles what one slot at `shift` holds when `run` is everything bound for
+ * it: a single entry, a collision node when every hash agrees, or a bitmap
+ * node one level down. Adds the distinct keys placed to `*built`.
+ */
+static bool persimm_hamt_run_build(persimm_hamt_item_t *run, size_t count, size_t shift,
+                                   const persimm_hamt_t *hamt, size_t *built,
+                                   persimm_hamt_slot_t *out) {
+    bool same = persimm_hamt_same_hash(run, count);
+    if (same) count = persimm_hamt_settle(run, count, hamt);
+
+    if (1 == count) {
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        out->entry = run[0];
+        out->merkle = persimm_hamt_term(hamt, run[0].hash, run[0].value);
+        (*built)++;
+        return true;
+    }
+
+    persimm_hamt_node_t *child;
+    if (same) {
+        child = persimm_hamt_collision_build(run, count, hamt);
+        if (NULL != child) *built += count;
+    } else {
+        child = persimm_hamt_node_build(run, count, shift + PERSIMM_BITS, hamt, built);
+    }
+    if (NULL == child) return false;
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = child;
+    out->merkle = child->merkle;
+    return true;
+}
+
+/*
+ * Builds the bitmap node for `items`, which all agree on every level above
+ * `shift`. Each slot's run is built first, so the node itself is allocated
+ * once at its final size. Adds the distinct keys placed to `*built`. Returns
+ * NULL if an allocation failed, having released whatever it had made.
+ */
+static persimm_hamt_node_t *persimm_hamt_node_build(persimm_hamt_item_t *items, size_t count,
+                                                    size_t shift, const persimm_hamt_t *hamt,
+                                                    size_t *built) {
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        size_t length = starts[slot + 1] - starts[slot];
+        if (0 == length) continue;
+        if (!persimm_hamt_run_build(items + starts[slot], length, shift, hamt, built,
+                                    &slots[slot])) {
+            persimm_hamt_slots_release(slots, hamt);
+            return NULL;
+        }
+    }
+
+    persimm_hamt_slot_t out;
+    if (!persimm_hamt_finish(NULL, slots, shift, hamt, &out)) return NULL;
+
+    return out.child;
+}
+
+persimm_status persimm_hamt_build(persimm_hamt_node_t **root, const void *entries,
+                                  size_t count, const persimm_hamt_t *hamt, size_t *built) {
+    *root = NULL;
+    *built = 0;
+    if (0 == count) return PERSIMM_OK;
+
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, count,
+                                                        hamt->layout.entry_size, 0, hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    *root = persimm_hamt_node_build(items, count, 0, hamt, built);
+    free(items);
+    if (NULL == *root) {
+        *built = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    return PERSIMM_OK;
+}
+
+/*
+ * A parallel build does what persimm_hamt_node_build does for the root, with
+ * the slow parts fanned out: the inputs are hashed in chunks, and each of the
+ * root's slots is built as a task of its own once the items are partitioned.
+ * Only the partition and the root itself are made on the calling thread, by
+ * the same code a serial build runs, so the two cannot differ in shape.
+ */
+typedef struct {
+    const persimm_hamt_t *hamt;
+    const unsigned char *entries;
+    persimm_hamt_item_t *items;
+    size_t count;
+    size_t chunk;
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+    size_t built[PERSIMM_WIDTH];
+    bool failed[PERSIMM_WIDTH];
+} persimm_hamt_build_fanout_t;
+
+static void persimm_hamt_hash_task(void *arg, size_t task) {
+    persimm_hamt_build_fanout_t *fanout = arg;
+    size_t entry_size = fanout->hamt->layout.entry_size;
+    size_t end = (task + 1) * fanout->chunk;
+    if (end > fanout->count) end = fanout->count;
+    for (size_t i = task * fanout->chunk; i < end; i++) {
+        persimm_hamt_item_t *item = &fanout->items[i];
+        item->key = fanout->entries + (i * entry_size);
+        item->value = item->key;
+        item->hash = persimm_hamt_hash_of(fanout->hamt, item->key);
+    }
+}
+
+static void persimm_hamt_slot_task(void *arg, size_t slot) {
+    persimm_hamt_build_fanout_t *fanout = arg;
+    size_t length = fanout->starts[slot + 1] - fanout->starts[slot];
+    if (0 == length) return;
+    if (!persimm_hamt_run_build(fanout->items + fanout->starts[slot], length, 0, fanout->hamt,
+                                &fanout->built[slot], &fanout->slots[slot])) {
+        fanout->slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+        fanout->failed[slot] = true;
+    }
+}
+
+persimm_status persimm_hamt_parallel_build(persimm_hamt_node_t **root, const void *entries,
+                                           size_t count, const persimm_hamt_t *hamt,
+                                           const persimm_executor *executor, size_t *built) {
+    if (NULL == executor) return persimm_hamt_build(root, entries, count, hamt, built);
+
+    *root = NULL;
+    *built = 0;
+    if (0 == count) return PERSIMM_OK;
+
+    persimm_hamt_build_fanout_t *fanout = calloc(1, sizeof(persimm_hamt_build_fanout_t));
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, 0, 0, count, hamt);
+    if (NULL == fanout || NULL == items) {
+        free(fanout);
+        free(items);
+        return PERSIMM_ERR_ALLOC;
+    }
+    fanout->hamt = hamt;
+    fanout->entries = entries;
+    fanout->items = items;
+    fanout->count = count;
+    fanout->chunk = (count + PERSIMM_WIDTH - 1) / PERSIMM_WIDTH;
+
+    persimm_executor_run(executor, (count + fanout->chunk - 1) / fanout->chunk,
+                         persimm_hamt_hash_task, fanout);
+    persimm_hamt_partition(items, count, 0, fanout->starts);
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        fanout->slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+    }
+    persimm_executor_run(executor, PERSIMM_WIDTH, persimm_hamt_slot_task, fanout);
+
+    bool failed = false;
+    size_t total = 0;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        failed = failed || fanout->failed[slot];
+        total += fanout->built[slot];
+    }
+
+    persimm_hamt_slot_t out;
+    if (failed) {
+        persimm_hamt_slots_release(fanout->slots, hamt);
+    } else if (persimm_hamt_finish(NULL, fanout->slots, 0, hamt, &out)) {
+        *root = out.child;
+        *built = total;
+    } else {
+        failed = true;
+    }
+
+    free(items);
+    free(fanout);
+    return failed ? PERSIMM_ERR_ALLOC : PERSIMM_OK;
+}
+
+/* Updating in Bulk */
+
+/*
+ * A batch descends the trie once. At each node it is partitioned by slot as a
+ * build is, each slot's run goes down to that slot's child alone, and the node
+ * is rebuilt once from what every slot came to. However many of a batch's
+ * entries land in a node, the node is copied at most once, and a subtree the
+ * batch never reaches is shared rather than copied.
+ *
+ * Neither walk below changes a node it is given: `node` is only read, and
+ * `*out` says what its parent should hold instead. The old trie stays whole
+ * until the caller swaps the root, which is what lets an entry that moves be
+ * copied straight out of the node it leaves.
+ */
+
+static bool persimm_hamt_node_assoc_many(persimm_hamt_node_t *node, size_t shift,
+                                         persimm_hamt_item_t *items, size_t count,
+                                         persimm_hamt_item_t *scratch, const persimm_hamt_t *hamt,
+                                         size_t *added, persimm_hamt_slot_t *out);
+
+/*
+ * Merges a run whose every hash is the collision node's own. The entries
+ * already held go first and keep their keys, so the run settles exactly as
+ * storing it entry by entry would have.
+ */
+static bool persimm_hamt_collision_assoc_many(persimm_hamt_node_t *node,
+                                              const persimm_hamt_item_t *items, size_t count,
+                                              const persimm_hamt_t *hamt, size_t *added,
+                                              persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    size_t held = node->datamap;
+    size_t total;
+    size_t bytes;
+    PERSIMM_COUNT(hamt, collision_scans);
+
+    if (!persimm_size_add(held, count, &total) ||
+        !persimm_size_mul(total, sizeof(persimm_hamt_item_t), &bytes)) {
+        return false;
+    }
+    persimm_hamt_item_t *merged = calloc(1, bytes);
+    if (NULL == merged) return false;
+
+    for (size_t i = 0; i < held; i++) {
+        merged[i].key = persimm_hamt_entry(node, (uint32_t)i, entry_size);
+        merged[i].value = merged[i].key;
+        merged[i].hash = node->hash;
+        merged[i].existing = true;
+    }
+    memcpy(merged + held, items, count * sizeof(persimm_hamt_item_t));
+
+    size_t kept = persimm_hamt_settle(merged, total, hamt);
+
+    /* A set whose every element was already present has nothing to change. */
+    if (kept == held && 0 == hamt->layout.value_size) {
+        free(merged);
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+
+    persimm_hamt_node_t *child = persimm_hamt_collision_build(merged, kept, hamt);
+    free(merged);
+    if (NULL == child) return false;
+
+    *added += kept - held;
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = child;
+    out->merkle = child->merkle;
+    return true;
+}
+
+static bool persimm_hamt_node_assoc_many(persimm_hamt_node_t *node, size_t shift,
+                                         persimm_hamt_item_t *items, size_t count,
+                                         persimm_hamt_item_t *scratch, const persimm_hamt_t *hamt,
+                                         size_t *added, persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        if (persimm_hamt_same_hash(items, count) && items[0].hash == node->hash) {
+            return persimm_hamt_collision_assoc_many(node, items, count, hamt, added, out);
+        }
+
+        /* Other hashes cannot belong here, so the collision node is seen
+           through a parent that separates them, as a single assoc does. The
+           parent never holds a reference of its own and goes with a plain
+           free, since whatever was made from it retained what it kept. */
+        persimm_hamt_node_t *parent = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+        if (NULL == parent) return false;
+        parent->nodemap = persimm_hamt_bit(node->hash, shift);
+        parent->merkle = node->merkle;
+        persimm_hamt_children(parent, entry_size)[0] = node;
+        bool done = persimm_hamt_node_assoc_many(parent, shift, items, count, scratch, hamt,
+                                                 added, out);
+        PERSIMM_COUNT(hamt, node_frees);
+        free(parent);
+        return done;
+    }
+
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_item_t *run = items + starts[slot];
+        size_t length = starts[slot + 1] - starts[slot];
+        bool done = true;
+
+        if (0 == length) continue;
+
+        if (node->nodemap & bit) {
+            persimm_hamt_node_t *child =
+                persimm_hamt_children(node, entry_size)[persimm_hamt_child_index(node, bit)];
+            done = persimm_hamt_node_assoc_many(child, shift + PERSIMM_BITS, run, length, scratch,
+                                                hamt, added, &slots[slot]);
+        } else if (node->datamap & bit) {
+            /* The entry already here joins the run at its head, so it keeps
+               its key against any equal one the batch brings. Only one slot
+               is settled at a time, so one scratch run serves them all. */
+            const unsigned char *held =
+                persimm_hamt_entry(node, persimm_hamt_data_index(node, bit), entry_size);
+            scratch[0].key = held;
+            scratch[0].value = held;
+            scratch[0].hash = persimm_hamt_hash_of(hamt, held);
+            scratch[0].existing = true;
+            memcpy(scratch + 1, run, length * sizeof(persimm_hamt_item_t));
+            slots[slot].held = persimm_hamt_term(hamt, scratch[0].hash, held);
+
+            size_t built = 0;
+            done = persimm_hamt_run_build(scratch, length + 1, shift, hamt, &built, &slots[slot]);
+            if (done) {
+                *added += built - 1;
+                if (PERSIMM_HAMT_SLOT_ENTRY == slots[slot].kind && 0 == hamt->layout.value_size) {
+                    slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+                }
+            }
+        } else {
+            done = persimm_hamt_run_build(run, length, shift, hamt, added, &slots[slot]);
+        }
+
+        if (!done) {
+            persimm_hamt_slots_release(slots, hamt);
+            return false;
+        }
+    }
+
+    return persimm_hamt_finish(node, slots, shift, hamt, out);
+}
+
+/* Whether the collision node's entry at `index` is one of the keys in `items`. */
+static bool persimm_hamt_collision_doomed(persimm_hamt_node_t *node, uint32_t index,
+                                          const persimm_hamt_item_t *items, size_t count,
+                                          const persimm_hamt_t *hamt) {
+    const void *entry = persimm_hamt_entry(node, index, hamt->layout.entry_size);
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].hash == node->hash && persimm_hamt_keys_equal(hamt, items[i].key, entry)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool persimm_hamt_collision_dissoc_many(persimm_hamt_node_t *node,
+                                               const persimm_hamt_item_t *items, size_t count,
+                                               const persimm_hamt_t *hamt, size_t *removed,
+                                               persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t held = node->datamap;
+    uint32_t kept = 0;
+    PERSIMM_COUNT(hamt, collision_scans);
+
+    for (uint32_t i = 0; i < held; i++) {
+        if (!persimm_hamt_collision_doomed(node, i, items, count, hamt)) kept++;
+    }
+
+    if (kept == held) {
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+    *removed += held - kept;
+
+    if (0 == kept) {
+        out->kind = PERSIMM_HAMT_SLOT_EMPTY;
+        return true;
+    }
+
+    if (1 == kept) {
+        uint32_t i = 0;
+        while (persimm_hamt_collision_doomed(node, i, items, count, hamt)) i++;
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        out->entry.key = persimm_hamt_entry(node, i, entry_size);
+        out->entry.value = out->entry.key;
+        out->entry.existing = true;
+        out->merkle = persimm_hamt_term(hamt, node->hash, out->entry.key);
+        return true;
+    }
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(PERSIMM_HAMT_COLLISION, kept, 0, entry_size);
+    if (NULL == copy) return false;
+    copy->datamap = kept;
+    copy->hash = node->hash;
+
+    uint32_t at = 0;
+    for (uint32_t i = 0; i < held; i++) {
+        if (persimm_hamt_collision_doomed(node, i, items, count, hamt)) continue;
+        void *entry = persimm_hamt_entry(copy, at++, entry_size);
+        memcpy(entry, persimm_hamt_entry(node, i, entry_size), entry_size);
+        persimm_hamt_entry_retain(hamt, entry);
+        copy->merkle += persimm_hamt_term(hamt, node->hash, entry);
+    }
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = copy;
+    out->merkle = copy->merkle;
+    return true;
+}
+
+static bool persimm_hamt_node_dissoc_many(persimm_hamt_node_t *node, size_t shift,
+                                          persimm_hamt_item_t *items, size_t count,
+                                          const persimm_hamt_t *hamt, size_t *removed,
+                                          persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        return persimm_hamt_collision_dissoc_many(node, items, count, hamt, removed, out);
+    }
+
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_item_t *run = items + starts[slot];
+        size_t length = starts[slot + 1] - starts[slot];
+
+        if (0 == length) continue;
+
+        if (node->nodemap & bit) {
+            persimm_hamt_node_t *child =
+                persimm_hamt_children(node, entry_size)[persimm_hamt_child_index(node, bit)];
+            if (!persimm_hamt_node_dissoc_many(child, shift + PERSIMM_BITS, run, length, hamt,
+                                               removed, &slots[slot])) {
+                persimm_hamt_slots_release(slots, hamt);
+                return false;
+            }
+        } else if (node->datamap & bit) {
+            const void *held =
+                persimm_hamt_entry(node, persimm_hamt_data_index(node, bit), entry_size);
+            for (size_t i = 0; i < length; i++) {
+                if (persimm_hamt_keys_equal(hamt, run[i].key, held)) {
+                    slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+                    slots[slot].held = persimm_hamt_term(hamt, run[i].hash, held);
+                    (*removed)++;
+                    break;
+                }
+            }
+        }
+    }
+
+    return persimm_hamt_finish(node, slots, shift, hamt, out);
+}
+
+/* Swaps in the root a batch produced. Only the root may be left empty. */
+static void persimm_hamt_settle_root(persimm_hamt_node_t **root, const persimm_hamt_slot_t *out,
+                                     const persimm_hamt_t *hamt) {
+    if (PERSIMM_HAMT_SLOT_KEEP == out->kind) return;
+    persimm_hamt_release(*root, hamt);
+    *root = (PERSIMM_HAMT_SLOT_CHILD == out->kind) ? out->child : NULL;
+}
+
+persimm_status persimm_hamt_assoc_many(persimm_hamt_node_t **root, const void *entries,
+                                       size_t count, const persimm_hamt_t *hamt,
+                                       size_t *added) {
+    *added = 0;
+    if (0 == count) return PERSIMM_OK;
+    if (NULL == *root) return persimm_hamt_build(root, entries, count, hamt, added);
+
+    /* One more item than the batch holds, after it, is the scratch run each
+       slot that already holds an entry is settled in. */
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, count, hamt->layout.entry_size,
+                                                        count + 1, hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    persimm_hamt_slot_t out;
+    bool done = persimm_hamt_node_assoc_many(*root, 0, items, count, items + count, hamt, added,
+                                             &out);
+    free(items);
+    if (!done) {
+        *added = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_hamt_settle_root(root, &out, hamt);
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_hamt_dissoc_many(persimm_hamt_node_t **root, const void *keys,
+                                        size_t count, const persimm_hamt_t *hamt,
+                                        size_t *removed) {
+    *removed = 0;
+    if (0 == count || NULL == *root) return PERSIMM_OK;
+
+    persimm_hamt_item_t *items = persimm_hamt_items_new(keys, count, hamt->layout.key_size, 0,
+                                                        hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    persimm_hamt_slot_t out;
+    bool done = persimm_hamt_node_dissoc_many(*root, 0, items, count, hamt, removed, &out);
+    free(items);
+    if (!done) {
+        *removed = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_hamt_settle_root(root, &out, hamt);
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+/*
+ * The root's 32 slots divide a trie by the low bits of each key's hash, and
+ * a root holding only one of them is exactly the root a trie of just those
+ * keys would have. Splitting and joining along that line therefore touches
+ * the root alone, whatever the size of the trie beneath it.
+ */
+
+static size_t persimm_hamt_node_size(persimm_hamt_node_t *node, size_t entry_size) {
+    size_t size = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        size += persimm_hamt_node_size(children[i], entry_size);
+    }
+    return size;
+}
+
+static void persimm_hamt_split_undo(persimm_hamt_node_t **roots, size_t *counts,
+                                    const persimm_hamt_t *hamt) {
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        persimm_hamt_release(roots[slot], hamt);
+        roots[slot] = NULL;
+        counts[slot] = 0;
+    }
+}
+
+persimm_status persimm_hamt_split(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                  persimm_hamt_node_t **roots, size_t *counts) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        roots[slot] = NULL;
+        counts[slot] = 0;
+    }
+    if (NULL == root) return PERSIMM_OK;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(root, entry_size);
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_node_t *part;
+
+        if (0 != (root->datamap & bit)) {
+            const void *entry = persimm_hamt_entry(root, persimm_hamt_data_index(root, bit),
+                                                   entry_size);
+            part = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 1, 0, entry_size);
+            if (NULL == part) {
+                persimm_hamt_split_undo(roots, counts, hamt);
+                return PERSIMM_ERR_ALLOC;
+            }
+            part->datamap = bit;
+            part->merkle = persimm_hamt_term(hamt, persimm_hamt_hash_of(hamt, entry), entry);
+            memcpy(persimm_hamt_entry(part, 0, entry_size), entry, entry_size);
+            persimm_hamt_entry_retain(hamt, persimm_hamt_entry(part, 0, entry_size));
+            counts[slot] = 1;
+        } else if (0 != (root->nodemap & bit)) {
+            persimm_hamt_node_t *child = children[persimm_hamt_child_index(root, bit)];
+            part = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+            if (NULL == part) {
+                persimm_hamt_split_undo(roots, counts, hamt);
+                return PERSIMM_ERR_ALLOC;
+            }
+            part->nodemap = bit;
+            part->merkle = child->merkle;
+            persimm_rc_inc(&child->ref_count, hamt->local);
+            persimm_hamt_children(part, entry_size)[0] = child;
+            counts[slot] = persimm_hamt_node_size(child, entry_size);
+        } else {
+            continue;
+        }
+        roots[slot] = part;
+    }
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_hamt_join(persimm_hamt_node_t *const *roots, size_t count,
+                                 const persimm_hamt_t *hamt, persimm_hamt_node_t **dest) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t datamap = 0;
+    uint32_t nodemap = 0;
+    uint32_t merkle = 0;
+
+    *dest = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (NULL == roots[i]) continue;
+        if (0 != ((datamap | nodemap) & (roots[i]->datamap | roots[i]->nodemap))) {
+            return PERSIMM_ERR_INVALID;
+        }
+        datamap |= roots[i]->datamap;
+        nodemap |= roots[i]->nodemap;
+        merkle += roots[i]->merkle;
+    }
+    if (0 == (datamap | nodemap)) return PERSIMM_OK;
+
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP,
+                                                      PERSIMM_POPCOUNT(datamap),
+                                                      PERSIMM_POPCOUNT(nodemap), entry_size);
+    if (NULL == node) return PERSIMM_ERR_ALLOC;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->merkle = merkle;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (size_t i = 0; i < count; i++) {
+        persimm_hamt_node_t *root = roots[i];
+        if (NULL == root) continue;
+
+        persimm_hamt_node_t **parts = persimm_hamt_children(root, entry_size);
+        for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+            uint32_t bit = (uint32_t)1 << slot;
+            if (0 != (root->datamap & bit)) {
+                void *entry = persimm_hamt_entry(node, persimm_hamt_data_index(node, bit),
+                                                 entry_size);
+                memcpy(entry, persimm_hamt_entry(root, persimm_hamt_data_index(root, bit),
+                                                 entry_size), entry_size);
+                persimm_hamt_entry_retain(hamt, entry);
+            } else if (0 != (root->nodemap & bit)) {
+                persimm_hamt_node_t *child = parts[persimm_hamt_child_index(root, bit)];
+                persimm_rc_inc(&child->ref_count, hamt->local);
+                children[persimm_hamt_child_index(node, bit)] = child;
+            }
+        }
+    }
+
+    *dest = node;
+    return PERSIMM_OK;
+}
+
+/* Memory Statistics */
+
+static size_t persimm_hamt_node_footprint(persimm_hamt_node_t *node, size_t entry_size) {
+    size_t bytes = 0;
+    persimm_hamt_node_bytes(persimm_hamt_data_count(node), persimm_hamt_child_count(node),
+                            entry_size, &bytes);
+    return bytes;
+}
+
+static void persimm_hamt_node_stats(persimm_hamt_node_t *node, size_t entry_size,
+                                    bool exclusive, persimm_memory_stats *stats) {
+    size_t bytes = persimm_hamt_node_footprint(node, entry_size);
+    exclusive = exclusive && 1 == PERSIMM_RC_PEEK(node->ref_count);
+    if (exclusive) {
+        stats->exclusive_bytes += bytes;
+    } else {
+        stats->shared_bytes += bytes;
+    }
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+    } else {
+        stats->branch_nodes++;
+        stats->branch_bytes += bytes;
+    }
+    stats->elem_bytes += persimm_hamt_data_count(node) * entry_size;
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_node_stats(children[i], entry_size, exclusive, stats);
+    }
+}
+
+void persimm_hamt_memory_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               persimm_memory_stats *stats) {
+    if (NULL != root) persimm_hamt_node_stats(root, hamt->layout.entry_size, true, stats);
+}
+
+persimm_status persimm_hamt_memory_gather(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                          persimm_node_set_t *nodes) {
+    if (NULL == root || persimm_node_set_has(nodes, root)) return PERSIMM_OK;
+
+    persimm_status status = persimm_node_set_add(nodes, root);
+    uint32_t child_count = persimm_hamt_child_count(root);
+    persimm_hamt_node_t **children = persimm_hamt_children(root, hamt->layout.entry_size);
+    for (uint32_t i = 0; i < child_count && PERSIMM_OK == status; i++) {
+        status = persimm_hamt_memory_gather(children[i], hamt, nodes);
+    }
+    return status;
+}
+
+void persimm_hamt_memory_delta(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               const persimm_node_set_t *nodes, size_t *bytes) {
+    if (NULL == root || persimm_node_set_has(nodes, root)) return;
+
+    size_t entry_size = hamt->layout.entry_size;
+    *bytes += persimm_hamt_node_footprint(root, entry_size);
+    uint32_t child_count = persimm_hamt_child_count(root);
+    persimm_hamt_node_t **children = persimm_hamt_children(root, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_memory_delta(children[i], hamt, nodes, bytes);
+    }
+}
+
+/* Shape Statistics */
+
+#define PERSIMM_HAMT_SHAPE_SLOTS 8
+
+/*
+ * Returns the calls to `equals` an absent key with a random hash makes below
+ * `node`, given that its hash already matches the bits that led there.
+ */
+static double persimm_hamt_node_shape(persimm_hamt_node_t *node, size_t entry_size,
+                                      size_t depth, persimm_shape_stats *stats,
+                                      double *equals) {
+    uint32_t data_count = persimm_hamt_data_count(node);
+    size_t slot = depth < PERSIMM_HAMT_SHAPE_SLOTS ? depth : PERSIMM_HAMT_SHAPE_SLOTS - 1;
+    stats->entries += data_count;
+    stats->depths[slot] += data_count;
+    if (depth > stats->max_depth) stats->max_depth = depth;
+
+    /* The rest of the hash must match too, and each bit halves the odds of that. */
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        size_t size = data_count;
+        size_t bucket = 0;
+        while (bucket + 1 < PERSIMM_HAMT_SHAPE_SLOTS && size >= ((size_t)4 << bucket)) bucket++;
+        stats->collision_nodes++;
+        stats->collision_entries += size;
+        stats->collision_sizes[bucket]++;
+        if (size > stats->largest_collision) stats->largest_collision = size;
+        *equals += (double)size * (double)(size + 1) / 2.0;
+
+        double miss = (double)size;
+        for (size_t bits = depth * PERSIMM_BITS; bits < 32; bits++) miss /= 2.0;
+        return miss;
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    stats->bitmap_nodes++;
+    stats->entries_per_node += data_count;
+    stats->children_per_node += child_count;
+    *equals += data_count;
+
+    double miss = data_count;
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        miss += persimm_hamt_node_shape(children[i], entry_size, depth + 1, stats, equals);
+    }
+    return miss / PERSIMM_WIDTH;
+}
+
+void persimm_hamt_shape_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              persimm_shape_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (NULL == root) return;
+
+    double equals = 0.0;
+    stats->equals_per_miss = persimm_hamt_node_shape(root, hamt->layout.entry_size, 0, stats,
+                                                     &equals);
+    stats->entries_per_node /= (double)stats->bitmap_nodes;
+    stats->children_per_node /= (double)stats->bitmap_nodes;
+    if (stats->entries > 0) stats->equals_per_hit = equals / (double)stats->entries;
+}
+
+/* Hashing */
+
+uint32_t persimm_hamt_hash(persimm_hamt_node_t *root) {
+    return (NULL != root) ? root->merkle : 0;
+}
+
+/* Traversing */
+
+static void persimm_hamt_node_foreach(persimm_hamt_node_t *node, const persimm_hamt_t *hamt,
+                                      persimm_visit_fn fn, void *ctx, size_t *index) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) {
+        fn(persimm_hamt_entry(node, i, entry_size), *index, ctx);
+        (*index)++;
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_node_foreach(children[i], hamt, fn, ctx, index);
+    }
+}
+
+void persimm_hamt_foreach(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                          persimm_visit_fn fn, void *ctx) {
+    size_t index = 0;
+    if (NULL == root) return;
+    persimm_hamt_node_foreach(root, hamt, fn, ctx, &index);
+}
+
+/* The entries of a node come before its children, as they do in foreach. */
+static void *persimm_hamt_node_first(persimm_hamt_node_t *node, const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    while (NULL != node) {
+        if (persimm_hamt_data_count(node) > 0) return persimm_hamt_entry(node, 0, entry_size);
+        if (0 == persimm_hamt_child_count(node)) return NULL;
+        node = persimm_hamt_children(node, entry_size)[0];
+    }
+
+    return NULL;
+}
+
+typedef enum {
+    PERSIMM_HAMT_ABSENT, // the key is not in this subtree
+    PERSIMM_HAMT_FOUND,  // the key is here and so is what follows it
+    PERSIMM_HAMT_LAST    // the key is here and nothing follows it in this subtree
+} persimm_hamt_seek;
+
+static persimm_hamt_seek persimm_hamt_node_next(persimm_hamt_node_t *node, size_t shift,
+                                                uint32_t hash, const void *key,
+                                                const persimm_hamt_t *hamt, void **out) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        if (node->hash != hash) return PERSIMM_HAMT_ABSENT;
+        PERSIMM_COUNT(hamt, collision_scans);
+        for (uint32_t i = 0; i < node->datamap; i++) {
+            if (!persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, i, entry_size))) {
+                continue;
+            }
+            if (i + 1 < node->datamap) {
+                *out = persimm_hamt_entry(node, i + 1, entry_size);
+                return PERSIMM_HAMT_FOUND;
+            }
+            return PERSIMM_HAMT_LAST;
+        }
+        return PERSIMM_HAMT_ABSENT;
+    }
+
+    uint32_t bit = persimm_hamt_bit(hash, shift);
+    uint32_t data_count = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+
+    if (node->datamap & bit) {
+        uint32_t index = persimm_hamt_data_index(node, bit);
+        if (!persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, index, entry_size))) {
+            return PERSIMM_HAMT_ABSENT;
+        }
+        if (index + 1 < data_count) {
+            *out = persimm_hamt_entry(node, index + 1, entry_size);
+            return PERSIMM_HAMT_FOUND;
+        }
+        if (child_count > 0) {
+            *out = persimm_hamt_node_first(children[0], hamt);
+            return PERSIMM_HAMT_FOUND;
+        }
+        return PERSIMM_HAMT_LAST;
+    }
+
+    if (node->nodemap & bit) {
+        uint32_t index = persimm_hamt_child_index(node, bit);
+        persimm_hamt_seek result = persimm_hamt_node_next(children[index], shift + PERSIMM_BITS,
+                                                          hash, key, hamt, out);
+        if (PERSIMM_HAMT_LAST != result) return result;
+        if (index + 1 < child_count) {
+            *out = persimm_hamt_node_first(children[index + 1], hamt);
+            return PERSIMM_HAMT_FOUND;
+        }
+        return PERSIMM_HAMT_LAST;
+    }
+
+    return PERSIMM_HAMT_ABSENT;
+}
+
+const void *persimm_hamt_next(persimm_hamt_node_t *root, const void *key,
+                              const persimm_hamt_t *hamt) {
+    if (NULL == root) return NULL;
+    if (NULL == key) return persimm_hamt_node_first(root, hamt);
+
+    void *out = NULL;
+    uint32_t hash = persimm_hamt_hash_of(hamt, key);
+    if (PERSIMM_HAMT_FOUND != persimm_hamt_node_next(root, 0, hash, key, hamt, &out)) return NULL;
+
+    return out;
+}
+
+/* Parallel Traversal */
+
+/*
+ * Tasks take whole subtrees, and the root's children are the first cut. While
+ * that gives fewer tasks than a node has slots, as a small trie or one whose
+ * keys crowd into a few slots does, each subtree gives way to its children
+ * and keeps only its own entries as a task. A pass starts below 32 parts and
+ * each part becomes at most 32, so the parts never pass 32 times 32.
+ */
+
+#define PERSIMM_HAMT_PARTS (PERSIMM_WIDTH * PERSIMM_WIDTH)
+
+typedef struct {
+    persimm_hamt_node_t *node;
+    /* Only the node's own entries, its children having parts of their own. */
+    bool entries_only;
+} persimm_hamt_part_t;
+
+typedef struct {
+    const persimm_hamt_t *hamt;
+    persimm_hamt_part_t *parts;
+    void *ctx;
+    persimm_visit_fn visit;
+    persimm_fold_fn fold;
+    unsigned char *accs;
+    size_t acc_size;
+} persimm_hamt_fanout_t;
+
+static size_t persimm_hamt_fan_out(persimm_hamt_node_t *root, size_t entry_size,
+                                     persimm_hamt_part_t *parts) {
+    size_t count = 0;
+    parts[count++] = (persimm_hamt_part_t){ root, false };
+
+    bool grew = true;
+    while (count < PERSIMM_WIDTH && grew) {
+        grew = false;
+        size_t end = count;
+        for (size_t i = 0; i < end; i++) {
+            persimm_hamt_node_t *node = parts[i].node;
+            uint32_t child_count = persimm_hamt_child_count(node);
+            if (parts[i].entries_only || 0 == child_count) continue;
+
+            persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+            uint32_t first = 0;
+            if (persimm_hamt_data_count(node) > 0) {
+                parts[i].entries_only = true;
+            } else {
+                parts[i].node = children[first++];
+            }
+            for (uint32_t c = first; c < child_count; c++) {
+                parts[count++] = (persimm_hamt_part_t){ children[c], false };
+            }
+            grew = true;
+        }
+    }
+    return count;
+}
+
+static void persimm_hamt_part_visit(const persimm_hamt_fanout_t *fanout, size_t part,
+                                    persimm_visit_fn fn, void *ctx) {
+    persimm_hamt_node_t *node = fanout->parts[part].node;
+    size_t index = 0;
+    if (!fanout->parts[part].entries_only) {
+        persimm_hamt_node_foreach(node, fanout->hamt, fn, ctx, &index);
+        return;
+    }
+    size_t entry_size = fanout->hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) fn(persimm_hamt_entry(node, i, entry_size), i, ctx);
+}
+
+static void persimm_hamt_foreach_task(void *arg, size_t part) {
+    persimm_hamt_fanout_t *fanout = arg;
+    persimm_hamt_part_visit(fanout, part, fanout->visit, fanout->ctx);
+}
+
+persimm_status persimm_hamt_parallel_foreach(persimm_hamt_node_t *root,
+                                             const persimm_hamt_t *hamt, persimm_visit_fn fn,
+                                             void *ctx, const persimm_executor *executor) {
+    if (NULL == executor || NULL == root) {
+        persimm_hamt_foreach(root, hamt, fn, ctx);
+        return PERSIMM_OK;
+    }
+
+    persimm_hamt_fanout_t fanout = { hamt, NULL, ctx, fn, NULL, NULL, 0 };
+    fanout.parts = calloc(PERSIMM_HAMT_PARTS, sizeof(persimm_hamt_part_t));
+    if (NULL == fanout.parts) return PERSIMM_ERR_ALLOC;
+
+    size_t parts = persimm_hamt_fan_out(root, hamt->layout.entry_size, fanout.parts);
+    persimm_executor_run(executor, parts, persimm_hamt_foreach_task, &fanout);
+
+    free(fanout.parts);
+    return PERSIMM_OK;
+}
+
+typedef struct {
+    persimm_fold_fn fold;
+    void *acc;
+    void *ctx;
+} persimm_hamt_fold_t;
+
+static void persimm_hamt_fold_visit(const void *entry, size_t position, void *ctx) {
+    persimm_hamt_fold_t *fold = ctx;
+    fold->fold(fold->acc, entry, position, fold->ctx);
+}
+
+static void persimm_hamt_reduce_task(void *arg, size_t part) {
+    persimm_hamt_fanout_t *fanout = arg;
+    persimm_hamt_fold_t fold = { fanout->fold, fanout->accs + part * fanout->acc_size,
+                                 fanout->ctx };
+    persimm_hamt_part_visit(fanout, part, persimm_hamt_fold_visit, &fold);
+}
+
+persimm_status persimm_hamt_parallel_reduce(persimm_hamt_node_t *root,
+                                            const persimm_hamt_t *hamt, persimm_fold_fn fold,
+                                            persimm_combine_fn combine, const void *identity,
+                                            size_t acc_size, void *ctx,
+                                            const persimm_executor *executor, void *result) {
+    memcpy(result, identity, acc_size);
+    if (NULL == executor || NULL == root) {
+        persimm_hamt_fold_t direct = { fold, result, ctx };
+        persimm_hamt_foreach(root, hamt, persimm_hamt_fold_visit, &direct);
+        return PERSIMM_OK;
+    }
+
+    persimm_hamt_fanout_t fanout = { hamt, NULL, ctx, NULL, fold, NULL, acc_size };
+    fanout.parts = calloc(PERSIMM_HAMT_PARTS, sizeof(persimm_hamt_part_t));
+    size_t parts = 0;
+    if (NULL != fanout.parts) {
+        parts = persimm_hamt_fan_out(root, hamt->layout.entry_size, fanout.parts);
+        fanout.accs = calloc(parts, acc_size);
+    }
+    if (NULL == fanout.accs) {
+        free(fanout.parts);
+        return PERSIMM_ERR_ALLOC;
+    }
+    for (size_t i = 0; i < parts; i++) memcpy(fanout.accs + i * acc_size, identity, acc_size);
+
+    persimm_executor_run(executor, parts, persimm_hamt_reduce_task, &fanout);
+    for (size_t i = 0; i < parts; i++) combine(result, fanout.accs + i * acc_size, ctx);
+
+    free(fanout.accs);
+    free(fanout.parts);
+    return PERSIMM_OK;
+}
+
+/* Tracing */
+
+static void persimm_hamt_entry_trace(const persimm_hamt_t *hamt, const void *entry) {
+    if (NULL != hamt->key_ops && NULL != hamt->key_ops->trace) {
+        hamt->key_ops->trace(entry, hamt->key_ctx);
+    }
+    if (hamt->layout.value_size > 0 && NULL != hamt->value_ops &&
+        NULL != hamt->value_ops->trace) {
+        hamt->value_ops->trace(persimm_hamt_value_const(hamt, entry), hamt->value_ctx);
+    }
+}
+
+static void persimm_hamt_node_trace(persimm_hamt_node_t *node, const persimm_hamt_t *hamt,
+                                    uint32_t epoch) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (!persimm_trace_claim(&node->traced, epoch)) return;
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) {
+        persimm_hamt_entry_trace(hamt, persimm_hamt_entry(node, i, entry_size));
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_node_trace(children[i], hamt, epoch);
+    }
+}
+
+void persimm_hamt_trace(persimm_hamt_node_t *root, const persimm_hamt_t *hamt) {
+    persimm_hamt_trace_epoch(root, hamt, 0);
+}
+
+void persimm_hamt_trace_epoch(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              uint32_t epoch) {
+    bool traces_keys = NULL != hamt->key_ops && NULL != hamt->key_ops->trace;
+    bool traces_values = hamt->layout.value_size > 0 && NULL != hamt->value_ops &&
+                         NULL != hamt->value_ops->trace;
+    if (NULL == root || (!traces_keys && !traces_values)) return;
+    persimm_hamt_node_trace(root, hamt, epoch);
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The map's face on the CHAMP trie in persimmon_hamt.c. Everything here is
+ * bookkeeping: the trie holds the entries and the map holds how many there
+ * are and how they are laid out.
+ */
+
+/* Configuring */
+
+static void persimm_map_hamt(const persimm_map_t *map, persimm_hamt_t *hamt) {
+    persimm_hamt_config(hamt, &map->layout, map->value_ops, map->value_ctx, map->key_ops,
+                        map->key_ctx, map->local);
+}
+
+static persimm_status persimm_map_assoc_in_place(persimm_map_t *map, const void *entry,
+                                                 bool immutable);
+static persimm_status persimm_map_dissoc_in_place(persimm_map_t *map, const void *key,
+                                                  bool immutable);
+
+/* Initialising */
+
+persimm_status persimm_map_init(persimm_map_t *map, const persimm_entry_layout *layout,
+                                const persimm_elem_ops *value_ops, void *value_ctx,
+                                const persimm_key_ops *key_ops, void *key_ctx) {
+    map->count = 0;
+    map->layout = *layout;
+    map->value_ops = value_ops;
+    map->key_ops = key_ops;
+    map->value_ctx = value_ctx;
+    map->key_ctx = key_ctx;
+    map->local = false;
+    map->root = NULL;
+
+    if (!persimm_hamt_layout_valid(layout)) return PERSIMM_ERR_INVALID;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_from_entries(const void *entries, size_t count,
+                                        const persimm_entry_layout *layout,
+                                        const persimm_elem_ops *value_ops, void *value_ctx,
+                                        const persimm_key_ops *key_ops, void *key_ctx,
+                                        persimm_map_t *dest) {
+    return persimm_map_parallel_from_entries(entries, count, layout, value_ops, value_ctx,
+                                             key_ops, key_ctx, NULL, dest);
+}
+
+persimm_status persimm_map_parallel_from_entries(const void *entries, size_t count,
+                                                 const persimm_entry_layout *layout,
+                                                 const persimm_elem_ops *value_ops,
+                                                 void *value_ctx,
+                                                 const persimm_key_ops *key_ops, void *key_ctx,
+                                                 const persimm_executor *executor,
+                                                 persimm_map_t *dest) {
+    persimm_status status = persimm_map_init(dest, layout, value_ops, value_ctx, key_ops,
+                                             key_ctx);
+    if (PERSIMM_OK != status) return status;
+    if (0 != count && NULL == entries) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+    return persimm_hamt_parallel_build(&dest->root, entries, count, &hamt, executor,
+                                       &dest->count);
+}
+
+persimm_status persimm_map_clone(const persimm_map_t *src, persimm_map_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->count = src->count;
+    dest->layout = src->layout;
+    dest->value_ops = src->value_ops;
+    dest->key_ops = src->key_ops;
+    dest->value_ctx = src->value_ctx;
+    dest->key_ctx = src->key_ctx;
+    dest->local = src->local;
+    dest->root = src->root;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+    persimm_hamt_retain(dest->root, &hamt);
+    return PERSIMM_OK;
+}
+
+/* Borrowing */
+
+void persimm_map_borrow(const persimm_map_t *src, persimm_map_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_map_t *persimm_map_view(const persimm_map_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_map_make_local(persimm_map_t *map) {
+    map->local = true;
+}
+
+void persimm_map_share(persimm_map_t *map) {
+    map->local = false;
+}
+
+void persimm_map_freeze(persimm_map_t *map) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_freeze(map->root, &hamt);
+}
+
+/* Transients */
+
+persimm_status persimm_map_to_transient(const persimm_map_t *src,
+                                        persimm_map_transient_t *transient) {
+    persimm_status status = persimm_map_clone(src, &transient->value);
+    if (PERSIMM_OK != status) return status;
+    transient->active = true;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_transient_init(persimm_map_transient_t *transient,
+                                          const persimm_entry_layout *layout,
+                                          const persimm_elem_ops *value_ops, void *value_ctx,
+                                          const persimm_key_ops *key_ops, void *key_ctx) {
+    persimm_status status = persimm_map_init(&transient->value, layout, value_ops, value_ctx,
+                                             key_ops, key_ctx);
+    transient->active = PERSIMM_OK == status;
+    return status;
+}
+
+void persimm_map_transient_deinit(persimm_map_transient_t *transient) {
+    persimm_map_deinit(&transient->value);
+    transient->active = false;
+}
+
+persimm_status persimm_map_transient_assoc(persimm_map_transient_t *transient,
+                                           const void *entry) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_map_assoc_in_place(&transient->value, entry, false);
+}
+
+persimm_status persimm_map_transient_dissoc(persimm_map_transient_t *transient,
+                                            const void *key) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_map_dissoc_in_place(&transient->value, key, false);
+}
+
+persimm_status persimm_map_transient_persist(persimm_map_transient_t *transient,
+                                             persimm_map_t *dest) {
+    if (&transient->value == dest) return PERSIMM_ERR_INVALID;
+    if (!transient->active) {
+        memset(dest, 0, sizeof(*dest));
+        return PERSIMM_ERR_INVALID;
+    }
+
+    *dest = transient->value;
+    memset(&transient->value, 0, sizeof(transient->value));
+    transient->active = false;
+    return PERSIMM_OK;
+}
+
+/*
+ * Each slot is an ordinary transient whose trie holds only keys from that
+ * slot, which is what lets threads edit different slots without a lock: no
+ * node is reachable from two of them, and the counts on nodes still shared
+ * with the source are atomic.
+ */
+persimm_status persimm_map_to_sharded_transient(const persimm_map_t *src,
+                                                persimm_map_sharded_transient_t *transient) {
+    persimm_map_t shards[PERSIMM_WIDTH];
+    persimm_status status = src->local ? PERSIMM_ERR_INVALID : persimm_map_split(src, shards);
+    transient->shape = *src;
+    transient->shape.count = 0;
+    transient->shape.root = NULL;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_transient_t *slot = &transient->slots[i].transient;
+        slot->value = PERSIMM_OK == status ? shards[i] : transient->shape;
+        slot->active = PERSIMM_OK == status;
+    }
+    return status;
+}
+
+persimm_status persimm_map_sharded_transient_init(persimm_map_sharded_transient_t *transient,
+                                                  const persimm_entry_layout *layout,
+                                                  const persimm_elem_ops *value_ops,
+                                                  void *value_ctx,
+                                                  const persimm_key_ops *key_ops, void *key_ctx) {
+    persimm_status status = PERSIMM_OK;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_status slot = persimm_map_transient_init(&transient->slots[i].transient, layout,
+                                                         value_ops, value_ctx, key_ops, key_ctx);
+        if (PERSIMM_OK == status) status = slot;
+    }
+    transient->shape = transient->slots[0].transient.value;
+    return status;
+}
+
+void persimm_map_sharded_transient_deinit(persimm_map_sharded_transient_t *transient) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_transient_deinit(&transient->slots[i].transient);
+    }
+}
+
+size_t persimm_map_sharded_transient_slot(const persimm_map_sharded_transient_t *transient,
+                                          const void *key) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&transient->shape, &hamt);
+    PERSIMM_COUNT(hamt, hash_calls);
+    return hamt.hash(key, hamt.layout.key_size, hamt.key_ctx) & PERSIMM_MASK;
+}
+
+persimm_status persimm_map_sharded_transient_assoc(persimm_map_sharded_transient_t *transient,
+                                                   const void *entry) {
+    size_t slot = persimm_map_sharded_transient_slot(transient, entry);
+    return persimm_map_transient_assoc(&transient->slots[slot].transient, entry);
+}
+
+persimm_status persimm_map_sharded_transient_dissoc(persimm_map_sharded_transient_t *transient,
+                                                    const void *key) {
+    size_t slot = persimm_map_sharded_transient_slot(transient, key);
+    return persimm_map_transient_dissoc(&transient->slots[slot].transient, key);
+}
+
+persimm_status persimm_map_sharded_transient_persist(persimm_map_sharded_transient_t *transient,
+                                                     persimm_map_t *dest) {
+    /* A slot persisted or deinitialised on its own no longer owns what it points to. */
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        if (!transient->slots[i].transient.active) {
+            memset(dest, 0, sizeof(*dest));
+            return PERSIMM_ERR_INVALID;
+        }
+    }
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t count = 0;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        roots[i] = transient->slots[i].transient.value.root;
+        count += transient->slots[i].transient.value.count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&transient->shape, &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, PERSIMM_WIDTH, &hamt, &root);
+    if (PERSIMM_OK != status) {
+        memset(dest, 0, sizeof(*dest));
+        return status;
+    }
+
+    *dest = transient->shape;
+    dest->count = count;
+    dest->root = root;
+    persimm_map_sharded_transient_deinit(transient);
+    return PERSIMM_OK;
+}
+
+/* Deinitialising */
+
+void persimm_map_deinit(persimm_map_t *map) {
+    if (NULL != map->root) {
+        persimm_hamt_t hamt;
+        persimm_map_hamt(map, &hamt);
+        persimm_hamt_release(map->root, &hamt);
+    }
+    map->root = NULL;
+    map->count = 0;
+}
+
+/* Accessing */
+
+const void *persimm_map_find_entry(const persimm_map_t *map, const void *key) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_ref(map->root, key, &hamt);
+}
+
+const void *persimm_map_find(const persimm_map_t *map, const void *key) {
+    if (0 == map->layout.value_size) return NULL;
+
+    const void *entry = persimm_map_find_entry(map, key);
+    if (NULL == entry) return NULL;
+
+    return (const unsigned char *)entry + map->layout.value_offset;
+}
+
+bool persimm_map_has(const persimm_map_t *map, const void *key) {
+    return NULL != persimm_map_find_entry(map, key);
+}
+
+/* Inserting */
+
+static persimm_status persimm_map_assoc_in_place(persimm_map_t *map, const void *entry,
+                                                 bool immutable) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+
+    bool added = false;
+    persimm_status status = persimm_hamt_assoc(&map->root, entry, &hamt, immutable, &added);
+    if (PERSIMM_OK != status) return status;
+
+    if (added) map->count++;
+
+    return PERSIMM_OK;
+}
+
+/* Removing */
+
+static persimm_status persimm_map_dissoc_in_place(persimm_map_t *map, const void *key,
+                                                  bool immutable) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+
+    bool removed = false;
+    persimm_status status = persimm_hamt_dissoc(&map->root, key, &hamt, immutable, &removed);
+    if (PERSIMM_OK != status) return status;
+
+    if (removed) map->count--;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_assoc(const persimm_map_t *src, const void *entry,
+                                 persimm_map_t *dest) {
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_map_assoc_in_place(dest, entry, true);
+    if (PERSIMM_OK != status) persimm_map_deinit(dest);
+    return status;
+}
+
+persimm_status persimm_map_dissoc(const persimm_map_t *src, const void *key,
+                                  persimm_map_t *dest) {
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_map_dissoc_in_place(dest, key, true);
+    if (PERSIMM_OK != status) persimm_map_deinit(dest);
+    return status;
+}
+
+/* As a transient does, edit in place every node nothing else holds. */
+persimm_status persimm_map_assoc_owned(persimm_map_t *map, const void *entry) {
+    return persimm_map_assoc_in_place(map, entry, false);
+}
+
+persimm_status persimm_map_dissoc_owned(persimm_map_t *map, const void *key) {
+    return persimm_map_dissoc_in_place(map, key, false);
+}
+
+persimm_status persimm_map_assoc_many(const persimm_map_t *src, const void *entries,
+                                      size_t count, persimm_map_t *dest) {
+    if (0 != count && NULL == entries) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+
+    size_t added = 0;
+    status = persimm_hamt_assoc_many(&dest->root, entries, count, &hamt, &added);
+    if (PERSIMM_OK != status) {
+        persimm_map_deinit(dest);
+        return status;
+    }
+
+    dest->count += added;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_dissoc_many(const persimm_map_t *src, const void *keys,
+                                       size_t count, persimm_map_t *dest) {
+    if (0 != count && NULL == keys) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+
+    size_t removed = 0;
+    status = persimm_hamt_dissoc_many(&dest->root, keys, count, &hamt, &removed);
+    if (PERSIMM_OK != status) {
+        persimm_map_deinit(dest);
+        return status;
+    }
+
+    dest->count -= removed;
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+persimm_status persimm_map_split(const persimm_map_t *map, persimm_map_t out[PERSIMM_SPLIT_WAYS]) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(map->root, &hamt, roots, counts);
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        out[i] = *map;
+        out[i].count = counts[i];
+        out[i].root = roots[i];
+    }
+    return status;
+}
+
+static bool persimm_map_matches(const persimm_map_t *a, const persimm_map_t *b) {
+    return a->layout.entry_size == b->layout.entry_size &&
+           a->layout.key_size == b->layout.key_size &&
+           a->layout.value_offset == b->layout.value_offset &&
+           a->layout.value_size == b->layout.value_size && a->value_ops == b->value_ops &&
+           a->value_ctx == b->value_ctx && a->key_ops == b->key_ops &&
+           a->key_ctx == b->key_ctx && a->local == b->local;
+}
+
+/*
+ * No more than 32 shards can hold anything without two of them meeting in a
+ * slot, so the roots fit on the stack however many empty shards come along.
+ */
+persimm_status persimm_map_join(const persimm_map_t *shards, size_t count,
+                                persimm_map_t *dest) {
+    if (0 == count) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t used = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!persimm_map_matches(&shards[0], &shards[i])) return PERSIMM_ERR_INVALID;
+        if (NULL == shards[i].root) continue;
+        if (PERSIMM_WIDTH == used) return PERSIMM_ERR_INVALID;
+        roots[used++] = shards[i].root;
+        total += shards[i].count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&shards[0], &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, used, &hamt, &root);
+    if (PERSIMM_OK != status) return status;
+
+    *dest = shards[0];
+    dest->count = total;
+    dest->root = root;
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+uint32_t persimm_map_hash(const persimm_map_t *map) {
+    return persimm_hash_finish(persimm_hamt_hash(map->root), map->count);
+}
+
+/* Memory Statistics */
+
+void persimm_map_memory_stats(const persimm_map_t *map, persimm_memory_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    memset(stats, 0, sizeof(*stats));
+    persimm_hamt_memory_stats(map->root, &hamt, stats);
+}
+
+persimm_status persimm_map_memory_delta(const persimm_map_t *a, const persimm_map_t *b,
+                                        size_t *bytes) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(a, &hamt);
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_hamt_memory_gather(a->root, &hamt, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_map_hamt(b, &hamt);
+        persimm_hamt_memory_delta(b->root, &hamt, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
+}
+
+/* Shape Statistics */
+
+void persimm_map_shape_stats(const persimm_map_t *map, persimm_shape_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_shape_stats(map->root, &hamt, stats);
+}
+
+/* Traversing */
+
+void persimm_map_foreach(const persimm_map_t *map, persimm_visit_fn fn, void *ctx) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_foreach(map->root, &hamt, fn, ctx);
+}
+
+persimm_status persimm_map_parallel_foreach(const persimm_map_t *map, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor) {
+    if (map->local) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_parallel_foreach(map->root, &hamt, fn, ctx, executor);
+}
+
+persimm_status persimm_map_parallel_reduce(const persimm_map_t *map, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result) {
+    if (map->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_parallel_reduce(map->root, &hamt, fold, combine, identity, acc_size,
+                                        ctx, executor, result);
+}
+
+const void *persimm_map_next(const persimm_map_t *map, const void *key) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_next(map->root, key, &hamt);
+}
+
+void persimm_map_trace(const persimm_map_t *map) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_trace(map->root, &hamt);
+}
+
+void persimm_map_trace_epoch(const persimm_map_t *map, uint32_t epoch) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_trace_epoch(map->root, &hamt, epoch);
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The set's face on the CHAMP trie in persimmon_hamt.c. A set's entries are
+ * keys and nothing else, which the layout says by giving them no value, and
+ * from there the trie needs to know nothing about which of the two it is
+ * serving.
+ */
+
+/* Configuring */
+
+static void persimm_set_hamt(const persimm_set_t *set, persimm_hamt_t *hamt) {
+    persimm_hamt_config(hamt, &set->layout, NULL, NULL, set->key_ops, set->key_ctx, set->local);
+}
+
+static persimm_status persimm_set_conj_in_place(persimm_set_t *set, const void *elem,
+                                                bool immutable);
+static persimm_status persimm_set_disj_in_place(persimm_set_t *set, const void *elem,
+                                                bool immutable);
+
+/* Initialising */
+
+persimm_status persimm_set_init(persimm_set_t *set, size_t elem_size,
+                                const persimm_key_ops *key_ops, void *key_ctx) {
+    set->count = 0;
+    set->layout.entry_size = elem_size;
+    set->layout.key_size = elem_size;
+    set->layout.value_offset = 0;
+    set->layout.value_size = 0;
+    set->key_ops = key_ops;
+    set->key_ctx = key_ctx;
+    set->local = false;
+    set->root = NULL;
+
+    if (0 == elem_size) return PERSIMM_ERR_INVALID;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_from_elems(const void *elems, size_t count, size_t elem_size,
+                                      const persimm_key_ops *key_ops, void *key_ctx,
+                                      persimm_set_t *dest) {
+    return persimm_set_parallel_from_elems(elems, count, elem_size, key_ops, key_ctx, NULL,
+                                           dest);
+}
+
+persimm_status persimm_set_parallel_from_elems(const void *elems, size_t count,
+                                               size_t elem_size, const persimm_key_ops *key_ops,
+                                               void *key_ctx, const persimm_executor *executor,
+                                               persimm_set_t *dest) {
+    persimm_status status = persimm_set_init(dest, elem_size, key_ops, key_ctx);
+    if (PERSIMM_OK != status) return status;
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+    return persimm_hamt_parallel_build(&dest->root, elems, count, &hamt, executor,
+                                       &dest->count);
+}
+
+persimm_status persimm_set_clone(const persimm_set_t *src, persimm_set_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->count = src->count;
+    dest->layout = src->layout;
+    dest->key_ops = src->key_ops;
+    dest->key_ctx = src->key_ctx;
+    dest->local = src->local;
+    dest->root = src->root;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+    persimm_hamt_retain(dest->root, &hamt);
+    return PERSIMM_OK;
+}
+
+/* Borrowing */
+
+void persimm_set_borrow(const persimm_set_t *src, persimm_set_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_set_t *persimm_set_view(const persimm_set_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_set_make_local(persimm_set_t *set) {
+    set->local = true;
+}
+
+void persimm_set_share(persimm_set_t *set) {
+    set->local = false;
+}
+
+void persimm_set_freeze(persimm_set_t *set) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_freeze(set->root, &hamt);
+}
+
+/* Transients */
+
+persimm_status persimm_set_to_transient(const persimm_set_t *src,
+                                        persimm_set_transient_t *transient) {
+    persimm_status status = persimm_set_clone(src, &transient->value);
+    if (PERSIMM_OK != status) return status;
+    transient->active = true;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_transient_init(persimm_set_transient_t *transient,
+                                          size_t elem_size, const persimm_key_ops *key_ops,
+                                          void *key_ctx) {
+    persimm_status status = persimm_set_init(&transient->value, elem_size, key_ops, key_ctx);
+    transient->active = PERSIMM_OK == status;
+    return status;
+}
+
+void persimm_set_transient_deinit(persimm_set_transient_t *transient) {
+    persimm_set_deinit(&transient->value);
+    transient->active = false;
+}
+
+persimm_status persimm_set_transient_conj(persimm_set_transient_t *transient,
+                                          const void *elem) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_set_conj_in_place(&transient->value, elem, false);
+}
+
+persimm_status persimm_set_transient_disj(persimm_set_transient_t *transient,
+                                          const void *elem) {
+    if (!transient->active) return PERSIMM_ERR_INVALID;
+    return persimm_set_disj_in_place(&transient->value, elem, false);
+}
+
+persimm_status persimm_set_transient_persist(persimm_set_transient_t *transient,
+                                             persimm_set_t *dest) {
+    if (&transient->value == dest) return PERSIMM_ERR_INVALID;
+    if (!transient->active) {
+        memset(dest, 0, sizeof(*dest));
+        return PERSIMM_ERR_INVALID;
+    }
+
+    *dest = transient->value;
+    memset(&transient->value, 0, sizeof(transient->value));
+    transient->active = false;
+    return PERSIMM_OK;
+}
+
+/* Deinitialising */
+
+void persimm_set_deinit(persimm_set_t *set) {
+    if (NULL != set->root) {
+        persimm_hamt_t hamt;
+        persimm_set_hamt(set, &hamt);
+        persimm_hamt_release(set->root, &hamt);
+    }
+    set->root = NULL;
+    set->count = 0;
+}
+
+/* Accessing */
+
+const void *persimm_set_find(const persimm_set_t *set, const void *elem) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_ref(set->root, elem, &hamt);
+}
+
+bool persimm_set_has(const persimm_set_t *set, const void *elem) {
+    return NULL != persimm_set_find(set, elem);
+}
+
+/* Inserting */
+
+static persimm_status persimm_set_conj_in_place(persimm_set_t *set, const void *elem,
+                                                bool immutable) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+
+    bool added = false;
+    persimm_status status = persimm_hamt_assoc(&set->root, elem, &hamt, immutable, &added);
+    if (PERSIMM_OK != status) return status;
+
+    if (added) set->count++;
+
+    return PERSIMM_OK;
+}
+
+/* Removing */
+
+static persimm_status persimm_set_disj_in_place(persimm_set_t *set, const void *elem,
+                                                bool immutable) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+
+    bool removed = false;
+    persimm_status status = persimm_hamt_dissoc(&set->root, elem, &hamt, immutable, &removed);
+    if (PERSIMM_OK != status) return status;
+
+    if (removed) set->count--;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_conj(const persimm_set_t *src, const void *elem,
+                                persimm_set_t *dest) {
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_set_conj_in_place(dest, elem, true);
+    if (PERSIMM_OK != status) persimm_set_deinit(dest);
+    return status;
+}
+
+persimm_status persimm_set_disj(const persimm_set_t *src, const void *elem,
+                                persimm_set_t *dest) {
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+    status = persimm_set_disj_in_place(dest, elem, true);
+    if (PERSIMM_OK != status) persimm_set_deinit(dest);
+    return status;
+}
+
+/* As a transient does, edit in place every node nothing else holds. */
+persimm_status persimm_set_conj_owned(persimm_set_t *set, const void *elem) {
+    return persimm_set_conj_in_place(set, elem, false);
+}
+
+persimm_status persimm_set_disj_owned(persimm_set_t *set, const void *elem) {
+    return persimm_set_disj_in_place(set, elem, false);
+}
+
+persimm_status persimm_set_conj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest) {
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+
+    size_t added = 0;
+    status = persimm_hamt_assoc_many(&dest->root, elems, count, &hamt, &added);
+    if (PERSIMM_OK != status) {
+        persimm_set_deinit(dest);
+        return status;
+    }
+
+    dest->count += added;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_disj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest) {
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+
+    size_t removed = 0;
+    status = persimm_hamt_dissoc_many(&dest->root, elems, count, &hamt, &removed);
+    if (PERSIMM_OK != status) {
+        persimm_set_deinit(dest);
+        return status;
+    }
+
+    dest->count -= removed;
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+persimm_status persimm_set_split(const persimm_set_t *set, persimm_set_t out[PERSIMM_SPLIT_WAYS]) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(set->root, &hamt, roots, counts);
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        out[i] = *set;
+        out[i].count = counts[i];
+        out[i].root = roots[i];
+    }
+    return status;
+}
+
+static bool persimm_set_matches(const persimm_set_t *a, const persimm_set_t *b) {
+    return a->layout.entry_size == b->layout.entry_size && a->key_ops == b->key_ops &&
+           a->key_ctx == b->key_ctx && a->local == b->local;
+}
+
+/* The roots fit on the stack as they do in persimm_map_join. */
+persimm_status persimm_set_join(const persimm_set_t *shards, size_t count,
+                                persimm_set_t *dest) {
+    if (0 == count) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t used = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!persimm_set_matches(&shards[0], &shards[i])) return PERSIMM_ERR_INVALID;
+        if (NULL == shards[i].root) continue;
+        if (PERSIMM_WIDTH == used) return PERSIMM_ERR_INVALID;
+        roots[used++] = shards[i].root;
+        total += shards[i].count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(&shards[0], &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, used, &hamt, &root);
+    if (PERSIMM_OK != status) return status;
+
+    *dest = shards[0];
+    dest->count = total;
+    dest->root = root;
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+uint32_t persimm_set_hash(const persimm_set_t *set) {
+    return persimm_hash_finish(persimm_hamt_hash(set->root), set->count);
+}
+
+/* Memory Statistics */
+
+void persimm_set_memory_stats(const persimm_set_t *set, persimm_memory_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    memset(stats, 0, sizeof(*stats));
+    persimm_hamt_memory_stats(set->root, &hamt, stats);
+}
+
+persimm_status persimm_set_memory_delta(const persimm_set_t *a, const persimm_set_t *b,
+                                        size_t *bytes) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(a, &hamt);
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_hamt_memory_gather(a->root, &hamt, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_set_hamt(b, &hamt);
+        persimm_hamt_memory_delta(b->root, &hamt, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
+}
+
+/* Shape Statistics */
+
+void persimm_set_shape_stats(const persimm_set_t *set, persimm_shape_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_shape_stats(set->root, &hamt, stats);
+}
+
+/* Traversing */
+
+void persimm_set_foreach(const persimm_set_t *set, persimm_visit_fn fn, void *ctx) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_foreach(set->root, &hamt, fn, ctx);
+}
+
+persimm_status persimm_set_parallel_foreach(const persimm_set_t *set, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor) {
+    if (set->local) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_parallel_foreach(set->root, &hamt, fn, ctx, executor);
+}
+
+persimm_status persimm_set_parallel_reduce(const persimm_set_t *set, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result) {
+    if (set->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_parallel_reduce(set->root, &hamt, fold, combine, identity, acc_size,
+                                        ctx, executor, result);
+}
+
+const void *persimm_set_next(const persimm_set_t *set, const void *elem) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_next(set->root, elem, &hamt);
+}
+
+void persimm_set_trace(const persimm_set_t *set) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_trace(set->root, &hamt);
+}
+
+void persimm_set_trace_epoch(const persimm_set_t *set, uint32_t epoch) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_trace_epoch(set->root, &hamt, epoch);
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A published collection that many threads read at once. Cloning it from
+ * every thread would have each of them increment and decrement the count on
+ * one root node, and that one cache line bouncing between cores is what stops
+ * the reads from scaling. A snapshot instead spreads its readers over several
+ * counts, each on its own cache line, so that threads on different shards
+ * never write to the same memory.
+ *
+ * Every shard starts with one count held on the publisher's behalf, and the
+ * snapshot holds a single reference to the collection for all of them.
+ * Retiring drops the publisher's count from each shard. A shard whose count
+ * reaches zero is closed for good, and the last shard to close takes the
+ * collection and the snapshot with it.
+ */
+
+/* Geometry */
+
+/* Wide enough for the cache lines of every processor the core targets. */
+#define PERSIMM_CACHE_LINE 64
+
+typedef struct {
+    persimm_refcount_t count;
+    unsigned char padding[PERSIMM_CACHE_LINE - sizeof(persimm_refcount_t)];
+} persimm_snapshot_shard_t;
+
+typedef enum {
+    PERSIMM_SNAPSHOT_VECTOR,
+    PERSIMM_SNAPSHOT_LIST,
+    PERSIMM_SNAPSHOT_MAP,
+    PERSIMM_SNAPSHOT_SET
+} persimm_snapshot_kind;
+
+struct persimm_snapshot {
+    persimm_snapshot_kind kind;
+    union {
+        persimm_vector_t vector;
+        persimm_list_t list;
+        persimm_map_t map;
+        persimm_set_t set;
+    } value;
+    size_t shard_count;
+    /* Shards not yet closed. */
+    persimm_refcount_t open;
+    /* Keeps the fields above, which every reader reads, off the first shard's line. */
+    unsigned char padding[PERSIMM_CACHE_LINE];
+    persimm_snapshot_shard_t shards[];
+};
+
+/* Publishing */
+
+static persimm_snapshot_t *persimm_snapshot_new(persimm_snapshot_kind kind, size_t shards) {
+    size_t bytes;
+    if (0 == shards ||
+        !persimm_size_mul(shards, sizeof(persimm_snapshot_shard_t), &bytes) ||
+        !persimm_size_add(offsetof(struct persimm_snapshot, shards), bytes, &bytes)) {
+        return NULL;
+    }
+
+    persimm_snapshot_t *snapshot = calloc(1, bytes);
+    if (NULL == snapshot) return NULL;
+
+    snapshot->kind = kind;
+    snapshot->shard_count = shards;
+    PERSIMM_RC_SET(snapshot->open, shards);
+    for (size_t i = 0; i < shards; i++) PERSIMM_RC_SET(snapshot->shards[i].count, 1);
+
+    return snapshot;
+}
+
+/*
+ * A local source is refused rather than shared behind the caller's back: the
+ * snapshot's clone would be counted plainly on the publisher's thread and
+ * released atomically on whichever thread closed the last shard.
+ */
+
+persimm_status persimm_vector_snapshot(const persimm_vector_t *src, size_t shards,
+                                       persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_VECTOR, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_vector_clone(src, &snapshot->value.vector);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_list_snapshot(const persimm_list_t *src, size_t shards,
+                                     persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_LIST, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_list_clone(src, &snapshot->value.list);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_snapshot(const persimm_map_t *src, size_t shards,
+                                    persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_MAP, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_map_clone(src, &snapshot->value.map);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_snapshot(const persimm_set_t *src, size_t shards,
+                                    persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_SET, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_set_clone(src, &snapshot->value.set);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+/* Reading */
+
+/*
+ * Takes a count only while the shard is still open. Once a shard has closed,
+ * its count of zero must stay zero, or the shard would close a second time
+ * and close the snapshot before the others had.
+ */
+bool persimm_snapshot_acquire(persimm_snapshot_t *snapshot, size_t shard) {
+    persimm_snapshot_shard_t *slot = &snapshot->shards[shard % snapshot->shard_count];
+    size_t count = PERSIMM_RC_LOAD(slot->count);
+    do {
+        if (0 == count) return false;
+    } while (!PERSIMM_RC_CAS(slot->count, count, count + 1));
+    return true;
+}
+
+const persimm_vector_t *persimm_snapshot_vector(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_VECTOR == snapshot->kind ? &snapshot->value.vector : NULL;
+}
+
+const persimm_list_t *persimm_snapshot_list(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_LIST == snapshot->kind ? &snapshot->value.list : NULL;
+}
+
+const persimm_map_t *persimm_snapshot_map(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_MAP == snapshot->kind ? &snapshot->value.map : NULL;
+}
+
+const persimm_set_t *persimm_snapshot_set(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_SET == snapshot->kind ? &snapshot->value.set : NULL;
+}
+
+/* Releasing */
+
+static void persimm_snapshot_drop(persimm_snapshot_t *snapshot, persimm_snapshot_shard_t *slot) {
+    if (PERSIMM_RC_DEC(slot->count) > 1) return;
+    if (PERSIMM_RC_DEC(snapshot->open) > 1) return;
+
+    switch (snapshot->kind) {
+        case PERSIMM_SNAPSHOT_VECTOR: persimm_vector_deinit(&snapshot->value.vector); break;
+        case PERSIMM_SNAPSHOT_LIST: persimm_list_deinit(&snapshot->value.list); break;
+        case PERSIMM_SNAPSHOT_MAP: persimm_map_deinit(&snapshot->value.map); break;
+        case PERSIMM_SNAPSHOT_SET: persimm_set_deinit(&snapshot->value.set); break;
+    }
+    free(snapshot);
+}
+
+void persimm_snapshot_release(persimm_snapshot_t *snapshot, size_t shard) {
+    persimm_snapshot_drop(snapshot, &snapshot->shards[shard % snapshot->shard_count]);
+}
+
+/* Only the last shard can close the snapshot, so the loop never reads freed memory. */
+void persimm_snapshot_retire(persimm_snapshot_t *snapshot) {
+    size_t shards = snapshot->shard_count;
+    for (size_t i = 0; i < shards; i++) persimm_snapshot_drop(snapshot, &snapshot->shards[i]);
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A single mutable reference to a persistent collection, shared between
+ * threads. The collection's handle spans several words, so it lives in a box
+ * on the heap and what the atom swaps is the pointer to the box. Publishing a
+ * version is one compare-exchange of that pointer.
+ *
+ * The hard part is the box a loader is about to clone from when a writer
+ * swaps it out. Loaders announce themselves on one of two counters for the
+ * few instructions it takes to read the pointer and clone what it points to.
+ * Once each counter has been seen at zero after a box was swapped out, every
+ * loader that could have read the old pointer has finished with it; anyone
+ * arriving later reads a newer one. Loaders are steered to whichever counter
+ * is not being watched, so a steady stream of them cannot keep it above zero.
+ *
+ * Writers do not wait for that. A box swapped out joins a list of retired
+ * boxes, and each publication spins briefly for the counters and frees the
+ * whole list if they drain, or leaves it for the next publication if a
+ * loader was preempted mid-load. Loaders never wait for anything.
+ *
+ * An atom in an epoch domain serves readers that take no reference at all,
+ * and who may hold its version for as long as their epoch section lasts
+ * rather than for the few instructions of a load. Boxes that clear the
+ * counters are handed to the domain instead of being freed, and the domain
+ * frees them once every reader has left the epochs in which they could have
+ * been seen. The classic scheme defers each freed node; deferring whole
+ * versions here keeps the trie and vector code unaware of epochs, since a
+ * version's nodes outlive it only while another version still holds them.
+ */
+
+/* Geometry */
+
+/* As for snapshots: keeps each counter on a cache line of its own. */
+#define PERSIMM_ATOM_LINE 64
+
+/* How long a publication watches a counter before leaving reclamation for later. */
+#define PERSIMM_ATOM_SPINS 1024
+
+typedef struct {
+    persimm_refcount_t count;
+    unsigned char padding[PERSIMM_ATOM_LINE - sizeof(persimm_refcount_t)];
+} persimm_atom_counter_t;
+
+typedef enum {
+    PERSIMM_ATOM_VECTOR,
+    PERSIMM_ATOM_MAP,
+    PERSIMM_ATOM_SET
+} persimm_atom_kind;
+
+typedef struct persimm_atom_box {
+    union {
+        persimm_vector_t vector;
+        persimm_map_t map;
+        persimm_set_t set;
+    } value;
+    persimm_atom_kind kind;
+    /* The domain epoch in which the box was handed over. */
+    size_t epoch;
+    /* Links retired boxes. */
+    struct persimm_atom_box *next;
+} persimm_atom_box_t;
+
+typedef struct {
+    persimm_refcount_t state;
+    unsigned char padding[PERSIMM_ATOM_LINE - sizeof(persimm_refcount_t)];
+} persimm_epoch_slot_t;
+
+/*
+ * A reader's slot holds zero outside a section, and inside one the epoch it
+ * entered shifted up past a low bit that marks it as occupied.
+ */
+struct persimm_epoch_domain {
+    persimm_refcount_t epoch;
+    persimm_atomic_ptr_t retired;
+    size_t slot_count;
+    unsigned char padding[PERSIMM_ATOM_LINE];
+    persimm_epoch_slot_t slots[];
+};
+
+typedef struct {
+    persimm_epoch_domain_t *domain;
+    persimm_atomic_ptr_t current;
+    persimm_atomic_ptr_t retired;
+    persimm_refcount_t phase;
+    unsigned char padding[PERSIMM_ATOM_LINE];
+    persimm_atom_counter_t loading[2];
+} persimm_atom_t;
+
+struct persimm_vector_atom {
+    persimm_atom_t atom;
+};
+
+struct persimm_map_atom {
+    persimm_atom_t atom;
+};
+
+struct persimm_set_atom {
+    persimm_atom_t atom;
+};
+
+/* Boxes */
+
+static persimm_atom_box_t *persimm_atom_box_new(persimm_atom_kind kind) {
+    persimm_atom_box_t *box = calloc(1, sizeof(persimm_atom_box_t));
+    if (NULL != box) box->kind = kind;
+    return box;
+}
+
+static void persimm_atom_box_free(persimm_atom_box_t *box) {
+    switch (box->kind) {
+        case PERSIMM_ATOM_VECTOR: persimm_vector_deinit(&box->value.vector); break;
+        case PERSIMM_ATOM_MAP: persimm_map_deinit(&box->value.map); break;
+        case PERSIMM_ATOM_SET: persimm_set_deinit(&box->value.set); break;
+    }
+    free(box);
+}
+
+static void persimm_atom_chain_free(persimm_atom_box_t *box) {
+    while (NULL != box) {
+        persimm_atom_box_t *next = box->next;
+        persimm_atom_box_free(box);
+        box = next;
+    }
+}
+
+/* Pushes the chain from `first` to `last` onto `list`. */
+static void persimm_atom_chain_push(persimm_atomic_ptr_t *list, persimm_atom_box_t *first,
+                                    persimm_atom_box_t *last) {
+    void *head = PERSIMM_PTR_LOAD(*list);
+    do {
+        last->next = head;
+    } while (!PERSIMM_PTR_CAS(*list, head, first));
+}
+
+/* Takes the whole of `list`, leaving it empty. */
+static persimm_atom_box_t *persimm_atom_chain_take(persimm_atomic_ptr_t *list) {
+    void *head = PERSIMM_PTR_LOAD(*list);
+    while (NULL != head && !PERSIMM_PTR_CAS(*list, head, NULL)) {
+        /* Another thread pushed or took the list; try again with what is there. */
+    }
+    return head;
+}
+
+/* Epochs */
+
+persimm_status persimm_epoch_domain_new(size_t readers, persimm_epoch_domain_t **dest) {
+    *dest = NULL;
+    size_t bytes;
+    if (0 == readers) return PERSIMM_ERR_INVALID;
+    if (!persimm_size_mul(readers, sizeof(persimm_epoch_slot_t), &bytes) ||
+        !persimm_size_add(offsetof(struct persimm_epoch_domain, slots), bytes, &bytes)) {
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_epoch_domain_t *domain = calloc(1, bytes);
+    if (NULL == domain) return PERSIMM_ERR_ALLOC;
+
+    domain->slot_count = readers;
+    PERSIMM_RC_SET(domain->epoch, 0);
+    PERSIMM_PTR_SET(domain->retired, NULL);
+    for (size_t i = 0; i < readers; i++) PERSIMM_RC_SET(domain->slots[i].state, 0);
+
+    *dest = domain;
+    return PERSIMM_OK;
+}
+
+void persimm_epoch_domain_free(persimm_epoch_domain_t *domain) {
+    persimm_atom_chain_free(PERSIMM_PTR_LOAD(domain->retired));
+    free(domain);
+}
+
+void persimm_epoch_enter(persimm_epoch_domain_t *domain, size_t reader) {
+    persimm_epoch_slot_t *slot = &domain->slots[reader % domain->slot_count];
+    PERSIMM_RC_PUT(slot->state, (PERSIMM_RC_LOAD(domain->epoch) << 1) | 1);
+    /* The slot must be visible before anything the section reads. */
+    PERSIMM_FENCE();
+}
+
+void persimm_epoch_exit(persimm_epoch_domain_t *domain, size_t reader) {
+    PERSIMM_RC_STORE(domain->slots[reader % domain->slot_count].state, 0);
+}
+
+/*
+ * Moves the epoch on if every reader inside a section entered the current
+ * one, and returns the epoch as it then stands. A reader that announced a
+ * stale epoch only holds the epoch back; it cannot see anything retired
+ * after its announcement was published.
+ */
+static size_t persimm_epoch_advance(persimm_epoch_domain_t *domain) {
+    PERSIMM_FENCE();
+    size_t epoch = PERSIMM_RC_LOAD(domain->epoch);
+    for (size_t i = 0; i < domain->slot_count; i++) {
+        size_t state = PERSIMM_RC_LOAD(domain->slots[i].state);
+        if ((state & 1) && (state >> 1) != epoch) return epoch;
+    }
+    size_t expected = epoch;
+    PERSIMM_RC_CAS(domain->epoch, expected, epoch + 1);
+    return PERSIMM_RC_LOAD(domain->epoch);
+}
+
+/*
+ * Takes over a chain of boxes no load can reach, then frees every box handed
+ * over two or more epochs ago. By then each reader inside a section entered
+ * after the box was handed over, and so after it stopped being current.
+ */
+static void persimm_epoch_defer(persimm_epoch_domain_t *domain, persimm_atom_box_t *chain) {
+    PERSIMM_FENCE();
+    size_t epoch = PERSIMM_RC_LOAD(domain->epoch);
+    persimm_atom_box_t *last = chain;
+    for (;;) {
+        last->epoch = epoch;
+        if (NULL == last->next) break;
+        last = last->next;
+    }
+    persimm_atom_chain_push(&domain->retired, chain, last);
+
+    epoch = persimm_epoch_advance(domain);
+    persimm_atom_box_t *box = persimm_atom_chain_take(&domain->retired);
+    persimm_atom_box_t *kept = NULL;
+    persimm_atom_box_t *kept_last = NULL;
+    while (NULL != box) {
+        persimm_atom_box_t *next = box->next;
+        if (box->epoch + 2 <= epoch) {
+            persimm_atom_box_free(box);
+        } else {
+            box->next = kept;
+            kept = box;
+            if (NULL == kept_last) kept_last = box;
+        }
+        box = next;
+    }
+    if (NULL != kept) persimm_atom_chain_push(&domain->retired, kept, kept_last);
+}
+
+/* Atoms */
+
+static void persimm_atom_init(persimm_atom_t *atom, persimm_epoch_domain_t *domain,
+                              persimm_atom_box_t *box) {
+    atom->domain = domain;
+    PERSIMM_PTR_SET(atom->current, box);
+    PERSIMM_PTR_SET(atom->retired, NULL);
+    PERSIMM_RC_SET(atom->phase, 0);
+    PERSIMM_RC_SET(atom->loading[0].count, 0);
+    PERSIMM_RC_SET(atom->loading[1].count, 0);
+}
+
+static void persimm_atom_deinit(persimm_atom_t *atom) {
+    persimm_atom_box_free(PERSIMM_PTR_LOAD(atom->current));
+    persimm_atom_chain_free(PERSIMM_PTR_LOAD(atom->retired));
+}
+
+/* Loading */
+
+static size_t persimm_atom_enter(persimm_atom_t *atom) {
+    size_t side = PERSIMM_RC_LOAD(atom->phase) & 1;
+    PERSIMM_RC_INC(atom->loading[side].count);
+    /* The announcement must land before the pointer is read, as a swap must
+       before the counters are watched. */
+    PERSIMM_FENCE();
+    return side;
+}
+
+static void persimm_atom_exit(persimm_atom_t *atom, size_t side) {
+    PERSIMM_RC_DEC(atom->loading[side].count);
+}
+
+static persimm_atom_box_t *persimm_atom_current(persimm_atom_t *atom) {
+    return PERSIMM_PTR_LOAD(atom->current);
+}
+
+/* Reclaiming */
+
+/*
+ * Whether each counter was seen at zero, which clears every box swapped out
+ * before the call. Only those sightings matter for safety; flipping the phase
+ * first just sends newcomers to the other counter.
+ */
+static bool persimm_atom_drained(persimm_atom_t *atom) {
+    PERSIMM_FENCE();
+    size_t side = PERSIMM_RC_LOAD(atom->phase) & 1;
+    for (int pass = 0; pass < 2; pass++) {
+        PERSIMM_RC_PUT(atom->phase, side ^ 1);
+        PERSIMM_FENCE();
+        for (int spins = 0; 0 != PERSIMM_RC_LOAD(atom->loading[side].count); spins++) {
+            if (PERSIMM_ATOM_SPINS == spins) return false;
+        }
+        side ^= 1;
+    }
+    return true;
+}
+
+/*
+ * Retires `old` and then tries to free everything retired so far. The list is
+ * taken whole before the counters are watched, so every box on it was swapped
+ * out before they were, and a list that cannot be freed yet goes back intact.
+ */
+static void persimm_atom_retire(persimm_atom_t *atom, persimm_atom_box_t *old) {
+    persimm_atom_chain_push(&atom->retired, old, old);
+
+    persimm_atom_box_t *box = persimm_atom_chain_take(&atom->retired);
+    if (NULL == box) return;
+
+    if (!persimm_atom_drained(atom)) {
+        persimm_atom_box_t *last = box;
+        while (NULL != last->next) last = last->next;
+        persimm_atom_chain_push(&atom->retired, box, last);
+    } else if (NULL != atom->domain) {
+        persimm_epoch_defer(atom->domain, box);
+    } else {
+        persimm_atom_chain_free(box);
+    }
+}
+
+/* Publishing */
+
+/*
+ * Installs `box` if the version the atom holds is `expected`, retiring the box
+ * it replaced. Fails without touching either box when the atom holds some
+ * other version. The check and the exchange happen inside a load section,
+ * which keeps the box checked from being freed, and its address reused,
+ * before the exchange can see it.
+ */
+static bool persimm_atom_replace(persimm_atom_t *atom, persimm_atom_box_t *box,
+                                 bool (*matches)(const persimm_atom_box_t *held,
+                                                 const void *expected),
+                                 const void *expected) {
+    size_t side = persimm_atom_enter(atom);
+    persimm_atom_box_t *held = persimm_atom_current(atom);
+    void *seen = held;
+    bool replaced = matches(held, expected) && PERSIMM_PTR_CAS(atom->current, seen, box);
+    persimm_atom_exit(atom, side);
+
+    if (replaced) persimm_atom_retire(atom, held);
+    return replaced;
+}
+
+/*
+ * The typed faces below differ only in the collection they box. Versions
+ * match when they share storage, which a loaded version and the one it was
+ * loaded from always do. A swap holds the version it loaded until its
+ * exchange is done, so that the storage cannot be freed and reused by a newer
+ * version that would then wrongly match.
+ */
+
+/* Vectors */
+
+static bool persimm_vector_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_vector_t *version = expected;
+    return version->root == held->value.vector.root && version->tail == held->value.vector.tail &&
+           version->count == held->value.vector.count;
+}
+
+persimm_status persimm_vector_atom_new(const persimm_vector_t *initial,
+                                       persimm_epoch_domain_t *domain,
+                                       persimm_vector_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_vector_atom_t *atom = calloc(1, sizeof(persimm_vector_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_VECTOR);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_vector_clone(initial, &box->value.vector);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_vector_atom_free(persimm_vector_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_vector_atom_load(persimm_vector_atom_t *atom, persimm_vector_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_vector_clone(&persimm_atom_current(&atom->atom)->value.vector, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_vector_t *persimm_vector_atom_read(persimm_vector_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.vector;
+}
+
+persimm_status persimm_vector_atom_compare_and_set(persimm_vector_atom_t *atom,
+                                                   const persimm_vector_t *expected,
+                                                   const persimm_vector_t *desired,
+                                                   bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_VECTOR);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_vector_clone(desired, &box->value.vector);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_vector_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_vector_atom_swap(persimm_vector_atom_t *atom,
+                                        persimm_vector_update_fn update, void *ctx,
+                                        persimm_vector_t *result) {
+    for (;;) {
+        persimm_vector_t current;
+        persimm_vector_t next;
+        persimm_vector_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_vector_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_vector_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_vector_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_vector_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
+
+/* Maps */
+
+static bool persimm_map_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_map_t *version = expected;
+    return version->root == held->value.map.root && version->count == held->value.map.count;
+}
+
+persimm_status persimm_map_atom_new(const persimm_map_t *initial,
+                                    persimm_epoch_domain_t *domain,
+                                    persimm_map_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_map_atom_t *atom = calloc(1, sizeof(persimm_map_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_MAP);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_map_clone(initial, &box->value.map);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_map_atom_free(persimm_map_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_map_atom_load(persimm_map_atom_t *atom, persimm_map_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_map_clone(&persimm_atom_current(&atom->atom)->value.map, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_map_t *persimm_map_atom_read(persimm_map_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.map;
+}
+
+persimm_status persimm_map_atom_compare_and_set(persimm_map_atom_t *atom,
+                                                const persimm_map_t *expected,
+                                                const persimm_map_t *desired,
+                                                bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_MAP);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_map_clone(desired, &box->value.map);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_map_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_atom_swap(persimm_map_atom_t *atom,
+                                     persimm_map_update_fn update, void *ctx,
+                                     persimm_map_t *result) {
+    for (;;) {
+        persimm_map_t current;
+        persimm_map_t next;
+        persimm_map_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_map_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_map_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_map_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_map_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
+
+/* Sets */
+
+static bool persimm_set_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_set_t *version = expected;
+    return version->root == held->value.set.root && version->count == held->value.set.count;
+}
+
+persimm_status persimm_set_atom_new(const persimm_set_t *initial,
+                                    persimm_epoch_domain_t *domain,
+                                    persimm_set_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_set_atom_t *atom = calloc(1, sizeof(persimm_set_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_SET);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_set_clone(initial, &box->value.set);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_set_atom_free(persimm_set_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_set_atom_load(persimm_set_atom_t *atom, persimm_set_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_set_clone(&persimm_atom_current(&atom->atom)->value.set, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_set_t *persimm_set_atom_read(persimm_set_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.set;
+}
+
+persimm_status persimm_set_atom_compare_and_set(persimm_set_atom_t *atom,
+                                                const persimm_set_t *expected,
+                                                const persimm_set_t *desired,
+                                                bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_SET);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_set_clone(desired, &box->value.set);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_set_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_atom_swap(persimm_set_atom_t *atom,
+                                     persimm_set_update_fn update, void *ctx,
+                                     persimm_set_t *result) {
+    for (;;) {
+        persimm_set_t current;
+        persimm_set_t next;
+        persimm_set_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_set_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_set_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_set_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_set_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A map that many threads update at once. Prokopec's Ctrie keeps an
+ * indirection node above every trie node and swings it with a
+ * compare-and-swap, so that writers on different branches never meet. Doing
+ * that at every level takes a garbage collector to free what the swings
+ * leave behind, which a C core cannot assume. Here the indirection sits at
+ * the root alone: each of the root's 32 slots is an atom holding the trie of
+ * the keys whose hashes land in it. A writer swaps one slot and copies only
+ * that slot's path, and writers in different slots share no memory at all.
+ * Reclaiming what a swap replaces is then the atom's business.
+ *
+ * A snapshot must see every slot as it was at one moment. It loads all 32,
+ * then checks that each still holds what was loaded. A version is never
+ * published twice, since an update derives a fresh root or fails to publish,
+ * so a slot that holds the same version at both ends held it throughout, and
+ * the loads together are the map as it was between the two passes. Joining
+ * the slots' roots then makes an ordinary map in one allocation.
+ *
+ * That can fail for as long as writers keep landing between the passes. A
+ * snapshot that has failed a few times raises a flag that holds new writers
+ * back, lets those already under way finish and then cannot fail again.
+ * Writers never wait for one another, but they do wait on such a snapshot:
+ * while the flag is up every writer spins, so a snapshot thread descheduled
+ * with it raised stalls them all until it runs again. Writers are lock-free
+ * only between snapshots that have to fall back that far.
+ */
+
+/* Geometry */
+
+/* As for snapshots: keeps the flag every writer reads off the lines writers change. */
+#define PERSIMM_CONCURRENT_LINE 64
+
+/*
+ * How many times a snapshot races writers before it holds them back. The
+ * thread checks build with it at 0 so that every snapshot holds them back.
+ */
+#if !defined(PERSIMM_CONCURRENT_TRIES)
+#define PERSIMM_CONCURRENT_TRIES 8
+#endif
+
+struct persimm_concurrent_map {
+    /* The layout, operation tables and contexts every slot shares, holding nothing. */
+    persimm_map_t empty;
+    persimm_hamt_t hamt;
+    persimm_map_atom_t *slots[PERSIMM_WIDTH];
+    unsigned char padding[PERSIMM_CONCURRENT_LINE];
+    /* Snapshots holding writers back. */
+    persimm_refcount_t pending;
+    unsigned char tail[PERSIMM_CONCURRENT_LINE - sizeof(persimm_refcount_t)];
+};
+
+/* Creating */
+
+persimm_status persimm_concurrent_map_new(const persimm_map_t *initial,
+                                          persimm_epoch_domain_t *domain,
+                                          persimm_concurrent_map_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_concurrent_map_t *map = calloc(1, sizeof(persimm_concurrent_map_t));
+    if (NULL == map) return PERSIMM_ERR_ALLOC;
+
+    map->empty = *initial;
+    map->empty.count = 0;
+    map->empty.root = NULL;
+    persimm_hamt_config(&map->hamt, &initial->layout, initial->value_ops, initial->value_ctx,
+                        initial->key_ops, initial->key_ctx, false);
+    PERSIMM_RC_SET(map->pending, 0);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(initial->root, &map->hamt, roots, counts);
+    if (PERSIMM_OK != status) {
+        free(map);
+        return status;
+    }
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_t part = map->empty;
+        part.count = counts[i];
+        part.root = roots[i];
+        if (PERSIMM_OK == status) status = persimm_map_atom_new(&part, domain, &map->slots[i]);
+        persimm_map_deinit(&part);
+    }
+    if (PERSIMM_OK != status) {
+        persimm_concurrent_map_free(map);
+        return status;
+    }
+
+    *dest = map;
+    return PERSIMM_OK;
+}
+
+void persimm_concurrent_map_free(persimm_concurrent_map_t *map) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        if (NULL != map->slots[i]) persimm_map_atom_free(map->slots[i]);
+    }
+    free(map);
+}
+
+static persimm_map_atom_t *persimm_concurrent_slot(persimm_concurrent_map_t *map,
+                                                   const void *key) {
+    PERSIMM_COUNT(hamt, hash_calls);
+    uint32_t hash = map->hamt.hash(key, map->hamt.layout.key_size, map->hamt.key_ctx);
+    return map->slots[hash & PERSIMM_MASK];
+}
+
+/* Reading */
+
+bool persimm_concurrent_map_get(persimm_concurrent_map_t *map, const void *key, void *entry) {
+    persimm_map_t part;
+    persimm_map_atom_load(persimm_concurrent_slot(map, key), &part);
+
+    const void *found = persimm_map_find_entry(&part, key);
+    if (NULL != found) {
+        memcpy(entry, found, map->hamt.layout.entry_size);
+        if (NULL != map->hamt.key_ops && NULL != map->hamt.key_ops->retain) {
+            map->hamt.key_ops->retain(entry, map->hamt.key_ctx);
+        }
+        if (map->hamt.layout.value_size > 0) {
+            persimm_elem_retain(map->hamt.value_ops, map->hamt.value_ctx,
+                                (unsigned char *)entry + map->hamt.layout.value_offset);
+        }
+    }
+
+    persimm_map_deinit(&part);
+    return NULL != found;
+}
+
+const void *persimm_concurrent_map_find(persimm_concurrent_map_t *map, const void *key) {
+    const persimm_map_t *part = persimm_map_atom_read(persimm_concurrent_slot(map, key));
+    return NULL == part ? NULL : persimm_map_find_entry(part, key);
+}
+
+/* Writing */
+
+typedef struct {
+    const void *item;
+    /* The size the slot's trie had before and after the last attempt. */
+    size_t before;
+    size_t after;
+} persimm_concurrent_edit_t;
+
+static persimm_status persimm_concurrent_assoc_slot(const persimm_map_t *current, void *ctx,
+                                                    persimm_map_t *next) {
+    persimm_concurrent_edit_t *edit = ctx;
+    persimm_status status = persimm_map_assoc(current, edit->item, next);
+    edit->before = current->count;
+    edit->after = next->count;
+    return status;
+}
+
+static persimm_status persimm_concurrent_dissoc_slot(const persimm_map_t *current, void *ctx,
+                                                     persimm_map_t *next) {
+    persimm_concurrent_edit_t *edit = ctx;
+    persimm_status status = persimm_map_dissoc(current, edit->item, next);
+    edit->before = current->count;
+    edit->after = next->count;
+    return status;
+}
+
+/*
+ * The flag is read before the slot is, so a writer that misses a snapshot's
+ * flag is one the snapshot will see under way or finished.
+ */
+static persimm_status persimm_concurrent_write(persimm_concurrent_map_t *map, const void *item,
+                                               persimm_map_update_fn update,
+                                               persimm_concurrent_edit_t *edit) {
+    while (0 != PERSIMM_RC_LOAD(map->pending)) PERSIMM_RELAX();
+    edit->item = item;
+    edit->before = 0;
+    edit->after = 0;
+    return persimm_map_atom_swap(persimm_concurrent_slot(map, item), update, edit, NULL);
+}
+
+persimm_status persimm_concurrent_map_assoc(persimm_concurrent_map_t *map, const void *entry,
+                                            bool *added) {
+    persimm_concurrent_edit_t edit;
+    persimm_status status = persimm_concurrent_write(map, entry, persimm_concurrent_assoc_slot,
+                                                     &edit);
+    if (NULL != added) *added = PERSIMM_OK == status && edit.after > edit.before;
+    return status;
+}
+
+persimm_status persimm_concurrent_map_dissoc(persimm_concurrent_map_t *map, const void *key,
+                                             bool *removed) {
+    persimm_concurrent_edit_t edit;
+    persimm_status status = persimm_concurrent_write(map, key, persimm_concurrent_dissoc_slot,
+                                                     &edit);
+    if (NULL != removed) *removed = PERSIMM_OK == status && edit.after < edit.before;
+    return status;
+}
+
+/* Snapshots */
+
+/* Loads every slot, returning whether each still held its version after all were loaded. */
+static bool persimm_concurrent_collect(persimm_concurrent_map_t *map, persimm_map_t *parts) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_atom_load(map->slots[i], &parts[i]);
+
+    bool steady = true;
+    for (size_t i = 0; i < PERSIMM_WIDTH && steady; i++) {
+        persimm_map_t held;
+        persimm_map_atom_load(map->slots[i], &held);
+        steady = held.root == parts[i].root && held.count == parts[i].count;
+        persimm_map_deinit(&held);
+    }
+    if (!steady) {
+        for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_deinit(&parts[i]);
+    }
+    return steady;
+}
+
+persimm_status persimm_concurrent_map_snapshot(persimm_concurrent_map_t *map,
+                                               persimm_map_t *dest) {
+    persimm_map_t parts[PERSIMM_WIDTH];
+    bool holding = false;
+
+    for (int tries = 0;; tries++) {
+        if (PERSIMM_CONCURRENT_TRIES == tries) {
+            PERSIMM_RC_INC(map->pending);
+            PERSIMM_FENCE();
+            holding = true;
+        }
+        if (persimm_concurrent_collect(map, parts)) break;
+    }
+    if (holding) PERSIMM_RC_DEC(map->pending);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t count = 0;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        roots[i] = parts[i].root;
+        count += parts[i].count;
+    }
+
+    *dest = map->empty;
+    persimm_status status = persimm_hamt_join(roots, PERSIMM_WIDTH, &map->hamt, &dest->root);
+    if (PERSIMM_OK == status) dest->count = count;
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_deinit(&parts[i]);
+    return status;
+}
@@ -44,11 +44,18 @@ const char *persimm_status_string(persimm_status status);
  * gets copied for structural sharing. `release` is called symmetrically.
  * `trace` exists for hosts with a tracing collector and is only ever called
  * via the corresponding `*_trace` function.
+ *
+ * `hash` lets a collection keep a structural hash of its contents up to date
+ * as it changes, so that persimm_vector_hash and persimm_map_hash answer
+ * without reading the elements. Elements the host treats as equal must hash
+ * equally. It is called for each element a change stores or lets go of, so it
+ * should be cheap.
  */
 typedef struct {
     void (*retain)(const void *slot, void *ctx);
     void (*release)(const void *slot, void *ctx);
     void (*trace)(const void *slot, void *ctx);
+    uint32_t (*hash)(const void *slot, void *ctx);
 } persimm_elem_ops;
 
 /*
@@ -132,6 +139,8 @@ typedef struct {
     size_t elem_size;
     const persimm_elem_ops *ops;
     void *ctx;
+    /* Set by persimm_vector_make_local and cleared by persimm_vector_share. */
+    bool local;
     struct persimm_vector_node *root;
     struct persimm_vector_node *tail;
 } persimm_vector_t;
@@ -147,6 +156,7 @@ typedef struct {
     size_t elem_size;
     const persimm_elem_ops *ops;
     void *ctx;
+    bool local;
     struct persimm_list_cell *head;
 } persimm_list_t;
 
@@ -183,6 +193,7 @@ typedef struct {
     const persimm_key_ops *key_ops;
     void *value_ctx;
     void *key_ctx;
+    bool local;
     struct persimm_hamt_node *root;
 } persimm_map_t;
 
@@ -195,6 +206,7 @@ typedef struct {
     persimm_entry_layout layout;
     const persimm_key_ops *key_ops;
     void *key_ctx;
+    bool local;
     struct persimm_hamt_node *root;
 } persimm_set_t;
 
@@ -222,16 +234,492 @@ typedef struct {
     bool active;
 } persimm_set_transient_t;
 
+/*
+ * How many shards a map or set splits into, one for each slot in the root of
+ * its trie. The arrays the split functions fill and the slots of a sharded
+ * transient have this many elements.
+ */
+#define PERSIMM_SPLIT_WAYS 32
+
+/*
+ * A map transient divided by hash across the root's 32 slots, each holding a
+ * transient of its own. Unlike the others it may be edited from several
+ * threads at once, so long as no two of them edit keys in the same slot at
+ * the same time.
+ *
+ * Each slot is followed by a 64-byte cache line's worth of padding, so that
+ * however the whole is aligned no line holds fields that edits to two slots
+ * write. `shape` holds no entries; it keeps the layout, operation tables and
+ * contexts that every slot lookup reads on lines that no edit writes.
+ */
+typedef struct {
+    persimm_map_transient_t transient;
+    unsigned char padding[64];
+} persimm_map_shard_t;
+
+typedef struct {
+    persimm_map_t shape;
+    unsigned char padding[64];
+    persimm_map_shard_t slots[PERSIMM_SPLIT_WAYS];
+} persimm_map_sharded_transient_t;
+
+/*
+ * Read-only handles that borrow a collection rather than share it. Borrowing
+ * copies the handle without taking a reference, so it touches no count, and
+ * the view's accessor yields a const collection for every read function:
+ * lookups, iteration, cursors, hashing, comparison, and persistent updates
+ * and clones that build a separate result. A view is a plain value that can
+ * be stored or passed along wherever a collection pointer could not safely go.
+ *
+ * The fields are reserved for library bookkeeping and must not be modified. A
+ * view is valid only while the collection it borrowed stays alive and
+ * unchanged, so it must not outlive the owner or a deinitialisation, owned
+ * update or transient edit of it. There is nothing to release. A view of a
+ * local collection must stay on the owner's thread.
+ */
+typedef struct {
+    persimm_vector_t value;
+} persimm_vector_view_t;
+
+typedef struct {
+    persimm_list_t value;
+} persimm_list_view_t;
+
+typedef struct {
+    persimm_map_t value;
+} persimm_map_view_t;
+
+typedef struct {
+    persimm_set_t value;
+} persimm_set_view_t;
+
 /* Reference Counting */
 
 /*
  * Internal storage is shared between structures and reference counted. The
- * counts are atomic where the toolchain provides atomics. This returns whether
- * that was the case for this build: when it is false, a graph of structures
- * must not be shared across threads.
+ * counts are atomic where the toolchain provides atomics, unless the library
+ * was built with PERSIMM_SINGLE_THREADED defined. This returns whether that
+ * was the case for this build: when it is false, a graph of structures must
+ * not be shared across threads.
  */
 bool persimm_has_atomic_refcounts(void);
 
+/*
+ * Counting atomically costs a locked instruction for every clone and for
+ * every node an update copies, which a host whose collections never leave the
+ * thread that built them pays for nothing. A collection made local counts
+ * with plain loads and stores instead, and every clone, update and transient
+ * derived from it is local too. Collections start out shared.
+ *
+ * Make a collection local only while no other thread can reach any of its
+ * storage, which is simplest straight after initialising or building it.
+ * Sharing puts a local collection back on atomic counts and must happen
+ * before another thread sees it. Any other local collection reaching the same
+ * storage, such as an earlier version, must by then be shared too or
+ * deinitialised, because counts one thread changes plainly while another
+ * changes them atomically are lost. Both calls change only the handle they
+ * are given and cost nothing.
+ */
+void persimm_vector_make_local(persimm_vector_t *vector);
+void persimm_vector_share(persimm_vector_t *vector);
+void persimm_list_make_local(persimm_list_t *list);
+void persimm_list_share(persimm_list_t *list);
+void persimm_map_make_local(persimm_map_t *map);
+void persimm_map_share(persimm_map_t *map);
+void persimm_set_make_local(persimm_set_t *set);
+void persimm_set_share(persimm_set_t *set);
+
+/*
+ * A collection built once and read for the life of the process gains nothing
+ * from being counted. Freezing marks all of its storage immortal: cloning and
+ * deinitialising then leave the counts untouched, so readers on any number of
+ * threads never write to shared memory, and the storage and the elements in
+ * it are never freed or released. Versions derived from a frozen collection
+ * share its storage as usual and copy whatever they change, and their own
+ * new storage is counted and freed normally.
+ *
+ * Freeze a collection before another thread can reach any of its storage.
+ * Earlier versions sharing that storage stay valid but will no longer free
+ * it. Freezing cannot be undone, and freezing a frozen collection costs
+ * only as much as its root.
+ */
+void persimm_vector_freeze(persimm_vector_t *vector);
+void persimm_list_freeze(persimm_list_t *list);
+void persimm_map_freeze(persimm_map_t *map);
+void persimm_set_freeze(persimm_set_t *set);
+
+/* Tracing */
+
+/*
+ * A tracing collector marks every collection it can reach, and versions of one
+ * collection share most of their nodes, so tracing each version in full visits
+ * the elements they share once per version. Tracing within an epoch visits
+ * each node once however many versions reach it.
+ *
+ * Call this at the start of each collection cycle and pass what it returns to
+ * the `*_trace_epoch` functions throughout that cycle. Every node remembers the
+ * last epoch it was traced in, and one already traced in the current epoch is
+ * passed over with everything beneath it. An epoch is never zero. Calls
+ * return the other 2^32 - 1 values in turn, whichever threads make them, and
+ * then wrap and start again, so an epoch repeats once that many calls have
+ * been made. A node is passed over wrongly only if the last epoch that traced
+ * it comes round again before anything traces it. A host that traces every
+ * collection it holds each cycle never meets that case. A host that keeps a
+ * collection from its collector for billions of cycles should trace it in
+ * full, with epoch zero, in the cycle it comes back. The record in each node
+ * is a plain field, so one node must not be traced from two threads at once.
+ *
+ * Map and set nodes always keep that record. Vector nodes and list cells keep
+ * it only in a core built with PERSIMM_TRACE_EPOCHS defined, since it costs
+ * each of them an alignment step of header; without it, their `_epoch` forms
+ * trace in full.
+ */
+uint32_t persimm_trace_epoch_begin(void);
+
+/* Memory Statistics */
+
+/*
+ * What a collection's storage costs, as the `*_memory_stats` functions report
+ * it. Bytes are what the library asked the allocator for, node headers
+ * included and the allocator's own overhead not. Branches are a vector's inner
+ * nodes and a map's or set's bitmap nodes. Leaves are a vector's leaves and
+ * tail, a list's cells and a map's or set's collision nodes. Element bytes are
+ * those the live elements or entries take up within all of them.
+ *
+ * Exclusive bytes are those that deinitialising the collection would free
+ * now: nodes counted once, reached only through other such nodes. The rest
+ * are shared, with other versions or through freezing, and stay put until
+ * every holder has let go.
+ *
+ * The `*_memory_delta` functions add up the bytes in nodes `b` reaches and `a`
+ * does not, which is what keeping `b` costs on top of keeping `a`. They gather
+ * every node of `a` first, which allocates, and so can fail with
+ * PERSIMM_ERR_ALLOC, leaving `bytes` zero.
+ *
+ * Counts read while other threads update versions sharing the storage may
+ * already be out of date by the time they are added up, so the split between
+ * exclusive and shared is then only approximate.
+ */
+typedef struct {
+    size_t branch_nodes;
+    size_t branch_bytes;
+    size_t leaf_nodes;
+    size_t leaf_bytes;
+    size_t elem_bytes;
+    size_t exclusive_bytes;
+    size_t shared_bytes;
+} persimm_memory_stats;
+
+/* Shape Statistics */
+
+/*
+ * How a map's or set's trie has grown, as persimm_map_shape_stats reports it,
+ * for telling a host hash that spreads keys badly from a map that is merely
+ * large. Depths count levels below the root, which is at depth 0, and an
+ * entry's depth is that of the node holding it. Only a poor hash puts many
+ * entries deep, since each level reads five more of its bits.
+ *
+ * Keys whose hashes agree in all 32 bits share a collision node, which is
+ * searched from one end to the other. `collision_sizes[i]` counts the nodes
+ * holding from 2^(i+1) up to 2^(i+2) - 1 entries, the last counting every
+ * larger node too. The per-node averages are over bitmap nodes alone.
+ *
+ * A lookup hashes its key once whatever the shape. The equality estimates are
+ * what a lookup costs on average in calls to the key table's `equals`: for a
+ * key the trie holds, chosen uniformly, and for an absent key whose hash is
+ * uniformly random. With a good hash a hit costs about one call and a miss
+ * less than one.
+ */
+typedef struct {
+    size_t entries;
+    size_t bitmap_nodes;
+    size_t collision_nodes;
+    size_t collision_entries;
+    size_t largest_collision;
+    size_t collision_sizes[8];
+    size_t depths[8];
+    size_t max_depth;
+    double entries_per_node;
+    double children_per_node;
+    double equals_per_hit;
+    double equals_per_miss;
+} persimm_shape_stats;
+
+/* Operation Counters */
+
+/*
+ * A build with PERSIMM_STATS defined counts what the core does on each thread,
+ * for explaining a change in throughput without a profiler. Without it the
+ * counting compiles away entirely, and a snapshot reports zeros and returns
+ * false.
+ *
+ * Nodes count allocations and frees of trie nodes and list cells. Path copies
+ * are nodes copied because another version still held them, and in-place
+ * edits are nodes a transient or owned update changed without copying. Hash
+ * and equality calls count calls into the host's callbacks or the byte-wise
+ * defaults. Retains and releases count each reference an element gains or
+ * loses, whether or not its table has a callback to hear of it. Collision
+ * scans are searches of a collision node's entries. Maps and sets share a
+ * trie and so share one set of counts.
+ *
+ * Each thread counts into its own storage, with no atomics on the way, and a
+ * snapshot or reset sees only the calling thread's. A host wanting totals
+ * across threads takes a snapshot on each and adds them up.
+ */
+typedef struct {
+    uint64_t node_allocs;
+    uint64_t node_frees;
+    uint64_t path_copies;
+    uint64_t in_place_edits;
+    uint64_t hash_calls;
+    uint64_t equals_calls;
+    uint64_t retains;
+    uint64_t releases;
+    uint64_t collision_scans;
+} persimm_op_counts;
+
+typedef struct {
+    persimm_op_counts vector;
+    persimm_op_counts list;
+    persimm_op_counts hamt;
+} persimm_op_stats;
+
+bool persimm_stats_snapshot(persimm_op_stats *dest);
+void persimm_stats_reset(void);
+
+/* Shared Snapshots */
+
+/*
+ * A collection published for many threads to read at once. Threads that each
+ * clone one collection all write to the reference count of its root, and
+ * that single cache line passing from core to core caps how far the reads
+ * scale. A snapshot splits its readers' counts over `shards` separate cache
+ * lines instead. A reader passes its own shard number, such as the index of
+ * its worker thread, and readers on different shards never write to the same
+ * memory. Shard numbers are taken modulo the number of shards.
+ *
+ * Publishing clones the source, which must not be local, and returns
+ * PERSIMM_ERR_INVALID for a local source or for no shards. The publisher may
+ * read the snapshot until it retires it. A reader brackets its reads with an
+ * acquire and a release on the same shard, and between the two reads through
+ * the accessor for the snapshot's type, which returns NULL for any other type.
+ * The collection behind a snapshot must not be changed or deinitialised, but
+ * a reader may clone it to keep it beyond the release.
+ *
+ * Retiring gives up the publisher's hold. The collection and the snapshot are
+ * freed when the last reader releases, or at once if none is reading. Like
+ * cloning, acquiring needs the snapshot to be alive, which the caller must
+ * know by other means: by holding an acquisition already, or because the
+ * publisher has not retired it yet. Acquiring a shard that has closed after
+ * retirement returns false and takes nothing.
+ */
+typedef struct persimm_snapshot persimm_snapshot_t;
+
+persimm_status persimm_vector_snapshot(const persimm_vector_t *src, size_t shards,
+                                       persimm_snapshot_t **dest);
+persimm_status persimm_list_snapshot(const persimm_list_t *src, size_t shards,
+                                     persimm_snapshot_t **dest);
+persimm_status persimm_map_snapshot(const persimm_map_t *src, size_t shards,
+                                    persimm_snapshot_t **dest);
+persimm_status persimm_set_snapshot(const persimm_set_t *src, size_t shards,
+                                    persimm_snapshot_t **dest);
+
+bool persimm_snapshot_acquire(persimm_snapshot_t *snapshot, size_t shard);
+void persimm_snapshot_release(persimm_snapshot_t *snapshot, size_t shard);
+void persimm_snapshot_retire(persimm_snapshot_t *snapshot);
+
+const persimm_vector_t *persimm_snapshot_vector(const persimm_snapshot_t *snapshot);
+const persimm_list_t *persimm_snapshot_list(const persimm_snapshot_t *snapshot);
+const persimm_map_t *persimm_snapshot_map(const persimm_snapshot_t *snapshot);
+const persimm_set_t *persimm_snapshot_set(const persimm_snapshot_t *snapshot);
+
+/* Atoms */
+
+/*
+ * A mutable reference to a persistent collection that threads share without a
+ * lock. Loading clones whatever version the atom holds. Publishing replaces it
+ * with a single compare-and-set, and a failed attempt changes nothing. Loads
+ * never wait and never hold up a publisher. The atom's hold on a replaced
+ * version is dropped by a later publication, once no load that might have
+ * seen it is still under way, and versions loaded earlier stay valid for as
+ * long as their holders keep them.
+ *
+ * Every version published must be shared rather than local, or the call
+ * returns PERSIMM_ERR_INVALID, and must use the same layout, operation tables
+ * and contexts as the first. The atom takes its own reference to each one, so
+ * the caller keeps and deinitialises what it passed in. Freeing the atom drops
+ * the version it holds and must not race with any other call on it, nor with
+ * a reader still using what it read in place.
+ *
+ * Compare-and-set publishes `desired` only if the atom still holds `expected`,
+ * which is to say a version loaded from it since the last publication, and
+ * reports whether it did in `replaced`. Swapping loads the current version,
+ * passes it to `update` to derive the next, and publishes that, trying again
+ * from a fresh load whenever another thread published in between. `update`
+ * may therefore run more than once and must leave `current` unchanged. An
+ * error from `update` is returned at once with nothing published. If `result`
+ * is not NULL it receives the version that was published.
+ *
+ * An atom created in an epoch domain, described below, can also be read in
+ * place. Between persimm_epoch_enter and persimm_epoch_exit on its domain,
+ * persimm_map_atom_read and its counterparts return the version the atom
+ * holds without touching any count, and that version and everything read
+ * through it stay valid until the section ends. They return NULL for an atom
+ * created outside a domain. Pass NULL as the domain for an atom read only by
+ * loading.
+ */
+typedef struct persimm_vector_atom persimm_vector_atom_t;
+typedef struct persimm_map_atom persimm_map_atom_t;
+typedef struct persimm_set_atom persimm_set_atom_t;
+typedef struct persimm_epoch_domain persimm_epoch_domain_t;
+
+typedef persimm_status (*persimm_vector_update_fn)(const persimm_vector_t *current, void *ctx,
+                                                   persimm_vector_t *next);
+typedef persimm_status (*persimm_map_update_fn)(const persimm_map_t *current, void *ctx,
+                                                persimm_map_t *next);
+typedef persimm_status (*persimm_set_update_fn)(const persimm_set_t *current, void *ctx,
+                                                persimm_set_t *next);
+
+persimm_status persimm_vector_atom_new(const persimm_vector_t *initial,
+                                       persimm_epoch_domain_t *domain,
+                                       persimm_vector_atom_t **dest);
+void persimm_vector_atom_free(persimm_vector_atom_t *atom);
+void persimm_vector_atom_load(persimm_vector_atom_t *atom, persimm_vector_t *dest);
+const persimm_vector_t *persimm_vector_atom_read(persimm_vector_atom_t *atom);
+persimm_status persimm_vector_atom_compare_and_set(persimm_vector_atom_t *atom,
+                                                   const persimm_vector_t *expected,
+                                                   const persimm_vector_t *desired,
+                                                   bool *replaced);
+persimm_status persimm_vector_atom_swap(persimm_vector_atom_t *atom,
+                                        persimm_vector_update_fn update, void *ctx,
+                                        persimm_vector_t *result);
+
+persimm_status persimm_map_atom_new(const persimm_map_t *initial, persimm_epoch_domain_t *domain,
+                                    persimm_map_atom_t **dest);
+void persimm_map_atom_free(persimm_map_atom_t *atom);
+void persimm_map_atom_load(persimm_map_atom_t *atom, persimm_map_t *dest);
+const persimm_map_t *persimm_map_atom_read(persimm_map_atom_t *atom);
+persimm_status persimm_map_atom_compare_and_set(persimm_map_atom_t *atom,
+                                                const persimm_map_t *expected,
+                                                const persimm_map_t *desired, bool *replaced);
+persimm_status persimm_map_atom_swap(persimm_map_atom_t *atom, persimm_map_update_fn update,
+                                     void *ctx, persimm_map_t *result);
+
+persimm_status persimm_set_atom_new(const persimm_set_t *initial, persimm_epoch_domain_t *domain,
+                                    persimm_set_atom_t **dest);
+void persimm_set_atom_free(persimm_set_atom_t *atom);
+void persimm_set_atom_load(persimm_set_atom_t *atom, persimm_set_t *dest);
+const persimm_set_t *persimm_set_atom_read(persimm_set_atom_t *atom);
+persimm_status persimm_set_atom_compare_and_set(persimm_set_atom_t *atom,
+                                                const persimm_set_t *expected,
+                                                const persimm_set_t *desired, bool *replaced);
+persimm_status persimm_set_atom_swap(persimm_set_atom_t *atom, persimm_set_update_fn update,
+                                     void *ctx, persimm_set_t *result);
+
+/* Epoch Domains */
+
+/*
+ * Loading from an atom still takes a reference, and every reader taking one
+ * on the same root contends for its count. Readers in an epoch domain take
+ * none. Each has a reader number of its own, taken modulo the number the
+ * domain was created for, and brackets its reads with an enter and an exit
+ * on that number; a number must not be used by two threads at once, nor
+ * entered twice without an exit between. Entering and exiting write only to
+ * the reader's own slot.
+ *
+ * A version replaced in an atom of the domain is freed only once every reader
+ * inside a section has entered since it was replaced, so sections should be
+ * short: a reader that stays inside holds back every version replaced after
+ * it entered. Creating a domain for no readers returns PERSIMM_ERR_INVALID.
+ * The domain must outlive every atom created in it, and freeing it frees the
+ * versions it was still holding back.
+ */
+persimm_status persimm_epoch_domain_new(size_t readers, persimm_epoch_domain_t **dest);
+void persimm_epoch_domain_free(persimm_epoch_domain_t *domain);
+void persimm_epoch_enter(persimm_epoch_domain_t *domain, size_t reader);
+void persimm_epoch_exit(persimm_epoch_domain_t *domain, size_t reader);
+
+/* Concurrent Maps */
+
+/*
+ * A map that threads read and update in place without a lock. Keys are spread
+ * over 32 slots by their hashes, each held in an atom of its own, so writers
+ * to different slots never contend and writers to the same one retry as an
+ * atom's swap does. The map starts from `initial`, which must be shared and
+ * whose layout, operation tables and contexts every entry then uses. Freeing
+ * it must not race with any other call on it.
+ *
+ * Getting copies the entry for `key` into `entry`, retaining its key and
+ * value for the caller, and reports whether there was one. A map created in an
+ * epoch domain can also be found in: between persimm_epoch_enter and
+ * persimm_epoch_exit, persimm_concurrent_map_find returns the stored entry
+ * without touching any count, or NULL, and always NULL outside a domain.
+ * `added` and `removed` may be NULL.
+ *
+ * A snapshot is an ordinary map holding what the concurrent map held at one
+ * moment, however many writers were under way, and costs the same whatever
+ * the map's size. A snapshot kept from completing by a stream of writers
+ * holds new ones back until it has what it needs. Writers are then blocked:
+ * they spin until that snapshot finishes, and stay stalled for as long as its
+ * thread is descheduled.
+ */
+typedef struct persimm_concurrent_map persimm_concurrent_map_t;
+
+persimm_status persimm_concurrent_map_new(const persimm_map_t *initial,
+                                          persimm_epoch_domain_t *domain,
+                                          persimm_concurrent_map_t **dest);
+void persimm_concurrent_map_free(persimm_concurrent_map_t *map);
+bool persimm_concurrent_map_get(persimm_concurrent_map_t *map, const void *key, void *entry);
+const void *persimm_concurrent_map_find(persimm_concurrent_map_t *map, const void *key);
+persimm_status persimm_concurrent_map_assoc(persimm_concurrent_map_t *map, const void *entry,
+                                            bool *added);
+persimm_status persimm_concurrent_map_dissoc(persimm_concurrent_map_t *map, const void *key,
+                                             bool *removed);
+persimm_status persimm_concurrent_map_snapshot(persimm_concurrent_map_t *map,
+                                               persimm_map_t *dest);
+
+/* Executors */
+
+/*
+ * The core starts no threads of its own. Operations that can split their work
+ * take an executor instead, through which the host lends whatever threads it
+ * has. `run` must call `fn(arg, i)` exactly once for every `i` below `tasks`,
+ * on any threads and in any order, and return only once every call has
+ * returned. It may run some or all of them on the calling thread itself.
+ *
+ * Tasks never wait on one another, so an executor that runs them one at a
+ * time is always correct, and a pool that lets a waiting thread pick up queued
+ * work never deadlocks. A task may itself run tasks through the same
+ * executor. Passing NULL wherever an executor is taken runs every task in
+ * order on the calling thread.
+ *
+ * Tasks on other threads share the collection being worked on, so operations
+ * taking an executor refuse a local collection, and a build without atomic
+ * reference counts must only be given an executor that runs tasks on the
+ * calling thread.
+ */
+typedef void (*persimm_task_fn)(void *arg, size_t index);
+
+typedef struct {
+    void (*run)(void *ctx, size_t tasks, persimm_task_fn fn, void *arg);
+    void *ctx;
+} persimm_executor;
+
+/*
+ * The callbacks a parallel reduction or transformation is made of. A fold
+ * adds one element to an accumulator and a combine adds one accumulator to
+ * another, each accumulator being `acc_size` bytes the caller describes. Every
+ * task starts from a copy of the identity, and the accumulators are combined
+ * on the calling thread once every task has finished. A transform writes the
+ * element that replaces `slot` into `out`, and may fail, which abandons the
+ * whole operation with its status. All of them may run on several threads at
+ * once and must be safe to.
+ */
+typedef void (*persimm_fold_fn)(void *acc, const void *slot, size_t position, void *ctx);
+typedef void (*persimm_combine_fn)(void *acc, const void *other, void *ctx);
+typedef persimm_status (*persimm_transform_fn)(const void *slot, size_t position, void *out,
+                                               void *ctx);
+
 /* Persistent Updates */
 
 /*
@@ -240,6 +728,17 @@ bool persimm_has_atomic_refcounts(void);
  * success, source and destination each own a reference and must eventually be
  * deinitialised. On failure, the destination is still safe to deinitialise.
  * Passing the source itself as the destination returns PERSIMM_ERR_INVALID.
+ *
+ * Each also has an `*_owned` form for a caller that is about to drop the
+ * source anyway. It consumes the collection it is handed and leaves the
+ * result in its place, with the same outcome as updating into a fresh
+ * destination, deinitialising the source and moving the destination back.
+ * Taking no second reference means every node the collection alone reaches is
+ * changed where it is, as a transient would change it, and only nodes another
+ * version still holds are copied. On failure the collection is left holding
+ * what it held before. Any other handle that shares the collection's storage
+ * through a clone is never affected, but a bitwise copy of the handle is
+ * invalidated by the call.
  */
 
 /* Transients */
@@ -286,6 +785,33 @@ persimm_status persimm_map_transient_dissoc(persimm_map_transient_t *transient,
 persimm_status persimm_map_transient_persist(persimm_map_transient_t *transient,
                                              persimm_map_t *dest);
 
+/*
+ * A sharded transient starts from a shared map split as persimm_map_split
+ * splits it, or empty, and refuses a local source with PERSIMM_ERR_INVALID.
+ * Slot returns which of the 32 slots `key` belongs to, so that the host can
+ * send each key to the thread that owns its slot. Assoc and dissoc edit that
+ * slot's transient alone. Persisting joins the slots under one root without
+ * walking them, giving the map that the same edits on one transient would
+ * have, and consumes the transient as persimm_map_transient_persist does; on
+ * failure the transient stays active. Deinitialising releases every slot.
+ */
+persimm_status persimm_map_to_sharded_transient(const persimm_map_t *src,
+                                                persimm_map_sharded_transient_t *transient);
+persimm_status persimm_map_sharded_transient_init(persimm_map_sharded_transient_t *transient,
+                                                  const persimm_entry_layout *layout,
+                                                  const persimm_elem_ops *value_ops,
+                                                  void *value_ctx,
+                                                  const persimm_key_ops *key_ops, void *key_ctx);
+void persimm_map_sharded_transient_deinit(persimm_map_sharded_transient_t *transient);
+size_t persimm_map_sharded_transient_slot(const persimm_map_sharded_transient_t *transient,
+                                          const void *key);
+persimm_status persimm_map_sharded_transient_assoc(persimm_map_sharded_transient_t *transient,
+                                                   const void *entry);
+persimm_status persimm_map_sharded_transient_dissoc(persimm_map_sharded_transient_t *transient,
+                                                    const void *key);
+persimm_status persimm_map_sharded_transient_persist(persimm_map_sharded_transient_t *transient,
+                                                     persimm_map_t *dest);
+
 persimm_status persimm_set_to_transient(const persimm_set_t *src,
                                         persimm_set_transient_t *transient);
 persimm_status persimm_set_transient_init(persimm_set_transient_t *transient,
@@ -318,6 +844,10 @@ persimm_status persimm_vector_init(persimm_vector_t *vector, size_t elem_size,
 persimm_status persimm_vector_clone(const persimm_vector_t *src,
                                     persimm_vector_t *dest);
 
+/* Borrows `src` without taking a reference, as described under the view types. */
+void persimm_vector_borrow(const persimm_vector_t *src, persimm_vector_view_t *dest);
+const persimm_vector_t *persimm_vector_view(const persimm_vector_view_t *view);
+
 void persimm_vector_deinit(persimm_vector_t *vector);
 
 /*
@@ -343,16 +873,106 @@ persimm_status persimm_vector_push(const persimm_vector_t *src, const void *elem
 persimm_status persimm_vector_update(const persimm_vector_t *src, size_t index,
                                      const void *elem, persimm_vector_t *dest);
 
+persimm_status persimm_vector_push_owned(persimm_vector_t *vector, const void *elem);
+
+persimm_status persimm_vector_update_owned(persimm_vector_t *vector, size_t index,
+                                           const void *elem);
+
 /*
  * Visits each element once, in index order.
  */
 void persimm_vector_foreach(const persimm_vector_t *vector, persimm_visit_fn fn, void *ctx);
 
 /*
- * Calls the element table's `trace` callback for every element.
+ * Folds every element into `result`, splitting the vector between tasks on
+ * `executor` by whole subtrees. Each task folds its elements in index order
+ * and the accumulators are combined in index order too, so `combine` need be
+ * associative but not commutative, and `identity` must leave any accumulator
+ * it is combined with unchanged. `result` receives `acc_size` bytes.
+ *
+ * Mapping builds a vector of the same length whose element at each index is
+ * what `transform` wrote for the source's, stored as pushing it would store
+ * it, with the element size, table and context given. The new vector has the
+ * same shape as the source, each task building whole subtrees of it. On
+ * failure `dest` is empty and safe to deinitialise.
+ *
+ * Both refuse a local vector, and a zero `acc_size` or `elem_size`, with
+ * PERSIMM_ERR_INVALID.
+ */
+persimm_status persimm_vector_parallel_reduce(const persimm_vector_t *vector,
+                                              persimm_fold_fn fold, persimm_combine_fn combine,
+                                              const void *identity, size_t acc_size, void *ctx,
+                                              const persimm_executor *executor, void *result);
+persimm_status persimm_vector_parallel_map(const persimm_vector_t *src,
+                                           persimm_transform_fn transform, void *ctx,
+                                           size_t elem_size, const persimm_elem_ops *ops,
+                                           void *ops_ctx, const persimm_executor *executor,
+                                           persimm_vector_t *dest);
+
+/*
+ * Element equality for comparing two vectors. `elem_size` is the vectors'
+ * shared element size. Where the comparison functions below accept NULL in
+ * its place they compare the slots' bytes with memcmp.
+ */
+typedef bool (*persimm_elem_eq_fn)(const void *slot_a, const void *slot_b, size_t elem_size,
+                                   void *ctx);
+
+/*
+ * Receives one index at which two vectors differ. A slot is NULL when the
+ * index lies beyond the end of that vector.
+ */
+typedef void (*persimm_diff_fn)(const void *slot_a, const void *slot_b, size_t index,
+                                void *ctx);
+
+/*
+ * Returns whether `a` and `b` hold equal elements in the same order. A leaf or
+ * inner node the two tries share is equal to itself and is never opened, so
+ * comparing a vector with one derived from it by a few updates costs the
+ * updates rather than the length. Vectors with different element sizes are
+ * never equal.
+ *
+ * When both vectors use the same element table and context, and the table can
+ * hash, vectors whose hashes differ are unequal without being opened at all.
+ * `elem_eq` must then hold no two elements equal that hash differently.
+ */
+bool persimm_vector_equals(const persimm_vector_t *a, const persimm_vector_t *b,
+                           persimm_elem_eq_fn elem_eq, void *ctx);
+
+/*
+ * Calls `visit` once for each index, in ascending order, at which `a` and `b`
+ * differ, skipping shared nodes as persimm_vector_equals does. Indices held by
+ * only one of the two are reported as differences. `ctx` is passed to both
+ * callbacks. Returns PERSIMM_ERR_INVALID, visiting nothing, when the element
+ * sizes differ or `visit` is NULL.
+ */
+persimm_status persimm_vector_diff(const persimm_vector_t *a, const persimm_vector_t *b,
+                                   persimm_elem_eq_fn elem_eq, persimm_diff_fn visit,
+                                   void *ctx);
+
+/*
+ * Returns a hash of the vector's elements in order. When the element table has
+ * a `hash` callback every node keeps the hash of what lies beneath it current
+ * through each change, so this costs nothing however long the vector is, and
+ * vectors holding equal elements agree on it however they were built.
+ * Otherwise the elements' bytes are hashed one by one on each call.
+ */
+uint32_t persimm_vector_hash(const persimm_vector_t *vector);
+
+/*
+ * Calls the element table's `trace` callback for every element. The `_epoch`
+ * form skips every node already traced in `epoch`, and traces in full when
+ * `epoch` is zero or the core was built without PERSIMM_TRACE_EPOCHS.
  */
 void persimm_vector_trace(const persimm_vector_t *vector);
 
+void persimm_vector_trace_epoch(const persimm_vector_t *vector, uint32_t epoch);
+
+/* Reports the storage the vector reaches, as described under Memory Statistics. */
+void persimm_vector_memory_stats(const persimm_vector_t *vector, persimm_memory_stats *stats);
+
+persimm_status persimm_vector_memory_delta(const persimm_vector_t *a, const persimm_vector_t *b,
+                                           size_t *bytes);
+
 /* Lists */
 
 /*
@@ -370,6 +990,10 @@ persimm_status persimm_list_init(persimm_list_t *list, size_t elem_size,
 persimm_status persimm_list_clone(const persimm_list_t *src,
                                   persimm_list_t *dest);
 
+/* Borrows `src` without taking a reference, as described under the view types. */
+void persimm_list_borrow(const persimm_list_t *src, persimm_list_view_t *dest);
+const persimm_list_t *persimm_list_view(const persimm_list_view_t *view);
+
 void persimm_list_deinit(persimm_list_t *list);
 
 /*
@@ -415,6 +1039,10 @@ persimm_status persimm_list_cons(const persimm_list_t *src, const void *elem,
  */
 persimm_status persimm_list_rest(const persimm_list_t *src, persimm_list_t *dest);
 
+persimm_status persimm_list_cons_owned(persimm_list_t *list, const void *elem);
+
+persimm_status persimm_list_rest_owned(persimm_list_t *list);
+
 /*
  * Walks the chain once, from head to tail, calling `fn` with each element's
  * slot.
@@ -422,10 +1050,21 @@ persimm_status persimm_list_rest(const persimm_list_t *src, persimm_list_t *dest
 void persimm_list_foreach(const persimm_list_t *list, persimm_visit_fn fn, void *ctx);
 
 /*
- * Calls the element table's `trace` callback for every element.
+ * Calls the element table's `trace` callback for every element. Lists share
+ * their tails, so the `_epoch` form stops at the first cell already traced in
+ * `epoch`: everything after it was traced with it. Without PERSIMM_TRACE_EPOCHS
+ * it traces in full, as persimm_vector_trace_epoch does.
  */
 void persimm_list_trace(const persimm_list_t *list);
 
+void persimm_list_trace_epoch(const persimm_list_t *list, uint32_t epoch);
+
+/* As persimm_vector_memory_stats and persimm_vector_memory_delta. */
+void persimm_list_memory_stats(const persimm_list_t *list, persimm_memory_stats *stats);
+
+persimm_status persimm_list_memory_delta(const persimm_list_t *a, const persimm_list_t *b,
+                                         size_t *bytes);
+
 /* Maps */
 
 /*
@@ -439,6 +1078,36 @@ persimm_status persimm_map_init(persimm_map_t *map, const persimm_entry_layout *
                                 const persimm_elem_ops *value_ops, void *value_ctx,
                                 const persimm_key_ops *key_ops, void *key_ctx);
 
+/*
+ * Initialises `dest` as persimm_map_init would and fills it with `count`
+ * entries read from `entries`, `layout->entry_size` bytes apart. Every key is
+ * hashed once and the trie is built from the bottom up, each node allocated
+ * once at its final size, which makes this much cheaper than storing the
+ * entries one at a time. The result is the same map. A key that appears more
+ * than once keeps its first appearance and takes the value of its last. On
+ * failure `dest` is empty and safe to deinitialise.
+ */
+persimm_status persimm_map_from_entries(const void *entries, size_t count,
+                                        const persimm_entry_layout *layout,
+                                        const persimm_elem_ops *value_ops, void *value_ctx,
+                                        const persimm_key_ops *key_ops, void *key_ctx,
+                                        persimm_map_t *dest);
+
+/*
+ * Builds as persimm_map_from_entries does, with the keys hashed and each of
+ * the root's 32 slots built as tasks on `executor`. The map is the one a
+ * serial build makes, node for node. The key operations and the value table's
+ * retain are called from the executor's threads and must be safe to call
+ * from several at once.
+ */
+persimm_status persimm_map_parallel_from_entries(const void *entries, size_t count,
+                                                 const persimm_entry_layout *layout,
+                                                 const persimm_elem_ops *value_ops,
+                                                 void *value_ctx,
+                                                 const persimm_key_ops *key_ops, void *key_ctx,
+                                                 const persimm_executor *executor,
+                                                 persimm_map_t *dest);
+
 /*
  * Points `dest` at the same storage as `src`, sharing its structure. `dest`
  * must be uninitialised and distinct from `src`. An alias is rejected without
@@ -446,6 +1115,10 @@ persimm_status persimm_map_init(persimm_map_t *map, const persimm_entry_layout *
  */
 persimm_status persimm_map_clone(const persimm_map_t *src, persimm_map_t *dest);
 
+/* Borrows `src` without taking a reference, as described under the view types. */
+void persimm_map_borrow(const persimm_map_t *src, persimm_map_view_t *dest);
+const persimm_map_t *persimm_map_view(const persimm_map_view_t *view);
+
 void persimm_map_deinit(persimm_map_t *map);
 
 /*
@@ -482,6 +1155,61 @@ persimm_status persimm_map_assoc(const persimm_map_t *src, const void *entry,
 persimm_status persimm_map_dissoc(const persimm_map_t *src, const void *key,
                                   persimm_map_t *dest);
 
+persimm_status persimm_map_assoc_owned(persimm_map_t *map, const void *entry);
+
+persimm_status persimm_map_dissoc_owned(persimm_map_t *map, const void *key);
+
+/*
+ * Stores `count` entries laid out `layout.entry_size` apart, with the same
+ * outcome as storing them one after another with persimm_map_assoc. The batch
+ * is sorted into the trie's own slot order and carried down once, so each
+ * node it reaches is copied once however many entries land in it, and only
+ * the paths the batch touches are copied at all. Prefer this to a transient
+ * for large batches against a large map.
+ */
+persimm_status persimm_map_assoc_many(const persimm_map_t *src, const void *entries,
+                                      size_t count, persimm_map_t *dest);
+
+/*
+ * Drops the entries for `count` keys laid out `layout.key_size` apart in one
+ * descent, as persimm_map_assoc_many stores them. Keys the map does not hold,
+ * and keys repeated in the batch, are not errors.
+ */
+persimm_status persimm_map_dissoc_many(const persimm_map_t *src, const void *keys,
+                                       size_t count, persimm_map_t *dest);
+
+/*
+ * Splits a map into 32 shards by the low five bits of each key's hash, leaving
+ * in `out[i]` the entries whose bits are `i`. Those bits pick the slot a key
+ * takes in the root, so each shard is a fresh root over that one slot of the
+ * original and shares everything beneath it. A shard of one entry holds it in
+ * its root, as any map of one entry does. Nothing is copied or rehashed, but
+ * finding each shard's count walks the nodes under its slot. Every shard uses
+ * the map's layout, tables and contexts and must be deinitialised. On failure
+ * every shard is empty.
+ *
+ * Joining takes `count` shards in any order and builds the one map holding all
+ * their entries, again touching their roots alone. They must share a layout,
+ * tables, contexts and locality, and no two of them may use the same slot in
+ * the root, as the shards of one split never do; otherwise, and when `count`
+ * is zero, the call returns PERSIMM_ERR_INVALID and leaves `dest` alone. The
+ * shards are left as they were.
+ */
+persimm_status persimm_map_split(const persimm_map_t *map, persimm_map_t out[PERSIMM_SPLIT_WAYS]);
+
+persimm_status persimm_map_join(const persimm_map_t *shards, size_t count,
+                                persimm_map_t *dest);
+
+/*
+ * Returns a hash of the map's entries, kept current in every node of the trie
+ * as the map changes, so reading it costs nothing. Entries are combined
+ * commutatively, so maps holding equal entries agree on it whatever order
+ * their colliding keys sit in. Values count only when the value table has a
+ * `hash` callback; keys are hashed with the key table's. Maps whose hashes
+ * differ are certainly unequal.
+ */
+uint32_t persimm_map_hash(const persimm_map_t *map);
+
 /*
  * Visits each entry once. The callback's position is a zero-based ordinal in
  * this traversal, not a persistent index for the entry. The order is not the
@@ -491,10 +1219,30 @@ persimm_status persimm_map_dissoc(const persimm_map_t *src, const void *key,
  * Keys whose hashes are equal in all 32 bits are the exception: they sit in
  * the order they arrived, and no order exists to sort opaque keys into. A host
  * deriving a hash from a whole map should combine its entries commutatively so
- * that equal maps still agree.
+ * that equal maps still agree, as persimm_map_hash does.
  */
 void persimm_map_foreach(const persimm_map_t *map, persimm_visit_fn fn, void *ctx);
 
+/*
+ * Visits or folds every entry as foreach does, but fanned out over tasks on
+ * `executor`. The tasks take whole subtrees below the root, going a level or
+ * two deeper when the root has few children, so no order holds between
+ * entries in different tasks and the callback's position only counts entries
+ * within a task. `combine` must be associative and commutative, and
+ * `identity` must leave any accumulator it is combined with unchanged.
+ * `result` receives `acc_size` bytes.
+ *
+ * Both refuse a local map, and reducing refuses a zero `acc_size`, with
+ * PERSIMM_ERR_INVALID. Given NULL for the executor, they walk the map in
+ * foreach order on the calling thread.
+ */
+persimm_status persimm_map_parallel_foreach(const persimm_map_t *map, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor);
+persimm_status persimm_map_parallel_reduce(const persimm_map_t *map, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result);
+
 /*
  * Returns the entry following `key`'s, the first entry when `key` is NULL, or
  * NULL when `key` is absent or the traversal is at its end. To walk a map,
@@ -509,10 +1257,22 @@ const void *persimm_map_next(const persimm_map_t *map, const void *key);
 
 /*
  * Calls the key table's `trace` callback for every key and the value table's
- * callback for every value.
+ * callback for every value. The `_epoch` form skips every node already traced
+ * in `epoch`, whether or not the core was built with PERSIMM_TRACE_EPOCHS.
  */
 void persimm_map_trace(const persimm_map_t *map);
 
+void persimm_map_trace_epoch(const persimm_map_t *map, uint32_t epoch);
+
+/* As persimm_vector_memory_stats and persimm_vector_memory_delta. */
+void persimm_map_memory_stats(const persimm_map_t *map, persimm_memory_stats *stats);
+
+persimm_status persimm_map_memory_delta(const persimm_map_t *a, const persimm_map_t *b,
+                                        size_t *bytes);
+
+/* Reports the shape of the map's trie, as described under Shape Statistics. */
+void persimm_map_shape_stats(const persimm_map_t *map, persimm_shape_stats *stats);
+
 /* Sets */
 
 /*
@@ -523,12 +1283,32 @@ void persimm_map_trace(const persimm_map_t *map);
 persimm_status persimm_set_init(persimm_set_t *set, size_t elem_size,
                                 const persimm_key_ops *key_ops, void *key_ctx);
 
+/*
+ * Initialises `dest` as persimm_set_init would and fills it with `count`
+ * elements read from `elems`, `elem_size` bytes apart, building the trie from
+ * the bottom up as persimm_map_from_entries does. Of a run of equal elements
+ * the first is kept. On failure `dest` is empty and safe to deinitialise.
+ */
+persimm_status persimm_set_from_elems(const void *elems, size_t count, size_t elem_size,
+                                      const persimm_key_ops *key_ops, void *key_ctx,
+                                      persimm_set_t *dest);
+
+/* Builds as persimm_set_from_elems does, fanned out as persimm_map_parallel_from_entries is. */
+persimm_status persimm_set_parallel_from_elems(const void *elems, size_t count,
+                                               size_t elem_size, const persimm_key_ops *key_ops,
+                                               void *key_ctx, const persimm_executor *executor,
+                                               persimm_set_t *dest);
+
 /*
  * Points `dest` at the same storage as `src`. `dest` must be uninitialised and
  * distinct from `src`. An alias is rejected without changing either argument.
  */
 persimm_status persimm_set_clone(const persimm_set_t *src, persimm_set_t *dest);
 
+/* Borrows `src` without taking a reference, as described under the view types. */
+void persimm_set_borrow(const persimm_set_t *src, persimm_set_view_t *dest);
+const persimm_set_t *persimm_set_view(const persimm_set_view_t *view);
+
 void persimm_set_deinit(persimm_set_t *set);
 
 /*
@@ -551,6 +1331,31 @@ persimm_status persimm_set_conj(const persimm_set_t *src, const void *elem,
 persimm_status persimm_set_disj(const persimm_set_t *src, const void *elem,
                                 persimm_set_t *dest);
 
+persimm_status persimm_set_conj_owned(persimm_set_t *set, const void *elem);
+
+persimm_status persimm_set_disj_owned(persimm_set_t *set, const void *elem);
+
+/*
+ * Add or remove `count` elements laid out `elem_size` apart in one descent of
+ * the trie, as persimm_map_assoc_many and persimm_map_dissoc_many do for a
+ * map. Of equal elements the one already held, or else the first in the
+ * batch, is kept.
+ */
+persimm_status persimm_set_conj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest);
+
+persimm_status persimm_set_disj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest);
+
+/* Splits and joins a set by hash as persimm_map_split and persimm_map_join do a map. */
+persimm_status persimm_set_split(const persimm_set_t *set, persimm_set_t out[PERSIMM_SPLIT_WAYS]);
+
+persimm_status persimm_set_join(const persimm_set_t *shards, size_t count,
+                                persimm_set_t *dest);
+
+/* Returns a hash of the set's elements, kept current as persimm_map_hash is. */
+uint32_t persimm_set_hash(const persimm_set_t *set);
+
 /*
  * Visits each element once in persimm_set_next order. The callback's position
  * is a zero-based traversal ordinal, not a persistent index for the element.
@@ -559,6 +1364,14 @@ persimm_status persimm_set_disj(const persimm_set_t *src, const void *elem,
  */
 void persimm_set_foreach(const persimm_set_t *set, persimm_visit_fn fn, void *ctx);
 
+/* Fans out over the set as persimm_map_parallel_foreach and its reduction do over a map. */
+persimm_status persimm_set_parallel_foreach(const persimm_set_t *set, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor);
+persimm_status persimm_set_parallel_reduce(const persimm_set_t *set, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result);
+
 /*
  * Returns the element following `elem`, the first element when `elem` is NULL,
  * or NULL when `elem` is absent or the traversal is at its end. To walk a set,
@@ -572,4 +1385,14 @@ const void *persimm_set_next(const persimm_set_t *set, const void *elem);
 
 void persimm_set_trace(const persimm_set_t *set);
 
+void persimm_set_trace_epoch(const persimm_set_t *set, uint32_t epoch);
+
+/* As persimm_vector_memory_stats and persimm_vector_memory_delta. */
+void persimm_set_memory_stats(const persimm_set_t *set, persimm_memory_stats *stats);
+
+persimm_status persimm_set_memory_delta(const persimm_set_t *a, const persimm_set_t *b,
+                                        size_t *bytes);
+
+void persimm_set_shape_stats(const persimm_set_t *set, persimm_shape_stats *stats);
+
 #endif /* end of include guard */
@@ -1,15 +1,51 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
 #include "persimmon.h"
 
 /*
- * A small, portable throughput benchmark for the core API. It uses C99's
- * clock rather than a platform-specific wall clock so that the same source
- * builds on every target Persimmon supports. Run it more than once and compare
- * results on an otherwise idle machine; it is a regression gauge, not a claim
- * about absolute performance.
+ * The core's benchmark suite. Each workload is one operation repeated over a
+ * stream of keys: sequential or random indices for hits, keys past the end
+ * for misses. Reads and persistent updates run against a collection built
+ * once per size and never changed, discarding what each update returns, so
+ * every pass sees the same collection. The workloads marked as builds instead
+ * grow a collection of their own from empty, and report a size of 0.
+ *
+ * Sizes are small (100), medium (10,000) and huge (1,000,000). Maps with wide
+ * keys, hashed byte by byte, and with eight keys to every hash run at the
+ * medium size only.
+ *
+ * A workload runs once to warm up, then a number of timed passes, of which
+ * the median time per operation is reported. A last pass times each operation
+ * alone for the p50, p99 and p999 latencies. The cost of reading the clock is
+ * measured at the start and taken off every sample, but a single operation
+ * still only costs a few clock ticks, so the percentiles of the fastest reads
+ * are coarse.
+ *
+ * The options are:
+ *
+ *   --json FILE        also write the results to FILE as JSON
+ *   --compare FILE     compare against results saved earlier with --json
+ *   --tolerance PCT    how much slower a workload may get before a comparison
+ *                      fails, 10 by default
+ *   --filter TEXT      run only the workloads whose names contain TEXT
+ *
+ * A comparison exits with status 1 if any workload run in both got slower
+ * than the tolerance allows. PERSIMMON_BENCH_SCALE multiplies the operations
+ * per pass and PERSIMMON_BENCH_REPS sets the number of passes.
+ *
+ * Timing needs a monotonic clock, which C99 lacks, so this uses POSIX's or
+ * Windows'. Run it more than once on an otherwise idle machine: it is a
+ * regression gauge, not a claim about absolute performance.
  */
 
 typedef struct {
@@ -24,6 +60,21 @@ static const persimm_entry_layout entry_layout = {
     sizeof(int)
 };
 
+/* Wide enough to make hashing and comparing a key cost something, as strings do. */
+#define WIDE_KEY 48
+
+typedef struct {
+    unsigned char key[WIDE_KEY];
+    int value;
+} wide_entry_t;
+
+static const persimm_entry_layout wide_layout = {
+    sizeof(wide_entry_t),
+    WIDE_KEY,
+    offsetof(wide_entry_t, value),
+    sizeof(int)
+};
+
 static volatile uint64_t sink = 0;
 
 static uint32_t int_hash(const void *key, size_t key_size, void *ctx) {
@@ -40,7 +91,15 @@ static bool int_equals(const void *a, const void *b, size_t key_size, void *ctx)
     return *(const int *)a == *(const int *)b;
 }
 
+#define CROWDING 8
+
+static uint32_t crowded_hash(const void *key, size_t key_size, void *ctx) {
+    int shared = *(const int *)key / CROWDING;
+    return int_hash(&shared, key_size, ctx);
+}
+
 static const persimm_key_ops int_key_ops = { int_hash, int_equals, NULL, NULL, NULL };
+static const persimm_key_ops crowded_key_ops = { crowded_hash, int_equals, NULL, NULL, NULL };
 
 static void check(persimm_status status, const char *operation) {
     if (PERSIMM_OK == status) return;
@@ -48,208 +107,669 @@ static void check(persimm_status status, const char *operation) {
     exit(1);
 }
 
-static double seconds_since(clock_t start) {
-    return (double)(clock() - start) / (double)CLOCKS_PER_SEC;
-}
-
-static void report(const char *name, size_t operations, double seconds) {
-    double ns = seconds * 1000000000.0 / (double)operations;
-    double rate = (double)operations / seconds / 1000000.0;
-    printf("%-30s %10zu ops  %9.2f ns/op  %8.2f Mops/s\n", name, operations, ns, rate);
+static void *allocate(size_t count, size_t size) {
+    void *memory = calloc(count, size);
+    if (NULL == memory) {
+        fprintf(stderr, "benchmark allocation failed\n");
+        exit(1);
+    }
+    return memory;
 }
 
-static size_t scaled(size_t base) {
-    const char *input = getenv("PERSIMMON_BENCH_SCALE");
-    if (NULL == input || '\0' == *input) return base;
+static size_t setting(const char *name, size_t fallback, unsigned long limit) {
+    const char *input = getenv(name);
+    if (NULL == input || '\0' == *input) return fallback;
 
     char *end = NULL;
-    unsigned long scale = strtoul(input, &end, 10);
-    if ('\0' != *end || 0 == scale || scale > 100) {
-        fprintf(stderr, "PERSIMMON_BENCH_SCALE must be an integer from 1 to 100\n");
-        exit(2);
-    }
-    if (base > SIZE_MAX / (size_t)scale) {
-        fprintf(stderr, "benchmark size overflow\n");
+    unsigned long value = strtoul(input, &end, 10);
+    if ('\0' != *end || 0 == value || value > limit) {
+        fprintf(stderr, "%s must be an integer from 1 to %lu\n", name, limit);
         exit(2);
     }
-    return base * (size_t)scale;
+    return (size_t)value;
 }
 
-static void benchmark_list(void) {
-    size_t count = scaled(500000);
-    persimm_list_t list;
-    check(persimm_list_init(&list, sizeof(int), NULL, NULL), "list init");
+/* Clock */
 
-    clock_t start = clock();
-    for (size_t i = 0; i < count; i++) {
-        persimm_list_t next;
-        int value = (int)i;
-        check(persimm_list_cons(&list, &value, &next), "list cons");
-        persimm_list_deinit(&list);
-        list = next;
+#if defined(_WIN32)
+static double now(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (0 == frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+#endif
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* The median of back-to-back reads, in nanoseconds. */
+static double clock_overhead(void) {
+    double samples[1001];
+    for (size_t i = 0; i < 1001; i++) {
+        double start = now();
+        samples[i] = (now() - start) * 1000000000.0;
     }
-    report("list cons", count, seconds_since(start));
+    qsort(samples, 1001, sizeof(double), compare_doubles);
+    return samples[500];
+}
 
+/* Fixtures */
+
+typedef struct {
+    size_t size;
+    size_t ops;
+    /* Indices below `size` in order and at random, and keys at or above it. */
+    int *sequential;
+    int *random;
+    int *missing;
+
+    persimm_vector_t vector;
+    persimm_list_t list;
+    persimm_map_t map;
+    persimm_set_t set;
+    /* Built for the medium size only. */
+    wide_entry_t *wide_keys;
+    persimm_map_t wide;
+    persimm_map_t crowded;
+    bool special;
+
+    /* What the build workloads grow, and the cursor list reads walk with. */
+    persimm_vector_transient_t vector_transient;
+    persimm_vector_t owned_vector;
+    persimm_map_transient_t map_transient;
+    persimm_map_t owned_map;
     persimm_list_cursor_t cursor;
-    persimm_list_cursor_reset(&cursor);
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        const int *value = (const int *)persimm_list_at_from(&list, &cursor, i);
-        if (NULL == value) {
-            fprintf(stderr, "list cursor returned NULL\n");
-            exit(1);
-        }
-        sink += (uint32_t)*value;
+} fixture_t;
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void wide_key(int key, wide_entry_t *entry) {
+    memset(entry, 0, sizeof(wide_entry_t));
+    snprintf((char *)entry->key, WIDE_KEY, "persimmon/benchmark/key/%d", key);
+    entry->value = key;
+}
+
+static void fixture_init(fixture_t *fixture, size_t size, size_t ops, bool special) {
+    memset(fixture, 0, sizeof(fixture_t));
+    fixture->size = size;
+    fixture->ops = ops;
+    fixture->special = special;
+
+    fixture->sequential = allocate(ops, sizeof(int));
+    fixture->random = allocate(ops, sizeof(int));
+    fixture->missing = allocate(ops, sizeof(int));
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    for (size_t i = 0; i < ops; i++) {
+        fixture->sequential[i] = (int)(i % size);
+        fixture->random[i] = (int)(next_random(&state) % size);
+        fixture->missing[i] = (int)(size + next_random(&state) % size);
     }
-    report("list cursor traversal", count, seconds_since(start));
 
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        persimm_list_t next;
-        check(persimm_list_rest(&list, &next), "list rest");
-        persimm_list_deinit(&list);
-        list = next;
+    int *elems = allocate(size, sizeof(int));
+    entry_t *entries = allocate(size, sizeof(entry_t));
+    for (size_t i = 0; i < size; i++) {
+        elems[i] = (int)i;
+        entries[i] = (entry_t){ (int)i, (int)i };
     }
-    report("list rest", count, seconds_since(start));
-    persimm_list_deinit(&list);
-}
 
-static void benchmark_vector(void) {
-    size_t count = scaled(500000);
-    persimm_vector_t vector;
     persimm_vector_transient_t transient;
     check(persimm_vector_transient_init(&transient, sizeof(int), NULL, NULL),
           "vector transient init");
+    for (size_t i = 0; i < size; i++) {
+        check(persimm_vector_transient_push(&transient, &elems[i]), "vector push");
+    }
+    check(persimm_vector_transient_persist(&transient, &fixture->vector), "vector persist");
 
-    clock_t start = clock();
-    for (size_t i = 0; i < count; i++) {
-        int value = (int)i;
-        check(persimm_vector_transient_push(&transient, &value), "transient vector push");
+    check(persimm_list_init(&fixture->list, sizeof(int), NULL, NULL), "list init");
+    for (size_t i = size; i > 0; i--) {
+        persimm_list_t next;
+        check(persimm_list_cons(&fixture->list, &elems[i - 1], &next), "list cons");
+        persimm_list_deinit(&fixture->list);
+        fixture->list = next;
     }
-    report("vector push (transient)", count, seconds_since(start));
-    check(persimm_vector_transient_persist(&transient, &vector), "persist vector transient");
 
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        const int *value = (const int *)persimm_vector_at(&vector, i);
-        if (NULL == value) {
-            fprintf(stderr, "vector at returned NULL\n");
-            exit(1);
-        }
-        sink += (uint32_t)*value;
+    check(persimm_map_from_entries(entries, size, &entry_layout, NULL, NULL, &int_key_ops, NULL,
+                                   &fixture->map),
+          "map build");
+    check(persimm_set_from_elems(elems, size, sizeof(int), &int_key_ops, NULL, &fixture->set),
+          "set build");
+
+    if (special) {
+        fixture->wide_keys = allocate(size, sizeof(wide_entry_t));
+        for (size_t i = 0; i < size; i++) wide_key((int)i, &fixture->wide_keys[i]);
+        check(persimm_map_from_entries(fixture->wide_keys, size, &wide_layout, NULL, NULL, NULL,
+                                       NULL, &fixture->wide),
+              "wide map build");
+        check(persimm_map_from_entries(entries, size, &entry_layout, NULL, NULL,
+                                       &crowded_key_ops, NULL, &fixture->crowded),
+              "crowded map build");
     }
-    report("vector sequential at", count, seconds_since(start));
-    persimm_vector_deinit(&vector);
 
-    count = scaled(150000);
-    check(persimm_vector_init(&vector, sizeof(int), NULL, NULL), "vector init");
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        persimm_vector_t next;
-        int value = (int)i;
-        check(persimm_vector_push(&vector, &value, &next), "persistent vector push");
-        persimm_vector_deinit(&vector);
-        vector = next;
+    free(entries);
+    free(elems);
+}
+
+static void fixture_deinit(fixture_t *fixture) {
+    persimm_vector_deinit(&fixture->vector);
+    persimm_list_deinit(&fixture->list);
+    persimm_map_deinit(&fixture->map);
+    persimm_set_deinit(&fixture->set);
+    if (fixture->special) {
+        persimm_map_deinit(&fixture->wide);
+        persimm_map_deinit(&fixture->crowded);
+        free(fixture->wide_keys);
     }
-    report("vector push (persistent)", count, seconds_since(start));
-    sink += vector.count;
-    persimm_vector_deinit(&vector);
+    free(fixture->missing);
+    free(fixture->random);
+    free(fixture->sequential);
+}
 
-    check(persimm_vector_transient_init(&transient, sizeof(int), NULL, NULL),
+/* Vector Workloads */
+
+static void vector_at_sequential(fixture_t *fixture, size_t i) {
+    sink += (uint32_t)*(const int *)persimm_vector_at(&fixture->vector,
+                                                      (size_t)fixture->sequential[i]);
+}
+
+static void vector_at_random(fixture_t *fixture, size_t i) {
+    sink += (uint32_t)*(const int *)persimm_vector_at(&fixture->vector,
+                                                      (size_t)fixture->random[i]);
+}
+
+static void vector_update(fixture_t *fixture, size_t i) {
+    persimm_vector_t next;
+    int value = -fixture->random[i];
+    check(persimm_vector_update(&fixture->vector, (size_t)fixture->random[i], &value, &next),
+          "vector update");
+    persimm_vector_deinit(&next);
+}
+
+static void vector_push(fixture_t *fixture, size_t i) {
+    persimm_vector_t next;
+    int value = (int)i;
+    check(persimm_vector_push(&fixture->vector, &value, &next), "vector push");
+    persimm_vector_deinit(&next);
+}
+
+static void vector_transient_begin(fixture_t *fixture) {
+    check(persimm_vector_transient_init(&fixture->vector_transient, sizeof(int), NULL, NULL),
           "vector transient init");
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        int value = (int)i;
-        check(persimm_vector_transient_push(&transient, &value), "transient vector push");
-    }
-    report("vector push (transient)", count, seconds_since(start));
-    check(persimm_vector_transient_persist(&transient, &vector), "persist vector transient");
-    sink += vector.count;
-    persimm_vector_deinit(&vector);
 }
 
-static void benchmark_map(void) {
-    size_t count = scaled(150000);
-    persimm_map_t map;
-    persimm_map_transient_t transient;
-    check(persimm_map_transient_init(&transient, &entry_layout, NULL, NULL, &int_key_ops, NULL),
+static void vector_transient_push(fixture_t *fixture, size_t i) {
+    int value = (int)i;
+    check(persimm_vector_transient_push(&fixture->vector_transient, &value), "vector push");
+}
+
+static void vector_transient_end(fixture_t *fixture) {
+    persimm_vector_transient_deinit(&fixture->vector_transient);
+}
+
+static void vector_owned_begin(fixture_t *fixture) {
+    check(persimm_vector_init(&fixture->owned_vector, sizeof(int), NULL, NULL), "vector init");
+}
+
+static void vector_owned_push(fixture_t *fixture, size_t i) {
+    int value = (int)i;
+    check(persimm_vector_push_owned(&fixture->owned_vector, &value), "vector push");
+}
+
+static void vector_owned_end(fixture_t *fixture) {
+    persimm_vector_deinit(&fixture->owned_vector);
+}
+
+/* List Workloads */
+
+static void list_cons(fixture_t *fixture, size_t i) {
+    persimm_list_t next;
+    int value = (int)i;
+    check(persimm_list_cons(&fixture->list, &value, &next), "list cons");
+    persimm_list_deinit(&next);
+}
+
+static void list_rest(fixture_t *fixture, size_t i) {
+    (void)i;
+    persimm_list_t next;
+    check(persimm_list_rest(&fixture->list, &next), "list rest");
+    persimm_list_deinit(&next);
+}
+
+static void list_cursor_begin(fixture_t *fixture) {
+    persimm_list_cursor_reset(&fixture->cursor);
+}
+
+static void list_at_cursor(fixture_t *fixture, size_t i) {
+    sink += (uint32_t)*(const int *)persimm_list_at_from(&fixture->list, &fixture->cursor,
+                                                         (size_t)fixture->sequential[i]);
+}
+
+/* Map Workloads */
+
+static void map_find(const persimm_map_t *map, const int *key) {
+    const int *value = persimm_map_find(map, key);
+    sink += NULL == value ? 1 : (uint32_t)*value;
+}
+
+static void map_find_sequential(fixture_t *fixture, size_t i) {
+    map_find(&fixture->map, &fixture->sequential[i]);
+}
+
+static void map_find_random(fixture_t *fixture, size_t i) {
+    map_find(&fixture->map, &fixture->random[i]);
+}
+
+static void map_find_missing(fixture_t *fixture, size_t i) {
+    map_find(&fixture->map, &fixture->missing[i]);
+}
+
+/* A handle taken per lookup, as a host passing maps to readers would. */
+static void map_find_cloned(fixture_t *fixture, size_t i) {
+    persimm_map_t held;
+    check(persimm_map_clone(&fixture->map, &held), "map clone");
+    map_find(&held, &fixture->random[i]);
+    persimm_map_deinit(&held);
+}
+
+static void map_find_borrowed(fixture_t *fixture, size_t i) {
+    persimm_map_view_t view;
+    persimm_map_borrow(&fixture->map, &view);
+    map_find(persimm_map_view(&view), &fixture->random[i]);
+}
+
+static void map_assoc_into(const persimm_map_t *map, const void *entry) {
+    persimm_map_t next;
+    check(persimm_map_assoc(map, entry, &next), "map assoc");
+    persimm_map_deinit(&next);
+}
+
+static void map_assoc_present(fixture_t *fixture, size_t i) {
+    entry_t entry = { fixture->random[i], -fixture->random[i] };
+    map_assoc_into(&fixture->map, &entry);
+}
+
+static void map_assoc_missing(fixture_t *fixture, size_t i) {
+    entry_t entry = { fixture->missing[i], 0 };
+    map_assoc_into(&fixture->map, &entry);
+}
+
+static void map_dissoc(fixture_t *fixture, size_t i) {
+    persimm_map_t next;
+    check(persimm_map_dissoc(&fixture->map, &fixture->random[i], &next), "map dissoc");
+    persimm_map_deinit(&next);
+}
+
+static void map_find_wide(fixture_t *fixture, size_t i) {
+    const wide_entry_t *key = &fixture->wide_keys[fixture->random[i]];
+    sink += (uint32_t)*(const int *)persimm_map_find(&fixture->wide, key);
+}
+
+static void map_assoc_wide(fixture_t *fixture, size_t i) {
+    wide_entry_t entry = fixture->wide_keys[fixture->random[i]];
+    entry.value = -entry.value;
+    map_assoc_into(&fixture->wide, &entry);
+}
+
+static void map_find_crowded(fixture_t *fixture, size_t i) {
+    map_find(&fixture->crowded, &fixture->random[i]);
+}
+
+static void map_find_crowded_missing(fixture_t *fixture, size_t i) {
+    map_find(&fixture->crowded, &fixture->missing[i]);
+}
+
+static void map_assoc_crowded(fixture_t *fixture, size_t i) {
+    entry_t entry = { fixture->random[i], -fixture->random[i] };
+    map_assoc_into(&fixture->crowded, &entry);
+}
+
+static void map_transient_begin(fixture_t *fixture) {
+    check(persimm_map_transient_init(&fixture->map_transient, &entry_layout, NULL, NULL,
+                                     &int_key_ops, NULL),
           "map transient init");
+}
 
-    clock_t start = clock();
-    for (size_t i = 0; i < count; i++) {
-        entry_t entry = { (int)i, (int)(i * 3) };
-        check(persimm_map_transient_assoc(&transient, &entry), "transient map assoc");
+static void map_transient_assoc(fixture_t *fixture, size_t i) {
+    entry_t entry = { (int)i, (int)i };
+    check(persimm_map_transient_assoc(&fixture->map_transient, &entry), "map assoc");
+}
+
+static void map_transient_end(fixture_t *fixture) {
+    persimm_map_transient_deinit(&fixture->map_transient);
+}
+
+static void map_owned_begin(fixture_t *fixture) {
+    check(persimm_map_init(&fixture->owned_map, &entry_layout, NULL, NULL, &int_key_ops, NULL),
+          "map init");
+}
+
+static void map_owned_assoc(fixture_t *fixture, size_t i) {
+    entry_t entry = { (int)i, (int)i };
+    check(persimm_map_assoc_owned(&fixture->owned_map, &entry), "map assoc");
+}
+
+static void map_owned_end(fixture_t *fixture) {
+    persimm_map_deinit(&fixture->owned_map);
+}
+
+/* Set Workloads */
+
+static void set_has_random(fixture_t *fixture, size_t i) {
+    sink += persimm_set_has(&fixture->set, &fixture->random[i]);
+}
+
+static void set_has_missing(fixture_t *fixture, size_t i) {
+    sink += persimm_set_has(&fixture->set, &fixture->missing[i]);
+}
+
+static void set_conj(fixture_t *fixture, size_t i) {
+    persimm_set_t next;
+    check(persimm_set_conj(&fixture->set, &fixture->missing[i], &next), "set conj");
+    persimm_set_deinit(&next);
+}
+
+static void set_disj(fixture_t *fixture, size_t i) {
+    persimm_set_t next;
+    check(persimm_set_disj(&fixture->set, &fixture->random[i], &next), "set disj");
+    persimm_set_deinit(&next);
+}
+
+/* Workloads */
+
+#define SIZE_SMALL 1u
+#define SIZE_MEDIUM 2u
+#define SIZE_HUGE 4u
+#define SIZE_EVERY (SIZE_SMALL | SIZE_MEDIUM | SIZE_HUGE)
+/* Grows its own collection from empty, and so runs once rather than per size. */
+#define SIZE_BUILD 8u
+
+typedef void (*phase_fn)(fixture_t *fixture);
+typedef void (*op_fn)(fixture_t *fixture, size_t i);
+
+typedef struct {
+    const char *name;
+    unsigned sizes;
+    phase_fn begin;
+    op_fn op;
+    phase_fn end;
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "vector at (sequential)", SIZE_EVERY, NULL, vector_at_sequential, NULL },
+    { "vector at (random)", SIZE_EVERY, NULL, vector_at_random, NULL },
+    { "vector update (persistent)", SIZE_EVERY, NULL, vector_update, NULL },
+    { "vector push (persistent)", SIZE_EVERY, NULL, vector_push, NULL },
+    { "vector push (transient)", SIZE_BUILD, vector_transient_begin, vector_transient_push,
+      vector_transient_end },
+    { "vector push (owned)", SIZE_BUILD, vector_owned_begin, vector_owned_push, vector_owned_end },
+    { "list cons (persistent)", SIZE_EVERY, NULL, list_cons, NULL },
+    { "list rest (persistent)", SIZE_EVERY, NULL, list_rest, NULL },
+    { "list at (cursor)", SIZE_EVERY, list_cursor_begin, list_at_cursor, NULL },
+    { "map find hit (sequential)", SIZE_EVERY, NULL, map_find_sequential, NULL },
+    { "map find hit (random)", SIZE_EVERY, NULL, map_find_random, NULL },
+    { "map find miss", SIZE_EVERY, NULL, map_find_missing, NULL },
+    { "map find (cloned handle)", SIZE_MEDIUM, NULL, map_find_cloned, NULL },
+    { "map find (borrowed view)", SIZE_MEDIUM, NULL, map_find_borrowed, NULL },
+    { "map assoc hit (persistent)", SIZE_EVERY, NULL, map_assoc_present, NULL },
+    { "map assoc miss (persistent)", SIZE_EVERY, NULL, map_assoc_missing, NULL },
+    { "map dissoc (persistent)", SIZE_EVERY, NULL, map_dissoc, NULL },
+    { "map find hit (wide keys)", SIZE_MEDIUM, NULL, map_find_wide, NULL },
+    { "map assoc hit (wide keys)", SIZE_MEDIUM, NULL, map_assoc_wide, NULL },
+    { "map find hit (collisions)", SIZE_MEDIUM, NULL, map_find_crowded, NULL },
+    { "map find miss (collisions)", SIZE_MEDIUM, NULL, map_find_crowded_missing, NULL },
+    { "map assoc hit (collisions)", SIZE_MEDIUM, NULL, map_assoc_crowded, NULL },
+    { "map assoc (transient)", SIZE_BUILD, map_transient_begin, map_transient_assoc,
+      map_transient_end },
+    { "map assoc (owned)", SIZE_BUILD, map_owned_begin, map_owned_assoc, map_owned_end },
+    { "set has hit (random)", SIZE_EVERY, NULL, set_has_random, NULL },
+    { "set has miss", SIZE_EVERY, NULL, set_has_missing, NULL },
+    { "set conj (persistent)", SIZE_EVERY, NULL, set_conj, NULL },
+    { "set disj (persistent)", SIZE_EVERY, NULL, set_disj, NULL }
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+/* Measuring */
+
+typedef struct {
+    const char *name;
+    size_t size;
+    double ns_per_op;
+    double p50;
+    double p99;
+    double p999;
+} result_t;
+
+typedef struct {
+    size_t ops;
+    size_t reps;
+    double overhead;
+    /* One sample per operation, reused by every workload's latency pass. */
+    double *samples;
+} config_t;
+
+static double pass(const workload_t *workload, fixture_t *fixture, size_t ops) {
+    if (NULL != workload->begin) workload->begin(fixture);
+    double start = now();
+    for (size_t i = 0; i < ops; i++) workload->op(fixture, i);
+    double seconds = now() - start;
+    if (NULL != workload->end) workload->end(fixture);
+    return seconds * 1000000000.0 / (double)ops;
+}
+
+/* The nearest-rank percentile, `permille` thousandths of the way up. */
+static double percentile(const double *sorted, size_t count, size_t permille) {
+    size_t rank = (count * permille + 999) / 1000;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static result_t measure(const workload_t *workload, fixture_t *fixture, size_t size,
+                        const config_t *config) {
+    size_t ops = config->ops;
+    pass(workload, fixture, ops);
+
+    double *times = allocate(config->reps, sizeof(double));
+    for (size_t rep = 0; rep < config->reps; rep++) times[rep] = pass(workload, fixture, ops);
+    qsort(times, config->reps, sizeof(double), compare_doubles);
+
+    if (NULL != workload->begin) workload->begin(fixture);
+    for (size_t i = 0; i < ops; i++) {
+        double start = now();
+        workload->op(fixture, i);
+        double ns = (now() - start) * 1000000000.0 - config->overhead;
+        config->samples[i] = ns > 0.0 ? ns : 0.0;
     }
-    report("map assoc (transient)", count, seconds_since(start));
-    check(persimm_map_transient_persist(&transient, &map), "persist map transient");
+    if (NULL != workload->end) workload->end(fixture);
+    qsort(config->samples, ops, sizeof(double), compare_doubles);
+
+    result_t result = {
+        workload->name,
+        size,
+        times[config->reps / 2],
+        percentile(config->samples, ops, 500),
+        percentile(config->samples, ops, 990),
+        percentile(config->samples, ops, 999)
+    };
+    free(times);
+    return result;
+}
+
+/* Reporting */
 
-    start = clock();
+static void print_text(const result_t *results, size_t count, const config_t *config) {
+    printf("Persimmon core benchmark\n");
+    printf("%zu ops per pass, median of %zu passes; clock overhead %.1f ns\n\n", config->ops,
+           config->reps, config->overhead);
+    printf("%-30s %8s %10s %10s %10s %10s\n", "workload", "size", "ns/op", "p50", "p99", "p999");
     for (size_t i = 0; i < count; i++) {
-        int key = (int)i;
-        const int *value = (const int *)persimm_map_find(&map, &key);
-        if (NULL == value) {
-            fprintf(stderr, "map find returned NULL\n");
-            exit(1);
-        }
-        sink += (uint32_t)*value;
+        const result_t *r = &results[i];
+        printf("%-30s %8zu %10.2f %10.1f %10.1f %10.1f\n", r->name, r->size, r->ns_per_op,
+               r->p50, r->p99, r->p999);
     }
-    report("map sequential find", count, seconds_since(start));
-    persimm_map_deinit(&map);
+}
 
-    count = scaled(75000);
-    check(persimm_map_init(&map, &entry_layout, NULL, NULL, &int_key_ops, NULL), "map init");
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        persimm_map_t next;
-        entry_t entry = { (int)i, (int)(i * 3) };
-        check(persimm_map_assoc(&map, &entry, &next), "persistent map assoc");
-        persimm_map_deinit(&map);
-        map = next;
+/*
+ * One result to a line, which is what lets a comparison read a saved run back
+ * without a JSON parser.
+ */
+static void write_json(const char *path, const result_t *results, size_t count,
+                       const config_t *config) {
+    FILE *file = fopen(path, "w");
+    if (NULL == file) {
+        fprintf(stderr, "cannot write %s\n", path);
+        exit(2);
     }
-    report("map assoc (persistent)", count, seconds_since(start));
 
-    start = clock();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"benchmark\": \"persimmon-core\",\n");
+    fprintf(file, "  \"ops_per_pass\": %zu,\n", config->ops);
+    fprintf(file, "  \"passes\": %zu,\n", config->reps);
+    fprintf(file, "  \"clock_overhead_ns\": %.2f,\n", config->overhead);
+    fprintf(file, "  \"results\": [\n");
     for (size_t i = 0; i < count; i++) {
-        persimm_map_t next;
-        int key = (int)i;
-        check(persimm_map_dissoc(&map, &key, &next), "persistent map dissoc");
-        persimm_map_deinit(&map);
-        map = next;
+        const result_t *r = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"size\": %zu, \"ns_per_op\": %.3f, "
+                "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f}%s\n",
+                r->name, r->size, r->ns_per_op, r->p50, r->p99, r->p999,
+                i + 1 < count ? "," : "");
     }
-    report("map dissoc (persistent)", count, seconds_since(start));
-    persimm_map_deinit(&map);
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
 
-    check(persimm_map_transient_init(&transient, &entry_layout, NULL, NULL, &int_key_ops, NULL),
-          "map transient init");
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        entry_t entry = { (int)i, (int)(i * 3) };
-        check(persimm_map_transient_assoc(&transient, &entry), "transient map assoc");
+/* Returns whether every workload in both runs stayed within the tolerance. */
+static bool compare(const char *path, const result_t *results, size_t count, double tolerance) {
+    FILE *file = fopen(path, "r");
+    if (NULL == file) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(2);
     }
-    report("map assoc (transient)", count, seconds_since(start));
-    check(persimm_map_transient_persist(&transient, &map), "persist map transient");
 
-    check(persimm_map_to_transient(&map, &transient), "make map transient");
-    persimm_map_deinit(&map);
-    start = clock();
-    for (size_t i = 0; i < count; i++) {
-        int key = (int)i;
-        check(persimm_map_transient_dissoc(&transient, &key), "transient map dissoc");
+    printf("%-30s %8s %10s %10s %8s\n", "workload", "size", "base", "now", "change");
+    bool steady = true;
+    size_t matched = 0;
+    char line[512];
+    while (NULL != fgets(line, sizeof(line), file)) {
+        char name[128];
+        size_t size;
+        double base;
+        if (3 != sscanf(line, " {\"name\": \"%127[^\"]\", \"size\": %zu, \"ns_per_op\": %lf",
+                        name, &size, &base)) {
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (0 != strcmp(name, results[i].name) || size != results[i].size) continue;
+            double change = 100.0 * (results[i].ns_per_op - base) / base;
+            bool slower = change > tolerance;
+            printf("%-30s %8zu %10.2f %10.2f %+7.1f%%%s\n", name, size, base,
+                   results[i].ns_per_op, change, slower ? "  slower" : "");
+            if (slower) steady = false;
+            matched++;
+        }
+    }
+    fclose(file);
+
+    if (0 == matched) {
+        fprintf(stderr, "%s holds no results this run can be compared with\n", path);
+        exit(2);
     }
-    report("map dissoc (transient)", count, seconds_since(start));
-    check(persimm_map_transient_persist(&transient, &map), "persist map transient");
-    persimm_map_deinit(&map);
+    printf("\n%zu workloads compared; %s\n", matched,
+           steady ? "none slower than the tolerance" : "some slower than the tolerance");
+    return steady;
 }
 
-int main(void) {
-    printf("Persimmon core benchmark\n");
-    printf("list handle: %zu bytes; cursor: %zu bytes\n\n",
-           sizeof(persimm_list_t), sizeof(persimm_list_cursor_t));
+/* Running */
+
+/* Build workloads need no fixture, and ride along with the first size's. */
+static bool selected(const workload_t *workload, size_t size_index, unsigned size_flag,
+                     const char *filter) {
+    bool fits = 0 != (workload->sizes & SIZE_BUILD) ? 0 == size_index
+                                                     : 0 != (workload->sizes & size_flag);
+    return fits && (NULL == filter || NULL != strstr(workload->name, filter));
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: persimmon-bench [--json FILE] [--compare FILE] [--tolerance PCT] "
+                    "[--filter TEXT]\n");
+    exit(2);
+}
 
-    benchmark_list();
-    benchmark_vector();
-    benchmark_map();
+int main(int argc, char **argv) {
+    const char *json = NULL;
+    const char *baseline = NULL;
+    const char *filter = NULL;
+    double tolerance = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--json") && i + 1 < argc) {
+            json = argv[++i];
+        } else if (0 == strcmp(argv[i], "--compare") && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (0 == strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (0 == strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            char *end = NULL;
+            tolerance = strtod(argv[++i], &end);
+            if ('\0' != *end || tolerance < 0.0) usage();
+        } else {
+            usage();
+        }
+    }
+
+    config_t config;
+    config.ops = 20000 * setting("PERSIMMON_BENCH_SCALE", 1, 100);
+    config.reps = setting("PERSIMMON_BENCH_REPS", 5, 99);
+    config.overhead = clock_overhead();
+    config.samples = allocate(config.ops, sizeof(double));
+
+    static const size_t sizes[] = { 100, 10000, 1000000 };
+    static const unsigned size_flags[] = { SIZE_SMALL, SIZE_MEDIUM, SIZE_HUGE };
+    result_t *results = allocate(WORKLOAD_COUNT * 4, sizeof(result_t));
+    size_t count = 0;
+
+    for (size_t s = 0; s < 3; s++) {
+        bool wanted = false;
+        for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+            wanted = wanted || selected(&workloads[w], s, size_flags[s], filter);
+        }
+        if (!wanted) continue;
+
+        fixture_t fixture;
+        fixture_init(&fixture, sizes[s], config.ops, SIZE_MEDIUM == size_flags[s]);
+        for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+            const workload_t *workload = &workloads[w];
+            if (!selected(workload, s, size_flags[s], filter)) continue;
+            size_t size = 0 != (workload->sizes & SIZE_BUILD) ? 0 : sizes[s];
+            results[count++] = measure(workload, &fixture, size, &config);
+        }
+        fixture_deinit(&fixture);
+    }
+
+    if (NULL != json) write_json(json, results, count, &config);
+    bool steady = true;
+    if (NULL != baseline) {
+        steady = compare(baseline, results, count, tolerance);
+    } else {
+        print_text(results, count, &config);
+    }
 
-    printf("\nchecksum: %" PRIu64 "\n", sink);
-    return 0;
+    free(results);
+    free(config.samples);
+    fprintf(stderr, "checksum: %" PRIu64 "\n", sink);
+    return steady ? 0 : 1;
 }
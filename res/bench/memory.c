@@ -0,0 +1,325 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "persimmon.h"
+
+/*
+ * A memory benchmark for the core. It is built with the core's own sources
+ * and PERSIMM_TEST_ALLOC defined, which routes every allocation the core
+ * makes through the counting allocator below, so what it reports is what the
+ * collections asked for rather than an estimate from their layouts.
+ *
+ * The first table fills each collection with elements of 4, 8, 16, 64 and 256
+ * bytes and reports the bytes and blocks requested per element, what those
+ * requests would cost under an allocator that adds an 8-byte header to each
+ * block and rounds it up to 16 bytes, as glibc's does on 64-bit targets, and
+ * how much of that is overhead beyond the element itself. A map's elements
+ * are its values, each stored beside a 4-byte key.
+ *
+ * The second keeps a chain of versions, each one persistent update away from
+ * the last, and reports the bytes each update added and how much of a new
+ * version was shared with the one before it. Updates replace a random
+ * element of a vector or map, add an element to a set and prepend to a list.
+ *
+ * PERSIMMON_BENCH_SCALE multiplies the number of elements and updates.
+ */
+
+/* Counting */
+
+typedef union {
+    size_t size;
+    /* Keeps what follows the header aligned for anything the core stores. */
+    long double align_float;
+    void *align_pointer;
+    long long align_integer;
+} header_t;
+
+static size_t live_bytes = 0;
+static size_t live_blocks = 0;
+static size_t heap_bytes = 0;
+
+/* What a block costs an allocator with an 8-byte header and 16-byte granules. */
+static size_t heap_cost(size_t bytes) {
+    size_t chunk = (bytes + 8 + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+void *persimm_test_calloc(size_t count, size_t size) {
+    if (0 != size && count > (SIZE_MAX - sizeof(header_t)) / size) return NULL;
+    size_t bytes = count * size;
+    header_t *header = calloc(1, sizeof(header_t) + bytes);
+    if (NULL == header) return NULL;
+    header->size = bytes;
+    live_bytes += bytes;
+    live_blocks++;
+    heap_bytes += heap_cost(bytes);
+    return header + 1;
+}
+
+void persimm_test_free(void *ptr) {
+    if (NULL == ptr) return;
+    header_t *header = (header_t *)ptr - 1;
+    live_bytes -= header->size;
+    live_blocks--;
+    heap_bytes -= heap_cost(header->size);
+    free(header);
+}
+
+typedef struct {
+    size_t bytes;
+    size_t blocks;
+    size_t heap;
+} usage_t;
+
+static usage_t usage(void) {
+    usage_t now = { live_bytes, live_blocks, heap_bytes };
+    return now;
+}
+
+/* Collections */
+
+typedef enum {
+    KIND_VECTOR,
+    KIND_LIST,
+    KIND_MAP,
+    KIND_SET
+} kind_t;
+
+static const char *const kind_names[] = { "vector", "list", "map", "set" };
+
+typedef union {
+    persimm_vector_t vector;
+    persimm_list_t list;
+    persimm_map_t map;
+    persimm_set_t set;
+} collection_t;
+
+static uint32_t int_hash(const void *key, size_t key_size, void *ctx) {
+    (void)key_size;
+    (void)ctx;
+    uint32_t hash = (uint32_t)*(const int *)key;
+    hash *= 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+static bool int_equals(const void *a, const void *b, size_t key_size, void *ctx) {
+    (void)key_size;
+    (void)ctx;
+    return *(const int *)a == *(const int *)b;
+}
+
+static const persimm_key_ops int_key_ops = { int_hash, int_equals, NULL, NULL, NULL };
+
+static void check(persimm_status status, const char *operation) {
+    if (PERSIMM_OK == status) return;
+    fprintf(stderr, "%s failed: %s\n", operation, persimm_status_string(status));
+    exit(1);
+}
+
+static size_t scaled(size_t base) {
+    const char *input = getenv("PERSIMMON_BENCH_SCALE");
+    if (NULL == input || '\0' == *input) return base;
+
+    char *end = NULL;
+    unsigned long scale = strtoul(input, &end, 10);
+    if ('\0' != *end || 0 == scale || scale > 100) {
+        fprintf(stderr, "PERSIMMON_BENCH_SCALE must be an integer from 1 to 100\n");
+        exit(2);
+    }
+    return base * (size_t)scale;
+}
+
+/*
+ * An element of `size` bytes holding `number` in its first four, so that it
+ * makes a distinct key. A map entry puts `number` in its key and the element
+ * after it.
+ */
+static void fill(unsigned char *elem, size_t size, int number) {
+    memset(elem, 0, size);
+    memcpy(elem, &number, sizeof(int));
+}
+
+static persimm_entry_layout map_layout(size_t size) {
+    persimm_entry_layout layout = { sizeof(int) + size, sizeof(int), sizeof(int), size };
+    return layout;
+}
+
+/* The bytes of its own each element carries. */
+static size_t payload(kind_t kind, size_t size) {
+    return KIND_MAP == kind ? sizeof(int) + size : size;
+}
+
+static void build(kind_t kind, size_t size, size_t count, unsigned char *scratch,
+                  collection_t *dest) {
+    switch (kind) {
+        case KIND_VECTOR: {
+            persimm_vector_transient_t transient;
+            check(persimm_vector_transient_init(&transient, size, NULL, NULL), "vector init");
+            for (size_t i = 0; i < count; i++) {
+                fill(scratch, size, (int)i);
+                check(persimm_vector_transient_push(&transient, scratch), "vector push");
+            }
+            check(persimm_vector_transient_persist(&transient, &dest->vector), "vector persist");
+            break;
+        }
+        case KIND_LIST:
+            check(persimm_list_init(&dest->list, size, NULL, NULL), "list init");
+            for (size_t i = 0; i < count; i++) {
+                fill(scratch, size, (int)i);
+                check(persimm_list_cons_owned(&dest->list, scratch), "list cons");
+            }
+            break;
+        case KIND_MAP: {
+            persimm_entry_layout layout = map_layout(size);
+            persimm_map_transient_t transient;
+            check(persimm_map_transient_init(&transient, &layout, NULL, NULL, &int_key_ops, NULL),
+                  "map init");
+            for (size_t i = 0; i < count; i++) {
+                fill(scratch, layout.entry_size, (int)i);
+                check(persimm_map_transient_assoc(&transient, scratch), "map assoc");
+            }
+            check(persimm_map_transient_persist(&transient, &dest->map), "map persist");
+            break;
+        }
+        case KIND_SET: {
+            persimm_set_transient_t transient;
+            check(persimm_set_transient_init(&transient, size, NULL, NULL), "set init");
+            for (size_t i = 0; i < count; i++) {
+                fill(scratch, size, (int)i);
+                check(persimm_set_transient_conj(&transient, scratch), "set conj");
+            }
+            check(persimm_set_transient_persist(&transient, &dest->set), "set persist");
+            break;
+        }
+    }
+}
+
+static void deinit(kind_t kind, collection_t *collection) {
+    switch (kind) {
+        case KIND_VECTOR: persimm_vector_deinit(&collection->vector); break;
+        case KIND_LIST: persimm_list_deinit(&collection->list); break;
+        case KIND_MAP: persimm_map_deinit(&collection->map); break;
+        case KIND_SET: persimm_set_deinit(&collection->set); break;
+    }
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* One persistent update of `src`, as the second table describes. */
+static void update(kind_t kind, const collection_t *src, size_t size, size_t count,
+                   int number, uint64_t *state, unsigned char *scratch, collection_t *dest) {
+    int target = (int)(next_random(state) % count);
+    switch (kind) {
+        case KIND_VECTOR:
+            fill(scratch, size, number);
+            check(persimm_vector_update(&src->vector, (size_t)target, scratch, &dest->vector),
+                  "vector update");
+            break;
+        case KIND_LIST:
+            fill(scratch, size, number);
+            check(persimm_list_cons(&src->list, scratch, &dest->list), "list cons");
+            break;
+        case KIND_MAP:
+            fill(scratch, sizeof(int) + size, target);
+            memcpy(scratch + sizeof(int), &number, sizeof(int));
+            check(persimm_map_assoc(&src->map, scratch, &dest->map), "map assoc");
+            break;
+        case KIND_SET:
+            fill(scratch, size, number);
+            check(persimm_set_conj(&src->set, scratch, &dest->set), "set conj");
+            break;
+    }
+}
+
+static void check_released(const char *what) {
+    if (0 == live_bytes && 0 == live_blocks) return;
+    fprintf(stderr, "%s: %zu bytes in %zu blocks outlived their collections\n", what,
+            live_bytes, live_blocks);
+    exit(1);
+}
+
+/* Reporting */
+
+static void report_footprint(kind_t kind, size_t size, size_t count, unsigned char *scratch) {
+    collection_t collection;
+    usage_t before = usage();
+    build(kind, size, count, scratch, &collection);
+    usage_t after = usage();
+
+    double bytes = (double)(after.bytes - before.bytes) / (double)count;
+    double blocks = (double)(after.blocks - before.blocks) / (double)count;
+    double heap = (double)(after.heap - before.heap) / (double)count;
+    printf("%-8s %6zu %12.2f %12.4f %12.2f %12.2f\n", kind_names[kind], size, bytes, blocks,
+           heap, heap - (double)payload(kind, size));
+
+    deinit(kind, &collection);
+    check_released(kind_names[kind]);
+}
+
+static void report_chain(kind_t kind, size_t size, size_t count, size_t updates,
+                         unsigned char *scratch) {
+    collection_t *versions = calloc(updates + 1, sizeof(collection_t));
+    if (NULL == versions) {
+        fprintf(stderr, "could not allocate the version chain\n");
+        exit(1);
+    }
+
+    usage_t before = usage();
+    build(kind, size, count, scratch, &versions[0]);
+    usage_t base = usage();
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    for (size_t i = 0; i < updates; i++) {
+        update(kind, &versions[i], size, count, -(int)i - 1, &state, scratch, &versions[i + 1]);
+    }
+    usage_t after = usage();
+
+    double version = (double)(base.heap - before.heap);
+    double added = (double)(after.heap - base.heap) / (double)updates;
+    printf("%-8s %6zu %14.2f %14.2f %9.3f%%\n", kind_names[kind], size,
+           (double)(after.bytes - base.bytes) / (double)updates, added,
+           100.0 * (1.0 - added / version));
+
+    for (size_t i = 0; i <= updates; i++) deinit(kind, &versions[i]);
+    free(versions);
+    check_released(kind_names[kind]);
+}
+
+int main(void) {
+    static const size_t sizes[] = { 4, 8, 16, 64, 256 };
+    const size_t size_count = sizeof(sizes) / sizeof(sizes[0]);
+    const size_t count = scaled(100000);
+    const size_t updates = scaled(1000);
+
+    unsigned char *scratch = calloc(1, sizeof(int) + sizes[size_count - 1]);
+    if (NULL == scratch) {
+        fprintf(stderr, "could not allocate an element\n");
+        return 1;
+    }
+
+    printf("Persimmon memory benchmark\n");
+    printf("%zu elements per collection\n\n", count);
+    printf("%-8s %6s %12s %12s %12s %12s\n", "", "elem", "bytes/elem", "blocks/elem",
+           "heap/elem", "overhead");
+    for (int kind = KIND_VECTOR; kind <= KIND_SET; kind++) {
+        for (size_t i = 0; i < size_count; i++) {
+            report_footprint((kind_t)kind, sizes[i], count, scratch);
+        }
+    }
+
+    printf("\n%zu persistent updates on a chain of versions\n\n", updates);
+    printf("%-8s %6s %14s %14s %10s\n", "", "elem", "bytes/update", "heap/update", "shared");
+    for (int kind = KIND_VECTOR; kind <= KIND_SET; kind++) {
+        for (size_t i = 0; i < size_count; i++) {
+            report_chain((kind_t)kind, sizes[i], count, updates, scratch);
+        }
+    }
+
+    free(scratch);
+    return 0;
+}
@@ -0,0 +1,690 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "persimmon.h"
+
+/*
+ * A read-scaling benchmark for collections shared between threads. Every
+ * thread looks up keys in one map, first by cloning the map around each
+ * lookup, then by acquiring a snapshot shard of its own and last by cloning
+ * a frozen copy. The plain clones all count on the same root node, so their
+ * cost shows how much that contention costs as threads are added; the
+ * snapshot and frozen rows should stay roughly flat. The atom rows mix loads
+ * from a shared atom with an occasional swap that bumps a counter entry, and
+ * check that no swap was lost; the epoch rows do the same but read the atom
+ * in place from an epoch section. The concurrent rows do the same against a
+ * concurrent map, where each thread bumps a counter of its own and so swaps a
+ * slot the other threads mostly leave alone.
+ *
+ * The published rows run from one thread up to one per core, while a writer
+ * thread of their own publishes new versions of a map and a vector as fast as
+ * it can. Each reader loads the current version, which clones it, reads one
+ * element and lets it go, so every load increments and decrements the count
+ * on a root the other readers are counting on too. The same readers then read
+ * in place from an epoch section, touching no count at all, and the gap
+ * between the two at each thread count is reported as the cost of the
+ * reference counts. Scaling is throughput relative to one reader.
+ *
+ * The last rows time a parallel reduction over a long vector, a parallel
+ * build of a large map and an ingest into a sharded transient, each slot's
+ * entries stored by a task of its own. All go through an executor that starts
+ * a thread per share of the tasks on every call. A host would lend a pool it
+ * already has; this is the simplest executor that is still parallel.
+ *
+ * Unlike core.c this needs POSIX threads and a monotonic clock. `make
+ * bench-threads` builds it against the core library with -pthread and runs
+ * it. `--threads N` stops every table at N threads rather than 16.
+ *
+ * Run it on an otherwise idle machine with at least as many cores as the
+ * largest thread count it reports.
+ */
+
+#define MAX_THREADS 16
+
+/* The largest thread count any table reaches, which --threads can lower. */
+static size_t max_threads = MAX_THREADS;
+
+typedef struct {
+    int key;
+    int value;
+} entry_t;
+
+static const persimm_entry_layout entry_layout = {
+    sizeof(entry_t),
+    sizeof(int),
+    offsetof(entry_t, value),
+    sizeof(int)
+};
+
+static uint32_t int_hash(const void *key, size_t key_size, void *ctx) {
+    (void)key_size;
+    (void)ctx;
+    uint32_t hash = (uint32_t)*(const int *)key;
+    hash *= 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+static bool int_equals(const void *a, const void *b, size_t key_size, void *ctx) {
+    (void)key_size;
+    (void)ctx;
+    return *(const int *)a == *(const int *)b;
+}
+
+static const persimm_key_ops int_key_ops = { int_hash, int_equals, NULL, NULL, NULL };
+
+typedef struct {
+    const persimm_map_t *map;
+    persimm_snapshot_t *snapshot;
+    persimm_map_atom_t *atom;
+    persimm_epoch_domain_t *domain;
+    persimm_concurrent_map_t *shared;
+    size_t shard;
+    size_t lookups;
+    int keys;
+    uint64_t found;
+} worker_t;
+
+static void check(persimm_status status, const char *operation) {
+    if (PERSIMM_OK == status) return;
+    fprintf(stderr, "%s failed: %s\n", operation, persimm_status_string(status));
+    exit(1);
+}
+
+static void build(persimm_map_t *map, int keys) {
+    check(persimm_map_init(map, &entry_layout, NULL, NULL, &int_key_ops, NULL), "map init");
+    for (int i = 0; i < keys; i++) {
+        entry_t entry = { i, i };
+        check(persimm_map_assoc_owned(map, &entry), "map assoc");
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static void *read_by_clone(void *arg) {
+    worker_t *worker = arg;
+    for (size_t i = 0; i < worker->lookups; i++) {
+        persimm_map_t held;
+        persimm_map_clone(worker->map, &held);
+        int key = (int)(i % (size_t)worker->keys);
+        if (NULL != persimm_map_find(&held, &key)) worker->found++;
+        persimm_map_deinit(&held);
+    }
+    return NULL;
+}
+
+static void *read_by_snapshot(void *arg) {
+    worker_t *worker = arg;
+    for (size_t i = 0; i < worker->lookups; i++) {
+        if (!persimm_snapshot_acquire(worker->snapshot, worker->shard)) abort();
+        int key = (int)(i % (size_t)worker->keys);
+        if (NULL != persimm_map_find(persimm_snapshot_map(worker->snapshot), &key)) {
+            worker->found++;
+        }
+        persimm_snapshot_release(worker->snapshot, worker->shard);
+    }
+    return NULL;
+}
+
+/* Keyed below every real key, so lookups never land on it. */
+#define SWAP_COUNTER -1
+#define SWAP_EVERY 64
+
+static persimm_status bump(const persimm_map_t *current, void *ctx, persimm_map_t *next) {
+    (void)ctx;
+    int key = SWAP_COUNTER;
+    const int *count = persimm_map_find(current, &key);
+    entry_t entry = { SWAP_COUNTER, NULL == count ? 1 : *count + 1 };
+    return persimm_map_assoc(current, &entry, next);
+}
+
+static void *read_by_atom(void *arg) {
+    worker_t *worker = arg;
+    for (size_t i = 0; i < worker->lookups; i++) {
+        if (0 == i % SWAP_EVERY) {
+            check(persimm_map_atom_swap(worker->atom, bump, NULL, NULL), "atom swap");
+        }
+        persimm_map_t held;
+        persimm_map_atom_load(worker->atom, &held);
+        int key = (int)(i % (size_t)worker->keys);
+        if (NULL != persimm_map_find(&held, &key)) worker->found++;
+        persimm_map_deinit(&held);
+    }
+    return NULL;
+}
+
+static void *read_by_epoch(void *arg) {
+    worker_t *worker = arg;
+    for (size_t i = 0; i < worker->lookups; i++) {
+        if (0 == i % SWAP_EVERY) {
+            check(persimm_map_atom_swap(worker->atom, bump, NULL, NULL), "atom swap");
+        }
+        persimm_epoch_enter(worker->domain, worker->shard);
+        int key = (int)(i % (size_t)worker->keys);
+        if (NULL != persimm_map_find(persimm_map_atom_read(worker->atom), &key)) worker->found++;
+        persimm_epoch_exit(worker->domain, worker->shard);
+    }
+    return NULL;
+}
+
+static void *read_by_concurrent(void *arg) {
+    worker_t *worker = arg;
+    entry_t entry;
+    for (size_t i = 0; i < worker->lookups; i++) {
+        if (0 == i % SWAP_EVERY) {
+            entry = (entry_t){ SWAP_COUNTER - (int)worker->shard, (int)(i / SWAP_EVERY) + 1 };
+            check(persimm_concurrent_map_assoc(worker->shared, &entry, NULL), "concurrent assoc");
+        }
+        int key = (int)(i % (size_t)worker->keys);
+        if (persimm_concurrent_map_get(worker->shared, &key, &entry)) worker->found++;
+    }
+    return NULL;
+}
+
+static void check_concurrent(persimm_concurrent_map_t *shared, size_t threads, size_t lookups) {
+    persimm_map_t last;
+    check(persimm_concurrent_map_snapshot(shared, &last), "concurrent snapshot");
+    for (size_t t = 0; t < threads; t++) {
+        int key = SWAP_COUNTER - (int)t;
+        const int *count = persimm_map_find(&last, &key);
+        if (NULL == count || (int)((lookups + SWAP_EVERY - 1) / SWAP_EVERY) != *count) {
+            fprintf(stderr, "concurrent map: swaps were lost\n");
+            exit(1);
+        }
+    }
+    persimm_map_deinit(&last);
+}
+
+/* Published */
+
+typedef struct {
+    persimm_map_atom_t *map;
+    persimm_vector_atom_t *vector;
+    persimm_epoch_domain_t *domain;
+    pthread_mutex_t lock;
+    bool stopped;
+    uint64_t publishes;
+} publisher_t;
+
+typedef struct {
+    publisher_t *publisher;
+    size_t shard;
+    size_t lookups;
+    int keys;
+    uint64_t found;
+} reader_t;
+
+/* The vector's first element counts its versions, as the map's counter entry does. */
+static persimm_status bump_first(const persimm_vector_t *current, void *ctx,
+                                 persimm_vector_t *next) {
+    (void)ctx;
+    int count = *(const int *)persimm_vector_at(current, 0) + 1;
+    return persimm_vector_update(current, 0, &count, next);
+}
+
+static bool publishing(publisher_t *publisher) {
+    pthread_mutex_lock(&publisher->lock);
+    bool stopped = publisher->stopped;
+    pthread_mutex_unlock(&publisher->lock);
+    return !stopped;
+}
+
+static void *publish(void *arg) {
+    publisher_t *publisher = arg;
+    while (publishing(publisher)) {
+        check(persimm_map_atom_swap(publisher->map, bump, NULL, NULL), "map atom swap");
+        check(persimm_vector_atom_swap(publisher->vector, bump_first, NULL, NULL),
+              "vector atom swap");
+        publisher->publishes += 2;
+    }
+    return NULL;
+}
+
+static void *find_published(void *arg) {
+    reader_t *reader = arg;
+    for (size_t i = 0; i < reader->lookups; i++) {
+        persimm_map_t held;
+        persimm_map_atom_load(reader->publisher->map, &held);
+        int key = (int)(i % (size_t)reader->keys);
+        if (NULL != persimm_map_find(&held, &key)) reader->found++;
+        persimm_map_deinit(&held);
+    }
+    return NULL;
+}
+
+static void *find_published_in_place(void *arg) {
+    reader_t *reader = arg;
+    publisher_t *publisher = reader->publisher;
+    for (size_t i = 0; i < reader->lookups; i++) {
+        persimm_epoch_enter(publisher->domain, reader->shard);
+        int key = (int)(i % (size_t)reader->keys);
+        if (NULL != persimm_map_find(persimm_map_atom_read(publisher->map), &key)) {
+            reader->found++;
+        }
+        persimm_epoch_exit(publisher->domain, reader->shard);
+    }
+    return NULL;
+}
+
+static void *at_published(void *arg) {
+    reader_t *reader = arg;
+    for (size_t i = 0; i < reader->lookups; i++) {
+        persimm_vector_t held;
+        persimm_vector_atom_load(reader->publisher->vector, &held);
+        if (NULL != persimm_vector_at(&held, i % (size_t)reader->keys)) reader->found++;
+        persimm_vector_deinit(&held);
+    }
+    return NULL;
+}
+
+static void *at_published_in_place(void *arg) {
+    reader_t *reader = arg;
+    publisher_t *publisher = reader->publisher;
+    for (size_t i = 0; i < reader->lookups; i++) {
+        persimm_epoch_enter(publisher->domain, reader->shard);
+        const persimm_vector_t *vector = persimm_vector_atom_read(publisher->vector);
+        if (NULL != persimm_vector_at(vector, i % (size_t)reader->keys)) reader->found++;
+        persimm_epoch_exit(publisher->domain, reader->shard);
+    }
+    return NULL;
+}
+
+/*
+ * Prints a row and returns its time per operation. `single` holds the
+ * throughput of the row's one-reader run, which the first run records.
+ */
+static double run_published(const char *name, void *(*body)(void *), publisher_t *publisher,
+                            size_t threads, size_t lookups, int keys, double *single) {
+    pthread_t writer;
+    pthread_t ids[MAX_THREADS];
+    reader_t readers[MAX_THREADS];
+    for (size_t t = 0; t < threads; t++) readers[t] = (reader_t){ publisher, t, lookups, keys, 0 };
+
+    publisher->stopped = false;
+    publisher->publishes = 0;
+    if (0 != pthread_create(&writer, NULL, publish, publisher)) {
+        fprintf(stderr, "could not start the writer\n");
+        exit(1);
+    }
+
+    double start = now();
+    for (size_t t = 0; t < threads; t++) {
+        if (0 != pthread_create(&ids[t], NULL, body, &readers[t])) {
+            fprintf(stderr, "could not start thread %zu\n", t);
+            exit(1);
+        }
+    }
+    uint64_t found = 0;
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        found += readers[t].found;
+    }
+    double seconds = now() - start;
+
+    pthread_mutex_lock(&publisher->lock);
+    publisher->stopped = true;
+    pthread_mutex_unlock(&publisher->lock);
+    pthread_join(writer, NULL);
+
+    size_t operations = threads * lookups;
+    if (found != (uint64_t)operations) {
+        fprintf(stderr, "%s: %" PRIu64 " of %zu reads found\n", name, found, operations);
+        exit(1);
+    }
+    double rate = (double)operations / seconds;
+    if (1 == threads) *single = rate;
+    double ns = seconds * 1000000000.0 / (double)lookups;
+    printf("%-24s %2zu threads  %9.2f ns/op  %8.2f Mops/s  %5.2fx  %8.0f publishes/s\n", name,
+           threads, ns, rate / 1000000.0, rate / *single, (double)publisher->publishes / seconds);
+    return ns;
+}
+
+/* Every power of two up to the core count, and the core count itself. */
+static size_t next_threads(size_t threads, size_t cores) {
+    if (threads >= cores) return 0;
+    return threads * 2 < cores ? threads * 2 : cores;
+}
+
+static size_t core_count(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) return 1;
+    return (size_t)online < max_threads ? (size_t)online : max_threads;
+}
+
+static void run_contention(const persimm_map_t *map, int keys, size_t lookups) {
+    size_t cores = core_count();
+    persimm_vector_t vector;
+    check(persimm_vector_init(&vector, sizeof(int), NULL, NULL), "vector init");
+    for (int i = 0; i < keys; i++) check(persimm_vector_push_owned(&vector, &i), "vector push");
+
+    publisher_t publisher;
+    check(persimm_epoch_domain_new(cores, &publisher.domain), "epoch domain");
+    check(persimm_map_atom_new(map, publisher.domain, &publisher.map), "map atom");
+    check(persimm_vector_atom_new(&vector, publisher.domain, &publisher.vector), "vector atom");
+    persimm_vector_deinit(&vector);
+    if (0 != pthread_mutex_init(&publisher.lock, NULL)) {
+        fprintf(stderr, "could not create the writer's lock\n");
+        exit(1);
+    }
+
+    double singles[4];
+    for (size_t threads = 1; 0 != threads; threads = next_threads(threads, cores)) {
+        double cloned = run_published("map find (published)", find_published, &publisher,
+                                      threads, lookups, keys, &singles[0]);
+        double in_place = run_published("map find (in place)", find_published_in_place,
+                                        &publisher, threads, lookups, keys, &singles[1]);
+        printf("%-24s %2zu threads  %9.2f ns/op\n", "map refcount cost", threads,
+               cloned - in_place);
+
+        cloned = run_published("vector at (published)", at_published, &publisher, threads,
+                               lookups, keys, &singles[2]);
+        in_place = run_published("vector at (in place)", at_published_in_place, &publisher,
+                                 threads, lookups, keys, &singles[3]);
+        printf("%-24s %2zu threads  %9.2f ns/op\n", "vector refcount cost", threads,
+               cloned - in_place);
+    }
+
+    pthread_mutex_destroy(&publisher.lock);
+    persimm_vector_atom_free(publisher.vector);
+    persimm_map_atom_free(publisher.map);
+    persimm_epoch_domain_free(publisher.domain);
+}
+
+/* Deals the tasks out round-robin to `threads` threads started for this call alone. */
+typedef struct {
+    size_t threads;
+} executor_t;
+
+typedef struct {
+    persimm_task_fn fn;
+    void *arg;
+    size_t tasks;
+    size_t first;
+    size_t stride;
+} share_t;
+
+static void *run_share(void *arg) {
+    share_t *share = arg;
+    for (size_t i = share->first; i < share->tasks; i += share->stride) share->fn(share->arg, i);
+    return NULL;
+}
+
+static void executor_run(void *ctx, size_t tasks, persimm_task_fn fn, void *arg) {
+    executor_t *executor = ctx;
+    pthread_t ids[MAX_THREADS];
+    share_t shares[MAX_THREADS];
+    size_t threads = executor->threads < tasks ? executor->threads : tasks;
+    if (0 == threads) return;
+    for (size_t t = 0; t < threads; t++) {
+        shares[t] = (share_t){ fn, arg, tasks, t, threads };
+        if (t > 0 && 0 != pthread_create(&ids[t], NULL, run_share, &shares[t])) {
+            fprintf(stderr, "could not start thread %zu\n", t);
+            exit(1);
+        }
+    }
+    run_share(&shares[0]);
+    for (size_t t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+}
+
+static void sum_fold(void *acc, const void *slot, size_t position, void *ctx) {
+    (void)position;
+    (void)ctx;
+    *(uint64_t *)acc += (uint64_t)*(const int *)slot;
+}
+
+static void sum_combine(void *acc, const void *other, void *ctx) {
+    (void)ctx;
+    *(uint64_t *)acc += *(const uint64_t *)other;
+}
+
+static void run_reduce(const persimm_vector_t *vector, size_t threads, size_t passes) {
+    executor_t pool = { threads };
+    persimm_executor executor = { executor_run, &pool };
+    const uint64_t zero = 0;
+    uint64_t expected = (uint64_t)vector->count * (vector->count - 1) / 2;
+
+    double start = now();
+    for (size_t pass = 0; pass < passes; pass++) {
+        uint64_t sum;
+        check(persimm_vector_parallel_reduce(vector, sum_fold, sum_combine, &zero,
+                                             sizeof(uint64_t), NULL, &executor, &sum),
+              "vector reduce");
+        if (sum != expected) {
+            fprintf(stderr, "vector reduce: the sum is wrong\n");
+            exit(1);
+        }
+    }
+    double seconds = now() - start;
+
+    double elements = (double)vector->count * (double)passes;
+    printf("%-24s %2zu threads  %9.2f ns/op  %8.2f Mops/s\n", "vector reduce (parallel)",
+           threads, seconds * 1000000000.0 / elements * (double)threads,
+           elements / seconds / 1000000.0);
+}
+
+static void run_build(const entry_t *entries, size_t count, size_t threads) {
+    executor_t pool = { threads };
+    persimm_executor executor = { executor_run, &pool };
+
+    double start = now();
+    persimm_map_t built;
+    check(persimm_map_parallel_from_entries(entries, count, &entry_layout, NULL, NULL,
+                                            &int_key_ops, NULL, &executor, &built),
+          "map build");
+    double seconds = now() - start;
+    if (built.count != count) {
+        fprintf(stderr, "map build: %zu of %zu entries built\n", built.count, count);
+        exit(1);
+    }
+    persimm_map_deinit(&built);
+
+    printf("%-24s %2zu threads  %9.2f ns/op  %8.2f Mops/s\n", "map build (parallel)", threads,
+           seconds * 1000000000.0 / (double)count * (double)threads,
+           (double)count / seconds / 1000000.0);
+}
+
+/* The entries sorted by slot, with `starts[i]` the first in slot `i`. */
+typedef struct {
+    persimm_map_sharded_transient_t *transient;
+    const entry_t *entries;
+    size_t starts[PERSIMM_SPLIT_WAYS + 1];
+} ingest_t;
+
+static void ingest_slot(void *arg, size_t index) {
+    ingest_t *ingest = arg;
+    for (size_t i = ingest->starts[index]; i < ingest->starts[index + 1]; i++) {
+        check(persimm_map_sharded_transient_assoc(ingest->transient, &ingest->entries[i]),
+              "sharded assoc");
+    }
+}
+
+static void run_ingest(ingest_t *ingest, size_t threads) {
+    executor_t pool = { threads };
+    persimm_executor executor = { executor_run, &pool };
+    size_t count = ingest->starts[PERSIMM_SPLIT_WAYS];
+
+    double start = now();
+    persimm_map_sharded_transient_t transient;
+    check(persimm_map_sharded_transient_init(&transient, &entry_layout, NULL, NULL,
+                                             &int_key_ops, NULL),
+          "sharded init");
+    ingest->transient = &transient;
+    executor.run(executor.ctx, PERSIMM_SPLIT_WAYS, ingest_slot, ingest);
+    persimm_map_t built;
+    check(persimm_map_sharded_transient_persist(&transient, &built), "sharded persist");
+    double seconds = now() - start;
+    if (built.count != count) {
+        fprintf(stderr, "map ingest: %zu of %zu entries stored\n", built.count, count);
+        exit(1);
+    }
+    persimm_map_deinit(&built);
+
+    printf("%-24s %2zu threads  %9.2f ns/op  %8.2f Mops/s\n", "map ingest (sharded)", threads,
+           seconds * 1000000000.0 / (double)count * (double)threads,
+           (double)count / seconds / 1000000.0);
+}
+
+static void check_swaps(persimm_map_atom_t *atom, size_t threads, size_t lookups) {
+    persimm_map_t last;
+    persimm_map_atom_load(atom, &last);
+    int key = SWAP_COUNTER;
+    size_t swaps = threads * ((lookups + SWAP_EVERY - 1) / SWAP_EVERY);
+    if ((int)swaps != *(const int *)persimm_map_find(&last, &key)) {
+        fprintf(stderr, "map atom: swaps were lost\n");
+        exit(1);
+    }
+    persimm_map_deinit(&last);
+}
+
+static void run(const char *name, void *(*body)(void *), const persimm_map_t *map,
+                persimm_snapshot_t *snapshot, persimm_map_atom_t *atom,
+                persimm_epoch_domain_t *domain, persimm_concurrent_map_t *shared, size_t threads,
+                size_t lookups, int keys) {
+    pthread_t ids[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    for (size_t t = 0; t < threads; t++) {
+        workers[t] = (worker_t){ map, snapshot, atom, domain, shared, t, lookups, keys, 0 };
+    }
+
+    double start = now();
+    for (size_t t = 0; t < threads; t++) {
+        if (0 != pthread_create(&ids[t], NULL, body, &workers[t])) {
+            fprintf(stderr, "could not start thread %zu\n", t);
+            exit(1);
+        }
+    }
+    uint64_t found = 0;
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        found += workers[t].found;
+    }
+    double seconds = now() - start;
+
+    size_t operations = threads * lookups;
+    if (found != (uint64_t)operations) {
+        fprintf(stderr, "%s: %" PRIu64 " of %zu lookups found\n", name, found, operations);
+        exit(1);
+    }
+    printf("%-24s %2zu threads  %9.2f ns/op  %8.2f Mops/s\n", name, threads,
+           seconds * 1000000000.0 / (double)lookups,
+           (double)operations / seconds / 1000000.0);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: persimmon-threads-bench [--threads N]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--threads") && i + 1 < argc) {
+            char *end = NULL;
+            unsigned long threads = strtoul(argv[++i], &end, 10);
+            if ('\0' != *end || 0 == threads || threads > MAX_THREADS) usage();
+            max_threads = (size_t)threads;
+        } else {
+            usage();
+        }
+    }
+
+    if (!persimm_has_atomic_refcounts()) {
+        fprintf(stderr, "this build counts references without atomics\n");
+        return 2;
+    }
+
+    const int keys = 1024;
+    const size_t lookups = 1000000;
+
+    persimm_map_t map;
+    build(&map, keys);
+
+    /* Built apart from `map` and never deinitialised, as a startup table would be. */
+    static persimm_map_t frozen;
+    build(&frozen, keys);
+    persimm_map_freeze(&frozen);
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        persimm_snapshot_t *snapshot;
+        persimm_map_atom_t *atom;
+        persimm_map_atom_t *epoch_atom;
+        persimm_epoch_domain_t *domain;
+        persimm_concurrent_map_t *shared;
+        check(persimm_map_snapshot(&map, threads, &snapshot), "map snapshot");
+        check(persimm_map_atom_new(&map, NULL, &atom), "map atom");
+        check(persimm_epoch_domain_new(threads, &domain), "epoch domain");
+        check(persimm_map_atom_new(&map, domain, &epoch_atom), "map atom");
+        check(persimm_concurrent_map_new(&map, NULL, &shared), "concurrent map");
+
+        run("map find (clone)", read_by_clone, &map, NULL, NULL, NULL, NULL, threads, lookups,
+            keys);
+        run("map find (snapshot)", read_by_snapshot, NULL, snapshot, NULL, NULL, NULL, threads,
+            lookups, keys);
+        run("map find (frozen)", read_by_clone, &frozen, NULL, NULL, NULL, NULL, threads,
+            lookups, keys);
+        run("map find (atom)", read_by_atom, NULL, NULL, atom, NULL, NULL, threads, lookups,
+            keys);
+        run("map find (epoch)", read_by_epoch, NULL, NULL, epoch_atom, domain, NULL, threads,
+            lookups, keys);
+        run("map find (concurrent)", read_by_concurrent, NULL, NULL, NULL, NULL, shared, threads,
+            lookups, keys);
+        check_swaps(atom, threads, lookups);
+        check_swaps(epoch_atom, threads, lookups);
+        check_concurrent(shared, threads, lookups);
+
+        persimm_concurrent_map_free(shared);
+        persimm_map_atom_free(epoch_atom);
+        persimm_epoch_domain_free(domain);
+        persimm_map_atom_free(atom);
+        persimm_snapshot_retire(snapshot);
+    }
+
+    run_contention(&map, keys, lookups);
+
+    persimm_vector_t vector;
+    check(persimm_vector_init(&vector, sizeof(int), NULL, NULL), "vector init");
+    for (int i = 0; i < 4000000; i++) check(persimm_vector_push_owned(&vector, &i), "vector push");
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) run_reduce(&vector, threads, 20);
+    persimm_vector_deinit(&vector);
+
+    const size_t built = 2000000;
+    entry_t *entries = calloc(built, sizeof(entry_t));
+    if (NULL == entries) {
+        fprintf(stderr, "could not allocate the entries to build from\n");
+        return 1;
+    }
+    for (size_t i = 0; i < built; i++) entries[i] = (entry_t){ (int)i, (int)i };
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        run_build(entries, built, threads);
+    }
+
+    entry_t *sorted = calloc(built, sizeof(entry_t));
+    if (NULL == sorted) {
+        fprintf(stderr, "could not allocate the entries to ingest\n");
+        return 1;
+    }
+    ingest_t ingest = { NULL, sorted, { 0 } };
+    size_t next[PERSIMM_SPLIT_WAYS];
+    for (size_t i = 0; i < built; i++) {
+        ingest.starts[(int_hash(&entries[i].key, 0, NULL) % PERSIMM_SPLIT_WAYS) + 1]++;
+    }
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) ingest.starts[i + 1] += ingest.starts[i];
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) next[i] = ingest.starts[i];
+    for (size_t i = 0; i < built; i++) {
+        sorted[next[int_hash(&entries[i].key, 0, NULL) % PERSIMM_SPLIT_WAYS]++] = entries[i];
+    }
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) run_ingest(&ingest, threads);
+    free(sorted);
+    free(entries);
+
+    persimm_map_deinit(&map);
+    return 0;
+}
@@ -13,12 +13,70 @@ static void janet_persimm_trace(const void *slot, void *ctx) {
     janet_mark(*(const Janet *)slot);
 }
 
+/*
+ * Handing the core Janet's own hash lets every vector, map and set keep its
+ * structural hash current as it changes, so hashing one, which Janet does each
+ * time it serves as a table key, reads a field rather than walking it.
+ */
+static uint32_t janet_persimm_hash(const void *slot, void *ctx) {
+    (void) ctx;
+    return (uint32_t)janet_hash(*(const Janet *)slot);
+}
+
 static const persimm_elem_ops janet_persimm_ops = {
     NULL, /* Retain */
     NULL, /* Release */
-    janet_persimm_trace
+    janet_persimm_trace,
+    janet_persimm_hash
+};
+
+/* Tracing */
+
+/*
+ * Versions of a collection share most of their nodes, so every collection is
+ * marked within an epoch and a node any version already marked this cycle is
+ * passed over. Janet gives no notice that a cycle has begun, so the binding
+ * infers it from the last one ending. The first mark of a cycle starts an
+ * epoch and makes a sentinel nothing refers to. The sentinel is swept when the
+ * cycle ends, and its finaliser clears the epoch so that the next mark starts
+ * another.
+ *
+ * This leans on Janet internals it does not document. Allocating from a mark
+ * function is not a promised part of the API; it works because janet_collect
+ * finishes marking before it sweeps, and a block allocated in between is
+ * unmarked and so swept in that same cycle. Were a sentinel to survive its
+ * cycle, the next cycle would reuse a stale epoch and pass over nodes it had
+ * never marked, freeing the elements they hold. The GC survival tests in
+ * test/map.janet and test/vector.janet catch that.
+ *
+ * Because the finaliser resets the epoch, every cycle that marks anything
+ * draws a fresh one, and Janet marks every live collection in every cycle.
+ * A node's stamp is therefore always from the cycle before at the latest, so
+ * the core's 32-bit epochs wrapping cannot make a cycle pass one over.
+ */
+static JANET_THREAD_LOCAL uint32_t janet_persimm_epoch = 0;
+
+static int janet_persimm_sentinel_gc(void *p, size_t size) {
+    (void) p;
+    (void) size;
+    janet_persimm_epoch = 0;
+    return 0;
+}
+
+static const JanetAbstractType janet_persimm_sentinel_type = {
+    "persimmon/sentinel",
+    janet_persimm_sentinel_gc,
+    JANET_ATEND_GC
 };
 
+static uint32_t janet_persimm_mark_epoch(void) {
+    if (0 == janet_persimm_epoch) {
+        janet_persimm_epoch = persimm_trace_epoch_begin();
+        janet_abstract(&janet_persimm_sentinel_type, 0);
+    }
+    return janet_persimm_epoch;
+}
+
 /* Entries */
 
 /*
@@ -96,53 +154,6 @@ static bool janet_persimm_index(size_t count, Janet input, size_t *index) {
     return true;
 }
 
-/* Unmarshalling moves its unpublished value through a transient one item at a
- * time. Persisting after each item keeps everything already read visible to
- * Janet's collector while the next item is decoded. */
-static persimm_status janet_persimm_vector_build_push(persimm_vector_t *vector,
-                                                      const void *elem) {
-    persimm_vector_transient_t transient;
-    persimm_status status = persimm_vector_to_transient(vector, &transient);
-    if (PERSIMM_OK != status) return status;
-    persimm_vector_deinit(vector);
-    status = persimm_vector_transient_push(&transient, elem);
-    persimm_status persisted = persimm_vector_transient_persist(&transient, vector);
-    return PERSIMM_OK == status ? persisted : status;
-}
-
-static persimm_status janet_persimm_list_build_cons(persimm_list_t *list,
-                                                    const void *elem) {
-    persimm_list_t next;
-    persimm_status status = persimm_list_cons(list, elem, &next);
-    if (PERSIMM_OK == status) {
-        persimm_list_deinit(list);
-        *list = next;
-    }
-    return status;
-}
-
-static persimm_status janet_persimm_map_build_assoc(persimm_map_t *map,
-                                                    const void *entry) {
-    persimm_map_transient_t transient;
-    persimm_status status = persimm_map_to_transient(map, &transient);
-    if (PERSIMM_OK != status) return status;
-    persimm_map_deinit(map);
-    status = persimm_map_transient_assoc(&transient, entry);
-    persimm_status persisted = persimm_map_transient_persist(&transient, map);
-    return PERSIMM_OK == status ? persisted : status;
-}
-
-static persimm_status janet_persimm_set_build_conj(persimm_set_t *set,
-                                                   const void *elem) {
-    persimm_set_transient_t transient;
-    persimm_status status = persimm_set_to_transient(set, &transient);
-    if (PERSIMM_OK != status) return status;
-    persimm_set_deinit(set);
-    status = persimm_set_transient_conj(&transient, elem);
-    persimm_status persisted = persimm_set_transient_persist(&transient, set);
-    return PERSIMM_OK == status ? persisted : status;
-}
-
 static void janet_persimm_to_array_visit(const void *slot, size_t index, void *ctx) {
     (void) index;
     janet_array_push((JanetArray *)ctx, *(const Janet *)slot);
@@ -154,32 +165,14 @@ static void janet_persimm_to_string_visit(const void *slot, size_t index, void *
     janet_buffer_push_string(buf, janet_to_string(*(const Janet *)slot));
 }
 
-static void janet_persimm_hash_visit(const void *slot, size_t index, void *ctx) {
-    (void) index;
-    uint32_t *hash = (uint32_t *)ctx;
-    *hash = (*hash << 5) + *hash + (uint32_t)janet_hash(*(const Janet *)slot);
-}
-
 /*
- * A vector and a list are hashed in order, because their order is what they
- * are. A map and a set are not: two of them holding the same entries may hand
- * them over in different orders when keys share a hash, so their entries are
- * combined by adding, which does not care.
+ * A list's cells keep no hash, so a list is hashed by walking it, in order
+ * because its order is what it is. The other collections hash themselves.
  */
-
-static void janet_persimm_set_hash_visit(const void *slot, size_t index, void *ctx) {
-    (void) index;
-    uint32_t *hash = (uint32_t *)ctx;
-    *hash += (uint32_t)janet_hash(*(const Janet *)slot) * 2654435761u;
-}
-
-static void janet_persimm_map_hash_visit(const void *slot, size_t index, void *ctx) {
+static void janet_persimm_hash_visit(const void *slot, size_t index, void *ctx) {
     (void) index;
     uint32_t *hash = (uint32_t *)ctx;
-    const janet_persimm_entry_t *entry = (const janet_persimm_entry_t *)slot;
-    uint32_t key = (uint32_t)janet_hash(entry->key);
-    uint32_t value = (uint32_t)janet_hash(entry->value);
-    *hash += (key * 31u + value) * 2654435761u;
+    *hash = (*hash << 5) + *hash + (uint32_t)janet_hash(*(const Janet *)slot);
 }
 
 static void janet_persimm_map_to_string_visit(const void *slot, size_t index, void *ctx) {
@@ -259,7 +252,7 @@ static void janet_persimm_reverse_visit(const void *slot, size_t index, void *ct
     (void) index;
     janet_persimm_reverse_t *state = (janet_persimm_reverse_t *)ctx;
     if (PERSIMM_OK != state->status) return;
-    state->status = janet_persimm_list_build_cons(state->into, slot);
+    state->status = persimm_list_cons_owned(state->into, slot);
 }
 
 /*
@@ -402,7 +395,7 @@ static int janet_persimm_vector_gc(void *p, size_t size) {
 
 static int janet_persimm_vector_mark(void *p, size_t size) {
     (void) size;
-    persimm_vector_trace((persimm_vector_t *)p);
+    persimm_vector_trace_epoch((persimm_vector_t *)p, janet_persimm_mark_epoch());
     return 0;
 }
 
@@ -434,9 +427,7 @@ static void janet_persimm_vector_to_string(void *p, JanetBuffer *buf) {
 
 static int32_t janet_persimm_vector_hash(void *p, size_t size) {
     (void) size;
-    uint32_t hash = 5381;
-    persimm_vector_foreach((persimm_vector_t *)p, janet_persimm_hash_visit, &hash);
-    return (int32_t)hash;
+    return (int32_t)persimm_vector_hash((persimm_vector_t *)p);
 }
 
 static Janet janet_persimm_vector_next(void *p, Janet key) {
@@ -514,11 +505,14 @@ static void *janet_persimm_vector_unmarshal(JanetMarshalContext *ctx) {
     /* Nothing allocates between the vector coming into existence and its being
        initialised, so a collection never meets one it cannot trace. */
     janet_persimm_check(persimm_vector_init(vector, sizeof(Janet), &janet_persimm_ops, NULL));
+    persimm_vector_make_local(vector);
 
+    /* Each owned push leaves a whole vector behind, so everything already read
+       stays visible to the collector while the next item is decoded. */
     size_t count = janet_persimm_unmarshal_count(ctx);
     for (size_t i = 0; i < count; i++) {
         Janet value = janet_unmarshal_janet(ctx);
-        janet_persimm_check(janet_persimm_vector_build_push(vector, &value));
+        janet_persimm_check(persimm_vector_push_owned(vector, &value));
     }
 
     return vector;
@@ -564,7 +558,7 @@ static int janet_persimm_list_gc(void *p, size_t size) {
 
 static int janet_persimm_list_mark(void *p, size_t size) {
     (void) size;
-    persimm_list_trace(&((janet_persimm_list_t *)p)->list);
+    persimm_list_trace_epoch(&((janet_persimm_list_t *)p)->list, janet_persimm_mark_epoch());
     return 0;
 }
 
@@ -668,11 +662,12 @@ static void *janet_persimm_list_unmarshal(JanetMarshalContext *ctx) {
     persimm_list_cursor_reset(&wrapper->cursor);
     janet_persimm_check(persimm_list_init(&wrapper->list, sizeof(Janet), &janet_persimm_ops,
                                           NULL));
+    persimm_list_make_local(&wrapper->list);
 
     size_t count = janet_persimm_unmarshal_count(ctx);
     for (size_t i = 0; i < count; i++) {
         Janet value = janet_unmarshal_janet(ctx);
-        janet_persimm_check(janet_persimm_list_build_cons(&wrapper->list, &value));
+        janet_persimm_check(persimm_list_cons_owned(&wrapper->list, &value));
     }
 
     /* The elements went on the front as they arrived, so the chain reads
@@ -681,6 +676,7 @@ static void *janet_persimm_list_unmarshal(JanetMarshalContext *ctx) {
        the values are held by only one of the two chains. */
     persimm_list_t ordered;
     janet_persimm_check(persimm_list_init(&ordered, sizeof(Janet), &janet_persimm_ops, NULL));
+    persimm_list_make_local(&ordered);
 
     janet_persimm_reverse_t state = { &ordered, PERSIMM_OK };
     persimm_list_foreach(&wrapper->list, janet_persimm_reverse_visit, &state);
@@ -724,7 +720,7 @@ static int janet_persimm_map_gc(void *p, size_t size) {
 
 static int janet_persimm_map_mark(void *p, size_t size) {
     (void) size;
-    persimm_map_trace((persimm_map_t *)p);
+    persimm_map_trace_epoch((persimm_map_t *)p, janet_persimm_mark_epoch());
     return 0;
 }
 
@@ -759,9 +755,7 @@ static void janet_persimm_map_to_string(void *p, JanetBuffer *buf) {
 
 static int32_t janet_persimm_map_hash(void *p, size_t size) {
     (void) size;
-    uint32_t hash = 5381;
-    persimm_map_foreach((persimm_map_t *)p, janet_persimm_map_hash_visit, &hash);
-    return (int32_t)hash;
+    return (int32_t)persimm_map_hash((persimm_map_t *)p);
 }
 
 /*
@@ -805,7 +799,9 @@ static const JanetAbstractType persimm_map_type = {
  * A map carries no order of its own, so equality is all this can answer
  * exactly: the same number of entries, and every key mapped to an equal value.
  * Two maps that differ fall back to their counts and then to their addresses,
- * which makes the order between unequal maps one not to rely on.
+ * which makes the order between unequal maps one not to rely on. Maps whose
+ * structural hashes differ cannot be equal, so most unequal pairs of the same
+ * size are told apart without a single lookup.
  *
  * The count is taken first here, unlike in a vector, and for the same reason
  * the vector cannot take it first: with no order among the entries themselves,
@@ -820,6 +816,7 @@ static int janet_persimm_map_compare(void *p1, void *p2) {
     persimm_map_t *a = (persimm_map_t *)p1;
     persimm_map_t *b = (persimm_map_t *)p2;
     if (a->count != b->count) return janet_persimm_order_by_count(a->count, b->count);
+    if (persimm_map_hash(a) != persimm_map_hash(b)) return janet_persimm_order_by_address(p1, p2);
 
     for (const void *entry = persimm_map_next(a, NULL);
          NULL != entry;
@@ -846,6 +843,7 @@ static void *janet_persimm_map_unmarshal(JanetMarshalContext *ctx) {
     persimm_map_t *map = (persimm_map_t *)janet_unmarshal_abstract(ctx, sizeof(persimm_map_t));
     janet_persimm_check(persimm_map_init(map, &janet_persimm_map_layout, &janet_persimm_ops,
                                          NULL, &janet_persimm_key_ops, NULL));
+    persimm_map_make_local(map);
 
     size_t count = janet_persimm_unmarshal_count(ctx);
     for (size_t i = 0; i < count; i++) {
@@ -856,9 +854,9 @@ static void *janet_persimm_map_unmarshal(JanetMarshalContext *ctx) {
            collector can see it, while the value is read. Storing it a second
            time replaces the stand-in and leaves the count where it was. */
         janet_persimm_entry_t entry = { key, key };
-        janet_persimm_check(janet_persimm_map_build_assoc(map, &entry));
+        janet_persimm_check(persimm_map_assoc_owned(map, &entry));
         entry.value = janet_unmarshal_janet(ctx);
-        janet_persimm_check(janet_persimm_map_build_assoc(map, &entry));
+        janet_persimm_check(persimm_map_assoc_owned(map, &entry));
     }
 
     return map;
@@ -890,7 +888,7 @@ static int janet_persimm_set_gc(void *p, size_t size) {
 
 static int janet_persimm_set_mark(void *p, size_t size) {
     (void) size;
-    persimm_set_trace((persimm_set_t *)p);
+    persimm_set_trace_epoch((persimm_set_t *)p, janet_persimm_mark_epoch());
     return 0;
 }
 
@@ -924,9 +922,7 @@ static void janet_persimm_set_to_string(void *p, JanetBuffer *buf) {
 
 static int32_t janet_persimm_set_hash(void *p, size_t size) {
     (void) size;
-    uint32_t hash = 5381;
-    persimm_set_foreach((persimm_set_t *)p, janet_persimm_set_hash_visit, &hash);
-    return (int32_t)hash;
+    return (int32_t)persimm_set_hash((persimm_set_t *)p);
 }
 
 static Janet janet_persimm_set_next(void *p, Janet key) {
@@ -974,6 +970,7 @@ static int janet_persimm_set_compare(void *p1, void *p2) {
     persimm_set_t *a = (persimm_set_t *)p1;
     persimm_set_t *b = (persimm_set_t *)p2;
     if (a->count != b->count) return janet_persimm_order_by_count(a->count, b->count);
+    if (persimm_set_hash(a) != persimm_set_hash(b)) return janet_persimm_order_by_address(p1, p2);
 
     for (const void *elem = persimm_set_next(a, NULL);
          NULL != elem;
@@ -995,12 +992,13 @@ static void *janet_persimm_set_unmarshal(JanetMarshalContext *ctx) {
     persimm_set_t *set = (persimm_set_t *)janet_unmarshal_abstract(ctx, sizeof(persimm_set_t));
     janet_persimm_check(
         persimm_set_init(set, sizeof(Janet), &janet_persimm_key_ops, NULL));
+    persimm_set_make_local(set);
 
     size_t count = janet_persimm_unmarshal_count(ctx);
     for (size_t i = 0; i < count; i++) {
         Janet elem = janet_unmarshal_janet(ctx);
         janet_persimm_check_key(elem);
-        janet_persimm_check(janet_persimm_set_build_conj(set, &elem));
+        janet_persimm_check(persimm_set_conj_owned(set, &elem));
     }
 
     return set;
@@ -1044,7 +1042,9 @@ static int janet_persimm_vector_transient_gc(void *p, size_t size) {
 static int janet_persimm_vector_transient_mark(void *p, size_t size) {
     (void) size;
     persimm_vector_transient_t *transient = (persimm_vector_transient_t *)p;
-    if (transient->active) persimm_vector_trace(&transient->value);
+    if (transient->active) {
+        persimm_vector_trace_epoch(&transient->value, janet_persimm_mark_epoch());
+    }
     return 0;
 }
 
@@ -1107,7 +1107,9 @@ static int janet_persimm_map_transient_gc(void *p, size_t size) {
 static int janet_persimm_map_transient_mark(void *p, size_t size) {
     (void) size;
     persimm_map_transient_t *transient = (persimm_map_transient_t *)p;
-    if (transient->active) persimm_map_trace(&transient->value);
+    if (transient->active) {
+        persimm_map_trace_epoch(&transient->value, janet_persimm_mark_epoch());
+    }
     return 0;
 }
 
@@ -1165,7 +1167,9 @@ static int janet_persimm_set_transient_gc(void *p, size_t size) {
 static int janet_persimm_set_transient_mark(void *p, size_t size) {
     (void) size;
     persimm_set_transient_t *transient = (persimm_set_transient_t *)p;
-    if (transient->active) persimm_set_trace(&transient->value);
+    if (transient->active) {
+        persimm_set_trace_epoch(&transient->value, janet_persimm_mark_epoch());
+    }
     return 0;
 }
 
@@ -1215,6 +1219,13 @@ static const JanetAbstractType persimm_set_transient_type = {
 
 /* Constructing */
 
+/*
+ * A Janet value lives on the heap of the thread that made it, and another
+ * thread only ever receives a marshalled copy, so every collection made here
+ * is local from the start and never pays for atomic reference counts. Each
+ * update inherits that from its source.
+ */
+
 static persimm_vector_t *janet_persimm_alloc_vector(void) {
     return (persimm_vector_t *)janet_abstract(&persimm_vector_type, sizeof(persimm_vector_t));
 }
@@ -1222,6 +1233,7 @@ static persimm_vector_t *janet_persimm_alloc_vector(void) {
 static persimm_vector_t *janet_persimm_new_vector(void) {
     persimm_vector_t *vector = janet_persimm_alloc_vector();
     janet_persimm_check(persimm_vector_init(vector, sizeof(Janet), &janet_persimm_ops, NULL));
+    persimm_vector_make_local(vector);
     return vector;
 }
 
@@ -1240,6 +1252,7 @@ static janet_persimm_list_t *janet_persimm_alloc_list(void) {
 static janet_persimm_list_t *janet_persimm_new_list(void) {
     janet_persimm_list_t *wrapper = janet_persimm_alloc_list();
     janet_persimm_check(persimm_list_init(&wrapper->list, sizeof(Janet), &janet_persimm_ops, NULL));
+    persimm_list_make_local(&wrapper->list);
     return wrapper;
 }
 
@@ -1251,6 +1264,7 @@ static persimm_map_t *janet_persimm_new_map(void) {
     persimm_map_t *map = janet_persimm_alloc_map();
     janet_persimm_check(persimm_map_init(map, &janet_persimm_map_layout, &janet_persimm_ops,
                                          NULL, &janet_persimm_key_ops, NULL));
+    persimm_map_make_local(map);
     return map;
 }
 
@@ -1262,14 +1276,16 @@ static persimm_set_t *janet_persimm_new_set(void) {
     persimm_set_t *set = janet_persimm_alloc_set();
     janet_persimm_check(
         persimm_set_init(set, sizeof(Janet), &janet_persimm_key_ops, NULL));
+    persimm_set_make_local(set);
     return set;
 }
 
 /*
  * Builders
  *
- * Each builder seeds a collection through a single transient rather than one
- * persistent update per element. The values stay reachable through the
+ * Each builder seeds a collection in one operation rather than one persistent
+ * update per element: a vector through a single transient, a map or set
+ * through the core's bulk construction. The values stay reachable through the
  * caller's arguments for the whole batch, so nothing can be collected
  * part-way through. The variadic constructors and the from-* conversions
  * share these, differing only in where their elements come from.
@@ -1300,7 +1316,7 @@ static janet_persimm_list_t *janet_persimm_build_list(const Janet *items, int32_
     /* Consing walks the elements backwards so the list reads in the same
        order as the arguments it came from. */
     for (int32_t i = len - 1; i >= 0; i--) {
-        janet_persimm_check(janet_persimm_list_build_cons(&wrapper->list, &items[i]));
+        janet_persimm_check(persimm_list_cons_owned(&wrapper->list, &items[i]));
     }
 
     return wrapper;
@@ -1313,47 +1329,52 @@ static persimm_set_t *janet_persimm_build_set(const Janet *items, int32_t len) {
     /* Reject nil before building so a bad element leaves nothing half-made. */
     for (int32_t i = 0; i < len; i++) janet_persimm_check_key(items[i]);
 
-    persimm_set_transient_t transient;
-    janet_persimm_check(persimm_set_to_transient(set, &transient));
     persimm_set_deinit(set);
-    for (int32_t i = 0; i < len; i++) {
-        persimm_status status = persimm_set_transient_conj(&transient, &items[i]);
-        if (PERSIMM_OK != status) {
-            persimm_set_transient_deinit(&transient);
-            janet_panic(persimm_status_string(status));
-        }
-    }
-    janet_persimm_check(persimm_set_transient_persist(&transient, set));
+    janet_persimm_check(persimm_set_from_elems(items, (size_t)len, sizeof(Janet),
+                                               &janet_persimm_key_ops, NULL, set));
+    persimm_set_make_local(set);
 
     return set;
 }
 
-static void janet_persimm_seed_entry(persimm_map_transient_t *transient,
-                                     Janet key, Janet value) {
-    janet_persimm_entry_t entry = { key, value };
-    persimm_status status = persimm_map_transient_assoc(transient, &entry);
-    if (PERSIMM_OK != status) {
-        persimm_map_transient_deinit(transient);
-        janet_panic(persimm_status_string(status));
-    }
-}
-
-/* Pairs arrive flat: a key at each even offset and its value just after it. */
+/*
+ * Pairs arrive flat: a key at each even offset and its value just after it,
+ * which is already how an entry lies in memory, so the pairs go to the core
+ * as they are. A nil value is no entry, as it is in a Janet table, and only
+ * when there is one are the remaining pairs copied out without it.
+ */
 static persimm_map_t *janet_persimm_build_map(const Janet *pairs, int32_t len) {
     persimm_map_t *map = janet_persimm_new_map();
     if (0 == len) return map;
 
-    for (int32_t i = 0; i < len; i += 2) janet_persimm_check_key(pairs[i]);
-
-    persimm_map_transient_t transient;
-    janet_persimm_check(persimm_map_to_transient(map, &transient));
-    persimm_map_deinit(map);
+    int32_t kept = 0;
     for (int32_t i = 0; i < len; i += 2) {
-        /* A nil value is no entry, as it is in a Janet table. */
-        if (janet_checktype(pairs[i + 1], JANET_NIL)) continue;
-        janet_persimm_seed_entry(&transient, pairs[i], pairs[i + 1]);
+        janet_persimm_check_key(pairs[i]);
+        if (!janet_checktype(pairs[i + 1], JANET_NIL)) kept++;
+    }
+
+    const void *entries = pairs;
+    janet_persimm_entry_t *copied = NULL;
+    if (kept != len / 2) {
+        copied = janet_smalloc(sizeof(janet_persimm_entry_t) * (size_t)(kept > 0 ? kept : 1));
+        int32_t at = 0;
+        for (int32_t i = 0; i < len; i += 2) {
+            if (janet_checktype(pairs[i + 1], JANET_NIL)) continue;
+            copied[at].key = pairs[i];
+            copied[at].value = pairs[i + 1];
+            at++;
+        }
+        entries = copied;
     }
-    janet_persimm_check(persimm_map_transient_persist(&transient, map));
+
+    persimm_map_deinit(map);
+    persimm_status status = persimm_map_from_entries(entries, (size_t)kept,
+                                                     &janet_persimm_map_layout,
+                                                     &janet_persimm_ops, NULL,
+                                                     &janet_persimm_key_ops, NULL, map);
+    if (NULL != copied) janet_sfree(copied);
+    janet_persimm_check(status);
+    persimm_map_make_local(map);
 
     return map;
 }
@@ -1470,7 +1491,7 @@ static janet_persimm_list_t *janet_persimm_into_list(const persimm_list_t *targe
 
     janet_persimm_check(persimm_list_clone(target, &result->list));
     for (int32_t i = elems->count - 1; i >= 0; i--) {
-        janet_persimm_check(janet_persimm_list_build_cons(&result->list, &elems->data[i]));
+        janet_persimm_check(persimm_list_cons_owned(&result->list, &elems->data[i]));
     }
 
     return result;
@@ -1484,16 +1505,8 @@ static persimm_set_t *janet_persimm_into_set(const persimm_set_t *target,
     persimm_set_t *result = janet_persimm_alloc_set();
     janet_gcunroot(janet_wrap_array(elems));
 
-    persimm_set_transient_t transient;
-    janet_persimm_check(persimm_set_to_transient(target, &transient));
-    for (int32_t i = 0; i < elems->count; i++) {
-        persimm_status status = persimm_set_transient_conj(&transient, &elems->data[i]);
-        if (PERSIMM_OK != status) {
-            persimm_set_transient_deinit(&transient);
-            janet_panic(persimm_status_string(status));
-        }
-    }
-    janet_persimm_check(persimm_set_transient_persist(&transient, result));
+    janet_persimm_check(persimm_set_conj_many(target, elems->data, (size_t)elems->count,
+                                              result));
 
     return result;
 }
@@ -1511,17 +1524,22 @@ static persimm_map_t *janet_persimm_into_map(const persimm_map_t *target,
     persimm_map_t *result = janet_persimm_alloc_map();
     janet_gcunroot(janet_wrap_array(pairs));
 
-    persimm_map_transient_t transient;
-    janet_persimm_check(persimm_map_to_transient(target, &transient));
+    /* A nil value is no entry, as it is in a Janet table. */
+    size_t room = (size_t)(pairs->count > 0 ? pairs->count : 1);
+    janet_persimm_entry_t *entries = janet_smalloc(sizeof(janet_persimm_entry_t) * room);
+    size_t count = 0;
     for (int32_t i = 0; i < pairs->count; i++) {
         Janet key;
         Janet value;
         janet_persimm_pair(pairs->data[i], &key, &value);
-        /* A nil value is no entry, as it is in a Janet table. */
         if (janet_checktype(value, JANET_NIL)) continue;
-        janet_persimm_seed_entry(&transient, key, value);
+        entries[count].key = key;
+        entries[count].value = value;
+        count++;
     }
-    janet_persimm_check(persimm_map_transient_persist(&transient, result));
+    persimm_status status = persimm_map_assoc_many(target, entries, count, result);
+    janet_sfree(entries);
+    janet_persimm_check(status);
 
     return result;
 }
@@ -1952,6 +1970,59 @@ JANET_FN(cfun_persimm_to_array,
     janet_panicf("expected a persimmon collection, got %v", argv[0]);
 }
 
+/* Puts `count` counts into an array, so a histogram keeps its order. */
+static Janet janet_persimm_wrap_counts(const size_t *counts, size_t count) {
+    JanetArray *array = janet_array((int32_t)count);
+    for (size_t i = 0; i < count; i++) {
+        janet_array_push(array, janet_wrap_number((double)counts[i]));
+    }
+    return janet_wrap_array(array);
+}
+
+JANET_FN(cfun_persimm_shape_stats,
+         "(shape-stats coll)",
+         "Describes the trie behind a persistent map or set: its entry and node "
+         "counts, entries by depth, collision nodes by size, average entries "
+         "and children per node, and the equality checks an average lookup "
+         "makes for a present and an absent key. Returns a table.") {
+    janet_fixarity(argc, 1);
+
+    persimm_shape_stats stats;
+    if (janet_checkabstract(argv[0], &persimm_map_type)) {
+        persimm_map_shape_stats((persimm_map_t *)janet_unwrap_abstract(argv[0]), &stats);
+    } else if (janet_checkabstract(argv[0], &persimm_set_type)) {
+        persimm_set_shape_stats((persimm_set_t *)janet_unwrap_abstract(argv[0]), &stats);
+    } else {
+        janet_panicf("expected a persimmon map or set, got %v", argv[0]);
+    }
+
+    JanetTable *table = janet_table(12);
+    janet_table_put(table, janet_ckeywordv("entries"), janet_wrap_number((double)stats.entries));
+    janet_table_put(table, janet_ckeywordv("bitmap-nodes"),
+                    janet_wrap_number((double)stats.bitmap_nodes));
+    janet_table_put(table, janet_ckeywordv("collision-nodes"),
+                    janet_wrap_number((double)stats.collision_nodes));
+    janet_table_put(table, janet_ckeywordv("collision-entries"),
+                    janet_wrap_number((double)stats.collision_entries));
+    janet_table_put(table, janet_ckeywordv("largest-collision"),
+                    janet_wrap_number((double)stats.largest_collision));
+    janet_table_put(table, janet_ckeywordv("collision-sizes"),
+                    janet_persimm_wrap_counts(stats.collision_sizes, 8));
+    janet_table_put(table, janet_ckeywordv("depths"), janet_persimm_wrap_counts(stats.depths, 8));
+    janet_table_put(table, janet_ckeywordv("max-depth"),
+                    janet_wrap_number((double)stats.max_depth));
+    janet_table_put(table, janet_ckeywordv("entries-per-node"),
+                    janet_wrap_number(stats.entries_per_node));
+    janet_table_put(table, janet_ckeywordv("children-per-node"),
+                    janet_wrap_number(stats.children_per_node));
+    janet_table_put(table, janet_ckeywordv("equals-per-hit"),
+                    janet_wrap_number(stats.equals_per_hit));
+    janet_table_put(table, janet_ckeywordv("equals-per-miss"),
+                    janet_wrap_number(stats.equals_per_miss));
+
+    return janet_wrap_table(table);
+}
+
 /* Environment Registration */
 
 void persimm_register_type(JanetTable *env) {
@@ -1991,6 +2062,7 @@ void persimm_register_functions(JanetTable *env) {
         JANET_REG("into", cfun_persimm_into),
         JANET_REG("to-array", cfun_persimm_to_array),
         JANET_REG("to-table", cfun_persimm_to_table),
+        JANET_REG("shape-stats", cfun_persimm_shape_stats),
         JANET_REG_END
     };
 
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "persimmon_internal.h"
 
 /*
@@ -23,3 +24,106 @@ const char *persimm_status_string(persimm_status status) {
 bool persimm_has_atomic_refcounts(void) {
     return PERSIMM_RC_ATOMIC ? true : false;
 }
+
+/* Tracing */
+
+/*
+ * Counted the way reference counts are, so that threads never share an epoch.
+ * The count is cut to 32 bits, so epochs wrap as persimmon.h describes.
+ */
+static persimm_refcount_t persimm_trace_epochs;
+
+uint32_t persimm_trace_epoch_begin(void) {
+    uint32_t epoch;
+    do {
+        epoch = (uint32_t)(PERSIMM_RC_INC(persimm_trace_epochs) + 1);
+    } while (0 == epoch);
+    return epoch;
+}
+
+/* Operation Counters */
+
+#if defined(PERSIMM_STATS)
+PERSIMM_THREAD_LOCAL persimm_op_stats persimm_stats_local;
+#endif
+
+bool persimm_stats_snapshot(persimm_op_stats *dest) {
+#if defined(PERSIMM_STATS)
+    *dest = persimm_stats_local;
+    return true;
+#else
+    memset(dest, 0, sizeof(*dest));
+    return false;
+#endif
+}
+
+void persimm_stats_reset(void) {
+#if defined(PERSIMM_STATS)
+    memset(&persimm_stats_local, 0, sizeof(persimm_stats_local));
+#endif
+}
+
+/* Executors */
+
+/* A single task gains nothing from a pool, so it never leaves the calling thread. */
+void persimm_executor_run(const persimm_executor *executor, size_t tasks, persimm_task_fn fn,
+                          void *arg) {
+    if (NULL == executor || NULL == executor->run || tasks < 2) {
+        for (size_t i = 0; i < tasks; i++) fn(arg, i);
+        return;
+    }
+    executor->run(executor->ctx, tasks, fn, arg);
+}
+
+/* Node Sets */
+
+static size_t persimm_node_set_slot(const void *node, size_t capacity) {
+    uintptr_t bits = (uintptr_t)node;
+    bits ^= bits >> 17;
+    bits *= (uintptr_t)0x9e3779b97f4a7c15ull;
+    return (size_t)(bits ^ (bits >> 29)) & (capacity - 1);
+}
+
+static void persimm_node_set_place(const void **slots, size_t capacity, const void *node) {
+    size_t slot = persimm_node_set_slot(node, capacity);
+    while (NULL != slots[slot]) slot = (slot + 1) & (capacity - 1);
+    slots[slot] = node;
+}
+
+persimm_status persimm_node_set_add(persimm_node_set_t *set, const void *node) {
+    if (persimm_node_set_has(set, node)) return PERSIMM_OK;
+
+    if (2 * (set->count + 1) > set->capacity) {
+        size_t capacity = 0 == set->capacity ? 64 : 2 * set->capacity;
+        if (capacity > SIZE_MAX / (2 * sizeof(void *))) return PERSIMM_ERR_ALLOC;
+        const void **slots = calloc(capacity, sizeof(void *));
+        if (NULL == slots) return PERSIMM_ERR_ALLOC;
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (NULL != set->slots[i]) persimm_node_set_place(slots, capacity, set->slots[i]);
+        }
+        free((void *)set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    persimm_node_set_place(set->slots, set->capacity, node);
+    set->count++;
+    return PERSIMM_OK;
+}
+
+bool persimm_node_set_has(const persimm_node_set_t *set, const void *node) {
+    if (0 == set->capacity) return false;
+    size_t slot = persimm_node_set_slot(node, set->capacity);
+    while (NULL != set->slots[slot]) {
+        if (node == set->slots[slot]) return true;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return false;
+}
+
+void persimm_node_set_free(persimm_node_set_t *set) {
+    free((void *)set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
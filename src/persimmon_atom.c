@@ -0,0 +1,599 @@
+#include <stdlib.h>
+#include <string.h>
+#include "persimmon_internal.h"
+
+/*
+ * A single mutable reference to a persistent collection, shared between
+ * threads. The collection's handle spans several words, so it lives in a box
+ * on the heap and what the atom swaps is the pointer to the box. Publishing a
+ * version is one compare-exchange of that pointer.
+ *
+ * The hard part is the box a loader is about to clone from when a writer
+ * swaps it out. Loaders announce themselves on one of two counters for the
+ * few instructions it takes to read the pointer and clone what it points to.
+ * Once each counter has been seen at zero after a box was swapped out, every
+ * loader that could have read the old pointer has finished with it; anyone
+ * arriving later reads a newer one. Loaders are steered to whichever counter
+ * is not being watched, so a steady stream of them cannot keep it above zero.
+ *
+ * Writers do not wait for that. A box swapped out joins a list of retired
+ * boxes, and each publication spins briefly for the counters and frees the
+ * whole list if they drain, or leaves it for the next publication if a
+ * loader was preempted mid-load. Loaders never wait for anything.
+ *
+ * An atom in an epoch domain serves readers that take no reference at all,
+ * and who may hold its version for as long as their epoch section lasts
+ * rather than for the few instructions of a load. Boxes that clear the
+ * counters are handed to the domain instead of being freed, and the domain
+ * frees them once every reader has left the epochs in which they could have
+ * been seen. The classic scheme defers each freed node; deferring whole
+ * versions here keeps the trie and vector code unaware of epochs, since a
+ * version's nodes outlive it only while another version still holds them.
+ */
+
+/* Geometry */
+
+/* As for snapshots: keeps each counter on a cache line of its own. */
+#define PERSIMM_ATOM_LINE 64
+
+/* How long a publication watches a counter before leaving reclamation for later. */
+#define PERSIMM_ATOM_SPINS 1024
+
+typedef struct {
+    persimm_refcount_t count;
+    unsigned char padding[PERSIMM_ATOM_LINE - sizeof(persimm_refcount_t)];
+} persimm_atom_counter_t;
+
+typedef enum {
+    PERSIMM_ATOM_VECTOR,
+    PERSIMM_ATOM_MAP,
+    PERSIMM_ATOM_SET
+} persimm_atom_kind;
+
+typedef struct persimm_atom_box {
+    union {
+        persimm_vector_t vector;
+        persimm_map_t map;
+        persimm_set_t set;
+    } value;
+    persimm_atom_kind kind;
+    /* The domain epoch in which the box was handed over. */
+    size_t epoch;
+    /* Links retired boxes. */
+    struct persimm_atom_box *next;
+} persimm_atom_box_t;
+
+typedef struct {
+    persimm_refcount_t state;
+    unsigned char padding[PERSIMM_ATOM_LINE - sizeof(persimm_refcount_t)];
+} persimm_epoch_slot_t;
+
+/*
+ * A reader's slot holds zero outside a section, and inside one the epoch it
+ * entered shifted up past a low bit that marks it as occupied.
+ */
+struct persimm_epoch_domain {
+    persimm_refcount_t epoch;
+    persimm_atomic_ptr_t retired;
+    size_t slot_count;
+    unsigned char padding[PERSIMM_ATOM_LINE];
+    persimm_epoch_slot_t slots[];
+};
+
+typedef struct {
+    persimm_epoch_domain_t *domain;
+    persimm_atomic_ptr_t current;
+    persimm_atomic_ptr_t retired;
+    persimm_refcount_t phase;
+    unsigned char padding[PERSIMM_ATOM_LINE];
+    persimm_atom_counter_t loading[2];
+} persimm_atom_t;
+
+struct persimm_vector_atom {
+    persimm_atom_t atom;
+};
+
+struct persimm_map_atom {
+    persimm_atom_t atom;
+};
+
+struct persimm_set_atom {
+    persimm_atom_t atom;
+};
+
+/* Boxes */
+
+static persimm_atom_box_t *persimm_atom_box_new(persimm_atom_kind kind) {
+    persimm_atom_box_t *box = calloc(1, sizeof(persimm_atom_box_t));
+    if (NULL != box) box->kind = kind;
+    return box;
+}
+
+static void persimm_atom_box_free(persimm_atom_box_t *box) {
+    switch (box->kind) {
+        case PERSIMM_ATOM_VECTOR: persimm_vector_deinit(&box->value.vector); break;
+        case PERSIMM_ATOM_MAP: persimm_map_deinit(&box->value.map); break;
+        case PERSIMM_ATOM_SET: persimm_set_deinit(&box->value.set); break;
+    }
+    free(box);
+}
+
+static void persimm_atom_chain_free(persimm_atom_box_t *box) {
+    while (NULL != box) {
+        persimm_atom_box_t *next = box->next;
+        persimm_atom_box_free(box);
+        box = next;
+    }
+}
+
+/* Pushes the chain from `first` to `last` onto `list`. */
+static void persimm_atom_chain_push(persimm_atomic_ptr_t *list, persimm_atom_box_t *first,
+                                    persimm_atom_box_t *last) {
+    void *head = PERSIMM_PTR_LOAD(*list);
+    do {
+        last->next = head;
+    } while (!PERSIMM_PTR_CAS(*list, head, first));
+}
+
+/* Takes the whole of `list`, leaving it empty. */
+static persimm_atom_box_t *persimm_atom_chain_take(persimm_atomic_ptr_t *list) {
+    void *head = PERSIMM_PTR_LOAD(*list);
+    while (NULL != head && !PERSIMM_PTR_CAS(*list, head, NULL)) {
+        /* Another thread pushed or took the list; try again with what is there. */
+    }
+    return head;
+}
+
+/* Epochs */
+
+persimm_status persimm_epoch_domain_new(size_t readers, persimm_epoch_domain_t **dest) {
+    *dest = NULL;
+    size_t bytes;
+    if (0 == readers) return PERSIMM_ERR_INVALID;
+    if (!persimm_size_mul(readers, sizeof(persimm_epoch_slot_t), &bytes) ||
+        !persimm_size_add(offsetof(struct persimm_epoch_domain, slots), bytes, &bytes)) {
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_epoch_domain_t *domain = calloc(1, bytes);
+    if (NULL == domain) return PERSIMM_ERR_ALLOC;
+
+    domain->slot_count = readers;
+    PERSIMM_RC_SET(domain->epoch, 0);
+    PERSIMM_PTR_SET(domain->retired, NULL);
+    for (size_t i = 0; i < readers; i++) PERSIMM_RC_SET(domain->slots[i].state, 0);
+
+    *dest = domain;
+    return PERSIMM_OK;
+}
+
+void persimm_epoch_domain_free(persimm_epoch_domain_t *domain) {
+    persimm_atom_chain_free(PERSIMM_PTR_LOAD(domain->retired));
+    free(domain);
+}
+
+void persimm_epoch_enter(persimm_epoch_domain_t *domain, size_t reader) {
+    persimm_epoch_slot_t *slot = &domain->slots[reader % domain->slot_count];
+    PERSIMM_RC_PUT(slot->state, (PERSIMM_RC_LOAD(domain->epoch) << 1) | 1);
+    /* The slot must be visible before anything the section reads. */
+    PERSIMM_FENCE();
+}
+
+void persimm_epoch_exit(persimm_epoch_domain_t *domain, size_t reader) {
+    PERSIMM_RC_STORE(domain->slots[reader % domain->slot_count].state, 0);
+}
+
+/*
+ * Moves the epoch on if every reader inside a section entered the current
+ * one, and returns the epoch as it then stands. A reader that announced a
+ * stale epoch only holds the epoch back; it cannot see anything retired
+ * after its announcement was published.
+ */
+static size_t persimm_epoch_advance(persimm_epoch_domain_t *domain) {
+    PERSIMM_FENCE();
+    size_t epoch = PERSIMM_RC_LOAD(domain->epoch);
+    for (size_t i = 0; i < domain->slot_count; i++) {
+        size_t state = PERSIMM_RC_LOAD(domain->slots[i].state);
+        if ((state & 1) && (state >> 1) != epoch) return epoch;
+    }
+    size_t expected = epoch;
+    PERSIMM_RC_CAS(domain->epoch, expected, epoch + 1);
+    return PERSIMM_RC_LOAD(domain->epoch);
+}
+
+/*
+ * Takes over a chain of boxes no load can reach, then frees every box handed
+ * over two or more epochs ago. By then each reader inside a section entered
+ * after the box was handed over, and so after it stopped being current.
+ */
+static void persimm_epoch_defer(persimm_epoch_domain_t *domain, persimm_atom_box_t *chain) {
+    PERSIMM_FENCE();
+    size_t epoch = PERSIMM_RC_LOAD(domain->epoch);
+    persimm_atom_box_t *last = chain;
+    for (;;) {
+        last->epoch = epoch;
+        if (NULL == last->next) break;
+        last = last->next;
+    }
+    persimm_atom_chain_push(&domain->retired, chain, last);
+
+    epoch = persimm_epoch_advance(domain);
+    persimm_atom_box_t *box = persimm_atom_chain_take(&domain->retired);
+    persimm_atom_box_t *kept = NULL;
+    persimm_atom_box_t *kept_last = NULL;
+    while (NULL != box) {
+        persimm_atom_box_t *next = box->next;
+        if (box->epoch + 2 <= epoch) {
+            persimm_atom_box_free(box);
+        } else {
+            box->next = kept;
+            kept = box;
+            if (NULL == kept_last) kept_last = box;
+        }
+        box = next;
+    }
+    if (NULL != kept) persimm_atom_chain_push(&domain->retired, kept, kept_last);
+}
+
+/* Atoms */
+
+static void persimm_atom_init(persimm_atom_t *atom, persimm_epoch_domain_t *domain,
+                              persimm_atom_box_t *box) {
+    atom->domain = domain;
+    PERSIMM_PTR_SET(atom->current, box);
+    PERSIMM_PTR_SET(atom->retired, NULL);
+    PERSIMM_RC_SET(atom->phase, 0);
+    PERSIMM_RC_SET(atom->loading[0].count, 0);
+    PERSIMM_RC_SET(atom->loading[1].count, 0);
+}
+
+static void persimm_atom_deinit(persimm_atom_t *atom) {
+    persimm_atom_box_free(PERSIMM_PTR_LOAD(atom->current));
+    persimm_atom_chain_free(PERSIMM_PTR_LOAD(atom->retired));
+}
+
+/* Loading */
+
+static size_t persimm_atom_enter(persimm_atom_t *atom) {
+    size_t side = PERSIMM_RC_LOAD(atom->phase) & 1;
+    PERSIMM_RC_INC(atom->loading[side].count);
+    /* The announcement must land before the pointer is read, as a swap must
+       before the counters are watched. */
+    PERSIMM_FENCE();
+    return side;
+}
+
+static void persimm_atom_exit(persimm_atom_t *atom, size_t side) {
+    PERSIMM_RC_DEC(atom->loading[side].count);
+}
+
+static persimm_atom_box_t *persimm_atom_current(persimm_atom_t *atom) {
+    return PERSIMM_PTR_LOAD(atom->current);
+}
+
+/* Reclaiming */
+
+/*
+ * Whether each counter was seen at zero, which clears every box swapped out
+ * before the call. Only those sightings matter for safety; flipping the phase
+ * first just sends newcomers to the other counter.
+ */
+static bool persimm_atom_drained(persimm_atom_t *atom) {
+    PERSIMM_FENCE();
+    size_t side = PERSIMM_RC_LOAD(atom->phase) & 1;
+    for (int pass = 0; pass < 2; pass++) {
+        PERSIMM_RC_PUT(atom->phase, side ^ 1);
+        PERSIMM_FENCE();
+        for (int spins = 0; 0 != PERSIMM_RC_LOAD(atom->loading[side].count); spins++) {
+            if (PERSIMM_ATOM_SPINS == spins) return false;
+        }
+        side ^= 1;
+    }
+    return true;
+}
+
+/*
+ * Retires `old` and then tries to free everything retired so far. The list is
+ * taken whole before the counters are watched, so every box on it was swapped
+ * out before they were, and a list that cannot be freed yet goes back intact.
+ */
+static void persimm_atom_retire(persimm_atom_t *atom, persimm_atom_box_t *old) {
+    persimm_atom_chain_push(&atom->retired, old, old);
+
+    persimm_atom_box_t *box = persimm_atom_chain_take(&atom->retired);
+    if (NULL == box) return;
+
+    if (!persimm_atom_drained(atom)) {
+        persimm_atom_box_t *last = box;
+        while (NULL != last->next) last = last->next;
+        persimm_atom_chain_push(&atom->retired, box, last);
+    } else if (NULL != atom->domain) {
+        persimm_epoch_defer(atom->domain, box);
+    } else {
+        persimm_atom_chain_free(box);
+    }
+}
+
+/* Publishing */
+
+/*
+ * Installs `box` if the version the atom holds is `expected`, retiring the box
+ * it replaced. Fails without touching either box when the atom holds some
+ * other version. The check and the exchange happen inside a load section,
+ * which keeps the box checked from being freed, and its address reused,
+ * before the exchange can see it.
+ */
+static bool persimm_atom_replace(persimm_atom_t *atom, persimm_atom_box_t *box,
+                                 bool (*matches)(const persimm_atom_box_t *held,
+                                                 const void *expected),
+                                 const void *expected) {
+    size_t side = persimm_atom_enter(atom);
+    persimm_atom_box_t *held = persimm_atom_current(atom);
+    void *seen = held;
+    bool replaced = matches(held, expected) && PERSIMM_PTR_CAS(atom->current, seen, box);
+    persimm_atom_exit(atom, side);
+
+    if (replaced) persimm_atom_retire(atom, held);
+    return replaced;
+}
+
+/*
+ * The typed faces below differ only in the collection they box. Versions
+ * match when they share storage, which a loaded version and the one it was
+ * loaded from always do. A swap holds the version it loaded until its
+ * exchange is done, so that the storage cannot be freed and reused by a newer
+ * version that would then wrongly match.
+ */
+
+/* Vectors */
+
+static bool persimm_vector_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_vector_t *version = expected;
+    return version->root == held->value.vector.root && version->tail == held->value.vector.tail &&
+           version->count == held->value.vector.count;
+}
+
+persimm_status persimm_vector_atom_new(const persimm_vector_t *initial,
+                                       persimm_epoch_domain_t *domain,
+                                       persimm_vector_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_vector_atom_t *atom = calloc(1, sizeof(persimm_vector_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_VECTOR);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_vector_clone(initial, &box->value.vector);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_vector_atom_free(persimm_vector_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_vector_atom_load(persimm_vector_atom_t *atom, persimm_vector_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_vector_clone(&persimm_atom_current(&atom->atom)->value.vector, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_vector_t *persimm_vector_atom_read(persimm_vector_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.vector;
+}
+
+persimm_status persimm_vector_atom_compare_and_set(persimm_vector_atom_t *atom,
+                                                   const persimm_vector_t *expected,
+                                                   const persimm_vector_t *desired,
+                                                   bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_VECTOR);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_vector_clone(desired, &box->value.vector);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_vector_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_vector_atom_swap(persimm_vector_atom_t *atom,
+                                        persimm_vector_update_fn update, void *ctx,
+                                        persimm_vector_t *result) {
+    for (;;) {
+        persimm_vector_t current;
+        persimm_vector_t next;
+        persimm_vector_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_vector_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_vector_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_vector_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_vector_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
+
+/* Maps */
+
+static bool persimm_map_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_map_t *version = expected;
+    return version->root == held->value.map.root && version->count == held->value.map.count;
+}
+
+persimm_status persimm_map_atom_new(const persimm_map_t *initial,
+                                    persimm_epoch_domain_t *domain,
+                                    persimm_map_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_map_atom_t *atom = calloc(1, sizeof(persimm_map_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_MAP);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_map_clone(initial, &box->value.map);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_map_atom_free(persimm_map_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_map_atom_load(persimm_map_atom_t *atom, persimm_map_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_map_clone(&persimm_atom_current(&atom->atom)->value.map, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_map_t *persimm_map_atom_read(persimm_map_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.map;
+}
+
+persimm_status persimm_map_atom_compare_and_set(persimm_map_atom_t *atom,
+                                                const persimm_map_t *expected,
+                                                const persimm_map_t *desired,
+                                                bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_MAP);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_map_clone(desired, &box->value.map);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_map_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_atom_swap(persimm_map_atom_t *atom,
+                                     persimm_map_update_fn update, void *ctx,
+                                     persimm_map_t *result) {
+    for (;;) {
+        persimm_map_t current;
+        persimm_map_t next;
+        persimm_map_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_map_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_map_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_map_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_map_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
+
+/* Sets */
+
+static bool persimm_set_atom_matches(const persimm_atom_box_t *held, const void *expected) {
+    const persimm_set_t *version = expected;
+    return version->root == held->value.set.root && version->count == held->value.set.count;
+}
+
+persimm_status persimm_set_atom_new(const persimm_set_t *initial,
+                                    persimm_epoch_domain_t *domain,
+                                    persimm_set_atom_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_set_atom_t *atom = calloc(1, sizeof(persimm_set_atom_t));
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_SET);
+    if (NULL == atom || NULL == box) {
+        free(atom);
+        free(box);
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_set_clone(initial, &box->value.set);
+    persimm_atom_init(&atom->atom, domain, box);
+    *dest = atom;
+    return PERSIMM_OK;
+}
+
+void persimm_set_atom_free(persimm_set_atom_t *atom) {
+    persimm_atom_deinit(&atom->atom);
+    free(atom);
+}
+
+void persimm_set_atom_load(persimm_set_atom_t *atom, persimm_set_t *dest) {
+    size_t side = persimm_atom_enter(&atom->atom);
+    persimm_set_clone(&persimm_atom_current(&atom->atom)->value.set, dest);
+    persimm_atom_exit(&atom->atom, side);
+}
+
+const persimm_set_t *persimm_set_atom_read(persimm_set_atom_t *atom) {
+    if (NULL == atom->atom.domain) return NULL;
+    return &persimm_atom_current(&atom->atom)->value.set;
+}
+
+persimm_status persimm_set_atom_compare_and_set(persimm_set_atom_t *atom,
+                                                const persimm_set_t *expected,
+                                                const persimm_set_t *desired,
+                                                bool *replaced) {
+    *replaced = false;
+    if (desired->local) return PERSIMM_ERR_INVALID;
+
+    persimm_atom_box_t *box = persimm_atom_box_new(PERSIMM_ATOM_SET);
+    if (NULL == box) return PERSIMM_ERR_ALLOC;
+    persimm_set_clone(desired, &box->value.set);
+
+    *replaced = persimm_atom_replace(&atom->atom, box, persimm_set_atom_matches, expected);
+    if (!*replaced) persimm_atom_box_free(box);
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_atom_swap(persimm_set_atom_t *atom,
+                                     persimm_set_update_fn update, void *ctx,
+                                     persimm_set_t *result) {
+    for (;;) {
+        persimm_set_t current;
+        persimm_set_t next;
+        persimm_set_atom_load(atom, &current);
+        persimm_status status = update(&current, ctx, &next);
+        if (PERSIMM_OK != status) {
+            persimm_set_deinit(&current);
+            return status;
+        }
+
+        bool replaced;
+        status = persimm_set_atom_compare_and_set(atom, &current, &next, &replaced);
+        persimm_set_deinit(&current);
+        if (PERSIMM_OK == status && replaced && NULL != result) {
+            *result = next;
+        } else {
+            persimm_set_deinit(&next);
+        }
+        if (PERSIMM_OK != status || replaced) return status;
+    }
+}
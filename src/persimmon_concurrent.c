@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include "persimmon_internal.h"
+
+/*
+ * A map that many threads update at once. Prokopec's Ctrie keeps an
+ * indirection node above every trie node and swings it with a
+ * compare-and-swap, so that writers on different branches never meet. Doing
+ * that at every level takes a garbage collector to free what the swings
+ * leave behind, which a C core cannot assume. Here the indirection sits at
+ * the root alone: each of the root's 32 slots is an atom holding the trie of
+ * the keys whose hashes land in it. A writer swaps one slot and copies only
+ * that slot's path, and writers in different slots share no memory at all.
+ * Reclaiming what a swap replaces is then the atom's business.
+ *
+ * A snapshot must see every slot as it was at one moment. It loads all 32,
+ * then checks that each still holds what was loaded. A version is never
+ * published twice, since an update derives a fresh root or fails to publish,
+ * so a slot that holds the same version at both ends held it throughout, and
+ * the loads together are the map as it was between the two passes. Joining
+ * the slots' roots then makes an ordinary map in one allocation.
+ *
+ * That can fail for as long as writers keep landing between the passes. A
+ * snapshot that has failed a few times raises a flag that holds new writers
+ * back, lets those already under way finish and then cannot fail again.
+ * Writers never wait for one another, but they do wait on such a snapshot:
+ * while the flag is up every writer spins, so a snapshot thread descheduled
+ * with it raised stalls them all until it runs again. Writers are lock-free
+ * only between snapshots that have to fall back that far.
+ */
+
+/* Geometry */
+
+/* As for snapshots: keeps the flag every writer reads off the lines writers change. */
+#define PERSIMM_CONCURRENT_LINE 64
+
+/*
+ * How many times a snapshot races writers before it holds them back. The
+ * thread checks build with it at 0 so that every snapshot holds them back.
+ */
+#if !defined(PERSIMM_CONCURRENT_TRIES)
+#define PERSIMM_CONCURRENT_TRIES 8
+#endif
+
+struct persimm_concurrent_map {
+    /* The layout, operation tables and contexts every slot shares, holding nothing. */
+    persimm_map_t empty;
+    persimm_hamt_t hamt;
+    persimm_map_atom_t *slots[PERSIMM_WIDTH];
+    unsigned char padding[PERSIMM_CONCURRENT_LINE];
+    /* Snapshots holding writers back. */
+    persimm_refcount_t pending;
+    unsigned char tail[PERSIMM_CONCURRENT_LINE - sizeof(persimm_refcount_t)];
+};
+
+/* Creating */
+
+persimm_status persimm_concurrent_map_new(const persimm_map_t *initial,
+                                          persimm_epoch_domain_t *domain,
+                                          persimm_concurrent_map_t **dest) {
+    *dest = NULL;
+    if (initial->local) return PERSIMM_ERR_INVALID;
+
+    persimm_concurrent_map_t *map = calloc(1, sizeof(persimm_concurrent_map_t));
+    if (NULL == map) return PERSIMM_ERR_ALLOC;
+
+    map->empty = *initial;
+    map->empty.count = 0;
+    map->empty.root = NULL;
+    persimm_hamt_config(&map->hamt, &initial->layout, initial->value_ops, initial->value_ctx,
+                        initial->key_ops, initial->key_ctx, false);
+    PERSIMM_RC_SET(map->pending, 0);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(initial->root, &map->hamt, roots, counts);
+    if (PERSIMM_OK != status) {
+        free(map);
+        return status;
+    }
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_t part = map->empty;
+        part.count = counts[i];
+        part.root = roots[i];
+        if (PERSIMM_OK == status) status = persimm_map_atom_new(&part, domain, &map->slots[i]);
+        persimm_map_deinit(&part);
+    }
+    if (PERSIMM_OK != status) {
+        persimm_concurrent_map_free(map);
+        return status;
+    }
+
+    *dest = map;
+    return PERSIMM_OK;
+}
+
+void persimm_concurrent_map_free(persimm_concurrent_map_t *map) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        if (NULL != map->slots[i]) persimm_map_atom_free(map->slots[i]);
+    }
+    free(map);
+}
+
+static persimm_map_atom_t *persimm_concurrent_slot(persimm_concurrent_map_t *map,
+                                                   const void *key) {
+    PERSIMM_COUNT(hamt, hash_calls);
+    uint32_t hash = map->hamt.hash(key, map->hamt.layout.key_size, map->hamt.key_ctx);
+    return map->slots[hash & PERSIMM_MASK];
+}
+
+/* Reading */
+
+bool persimm_concurrent_map_get(persimm_concurrent_map_t *map, const void *key, void *entry) {
+    persimm_map_t part;
+    persimm_map_atom_load(persimm_concurrent_slot(map, key), &part);
+
+    const void *found = persimm_map_find_entry(&part, key);
+    if (NULL != found) {
+        memcpy(entry, found, map->hamt.layout.entry_size);
+        if (NULL != map->hamt.key_ops && NULL != map->hamt.key_ops->retain) {
+            map->hamt.key_ops->retain(entry, map->hamt.key_ctx);
+        }
+        if (map->hamt.layout.value_size > 0) {
+            persimm_elem_retain(map->hamt.value_ops, map->hamt.value_ctx,
+                                (unsigned char *)entry + map->hamt.layout.value_offset);
+        }
+    }
+
+    persimm_map_deinit(&part);
+    return NULL != found;
+}
+
+const void *persimm_concurrent_map_find(persimm_concurrent_map_t *map, const void *key) {
+    const persimm_map_t *part = persimm_map_atom_read(persimm_concurrent_slot(map, key));
+    return NULL == part ? NULL : persimm_map_find_entry(part, key);
+}
+
+/* Writing */
+
+typedef struct {
+    const void *item;
+    /* The size the slot's trie had before and after the last attempt. */
+    size_t before;
+    size_t after;
+} persimm_concurrent_edit_t;
+
+static persimm_status persimm_concurrent_assoc_slot(const persimm_map_t *current, void *ctx,
+                                                    persimm_map_t *next) {
+    persimm_concurrent_edit_t *edit = ctx;
+    persimm_status status = persimm_map_assoc(current, edit->item, next);
+    edit->before = current->count;
+    edit->after = next->count;
+    return status;
+}
+
+static persimm_status persimm_concurrent_dissoc_slot(const persimm_map_t *current, void *ctx,
+                                                     persimm_map_t *next) {
+    persimm_concurrent_edit_t *edit = ctx;
+    persimm_status status = persimm_map_dissoc(current, edit->item, next);
+    edit->before = current->count;
+    edit->after = next->count;
+    return status;
+}
+
+/*
+ * The flag is read before the slot is, so a writer that misses a snapshot's
+ * flag is one the snapshot will see under way or finished.
+ */
+static persimm_status persimm_concurrent_write(persimm_concurrent_map_t *map, const void *item,
+                                               persimm_map_update_fn update,
+                                               persimm_concurrent_edit_t *edit) {
+    while (0 != PERSIMM_RC_LOAD(map->pending)) PERSIMM_RELAX();
+    edit->item = item;
+    edit->before = 0;
+    edit->after = 0;
+    return persimm_map_atom_swap(persimm_concurrent_slot(map, item), update, edit, NULL);
+}
+
+persimm_status persimm_concurrent_map_assoc(persimm_concurrent_map_t *map, const void *entry,
+                                            bool *added) {
+    persimm_concurrent_edit_t edit;
+    persimm_status status = persimm_concurrent_write(map, entry, persimm_concurrent_assoc_slot,
+                                                     &edit);
+    if (NULL != added) *added = PERSIMM_OK == status && edit.after > edit.before;
+    return status;
+}
+
+persimm_status persimm_concurrent_map_dissoc(persimm_concurrent_map_t *map, const void *key,
+                                             bool *removed) {
+    persimm_concurrent_edit_t edit;
+    persimm_status status = persimm_concurrent_write(map, key, persimm_concurrent_dissoc_slot,
+                                                     &edit);
+    if (NULL != removed) *removed = PERSIMM_OK == status && edit.after < edit.before;
+    return status;
+}
+
+/* Snapshots */
+
+/* Loads every slot, returning whether each still held its version after all were loaded. */
+static bool persimm_concurrent_collect(persimm_concurrent_map_t *map, persimm_map_t *parts) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_atom_load(map->slots[i], &parts[i]);
+
+    bool steady = true;
+    for (size_t i = 0; i < PERSIMM_WIDTH && steady; i++) {
+        persimm_map_t held;
+        persimm_map_atom_load(map->slots[i], &held);
+        steady = held.root == parts[i].root && held.count == parts[i].count;
+        persimm_map_deinit(&held);
+    }
+    if (!steady) {
+        for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_deinit(&parts[i]);
+    }
+    return steady;
+}
+
+persimm_status persimm_concurrent_map_snapshot(persimm_concurrent_map_t *map,
+                                               persimm_map_t *dest) {
+    persimm_map_t parts[PERSIMM_WIDTH];
+    bool holding = false;
+
+    for (int tries = 0;; tries++) {
+        if (PERSIMM_CONCURRENT_TRIES == tries) {
+            PERSIMM_RC_INC(map->pending);
+            PERSIMM_FENCE();
+            holding = true;
+        }
+        if (persimm_concurrent_collect(map, parts)) break;
+    }
+    if (holding) PERSIMM_RC_DEC(map->pending);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t count = 0;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        roots[i] = parts[i].root;
+        count += parts[i].count;
+    }
+
+    *dest = map->empty;
+    persimm_status status = persimm_hamt_join(roots, PERSIMM_WIDTH, &map->hamt, &dest->root);
+    if (PERSIMM_OK == status) dest->count = count;
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_map_deinit(&parts[i]);
+    return status;
+}
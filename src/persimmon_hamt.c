@@ -27,6 +27,12 @@
  * group of fully colliding keys in different orders. Anything a host derives
  * from a whole map, a hash above all, must therefore not depend on the order
  * its entries come out in.
+ *
+ * Every node also carries a structural hash of what lies beneath it, the sum
+ * of one mixed term per entry. Addition is commutative, so a collision node's
+ * order does not reach it, and it is exact under subtraction, so a path copy
+ * corrects each node it makes by what changed rather than rereading the rest.
+ * The root's is then a hash of the whole trie at no cost to read.
  */
 
 /* Types */
@@ -42,6 +48,8 @@ struct persimm_hamt_node {
     uint32_t datamap; // bitmap: the slots holding an entry. collision: how many entries
     uint32_t nodemap; // bitmap: the slots holding a child. collision: zero
     uint32_t hash;    // collision: the hash every entry shares. bitmap: unused
+    uint32_t merkle;  // the sum of persimm_hamt_term over every entry beneath
+    uint32_t traced;  // the last epoch the node was traced in
     persimm_align_t data[];
 };
 
@@ -94,13 +102,7 @@ static bool persimm_hamt_is_single(persimm_hamt_node_t *node) {
 
 static uint32_t persimm_hamt_byte_hash(const void *key, size_t key_size, void *ctx) {
     (void) ctx;
-    const unsigned char *bytes = (const unsigned char *)key;
-    uint32_t hash = 2166136261u;
-    for (size_t i = 0; i < key_size; i++) {
-        hash ^= bytes[i];
-        hash *= 16777619u;
-    }
-    return hash;
+    return persimm_hash_bytes(key, key_size);
 }
 
 static bool persimm_hamt_byte_equals(const void *key_a, const void *key_b, size_t key_size,
@@ -111,7 +113,7 @@ static bool persimm_hamt_byte_equals(const void *key_a, const void *key_b, size_
 
 void persimm_hamt_config(persimm_hamt_t *hamt, const persimm_entry_layout *layout,
                          const persimm_elem_ops *value_ops, void *value_ctx,
-                         const persimm_key_ops *key_ops, void *key_ctx) {
+                         const persimm_key_ops *key_ops, void *key_ctx, bool local) {
     hamt->layout = *layout;
     hamt->value_ops = value_ops;
     hamt->key_ops = key_ops;
@@ -121,6 +123,7 @@ void persimm_hamt_config(persimm_hamt_t *hamt, const persimm_entry_layout *layou
                                                                 : persimm_hamt_byte_equals;
     hamt->value_ctx = value_ctx;
     hamt->key_ctx = key_ctx;
+    hamt->local = local;
 }
 
 bool persimm_hamt_layout_valid(const persimm_entry_layout *layout) {
@@ -133,11 +136,13 @@ bool persimm_hamt_layout_valid(const persimm_entry_layout *layout) {
 }
 
 static uint32_t persimm_hamt_hash_of(const persimm_hamt_t *hamt, const void *key) {
+    PERSIMM_COUNT(hamt, hash_calls);
     return hamt->hash(key, hamt->layout.key_size, hamt->key_ctx);
 }
 
 static bool persimm_hamt_keys_equal(const persimm_hamt_t *hamt, const void *key_a,
                                     const void *key_b) {
+    PERSIMM_COUNT(hamt, equals_calls);
     return hamt->equals(key_a, key_b, hamt->layout.key_size, hamt->key_ctx);
 }
 
@@ -156,7 +161,23 @@ static const void *persimm_hamt_value_const(const persimm_hamt_t *hamt, const vo
     return (const unsigned char *)entry + hamt->layout.value_offset;
 }
 
+/*
+ * An entry's share of the structural hash. `hash` is its key's, which every
+ * caller already has to hand. A value counts only when the host can hash it;
+ * otherwise maps differing only in their values share a hash, which is still
+ * sound since equal maps are all a hash has to agree on.
+ */
+static uint32_t persimm_hamt_term(const persimm_hamt_t *hamt, uint32_t hash, const void *entry) {
+    uint32_t value = 0;
+    if (hamt->layout.value_size > 0 && persimm_elem_hashes(hamt->value_ops)) {
+        PERSIMM_COUNT(hamt, hash_calls);
+        value = hamt->value_ops->hash(persimm_hamt_value_const(hamt, entry), hamt->value_ctx);
+    }
+    return persimm_hash_mix(hash ^ persimm_hash_mix(value + 0x9e3779b9u));
+}
+
 static void persimm_hamt_entry_retain(const persimm_hamt_t *hamt, void *entry) {
+    PERSIMM_COUNT(hamt, retains);
     if (NULL != hamt->key_ops && NULL != hamt->key_ops->retain) {
         hamt->key_ops->retain(entry, hamt->key_ctx);
     }
@@ -167,6 +188,7 @@ static void persimm_hamt_entry_retain(const persimm_hamt_t *hamt, void *entry) {
 }
 
 static void persimm_hamt_entry_release(const persimm_hamt_t *hamt, void *entry) {
+    PERSIMM_COUNT(hamt, releases);
     if (NULL != hamt->key_ops && NULL != hamt->key_ops->release) {
         hamt->key_ops->release(entry, hamt->key_ctx);
     }
@@ -178,13 +200,13 @@ static void persimm_hamt_entry_release(const persimm_hamt_t *hamt, void *entry)
 
 /* Deinitialising */
 
-void persimm_hamt_retain(persimm_hamt_node_t *root) {
-    if (NULL != root) PERSIMM_RC_INC(root->ref_count);
+void persimm_hamt_retain(persimm_hamt_node_t *root, const persimm_hamt_t *hamt) {
+    if (NULL != root) persimm_rc_inc(&root->ref_count, hamt->local);
 }
 
 void persimm_hamt_release(persimm_hamt_node_t *node, const persimm_hamt_t *hamt) {
     if (NULL == node) return;
-    if (PERSIMM_RC_DEC(node->ref_count) > 1) return;
+    if (persimm_rc_dec(&node->ref_count, hamt->local) > 1) return;
 
     size_t entry_size = hamt->layout.entry_size;
 
@@ -199,33 +221,53 @@ void persimm_hamt_release(persimm_hamt_node_t *node, const persimm_hamt_t *hamt)
         persimm_hamt_release(children[i], hamt);
     }
 
+    PERSIMM_COUNT(hamt, node_frees);
     free(node);
 }
 
+/*
+ * A node already immortal heads a subtree an earlier freeze reached, so the
+ * walk goes no further into it.
+ */
+void persimm_hamt_freeze(persimm_hamt_node_t *node, const persimm_hamt_t *hamt) {
+    if (NULL == node || !persimm_rc_freeze(&node->ref_count)) return;
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, hamt->layout.entry_size);
+    for (uint32_t i = 0; i < child_count; i++) persimm_hamt_freeze(children[i], hamt);
+}
+
 /* Initialising */
 
-static persimm_hamt_node_t *persimm_hamt_node_new(uint32_t kind, uint32_t data_count,
-                                                  uint32_t child_count, size_t entry_size) {
+static bool persimm_hamt_node_bytes(uint32_t data_count, uint32_t child_count,
+                                    size_t entry_size, size_t *size) {
     size_t bytes;
-    if (!persimm_size_mul((size_t)data_count, entry_size, &bytes)) return NULL;
+    if (!persimm_size_mul((size_t)data_count, entry_size, &bytes)) return false;
 
     if (child_count > 0) {
-        if (bytes > SIZE_MAX - (PERSIMM_ALIGNMENT - 1)) return NULL;
+        if (bytes > SIZE_MAX - (PERSIMM_ALIGNMENT - 1)) return false;
         bytes = PERSIMM_ALIGN_UP(bytes);
 
         size_t child_bytes;
         if (!persimm_size_mul((size_t)child_count, sizeof(persimm_hamt_node_t *), &child_bytes) ||
             !persimm_size_add(bytes, child_bytes, &bytes)) {
-            return NULL;
+            return false;
         }
     }
 
-    if (!persimm_size_add(offsetof(struct persimm_hamt_node, data), bytes, &bytes)) return NULL;
+    return persimm_size_add(offsetof(struct persimm_hamt_node, data), bytes, size);
+}
+
+static persimm_hamt_node_t *persimm_hamt_node_new(uint32_t kind, uint32_t data_count,
+                                                  uint32_t child_count, size_t entry_size) {
+    size_t bytes;
+    if (!persimm_hamt_node_bytes(data_count, child_count, entry_size, &bytes)) return NULL;
     persimm_hamt_node_t *node = calloc(1, bytes);
     if (NULL == node) return NULL;
 
     node->kind = kind;
     PERSIMM_RC_SET(node->ref_count, 1);
+    PERSIMM_COUNT(hamt, node_allocs);
 
     return node;
 }
@@ -256,10 +298,13 @@ typedef enum {
  */
 static void persimm_hamt_copy_children(persimm_hamt_node_t *from, persimm_hamt_node_t *to,
                                        persimm_hamt_child_edit edit, uint32_t at,
-                                       persimm_hamt_node_t *child, size_t entry_size) {
+                                       persimm_hamt_node_t *child,
+                                       const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
     uint32_t count = persimm_hamt_child_count(from);
     persimm_hamt_node_t **source = persimm_hamt_children(from, entry_size);
     persimm_hamt_node_t **dest = persimm_hamt_children(to, entry_size);
+    PERSIMM_COUNT(hamt, path_copies);
 
     uint32_t out = 0;
     for (uint32_t i = 0; i < count; i++) {
@@ -272,7 +317,7 @@ static void persimm_hamt_copy_children(persimm_hamt_node_t *from, persimm_hamt_n
             if (PERSIMM_HAMT_CHILD_INSERT == edit) dest[out++] = child;
         }
         dest[out] = source[i];
-        PERSIMM_RC_INC(dest[out]->ref_count);
+        persimm_rc_inc(&dest[out]->ref_count, hamt->local);
         out++;
     }
 
@@ -280,23 +325,33 @@ static void persimm_hamt_copy_children(persimm_hamt_node_t *from, persimm_hamt_n
     if (PERSIMM_HAMT_CHILD_INSERT == edit && at >= count) dest[out] = child;
 }
 
-/* Replaces the value of the entry at `index`, keeping the key already stored. */
+/*
+ * Replaces the value of the entry at `index`, keeping the key already stored.
+ * `hash` is the key's.
+ */
 static persimm_hamt_node_t *persimm_hamt_with_value(persimm_hamt_node_t *node, uint32_t index,
-                                                    const void *entry, const persimm_hamt_t *hamt,
-                                                    bool immutable) {
+                                                    const void *entry, uint32_t hash,
+                                                    const persimm_hamt_t *hamt, bool immutable) {
     size_t entry_size = hamt->layout.entry_size;
     size_t value_size = hamt->layout.value_size;
 
     /* A set's entries are keys alone, so one already present is unchanged. */
     if (0 == value_size) return node;
 
+    void *held = persimm_hamt_entry(node, index, entry_size);
+    uint32_t delta = persimm_hamt_term(hamt, hash, entry) - persimm_hamt_term(hamt, hash, held);
+
     if (!immutable && 1 == PERSIMM_RC_LOAD(node->ref_count)) {
-        void *slot = persimm_hamt_value(hamt, persimm_hamt_entry(node, index, entry_size));
+        void *slot = persimm_hamt_value(hamt, held);
         void *replacement = persimm_hamt_value(hamt, (void *)entry);
         if (replacement == slot) return node;
+        node->merkle += delta;
         persimm_elem_release(hamt->value_ops, hamt->value_ctx, slot);
         memcpy(slot, replacement, value_size);
         persimm_elem_retain(hamt->value_ops, hamt->value_ctx, slot);
+        PERSIMM_COUNT(hamt, releases);
+        PERSIMM_COUNT(hamt, retains);
+        PERSIMM_COUNT(hamt, in_place_edits);
         return node;
     }
 
@@ -309,6 +364,7 @@ static persimm_hamt_node_t *persimm_hamt_with_value(persimm_hamt_node_t *node, u
     copy->datamap = node->datamap;
     copy->nodemap = node->nodemap;
     copy->hash = node->hash;
+    copy->merkle = node->merkle + delta;
 
     memcpy(copy->data, node->data, (size_t)data_count * entry_size);
     /* The new value displaces the old before anything retains it, so the old
@@ -319,16 +375,19 @@ static persimm_hamt_node_t *persimm_hamt_with_value(persimm_hamt_node_t *node, u
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
 }
 
-/* Adds an entry at `index`, marking `bit` in the datamap of a bitmap node. */
+/*
+ * Adds an entry whose key hashes to `hash` at `index`, marking `bit` in the
+ * datamap of a bitmap node.
+ */
 static persimm_hamt_node_t *persimm_hamt_with_entry(persimm_hamt_node_t *node, uint32_t bit,
                                                     uint32_t index, const void *entry,
-                                                    const persimm_hamt_t *hamt) {
+                                                    uint32_t hash, const persimm_hamt_t *hamt) {
     size_t entry_size = hamt->layout.entry_size;
     uint32_t data_count = persimm_hamt_data_count(node);
     uint32_t child_count = persimm_hamt_child_count(node);
@@ -342,6 +401,7 @@ static persimm_hamt_node_t *persimm_hamt_with_entry(persimm_hamt_node_t *node, u
                                                            : (node->datamap | bit);
     copy->nodemap = node->nodemap;
     copy->hash = node->hash;
+    copy->merkle = node->merkle + persimm_hamt_term(hamt, hash, entry);
 
     memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
            (size_t)index * entry_size);
@@ -354,15 +414,18 @@ static persimm_hamt_node_t *persimm_hamt_with_entry(persimm_hamt_node_t *node, u
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
 }
 
-/* Drops the entry at `index`, clearing `bit` in the datamap of a bitmap node. */
+/*
+ * Drops the entry at `index`, whose key hashes to `hash`, clearing `bit` in the
+ * datamap of a bitmap node.
+ */
 static persimm_hamt_node_t *persimm_hamt_without_entry(persimm_hamt_node_t *node, uint32_t bit,
-                                                       uint32_t index,
+                                                       uint32_t index, uint32_t hash,
                                                        const persimm_hamt_t *hamt) {
     size_t entry_size = hamt->layout.entry_size;
     uint32_t data_count = persimm_hamt_data_count(node);
@@ -375,6 +438,8 @@ static persimm_hamt_node_t *persimm_hamt_without_entry(persimm_hamt_node_t *node
                                                            : (node->datamap & ~bit);
     copy->nodemap = node->nodemap;
     copy->hash = node->hash;
+    copy->merkle = node->merkle -
+                   persimm_hamt_term(hamt, hash, persimm_hamt_entry(node, index, entry_size));
 
     memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
            (size_t)index * entry_size);
@@ -386,7 +451,7 @@ static persimm_hamt_node_t *persimm_hamt_without_entry(persimm_hamt_node_t *node
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_KEEP, 0, NULL, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
@@ -401,8 +466,10 @@ static persimm_hamt_node_t *persimm_hamt_with_child(persimm_hamt_node_t *node, u
     if (!immutable && 1 == PERSIMM_RC_LOAD(node->ref_count)) {
         persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
         persimm_hamt_node_t *old = children[index];
+        node->merkle += child->merkle - old->merkle;
         children[index] = child;
         persimm_hamt_release(old, hamt);
+        PERSIMM_COUNT(hamt, in_place_edits);
         return node;
     }
 
@@ -415,21 +482,26 @@ static persimm_hamt_node_t *persimm_hamt_with_child(persimm_hamt_node_t *node, u
     copy->datamap = node->datamap;
     copy->nodemap = node->nodemap;
     copy->hash = node->hash;
+    copy->merkle = node->merkle + child->merkle -
+                   persimm_hamt_children(node, entry_size)[index]->merkle;
 
     memcpy(copy->data, node->data, (size_t)data_count * entry_size);
     for (uint32_t i = 0; i < data_count; i++) {
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REPLACE, index, child, entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REPLACE, index, child, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
 }
 
-/* Turns the entry in slot `bit` into the child that now holds it and one more. */
+/*
+ * Turns the entry in slot `bit`, whose key hashes to `hash`, into the child
+ * that now holds it and one more.
+ */
 static persimm_hamt_node_t *persimm_hamt_promote(persimm_hamt_node_t *node, uint32_t bit,
-                                                 persimm_hamt_node_t *child,
+                                                 uint32_t hash, persimm_hamt_node_t *child,
                                                  const persimm_hamt_t *hamt) {
     size_t entry_size = hamt->layout.entry_size;
     uint32_t data_count = persimm_hamt_data_count(node);
@@ -443,6 +515,8 @@ static persimm_hamt_node_t *persimm_hamt_promote(persimm_hamt_node_t *node, uint
     copy->datamap = node->datamap & ~bit;
     copy->nodemap = node->nodemap | bit;
     copy->hash = node->hash;
+    copy->merkle = node->merkle + child->merkle -
+                   persimm_hamt_term(hamt, hash, persimm_hamt_entry(node, data_index, entry_size));
 
     memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
            (size_t)data_index * entry_size);
@@ -454,16 +528,19 @@ static persimm_hamt_node_t *persimm_hamt_promote(persimm_hamt_node_t *node, uint
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_INSERT, child_index, child,
-                               entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_INSERT, child_index, child, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
 }
 
-/* Pulls `entry` out of the child in slot `bit` and inlines it in the child's place. */
+/*
+ * Pulls `entry` out of the child in slot `bit` and inlines it in the child's
+ * place. `term` is the entry's share of the structural hash.
+ */
 static persimm_hamt_node_t *persimm_hamt_demote(persimm_hamt_node_t *node, uint32_t bit,
-                                                const void *entry, const persimm_hamt_t *hamt) {
+                                                const void *entry, uint32_t term,
+                                                const persimm_hamt_t *hamt) {
     size_t entry_size = hamt->layout.entry_size;
     uint32_t data_count = persimm_hamt_data_count(node);
     uint32_t child_count = persimm_hamt_child_count(node);
@@ -476,6 +553,8 @@ static persimm_hamt_node_t *persimm_hamt_demote(persimm_hamt_node_t *node, uint3
     copy->datamap = node->datamap | bit;
     copy->nodemap = node->nodemap & ~bit;
     copy->hash = node->hash;
+    copy->merkle = node->merkle + term -
+                   persimm_hamt_children(node, entry_size)[child_index]->merkle;
 
     memcpy(persimm_hamt_entry(copy, 0, entry_size), persimm_hamt_entry(node, 0, entry_size),
            (size_t)data_index * entry_size);
@@ -490,8 +569,7 @@ static persimm_hamt_node_t *persimm_hamt_demote(persimm_hamt_node_t *node, uint3
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(copy, i, entry_size));
     }
 
-    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REMOVE, child_index, NULL,
-                               entry_size);
+    persimm_hamt_copy_children(node, copy, PERSIMM_HAMT_CHILD_REMOVE, child_index, NULL, hamt);
     persimm_hamt_release(node, hamt);
 
     return copy;
@@ -507,6 +585,8 @@ static persimm_hamt_node_t *persimm_hamt_merge(size_t shift, const void *entry_a
                                                const void *entry_b, uint32_t hash_b,
                                                const persimm_hamt_t *hamt) {
     size_t entry_size = hamt->layout.entry_size;
+    uint32_t merkle = persimm_hamt_term(hamt, hash_a, entry_a) +
+                      persimm_hamt_term(hamt, hash_b, entry_b);
     persimm_hamt_node_t *node;
 
     if (hash_a == hash_b) {
@@ -514,6 +594,7 @@ static persimm_hamt_node_t *persimm_hamt_merge(size_t shift, const void *entry_a
         if (NULL == node) return NULL;
         node->datamap = 2;
         node->hash = hash_a;
+        node->merkle = merkle;
         memcpy(persimm_hamt_entry(node, 0, entry_size), entry_a, entry_size);
         memcpy(persimm_hamt_entry(node, 1, entry_size), entry_b, entry_size);
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 0, entry_size));
@@ -534,6 +615,7 @@ static persimm_hamt_node_t *persimm_hamt_merge(size_t shift, const void *entry_a
             return NULL;
         }
         node->nodemap = bit_a;
+        node->merkle = merkle;
         persimm_hamt_children(node, entry_size)[0] = child;
         return node;
     }
@@ -541,6 +623,7 @@ static persimm_hamt_node_t *persimm_hamt_merge(size_t shift, const void *entry_a
     node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 2, 0, entry_size);
     if (NULL == node) return NULL;
     node->datamap = bit_a | bit_b;
+    node->merkle = merkle;
 
     /* Entries sit in bit order, so the lower slot takes the first place. */
     const void *first = (bit_a < bit_b) ? entry_a : entry_b;
@@ -565,6 +648,7 @@ const void *persimm_hamt_ref(persimm_hamt_node_t *root, const void *key,
     while (NULL != node) {
         if (PERSIMM_HAMT_COLLISION == node->kind) {
             if (node->hash != hash) return NULL;
+            PERSIMM_COUNT(hamt, collision_scans);
             for (uint32_t i = 0; i < node->datamap; i++) {
                 void *entry = persimm_hamt_entry(node, i, entry_size);
                 if (persimm_hamt_keys_equal(hamt, key, entry)) return entry;
@@ -605,13 +689,14 @@ static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, s
 
     if (PERSIMM_HAMT_COLLISION == node->kind) {
         if (node->hash == hash) {
+            PERSIMM_COUNT(hamt, collision_scans);
             for (uint32_t i = 0; i < node->datamap; i++) {
                 if (persimm_hamt_keys_equal(hamt, entry, persimm_hamt_entry(node, i, entry_size))) {
-                    return persimm_hamt_with_value(node, i, entry, hamt, immutable);
+                    return persimm_hamt_with_value(node, i, entry, hash, hamt, immutable);
                 }
             }
             *added = true;
-            return persimm_hamt_with_entry(node, 0, node->datamap, entry, hamt);
+            return persimm_hamt_with_entry(node, 0, node->datamap, entry, hash, hamt);
         }
 
         /* Another hash cannot belong here, so the collision node gains a
@@ -619,12 +704,14 @@ static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, s
         persimm_hamt_node_t *parent = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
         if (NULL == parent) return NULL;
         parent->nodemap = persimm_hamt_bit(node->hash, shift);
+        parent->merkle = node->merkle;
         persimm_hamt_children(parent, entry_size)[0] = node;
         persimm_hamt_node_t *result =
             persimm_hamt_node_assoc(parent, shift, hash, entry, hamt, immutable, added);
         if (NULL == result) {
             /* The caller still owns node when the operation fails. Parent's
              * temporary reference was a transfer only if the update commits. */
+            PERSIMM_COUNT(hamt, node_frees);
             free(parent);
         }
         return result;
@@ -637,15 +724,15 @@ static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, s
         void *existing = persimm_hamt_entry(node, index, entry_size);
 
         if (persimm_hamt_keys_equal(hamt, entry, existing)) {
-            return persimm_hamt_with_value(node, index, entry, hamt, immutable);
+            return persimm_hamt_with_value(node, index, entry, hash, hamt, immutable);
         }
 
+        uint32_t existing_hash = persimm_hamt_hash_of(hamt, existing);
         persimm_hamt_node_t *child = persimm_hamt_merge(shift + PERSIMM_BITS, existing,
-                                                        persimm_hamt_hash_of(hamt, existing),
-                                                        entry, hash, hamt);
+                                                        existing_hash, entry, hash, hamt);
         if (NULL == child) return NULL;
 
-        persimm_hamt_node_t *result = persimm_hamt_promote(node, bit, child, hamt);
+        persimm_hamt_node_t *result = persimm_hamt_promote(node, bit, existing_hash, child, hamt);
         if (NULL == result) {
             persimm_hamt_release(child, hamt);
             return NULL;
@@ -658,7 +745,7 @@ static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, s
     if (node->nodemap & bit) {
         uint32_t index = persimm_hamt_child_index(node, bit);
         persimm_hamt_node_t *child = persimm_hamt_children(node, entry_size)[index];
-        PERSIMM_RC_INC(child->ref_count);
+        persimm_rc_inc(&child->ref_count, hamt->local);
 
         persimm_hamt_node_t *updated = persimm_hamt_node_assoc(child, shift + PERSIMM_BITS, hash,
                                                                entry, hamt, immutable, added);
@@ -674,7 +761,8 @@ static persimm_hamt_node_t *persimm_hamt_node_assoc(persimm_hamt_node_t *node, s
     }
 
     *added = true;
-    return persimm_hamt_with_entry(node, bit, persimm_hamt_data_index(node, bit), entry, hamt);
+    return persimm_hamt_with_entry(node, bit, persimm_hamt_data_index(node, bit), entry, hash,
+                                   hamt);
 }
 
 persimm_status persimm_hamt_assoc(persimm_hamt_node_t **root, const void *entry,
@@ -688,6 +776,7 @@ persimm_status persimm_hamt_assoc(persimm_hamt_node_t **root, const void *entry,
         persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 1, 0, entry_size);
         if (NULL == node) return PERSIMM_ERR_ALLOC;
         node->datamap = persimm_hamt_bit(hash, 0);
+        node->merkle = persimm_hamt_term(hamt, hash, entry);
         memcpy(persimm_hamt_entry(node, 0, entry_size), entry, entry_size);
         persimm_hamt_entry_retain(hamt, persimm_hamt_entry(node, 0, entry_size));
         *root = node;
@@ -719,10 +808,11 @@ static persimm_hamt_node_t *persimm_hamt_node_dissoc(persimm_hamt_node_t *node,
 
     if (PERSIMM_HAMT_COLLISION == node->kind) {
         if (node->hash != hash) return node;
+        PERSIMM_COUNT(hamt, collision_scans);
         for (uint32_t i = 0; i < node->datamap; i++) {
             if (persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, i, entry_size))) {
                 *removed = true;
-                return persimm_hamt_without_entry(node, 0, i, hamt);
+                return persimm_hamt_without_entry(node, 0, i, hash, hamt);
             }
         }
         return node;
@@ -736,13 +826,13 @@ static persimm_hamt_node_t *persimm_hamt_node_dissoc(persimm_hamt_node_t *node,
             return node;
         }
         *removed = true;
-        return persimm_hamt_without_entry(node, bit, index, hamt);
+        return persimm_hamt_without_entry(node, bit, index, hash, hamt);
     }
 
     if (node->nodemap & bit) {
         uint32_t index = persimm_hamt_child_index(node, bit);
         persimm_hamt_node_t *child = persimm_hamt_children(node, entry_size)[index];
-        PERSIMM_RC_INC(child->ref_count);
+        persimm_rc_inc(&child->ref_count, hamt->local);
 
         persimm_hamt_node_t *updated = persimm_hamt_node_dissoc(child, shift + PERSIMM_BITS, hash,
                                                                 key, hamt, immutable, removed);
@@ -759,7 +849,8 @@ static persimm_hamt_node_t *persimm_hamt_node_dissoc(persimm_hamt_node_t *node,
            else belongs inline, and that may cascade the whole way up. */
         if (persimm_hamt_is_single(updated)) {
             persimm_hamt_node_t *result =
-                persimm_hamt_demote(node, bit, persimm_hamt_entry(updated, 0, entry_size), hamt);
+                persimm_hamt_demote(node, bit, persimm_hamt_entry(updated, 0, entry_size),
+                                    updated->merkle, hamt);
             persimm_hamt_release(updated, hamt);
             return result;
         }
@@ -794,6 +885,1091 @@ persimm_status persimm_hamt_dissoc(persimm_hamt_node_t **root, const void *key,
     return PERSIMM_OK;
 }
 
+/* Building */
+
+/*
+ * A bulk build hashes every input once up front and from then on works only
+ * with these. `key` is the input whose key the trie keeps and `value` the one
+ * whose value it keeps, which differ only when a key arrives more than once.
+ * An item marked `existing` stands for an entry a trie already holds, which a
+ * batch meets when it updates one.
+ */
+typedef struct {
+    const unsigned char *key;
+    const unsigned char *value;
+    uint32_t hash;
+    bool existing;
+} persimm_hamt_item_t;
+
+/*
+ * Allocates room for `count + spare` items and fills the first `count` from
+ * inputs laid out `stride` bytes apart, hashing each. The spare room is left
+ * for the caller.
+ */
+static persimm_hamt_item_t *persimm_hamt_items_new(const void *inputs, size_t count,
+                                                   size_t stride, size_t spare,
+                                                   const persimm_hamt_t *hamt) {
+    size_t total;
+    size_t bytes;
+    if (!persimm_size_add(count, spare, &total) ||
+        !persimm_size_mul(total, sizeof(persimm_hamt_item_t), &bytes)) {
+        return NULL;
+    }
+
+    persimm_hamt_item_t *items = calloc(1, bytes);
+    if (NULL == items) return NULL;
+
+    const unsigned char *input = (const unsigned char *)inputs;
+    for (size_t i = 0; i < count; i++) {
+        items[i].key = input + (i * stride);
+        items[i].value = items[i].key;
+        items[i].hash = persimm_hamt_hash_of(hamt, items[i].key);
+    }
+
+    return items;
+}
+
+static uint32_t persimm_hamt_chunk(uint32_t hash, size_t shift) {
+    return (hash >> shift) & PERSIMM_MASK;
+}
+
+/*
+ * Sorts `items` by the slot each takes at `shift`, in place, and records where
+ * each slot's run begins. This is a radix sort one digit at a time, the digit
+ * being the one the trie itself reads at this level, so sorting the next level
+ * down happens inside each run as the build reaches it and no second buffer is
+ * ever needed.
+ */
+static void persimm_hamt_partition(persimm_hamt_item_t *items, size_t count, size_t shift,
+                                   size_t starts[PERSIMM_WIDTH + 1]) {
+    size_t next[PERSIMM_WIDTH];
+
+    memset(starts, 0, sizeof(size_t) * (PERSIMM_WIDTH + 1));
+    for (size_t i = 0; i < count; i++) starts[persimm_hamt_chunk(items[i].hash, shift) + 1]++;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        starts[slot + 1] += starts[slot];
+        next[slot] = starts[slot];
+    }
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        while (next[slot] < starts[slot + 1]) {
+            size_t at = next[slot];
+            uint32_t home = persimm_hamt_chunk(items[at].hash, shift);
+            if (home == slot) {
+                next[slot]++;
+                continue;
+            }
+            persimm_hamt_item_t moving = items[at];
+            items[at] = items[next[home]];
+            items[next[home]++] = moving;
+        }
+    }
+}
+
+/* Existing entries come first, in the order the trie holds them, then inputs as they arrived. */
+static bool persimm_hamt_item_before(const persimm_hamt_item_t *a, const persimm_hamt_item_t *b) {
+    if (a->existing != b->existing) return a->existing;
+    return a->key < b->key;
+}
+
+/*
+ * Settles a run of items sharing one hash: puts them back in the order they
+ * arrived, which partitioning does not keep, then folds each repeated key into
+ * its first appearance. The first key stays and the last value wins, which is
+ * exactly what storing the inputs one after another would have produced.
+ * Returns how many distinct keys remain at the front of the run.
+ */
+static size_t persimm_hamt_settle(persimm_hamt_item_t *items, size_t count,
+                                  const persimm_hamt_t *hamt) {
+    for (size_t i = 1; i < count; i++) {
+        persimm_hamt_item_t moving = items[i];
+        size_t j = i;
+        for (; j > 0 && persimm_hamt_item_before(&moving, &items[j - 1]); j--) {
+            items[j] = items[j - 1];
+        }
+        items[j] = moving;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t match = 0;
+        while (match < kept && !persimm_hamt_keys_equal(hamt, items[i].key, items[match].key)) {
+            match++;
+        }
+        if (match < kept) {
+            items[match].value = items[i].value;
+        } else {
+            items[kept++] = items[i];
+        }
+    }
+
+    return kept;
+}
+
+static bool persimm_hamt_same_hash(const persimm_hamt_item_t *items, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        if (items[i].hash != items[0].hash) return false;
+    }
+    return true;
+}
+
+static void persimm_hamt_item_store(const persimm_hamt_t *hamt, void *slot,
+                                    const persimm_hamt_item_t *item) {
+    memcpy(slot, item->key, hamt->layout.entry_size);
+    if (hamt->layout.value_size > 0 && item->value != item->key) {
+        memcpy(persimm_hamt_value(hamt, slot), persimm_hamt_value_const(hamt, item->value),
+               hamt->layout.value_size);
+    }
+    persimm_hamt_entry_retain(hamt, slot);
+}
+
+static persimm_hamt_node_t *persimm_hamt_collision_build(const persimm_hamt_item_t *items,
+                                                         size_t count,
+                                                         const persimm_hamt_t *hamt) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (count > UINT32_MAX) return NULL;
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_COLLISION, (uint32_t)count, 0,
+                                                      entry_size);
+    if (NULL == node) return NULL;
+    node->datamap = (uint32_t)count;
+    node->hash = items[0].hash;
+    for (size_t i = 0; i < count; i++) {
+        persimm_hamt_item_store(hamt, persimm_hamt_entry(node, (uint32_t)i, entry_size),
+                                &items[i]);
+        node->merkle += persimm_hamt_term(hamt, items[i].hash, items[i].value);
+    }
+
+    return node;
+}
+
+/*
+ * What one slot of a node comes to once a build or a batch has passed through
+ * it. A slot left alone, or whose subtree came back unchanged, keeps what it
+ * held; otherwise it ends up empty, holding an entry, or holding a child made
+ * for it. Settling every slot before the node is allocated is what lets the
+ * node be allocated once, at its final size.
+ */
+typedef enum {
+    PERSIMM_HAMT_SLOT_KEEP,
+    PERSIMM_HAMT_SLOT_EMPTY,
+    PERSIMM_HAMT_SLOT_ENTRY,
+    PERSIMM_HAMT_SLOT_CHILD
+} persimm_hamt_slot_kind;
+
+typedef struct {
+    persimm_hamt_slot_kind kind;
+    persimm_hamt_item_t entry;  // ENTRY: what the slot stores
+    persimm_hamt_node_t *child; // CHILD: a node the slot takes over
+    uint32_t merkle;            // ENTRY or CHILD: the slot's share of the structural hash
+    uint32_t held;              // the share of an entry the slot held before, if it held one
+} persimm_hamt_slot_t;
+
+static void persimm_hamt_slots_release(persimm_hamt_slot_t slots[PERSIMM_WIDTH],
+                                       const persimm_hamt_t *hamt) {
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        if (PERSIMM_HAMT_SLOT_CHILD == slots[slot].kind) {
+            persimm_hamt_release(slots[slot].child, hamt);
+        }
+    }
+}
+
+/*
+ * Makes the node `slots` describe in place of `from`, which may be NULL when
+ * there was nothing before. A kept slot carries over what `from` holds there,
+ * retained for the new node. When every slot was kept `*out` keeps `from`
+ * itself; when nothing is left it is empty; and below the root a lone entry is
+ * handed up for the parent to inline rather than given a node of its own.
+ * Returns false if the allocation failed, having released the children made
+ * for the slots.
+ */
+static bool persimm_hamt_finish(persimm_hamt_node_t *from, persimm_hamt_slot_t slots[PERSIMM_WIDTH],
+                                size_t shift, const persimm_hamt_t *hamt,
+                                persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t datamap = 0;
+    uint32_t nodemap = 0;
+    uint32_t merkle = (NULL != from) ? from->merkle : 0;
+    bool changed = false;
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_slot_kind kind = slots[slot].kind;
+
+        /* The structural hash moves by what each settled slot gave up and took on. */
+        if (PERSIMM_HAMT_SLOT_KEEP != kind && NULL != from) {
+            if (from->datamap & bit) merkle -= slots[slot].held;
+            if (from->nodemap & bit) {
+                persimm_hamt_node_t **old = persimm_hamt_children(from, entry_size);
+                merkle -= old[persimm_hamt_child_index(from, bit)]->merkle;
+            }
+        }
+        if (PERSIMM_HAMT_SLOT_ENTRY == kind || PERSIMM_HAMT_SLOT_CHILD == kind) {
+            merkle += slots[slot].merkle;
+        }
+
+        switch (kind) {
+        case PERSIMM_HAMT_SLOT_KEEP:
+            if (NULL != from) {
+                datamap |= from->datamap & bit;
+                nodemap |= from->nodemap & bit;
+            }
+            break;
+        case PERSIMM_HAMT_SLOT_EMPTY:
+            changed = changed || (NULL != from && 0 != ((from->datamap | from->nodemap) & bit));
+            break;
+        case PERSIMM_HAMT_SLOT_ENTRY:
+            datamap |= bit;
+            changed = true;
+            break;
+        case PERSIMM_HAMT_SLOT_CHILD:
+            nodemap |= bit;
+            changed = true;
+            break;
+        }
+    }
+
+    if (NULL != from && !changed) {
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+
+    if (0 == datamap && 0 == nodemap) {
+        out->kind = PERSIMM_HAMT_SLOT_EMPTY;
+        return true;
+    }
+
+    if (shift > 0 && 0 == nodemap && 1 == PERSIMM_POPCOUNT(datamap)) {
+        size_t slot = 0;
+        while (0 == (datamap & ((uint32_t)1 << slot))) slot++;
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        if (PERSIMM_HAMT_SLOT_KEEP == slots[slot].kind) {
+            const unsigned char *entry = persimm_hamt_entry(
+                from, persimm_hamt_data_index(from, (uint32_t)1 << slot), entry_size);
+            out->entry.key = entry;
+            out->entry.value = entry;
+            out->entry.existing = true;
+        } else {
+            out->entry = slots[slot].entry;
+        }
+        out->merkle = merkle;
+        return true;
+    }
+
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP,
+                                                      PERSIMM_POPCOUNT(datamap),
+                                                      PERSIMM_POPCOUNT(nodemap), entry_size);
+    if (NULL == node) {
+        persimm_hamt_slots_release(slots, hamt);
+        return false;
+    }
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->merkle = merkle;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    uint32_t data_index = 0;
+    uint32_t child_index = 0;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        bool kept = PERSIMM_HAMT_SLOT_KEEP == slots[slot].kind;
+
+        if (datamap & bit) {
+            void *entry = persimm_hamt_entry(node, data_index++, entry_size);
+            if (kept) {
+                memcpy(entry,
+                       persimm_hamt_entry(from, persimm_hamt_data_index(from, bit), entry_size),
+                       entry_size);
+                persimm_hamt_entry_retain(hamt, entry);
+            } else {
+                persimm_hamt_item_store(hamt, entry, &slots[slot].entry);
+            }
+        } else if (nodemap & bit) {
+            persimm_hamt_node_t *child = slots[slot].child;
+            if (kept) {
+                child = persimm_hamt_children(from, entry_size)[persimm_hamt_child_index(from, bit)];
+                persimm_rc_inc(&child->ref_count, hamt->local);
+            }
+            children[child_index++] = child;
+        }
+    }
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = node;
+    out->merkle = merkle;
+    return true;
+}
+
+static persimm_hamt_node_t *persimm_hamt_node_build(persimm_hamt_item_t *items, size_t count,
+                                                    size_t shift, const persimm_hamt_t *hamt,
+                                                    size_t *built);
+
+/*
+ * Settles what one slot at `shift` holds when `run` is everything bound for
+ * it: a single entry, a collision node when every hash agrees, or a bitmap
+ * node one level down. Adds the distinct keys placed to `*built`.
+ */
+static bool persimm_hamt_run_build(persimm_hamt_item_t *run, size_t count, size_t shift,
+                                   const persimm_hamt_t *hamt, size_t *built,
+                                   persimm_hamt_slot_t *out) {
+    bool same = persimm_hamt_same_hash(run, count);
+    if (same) count = persimm_hamt_settle(run, count, hamt);
+
+    if (1 == count) {
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        out->entry = run[0];
+        out->merkle = persimm_hamt_term(hamt, run[0].hash, run[0].value);
+        (*built)++;
+        return true;
+    }
+
+    persimm_hamt_node_t *child;
+    if (same) {
+        child = persimm_hamt_collision_build(run, count, hamt);
+        if (NULL != child) *built += count;
+    } else {
+        child = persimm_hamt_node_build(run, count, shift + PERSIMM_BITS, hamt, built);
+    }
+    if (NULL == child) return false;
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = child;
+    out->merkle = child->merkle;
+    return true;
+}
+
+/*
+ * Builds the bitmap node for `items`, which all agree on every level above
+ * `shift`. Each slot's run is built first, so the node itself is allocated
+ * once at its final size. Adds the distinct keys placed to `*built`. Returns
+ * NULL if an allocation failed, having released whatever it had made.
+ */
+static persimm_hamt_node_t *persimm_hamt_node_build(persimm_hamt_item_t *items, size_t count,
+                                                    size_t shift, const persimm_hamt_t *hamt,
+                                                    size_t *built) {
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        size_t length = starts[slot + 1] - starts[slot];
+        if (0 == length) continue;
+        if (!persimm_hamt_run_build(items + starts[slot], length, shift, hamt, built,
+                                    &slots[slot])) {
+            persimm_hamt_slots_release(slots, hamt);
+            return NULL;
+        }
+    }
+
+    persimm_hamt_slot_t out;
+    if (!persimm_hamt_finish(NULL, slots, shift, hamt, &out)) return NULL;
+
+    return out.child;
+}
+
+persimm_status persimm_hamt_build(persimm_hamt_node_t **root, const void *entries,
+                                  size_t count, const persimm_hamt_t *hamt, size_t *built) {
+    *root = NULL;
+    *built = 0;
+    if (0 == count) return PERSIMM_OK;
+
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, count,
+                                                        hamt->layout.entry_size, 0, hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    *root = persimm_hamt_node_build(items, count, 0, hamt, built);
+    free(items);
+    if (NULL == *root) {
+        *built = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    return PERSIMM_OK;
+}
+
+/*
+ * A parallel build does what persimm_hamt_node_build does for the root, with
+ * the slow parts fanned out: the inputs are hashed in chunks, and each of the
+ * root's slots is built as a task of its own once the items are partitioned.
+ * Only the partition and the root itself are made on the calling thread, by
+ * the same code a serial build runs, so the two cannot differ in shape.
+ */
+typedef struct {
+    const persimm_hamt_t *hamt;
+    const unsigned char *entries;
+    persimm_hamt_item_t *items;
+    size_t count;
+    size_t chunk;
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+    size_t built[PERSIMM_WIDTH];
+    bool failed[PERSIMM_WIDTH];
+} persimm_hamt_build_fanout_t;
+
+static void persimm_hamt_hash_task(void *arg, size_t task) {
+    persimm_hamt_build_fanout_t *fanout = arg;
+    size_t entry_size = fanout->hamt->layout.entry_size;
+    size_t end = (task + 1) * fanout->chunk;
+    if (end > fanout->count) end = fanout->count;
+    for (size_t i = task * fanout->chunk; i < end; i++) {
+        persimm_hamt_item_t *item = &fanout->items[i];
+        item->key = fanout->entries + (i * entry_size);
+        item->value = item->key;
+        item->hash = persimm_hamt_hash_of(fanout->hamt, item->key);
+    }
+}
+
+static void persimm_hamt_slot_task(void *arg, size_t slot) {
+    persimm_hamt_build_fanout_t *fanout = arg;
+    size_t length = fanout->starts[slot + 1] - fanout->starts[slot];
+    if (0 == length) return;
+    if (!persimm_hamt_run_build(fanout->items + fanout->starts[slot], length, 0, fanout->hamt,
+                                &fanout->built[slot], &fanout->slots[slot])) {
+        fanout->slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+        fanout->failed[slot] = true;
+    }
+}
+
+persimm_status persimm_hamt_parallel_build(persimm_hamt_node_t **root, const void *entries,
+                                           size_t count, const persimm_hamt_t *hamt,
+                                           const persimm_executor *executor, size_t *built) {
+    if (NULL == executor) return persimm_hamt_build(root, entries, count, hamt, built);
+
+    *root = NULL;
+    *built = 0;
+    if (0 == count) return PERSIMM_OK;
+
+    persimm_hamt_build_fanout_t *fanout = calloc(1, sizeof(persimm_hamt_build_fanout_t));
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, 0, 0, count, hamt);
+    if (NULL == fanout || NULL == items) {
+        free(fanout);
+        free(items);
+        return PERSIMM_ERR_ALLOC;
+    }
+    fanout->hamt = hamt;
+    fanout->entries = entries;
+    fanout->items = items;
+    fanout->count = count;
+    fanout->chunk = (count + PERSIMM_WIDTH - 1) / PERSIMM_WIDTH;
+
+    persimm_executor_run(executor, (count + fanout->chunk - 1) / fanout->chunk,
+                         persimm_hamt_hash_task, fanout);
+    persimm_hamt_partition(items, count, 0, fanout->starts);
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        fanout->slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+    }
+    persimm_executor_run(executor, PERSIMM_WIDTH, persimm_hamt_slot_task, fanout);
+
+    bool failed = false;
+    size_t total = 0;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        failed = failed || fanout->failed[slot];
+        total += fanout->built[slot];
+    }
+
+    persimm_hamt_slot_t out;
+    if (failed) {
+        persimm_hamt_slots_release(fanout->slots, hamt);
+    } else if (persimm_hamt_finish(NULL, fanout->slots, 0, hamt, &out)) {
+        *root = out.child;
+        *built = total;
+    } else {
+        failed = true;
+    }
+
+    free(items);
+    free(fanout);
+    return failed ? PERSIMM_ERR_ALLOC : PERSIMM_OK;
+}
+
+/* Updating in Bulk */
+
+/*
+ * A batch descends the trie once. At each node it is partitioned by slot as a
+ * build is, each slot's run goes down to that slot's child alone, and the node
+ * is rebuilt once from what every slot came to. However many of a batch's
+ * entries land in a node, the node is copied at most once, and a subtree the
+ * batch never reaches is shared rather than copied.
+ *
+ * Neither walk below changes a node it is given: `node` is only read, and
+ * `*out` says what its parent should hold instead. The old trie stays whole
+ * until the caller swaps the root, which is what lets an entry that moves be
+ * copied straight out of the node it leaves.
+ */
+
+static bool persimm_hamt_node_assoc_many(persimm_hamt_node_t *node, size_t shift,
+                                         persimm_hamt_item_t *items, size_t count,
+                                         persimm_hamt_item_t *scratch, const persimm_hamt_t *hamt,
+                                         size_t *added, persimm_hamt_slot_t *out);
+
+/*
+ * Merges a run whose every hash is the collision node's own. The entries
+ * already held go first and keep their keys, so the run settles exactly as
+ * storing it entry by entry would have.
+ */
+static bool persimm_hamt_collision_assoc_many(persimm_hamt_node_t *node,
+                                              const persimm_hamt_item_t *items, size_t count,
+                                              const persimm_hamt_t *hamt, size_t *added,
+                                              persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    size_t held = node->datamap;
+    size_t total;
+    size_t bytes;
+    PERSIMM_COUNT(hamt, collision_scans);
+
+    if (!persimm_size_add(held, count, &total) ||
+        !persimm_size_mul(total, sizeof(persimm_hamt_item_t), &bytes)) {
+        return false;
+    }
+    persimm_hamt_item_t *merged = calloc(1, bytes);
+    if (NULL == merged) return false;
+
+    for (size_t i = 0; i < held; i++) {
+        merged[i].key = persimm_hamt_entry(node, (uint32_t)i, entry_size);
+        merged[i].value = merged[i].key;
+        merged[i].hash = node->hash;
+        merged[i].existing = true;
+    }
+    memcpy(merged + held, items, count * sizeof(persimm_hamt_item_t));
+
+    size_t kept = persimm_hamt_settle(merged, total, hamt);
+
+    /* A set whose every element was already present has nothing to change. */
+    if (kept == held && 0 == hamt->layout.value_size) {
+        free(merged);
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+
+    persimm_hamt_node_t *child = persimm_hamt_collision_build(merged, kept, hamt);
+    free(merged);
+    if (NULL == child) return false;
+
+    *added += kept - held;
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = child;
+    out->merkle = child->merkle;
+    return true;
+}
+
+static bool persimm_hamt_node_assoc_many(persimm_hamt_node_t *node, size_t shift,
+                                         persimm_hamt_item_t *items, size_t count,
+                                         persimm_hamt_item_t *scratch, const persimm_hamt_t *hamt,
+                                         size_t *added, persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        if (persimm_hamt_same_hash(items, count) && items[0].hash == node->hash) {
+            return persimm_hamt_collision_assoc_many(node, items, count, hamt, added, out);
+        }
+
+        /* Other hashes cannot belong here, so the collision node is seen
+           through a parent that separates them, as a single assoc does. The
+           parent never holds a reference of its own and goes with a plain
+           free, since whatever was made from it retained what it kept. */
+        persimm_hamt_node_t *parent = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+        if (NULL == parent) return false;
+        parent->nodemap = persimm_hamt_bit(node->hash, shift);
+        parent->merkle = node->merkle;
+        persimm_hamt_children(parent, entry_size)[0] = node;
+        bool done = persimm_hamt_node_assoc_many(parent, shift, items, count, scratch, hamt,
+                                                 added, out);
+        PERSIMM_COUNT(hamt, node_frees);
+        free(parent);
+        return done;
+    }
+
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_item_t *run = items + starts[slot];
+        size_t length = starts[slot + 1] - starts[slot];
+        bool done = true;
+
+        if (0 == length) continue;
+
+        if (node->nodemap & bit) {
+            persimm_hamt_node_t *child =
+                persimm_hamt_children(node, entry_size)[persimm_hamt_child_index(node, bit)];
+            done = persimm_hamt_node_assoc_many(child, shift + PERSIMM_BITS, run, length, scratch,
+                                                hamt, added, &slots[slot]);
+        } else if (node->datamap & bit) {
+            /* The entry already here joins the run at its head, so it keeps
+               its key against any equal one the batch brings. Only one slot
+               is settled at a time, so one scratch run serves them all. */
+            const unsigned char *held =
+                persimm_hamt_entry(node, persimm_hamt_data_index(node, bit), entry_size);
+            scratch[0].key = held;
+            scratch[0].value = held;
+            scratch[0].hash = persimm_hamt_hash_of(hamt, held);
+            scratch[0].existing = true;
+            memcpy(scratch + 1, run, length * sizeof(persimm_hamt_item_t));
+            slots[slot].held = persimm_hamt_term(hamt, scratch[0].hash, held);
+
+            size_t built = 0;
+            done = persimm_hamt_run_build(scratch, length + 1, shift, hamt, &built, &slots[slot]);
+            if (done) {
+                *added += built - 1;
+                if (PERSIMM_HAMT_SLOT_ENTRY == slots[slot].kind && 0 == hamt->layout.value_size) {
+                    slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+                }
+            }
+        } else {
+            done = persimm_hamt_run_build(run, length, shift, hamt, added, &slots[slot]);
+        }
+
+        if (!done) {
+            persimm_hamt_slots_release(slots, hamt);
+            return false;
+        }
+    }
+
+    return persimm_hamt_finish(node, slots, shift, hamt, out);
+}
+
+/* Whether the collision node's entry at `index` is one of the keys in `items`. */
+static bool persimm_hamt_collision_doomed(persimm_hamt_node_t *node, uint32_t index,
+                                          const persimm_hamt_item_t *items, size_t count,
+                                          const persimm_hamt_t *hamt) {
+    const void *entry = persimm_hamt_entry(node, index, hamt->layout.entry_size);
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].hash == node->hash && persimm_hamt_keys_equal(hamt, items[i].key, entry)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool persimm_hamt_collision_dissoc_many(persimm_hamt_node_t *node,
+                                               const persimm_hamt_item_t *items, size_t count,
+                                               const persimm_hamt_t *hamt, size_t *removed,
+                                               persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t held = node->datamap;
+    uint32_t kept = 0;
+    PERSIMM_COUNT(hamt, collision_scans);
+
+    for (uint32_t i = 0; i < held; i++) {
+        if (!persimm_hamt_collision_doomed(node, i, items, count, hamt)) kept++;
+    }
+
+    if (kept == held) {
+        out->kind = PERSIMM_HAMT_SLOT_KEEP;
+        return true;
+    }
+    *removed += held - kept;
+
+    if (0 == kept) {
+        out->kind = PERSIMM_HAMT_SLOT_EMPTY;
+        return true;
+    }
+
+    if (1 == kept) {
+        uint32_t i = 0;
+        while (persimm_hamt_collision_doomed(node, i, items, count, hamt)) i++;
+        out->kind = PERSIMM_HAMT_SLOT_ENTRY;
+        out->entry.key = persimm_hamt_entry(node, i, entry_size);
+        out->entry.value = out->entry.key;
+        out->entry.existing = true;
+        out->merkle = persimm_hamt_term(hamt, node->hash, out->entry.key);
+        return true;
+    }
+
+    persimm_hamt_node_t *copy = persimm_hamt_node_new(PERSIMM_HAMT_COLLISION, kept, 0, entry_size);
+    if (NULL == copy) return false;
+    copy->datamap = kept;
+    copy->hash = node->hash;
+
+    uint32_t at = 0;
+    for (uint32_t i = 0; i < held; i++) {
+        if (persimm_hamt_collision_doomed(node, i, items, count, hamt)) continue;
+        void *entry = persimm_hamt_entry(copy, at++, entry_size);
+        memcpy(entry, persimm_hamt_entry(node, i, entry_size), entry_size);
+        persimm_hamt_entry_retain(hamt, entry);
+        copy->merkle += persimm_hamt_term(hamt, node->hash, entry);
+    }
+
+    out->kind = PERSIMM_HAMT_SLOT_CHILD;
+    out->child = copy;
+    out->merkle = copy->merkle;
+    return true;
+}
+
+static bool persimm_hamt_node_dissoc_many(persimm_hamt_node_t *node, size_t shift,
+                                          persimm_hamt_item_t *items, size_t count,
+                                          const persimm_hamt_t *hamt, size_t *removed,
+                                          persimm_hamt_slot_t *out) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        return persimm_hamt_collision_dissoc_many(node, items, count, hamt, removed, out);
+    }
+
+    size_t starts[PERSIMM_WIDTH + 1];
+    persimm_hamt_slot_t slots[PERSIMM_WIDTH];
+
+    persimm_hamt_partition(items, count, shift, starts);
+
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) slots[slot].kind = PERSIMM_HAMT_SLOT_KEEP;
+    for (size_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_item_t *run = items + starts[slot];
+        size_t length = starts[slot + 1] - starts[slot];
+
+        if (0 == length) continue;
+
+        if (node->nodemap & bit) {
+            persimm_hamt_node_t *child =
+                persimm_hamt_children(node, entry_size)[persimm_hamt_child_index(node, bit)];
+            if (!persimm_hamt_node_dissoc_many(child, shift + PERSIMM_BITS, run, length, hamt,
+                                               removed, &slots[slot])) {
+                persimm_hamt_slots_release(slots, hamt);
+                return false;
+            }
+        } else if (node->datamap & bit) {
+            const void *held =
+                persimm_hamt_entry(node, persimm_hamt_data_index(node, bit), entry_size);
+            for (size_t i = 0; i < length; i++) {
+                if (persimm_hamt_keys_equal(hamt, run[i].key, held)) {
+                    slots[slot].kind = PERSIMM_HAMT_SLOT_EMPTY;
+                    slots[slot].held = persimm_hamt_term(hamt, run[i].hash, held);
+                    (*removed)++;
+                    break;
+                }
+            }
+        }
+    }
+
+    return persimm_hamt_finish(node, slots, shift, hamt, out);
+}
+
+/* Swaps in the root a batch produced. Only the root may be left empty. */
+static void persimm_hamt_settle_root(persimm_hamt_node_t **root, const persimm_hamt_slot_t *out,
+                                     const persimm_hamt_t *hamt) {
+    if (PERSIMM_HAMT_SLOT_KEEP == out->kind) return;
+    persimm_hamt_release(*root, hamt);
+    *root = (PERSIMM_HAMT_SLOT_CHILD == out->kind) ? out->child : NULL;
+}
+
+persimm_status persimm_hamt_assoc_many(persimm_hamt_node_t **root, const void *entries,
+                                       size_t count, const persimm_hamt_t *hamt,
+                                       size_t *added) {
+    *added = 0;
+    if (0 == count) return PERSIMM_OK;
+    if (NULL == *root) return persimm_hamt_build(root, entries, count, hamt, added);
+
+    /* One more item than the batch holds, after it, is the scratch run each
+       slot that already holds an entry is settled in. */
+    persimm_hamt_item_t *items = persimm_hamt_items_new(entries, count, hamt->layout.entry_size,
+                                                        count + 1, hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    persimm_hamt_slot_t out;
+    bool done = persimm_hamt_node_assoc_many(*root, 0, items, count, items + count, hamt, added,
+                                             &out);
+    free(items);
+    if (!done) {
+        *added = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_hamt_settle_root(root, &out, hamt);
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_hamt_dissoc_many(persimm_hamt_node_t **root, const void *keys,
+                                        size_t count, const persimm_hamt_t *hamt,
+                                        size_t *removed) {
+    *removed = 0;
+    if (0 == count || NULL == *root) return PERSIMM_OK;
+
+    persimm_hamt_item_t *items = persimm_hamt_items_new(keys, count, hamt->layout.key_size, 0,
+                                                        hamt);
+    if (NULL == items) return PERSIMM_ERR_ALLOC;
+
+    persimm_hamt_slot_t out;
+    bool done = persimm_hamt_node_dissoc_many(*root, 0, items, count, hamt, removed, &out);
+    free(items);
+    if (!done) {
+        *removed = 0;
+        return PERSIMM_ERR_ALLOC;
+    }
+
+    persimm_hamt_settle_root(root, &out, hamt);
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+/*
+ * The root's 32 slots divide a trie by the low bits of each key's hash, and
+ * a root holding only one of them is exactly the root a trie of just those
+ * keys would have. Splitting and joining along that line therefore touches
+ * the root alone, whatever the size of the trie beneath it.
+ */
+
+static size_t persimm_hamt_node_size(persimm_hamt_node_t *node, size_t entry_size) {
+    size_t size = persimm_hamt_data_count(node);
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        size += persimm_hamt_node_size(children[i], entry_size);
+    }
+    return size;
+}
+
+static void persimm_hamt_split_undo(persimm_hamt_node_t **roots, size_t *counts,
+                                    const persimm_hamt_t *hamt) {
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        persimm_hamt_release(roots[slot], hamt);
+        roots[slot] = NULL;
+        counts[slot] = 0;
+    }
+}
+
+persimm_status persimm_hamt_split(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                  persimm_hamt_node_t **roots, size_t *counts) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        roots[slot] = NULL;
+        counts[slot] = 0;
+    }
+    if (NULL == root) return PERSIMM_OK;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(root, entry_size);
+    for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        persimm_hamt_node_t *part;
+
+        if (0 != (root->datamap & bit)) {
+            const void *entry = persimm_hamt_entry(root, persimm_hamt_data_index(root, bit),
+                                                   entry_size);
+            part = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 1, 0, entry_size);
+            if (NULL == part) {
+                persimm_hamt_split_undo(roots, counts, hamt);
+                return PERSIMM_ERR_ALLOC;
+            }
+            part->datamap = bit;
+            part->merkle = persimm_hamt_term(hamt, persimm_hamt_hash_of(hamt, entry), entry);
+            memcpy(persimm_hamt_entry(part, 0, entry_size), entry, entry_size);
+            persimm_hamt_entry_retain(hamt, persimm_hamt_entry(part, 0, entry_size));
+            counts[slot] = 1;
+        } else if (0 != (root->nodemap & bit)) {
+            persimm_hamt_node_t *child = children[persimm_hamt_child_index(root, bit)];
+            part = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP, 0, 1, entry_size);
+            if (NULL == part) {
+                persimm_hamt_split_undo(roots, counts, hamt);
+                return PERSIMM_ERR_ALLOC;
+            }
+            part->nodemap = bit;
+            part->merkle = child->merkle;
+            persimm_rc_inc(&child->ref_count, hamt->local);
+            persimm_hamt_children(part, entry_size)[0] = child;
+            counts[slot] = persimm_hamt_node_size(child, entry_size);
+        } else {
+            continue;
+        }
+        roots[slot] = part;
+    }
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_hamt_join(persimm_hamt_node_t *const *roots, size_t count,
+                                 const persimm_hamt_t *hamt, persimm_hamt_node_t **dest) {
+    size_t entry_size = hamt->layout.entry_size;
+    uint32_t datamap = 0;
+    uint32_t nodemap = 0;
+    uint32_t merkle = 0;
+
+    *dest = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (NULL == roots[i]) continue;
+        if (0 != ((datamap | nodemap) & (roots[i]->datamap | roots[i]->nodemap))) {
+            return PERSIMM_ERR_INVALID;
+        }
+        datamap |= roots[i]->datamap;
+        nodemap |= roots[i]->nodemap;
+        merkle += roots[i]->merkle;
+    }
+    if (0 == (datamap | nodemap)) return PERSIMM_OK;
+
+    persimm_hamt_node_t *node = persimm_hamt_node_new(PERSIMM_HAMT_BITMAP,
+                                                      PERSIMM_POPCOUNT(datamap),
+                                                      PERSIMM_POPCOUNT(nodemap), entry_size);
+    if (NULL == node) return PERSIMM_ERR_ALLOC;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->merkle = merkle;
+
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (size_t i = 0; i < count; i++) {
+        persimm_hamt_node_t *root = roots[i];
+        if (NULL == root) continue;
+
+        persimm_hamt_node_t **parts = persimm_hamt_children(root, entry_size);
+        for (uint32_t slot = 0; slot < PERSIMM_WIDTH; slot++) {
+            uint32_t bit = (uint32_t)1 << slot;
+            if (0 != (root->datamap & bit)) {
+                void *entry = persimm_hamt_entry(node, persimm_hamt_data_index(node, bit),
+                                                 entry_size);
+                memcpy(entry, persimm_hamt_entry(root, persimm_hamt_data_index(root, bit),
+                                                 entry_size), entry_size);
+                persimm_hamt_entry_retain(hamt, entry);
+            } else if (0 != (root->nodemap & bit)) {
+                persimm_hamt_node_t *child = parts[persimm_hamt_child_index(root, bit)];
+                persimm_rc_inc(&child->ref_count, hamt->local);
+                children[persimm_hamt_child_index(node, bit)] = child;
+            }
+        }
+    }
+
+    *dest = node;
+    return PERSIMM_OK;
+}
+
+/* Memory Statistics */
+
+static size_t persimm_hamt_node_footprint(persimm_hamt_node_t *node, size_t entry_size) {
+    size_t bytes = 0;
+    persimm_hamt_node_bytes(persimm_hamt_data_count(node), persimm_hamt_child_count(node),
+                            entry_size, &bytes);
+    return bytes;
+}
+
+static void persimm_hamt_node_stats(persimm_hamt_node_t *node, size_t entry_size,
+                                    bool exclusive, persimm_memory_stats *stats) {
+    size_t bytes = persimm_hamt_node_footprint(node, entry_size);
+    exclusive = exclusive && 1 == PERSIMM_RC_PEEK(node->ref_count);
+    if (exclusive) {
+        stats->exclusive_bytes += bytes;
+    } else {
+        stats->shared_bytes += bytes;
+    }
+
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+    } else {
+        stats->branch_nodes++;
+        stats->branch_bytes += bytes;
+    }
+    stats->elem_bytes += persimm_hamt_data_count(node) * entry_size;
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_node_stats(children[i], entry_size, exclusive, stats);
+    }
+}
+
+void persimm_hamt_memory_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               persimm_memory_stats *stats) {
+    if (NULL != root) persimm_hamt_node_stats(root, hamt->layout.entry_size, true, stats);
+}
+
+persimm_status persimm_hamt_memory_gather(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                          persimm_node_set_t *nodes) {
+    if (NULL == root || persimm_node_set_has(nodes, root)) return PERSIMM_OK;
+
+    persimm_status status = persimm_node_set_add(nodes, root);
+    uint32_t child_count = persimm_hamt_child_count(root);
+    persimm_hamt_node_t **children = persimm_hamt_children(root, hamt->layout.entry_size);
+    for (uint32_t i = 0; i < child_count && PERSIMM_OK == status; i++) {
+        status = persimm_hamt_memory_gather(children[i], hamt, nodes);
+    }
+    return status;
+}
+
+void persimm_hamt_memory_delta(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               const persimm_node_set_t *nodes, size_t *bytes) {
+    if (NULL == root || persimm_node_set_has(nodes, root)) return;
+
+    size_t entry_size = hamt->layout.entry_size;
+    *bytes += persimm_hamt_node_footprint(root, entry_size);
+    uint32_t child_count = persimm_hamt_child_count(root);
+    persimm_hamt_node_t **children = persimm_hamt_children(root, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_memory_delta(children[i], hamt, nodes, bytes);
+    }
+}
+
+/* Shape Statistics */
+
+#define PERSIMM_HAMT_SHAPE_SLOTS 8
+
+/*
+ * Returns the calls to `equals` an absent key with a random hash makes below
+ * `node`, given that its hash already matches the bits that led there.
+ */
+static double persimm_hamt_node_shape(persimm_hamt_node_t *node, size_t entry_size,
+                                      size_t depth, persimm_shape_stats *stats,
+                                      double *equals) {
+    uint32_t data_count = persimm_hamt_data_count(node);
+    size_t slot = depth < PERSIMM_HAMT_SHAPE_SLOTS ? depth : PERSIMM_HAMT_SHAPE_SLOTS - 1;
+    stats->entries += data_count;
+    stats->depths[slot] += data_count;
+    if (depth > stats->max_depth) stats->max_depth = depth;
+
+    /* The rest of the hash must match too, and each bit halves the odds of that. */
+    if (PERSIMM_HAMT_COLLISION == node->kind) {
+        size_t size = data_count;
+        size_t bucket = 0;
+        while (bucket + 1 < PERSIMM_HAMT_SHAPE_SLOTS && size >= ((size_t)4 << bucket)) bucket++;
+        stats->collision_nodes++;
+        stats->collision_entries += size;
+        stats->collision_sizes[bucket]++;
+        if (size > stats->largest_collision) stats->largest_collision = size;
+        *equals += (double)size * (double)(size + 1) / 2.0;
+
+        double miss = (double)size;
+        for (size_t bits = depth * PERSIMM_BITS; bits < 32; bits++) miss /= 2.0;
+        return miss;
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    stats->bitmap_nodes++;
+    stats->entries_per_node += data_count;
+    stats->children_per_node += child_count;
+    *equals += data_count;
+
+    double miss = data_count;
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        miss += persimm_hamt_node_shape(children[i], entry_size, depth + 1, stats, equals);
+    }
+    return miss / PERSIMM_WIDTH;
+}
+
+void persimm_hamt_shape_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              persimm_shape_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (NULL == root) return;
+
+    double equals = 0.0;
+    stats->equals_per_miss = persimm_hamt_node_shape(root, hamt->layout.entry_size, 0, stats,
+                                                     &equals);
+    stats->entries_per_node /= (double)stats->bitmap_nodes;
+    stats->children_per_node /= (double)stats->bitmap_nodes;
+    if (stats->entries > 0) stats->equals_per_hit = equals / (double)stats->entries;
+}
+
+/* Hashing */
+
+uint32_t persimm_hamt_hash(persimm_hamt_node_t *root) {
+    return (NULL != root) ? root->merkle : 0;
+}
+
 /* Traversing */
 
 static void persimm_hamt_node_foreach(persimm_hamt_node_t *node, const persimm_hamt_t *hamt,
@@ -846,6 +2022,7 @@ static persimm_hamt_seek persimm_hamt_node_next(persimm_hamt_node_t *node, size_
 
     if (PERSIMM_HAMT_COLLISION == node->kind) {
         if (node->hash != hash) return PERSIMM_HAMT_ABSENT;
+        PERSIMM_COUNT(hamt, collision_scans);
         for (uint32_t i = 0; i < node->datamap; i++) {
             if (!persimm_hamt_keys_equal(hamt, key, persimm_hamt_entry(node, i, entry_size))) {
                 continue;
@@ -907,22 +2084,191 @@ const void *persimm_hamt_next(persimm_hamt_node_t *root, const void *key,
     return out;
 }
 
-static void persimm_hamt_trace_visit(const void *slot, size_t index, void *ctx) {
-    (void) index;
-    const persimm_hamt_t *hamt = (const persimm_hamt_t *)ctx;
+/* Parallel Traversal */
+
+/*
+ * Tasks take whole subtrees, and the root's children are the first cut. While
+ * that gives fewer tasks than a node has slots, as a small trie or one whose
+ * keys crowd into a few slots does, each subtree gives way to its children
+ * and keeps only its own entries as a task. A pass starts below 32 parts and
+ * each part becomes at most 32, so the parts never pass 32 times 32.
+ */
+
+#define PERSIMM_HAMT_PARTS (PERSIMM_WIDTH * PERSIMM_WIDTH)
+
+typedef struct {
+    persimm_hamt_node_t *node;
+    /* Only the node's own entries, its children having parts of their own. */
+    bool entries_only;
+} persimm_hamt_part_t;
+
+typedef struct {
+    const persimm_hamt_t *hamt;
+    persimm_hamt_part_t *parts;
+    void *ctx;
+    persimm_visit_fn visit;
+    persimm_fold_fn fold;
+    unsigned char *accs;
+    size_t acc_size;
+} persimm_hamt_fanout_t;
+
+static size_t persimm_hamt_fan_out(persimm_hamt_node_t *root, size_t entry_size,
+                                     persimm_hamt_part_t *parts) {
+    size_t count = 0;
+    parts[count++] = (persimm_hamt_part_t){ root, false };
+
+    bool grew = true;
+    while (count < PERSIMM_WIDTH && grew) {
+        grew = false;
+        size_t end = count;
+        for (size_t i = 0; i < end; i++) {
+            persimm_hamt_node_t *node = parts[i].node;
+            uint32_t child_count = persimm_hamt_child_count(node);
+            if (parts[i].entries_only || 0 == child_count) continue;
+
+            persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+            uint32_t first = 0;
+            if (persimm_hamt_data_count(node) > 0) {
+                parts[i].entries_only = true;
+            } else {
+                parts[i].node = children[first++];
+            }
+            for (uint32_t c = first; c < child_count; c++) {
+                parts[count++] = (persimm_hamt_part_t){ children[c], false };
+            }
+            grew = true;
+        }
+    }
+    return count;
+}
+
+static void persimm_hamt_part_visit(const persimm_hamt_fanout_t *fanout, size_t part,
+                                    persimm_visit_fn fn, void *ctx) {
+    persimm_hamt_node_t *node = fanout->parts[part].node;
+    size_t index = 0;
+    if (!fanout->parts[part].entries_only) {
+        persimm_hamt_node_foreach(node, fanout->hamt, fn, ctx, &index);
+        return;
+    }
+    size_t entry_size = fanout->hamt->layout.entry_size;
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) fn(persimm_hamt_entry(node, i, entry_size), i, ctx);
+}
+
+static void persimm_hamt_foreach_task(void *arg, size_t part) {
+    persimm_hamt_fanout_t *fanout = arg;
+    persimm_hamt_part_visit(fanout, part, fanout->visit, fanout->ctx);
+}
+
+persimm_status persimm_hamt_parallel_foreach(persimm_hamt_node_t *root,
+                                             const persimm_hamt_t *hamt, persimm_visit_fn fn,
+                                             void *ctx, const persimm_executor *executor) {
+    if (NULL == executor || NULL == root) {
+        persimm_hamt_foreach(root, hamt, fn, ctx);
+        return PERSIMM_OK;
+    }
+
+    persimm_hamt_fanout_t fanout = { hamt, NULL, ctx, fn, NULL, NULL, 0 };
+    fanout.parts = calloc(PERSIMM_HAMT_PARTS, sizeof(persimm_hamt_part_t));
+    if (NULL == fanout.parts) return PERSIMM_ERR_ALLOC;
+
+    size_t parts = persimm_hamt_fan_out(root, hamt->layout.entry_size, fanout.parts);
+    persimm_executor_run(executor, parts, persimm_hamt_foreach_task, &fanout);
+
+    free(fanout.parts);
+    return PERSIMM_OK;
+}
+
+typedef struct {
+    persimm_fold_fn fold;
+    void *acc;
+    void *ctx;
+} persimm_hamt_fold_t;
+
+static void persimm_hamt_fold_visit(const void *entry, size_t position, void *ctx) {
+    persimm_hamt_fold_t *fold = ctx;
+    fold->fold(fold->acc, entry, position, fold->ctx);
+}
+
+static void persimm_hamt_reduce_task(void *arg, size_t part) {
+    persimm_hamt_fanout_t *fanout = arg;
+    persimm_hamt_fold_t fold = { fanout->fold, fanout->accs + part * fanout->acc_size,
+                                 fanout->ctx };
+    persimm_hamt_part_visit(fanout, part, persimm_hamt_fold_visit, &fold);
+}
+
+persimm_status persimm_hamt_parallel_reduce(persimm_hamt_node_t *root,
+                                            const persimm_hamt_t *hamt, persimm_fold_fn fold,
+                                            persimm_combine_fn combine, const void *identity,
+                                            size_t acc_size, void *ctx,
+                                            const persimm_executor *executor, void *result) {
+    memcpy(result, identity, acc_size);
+    if (NULL == executor || NULL == root) {
+        persimm_hamt_fold_t direct = { fold, result, ctx };
+        persimm_hamt_foreach(root, hamt, persimm_hamt_fold_visit, &direct);
+        return PERSIMM_OK;
+    }
+
+    persimm_hamt_fanout_t fanout = { hamt, NULL, ctx, NULL, fold, NULL, acc_size };
+    fanout.parts = calloc(PERSIMM_HAMT_PARTS, sizeof(persimm_hamt_part_t));
+    size_t parts = 0;
+    if (NULL != fanout.parts) {
+        parts = persimm_hamt_fan_out(root, hamt->layout.entry_size, fanout.parts);
+        fanout.accs = calloc(parts, acc_size);
+    }
+    if (NULL == fanout.accs) {
+        free(fanout.parts);
+        return PERSIMM_ERR_ALLOC;
+    }
+    for (size_t i = 0; i < parts; i++) memcpy(fanout.accs + i * acc_size, identity, acc_size);
+
+    persimm_executor_run(executor, parts, persimm_hamt_reduce_task, &fanout);
+    for (size_t i = 0; i < parts; i++) combine(result, fanout.accs + i * acc_size, ctx);
+
+    free(fanout.accs);
+    free(fanout.parts);
+    return PERSIMM_OK;
+}
+
+/* Tracing */
+
+static void persimm_hamt_entry_trace(const persimm_hamt_t *hamt, const void *entry) {
     if (NULL != hamt->key_ops && NULL != hamt->key_ops->trace) {
-        hamt->key_ops->trace(slot, hamt->key_ctx);
+        hamt->key_ops->trace(entry, hamt->key_ctx);
     }
     if (hamt->layout.value_size > 0 && NULL != hamt->value_ops &&
         NULL != hamt->value_ops->trace) {
-        hamt->value_ops->trace(persimm_hamt_value_const(hamt, slot), hamt->value_ctx);
+        hamt->value_ops->trace(persimm_hamt_value_const(hamt, entry), hamt->value_ctx);
+    }
+}
+
+static void persimm_hamt_node_trace(persimm_hamt_node_t *node, const persimm_hamt_t *hamt,
+                                    uint32_t epoch) {
+    size_t entry_size = hamt->layout.entry_size;
+
+    if (!persimm_trace_claim(&node->traced, epoch)) return;
+
+    uint32_t data_count = persimm_hamt_data_count(node);
+    for (uint32_t i = 0; i < data_count; i++) {
+        persimm_hamt_entry_trace(hamt, persimm_hamt_entry(node, i, entry_size));
+    }
+
+    uint32_t child_count = persimm_hamt_child_count(node);
+    persimm_hamt_node_t **children = persimm_hamt_children(node, entry_size);
+    for (uint32_t i = 0; i < child_count; i++) {
+        persimm_hamt_node_trace(children[i], hamt, epoch);
     }
 }
 
 void persimm_hamt_trace(persimm_hamt_node_t *root, const persimm_hamt_t *hamt) {
+    persimm_hamt_trace_epoch(root, hamt, 0);
+}
+
+void persimm_hamt_trace_epoch(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              uint32_t epoch) {
     bool traces_keys = NULL != hamt->key_ops && NULL != hamt->key_ops->trace;
     bool traces_values = hamt->layout.value_size > 0 && NULL != hamt->value_ops &&
                          NULL != hamt->value_ops->trace;
-    if (!traces_keys && !traces_values) return;
-    persimm_hamt_foreach(root, hamt, persimm_hamt_trace_visit, (void *)hamt);
+    if (NULL == root || (!traces_keys && !traces_values)) return;
+    persimm_hamt_node_trace(root, hamt, epoch);
 }
@@ -10,6 +10,9 @@
 #define PERSIMM_WIDTH (1 << PERSIMM_BITS) /* 2^5 = 32 */
 #define PERSIMM_MASK (PERSIMM_WIDTH - 1) /* 31, or 0x1f */
 
+/* The public header promises callers one shard per root slot. */
+typedef char persimm_split_ways_match[PERSIMM_SPLIT_WAYS == PERSIMM_WIDTH ? 1 : -1];
+
 /* Private Types */
 
 typedef struct persimm_vector_node persimm_vector_node_t;
@@ -53,10 +56,27 @@ static inline bool persimm_size_mul(size_t a, size_t b, size_t *result) {
  * reference, so the node cannot be freed underneath it.
  *
  * PERSIMM_RC_INC and PERSIMM_RC_DEC both evaluate to the count as it was
- * before the operation, following the C11 fetch functions.
+ * before the operation, following the C11 fetch functions. PERSIMM_RC_PEEK and
+ * PERSIMM_RC_PUT read and write the count with no ordering at all, which is
+ * all a count no other thread can see needs, and PERSIMM_RC_STORE writes it
+ * with release ordering. PERSIMM_RC_CAS replaces the count
+ * with `desired` only if it still holds `expected`, and otherwise loads what
+ * it does hold into `expected`, following the C11 compare-exchange.
+ *
+ * The PERSIMM_PTR macros do the same for a pointer that is published to
+ * readers: stores release, loads acquire, and PERSIMM_PTR_CAS is a strong
+ * compare-exchange that never fails spuriously. PERSIMM_FENCE is a full
+ * barrier, for the few places a store must be visible before a later load.
+ *
+ * Defining PERSIMM_SINGLE_THREADED skips the atomic backends altogether, for a
+ * host that never lets a structure leave the thread that made it.
  */
 
-#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#if defined(PERSIMM_SINGLE_THREADED)
+
+/* Left to the plain counts below. */
+
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
 
 #include <stdatomic.h>
 typedef _Atomic size_t persimm_refcount_t;
@@ -65,6 +85,19 @@ typedef _Atomic size_t persimm_refcount_t;
 #define PERSIMM_RC_LOAD(rc) atomic_load_explicit(&(rc), memory_order_acquire)
 #define PERSIMM_RC_INC(rc) atomic_fetch_add_explicit(&(rc), 1, memory_order_relaxed)
 #define PERSIMM_RC_DEC(rc) atomic_fetch_sub_explicit(&(rc), 1, memory_order_acq_rel)
+#define PERSIMM_RC_PEEK(rc) atomic_load_explicit(&(rc), memory_order_relaxed)
+#define PERSIMM_RC_PUT(rc, v) atomic_store_explicit(&(rc), (size_t)(v), memory_order_relaxed)
+#define PERSIMM_RC_STORE(rc, v) atomic_store_explicit(&(rc), (size_t)(v), memory_order_release)
+#define PERSIMM_RC_CAS(rc, expected, desired)                                         \
+    atomic_compare_exchange_weak_explicit(&(rc), &(expected), (size_t)(desired),      \
+                                          memory_order_acq_rel, memory_order_acquire)
+typedef _Atomic(void *) persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) atomic_init(&(p), (void *)(v))
+#define PERSIMM_PTR_LOAD(p) atomic_load_explicit(&(p), memory_order_acquire)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    atomic_compare_exchange_strong_explicit(&(p), &(expected), (void *)(desired),     \
+                                            memory_order_acq_rel, memory_order_acquire)
+#define PERSIMM_FENCE() atomic_thread_fence(memory_order_seq_cst)
 
 #elif defined(__GNUC__) || defined(__clang__)
 
@@ -74,6 +107,19 @@ typedef size_t persimm_refcount_t;
 #define PERSIMM_RC_LOAD(rc) __atomic_load_n(&(rc), __ATOMIC_ACQUIRE)
 #define PERSIMM_RC_INC(rc) __atomic_fetch_add(&(rc), 1, __ATOMIC_RELAXED)
 #define PERSIMM_RC_DEC(rc) __atomic_fetch_sub(&(rc), 1, __ATOMIC_ACQ_REL)
+#define PERSIMM_RC_PEEK(rc) __atomic_load_n(&(rc), __ATOMIC_RELAXED)
+#define PERSIMM_RC_PUT(rc, v) __atomic_store_n(&(rc), (size_t)(v), __ATOMIC_RELAXED)
+#define PERSIMM_RC_STORE(rc, v) __atomic_store_n(&(rc), (size_t)(v), __ATOMIC_RELEASE)
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    __atomic_compare_exchange_n(&(rc), &(expected), (size_t)(desired), true,           \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+typedef void *persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) __atomic_store_n(&(p), (void *)(v), __ATOMIC_RELAXED)
+#define PERSIMM_PTR_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    __atomic_compare_exchange_n(&(p), &(expected), (void *)(desired), false,           \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define PERSIMM_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
 
 #elif defined(_WIN32)
 
@@ -85,13 +131,35 @@ typedef volatile size_t persimm_refcount_t;
 #define PERSIMM_RC_LOAD(rc) ((size_t)InterlockedCompareExchange64((volatile LONG64 *)&(rc), 0, 0))
 #define PERSIMM_RC_INC(rc) ((size_t)InterlockedIncrement64((volatile LONG64 *)&(rc)) - 1)
 #define PERSIMM_RC_DEC(rc) ((size_t)InterlockedDecrement64((volatile LONG64 *)&(rc)) + 1)
+#define PERSIMM_RC_SWAP(rc, expected, desired)                                         \
+    ((size_t)InterlockedCompareExchange64((volatile LONG64 *)&(rc), (LONG64)(desired), \
+                                          (LONG64)(expected)))
 #else
 #define PERSIMM_RC_LOAD(rc) ((size_t)InterlockedCompareExchange((volatile LONG *)&(rc), 0, 0))
 #define PERSIMM_RC_INC(rc) ((size_t)InterlockedIncrement((volatile LONG *)&(rc)) - 1)
 #define PERSIMM_RC_DEC(rc) ((size_t)InterlockedDecrement((volatile LONG *)&(rc)) + 1)
+#define PERSIMM_RC_SWAP(rc, expected, desired)                                         \
+    ((size_t)InterlockedCompareExchange((volatile LONG *)&(rc), (LONG)(desired),       \
+                                        (LONG)(expected)))
 #endif
+#define PERSIMM_RC_PEEK(rc) ((size_t)(rc))
+#define PERSIMM_RC_PUT(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_STORE(rc, v) (MemoryBarrier(), (rc) = (size_t)(v))
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    (PERSIMM_RC_SWAP(rc, expected, desired) == (expected)                             \
+         ? true : ((expected) = PERSIMM_RC_LOAD(rc), false))
+typedef void *volatile persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) ((p) = (void *)(v))
+#define PERSIMM_PTR_LOAD(p) InterlockedCompareExchangePointer(&(p), NULL, NULL)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    (InterlockedCompareExchangePointer(&(p), (void *)(desired), (expected)) == (expected) \
+         ? true : ((expected) = PERSIMM_PTR_LOAD(p), false))
+#define PERSIMM_FENCE() MemoryBarrier()
 
-#else
+#endif
+
+/* Without atomics, or without wanting them. */
+#if !defined(PERSIMM_RC_ATOMIC)
 
 typedef size_t persimm_refcount_t;
 #define PERSIMM_RC_ATOMIC 0
@@ -99,9 +167,75 @@ typedef size_t persimm_refcount_t;
 #define PERSIMM_RC_LOAD(rc) (rc)
 #define PERSIMM_RC_INC(rc) ((rc)++)
 #define PERSIMM_RC_DEC(rc) ((rc)--)
+#define PERSIMM_RC_PEEK(rc) (rc)
+#define PERSIMM_RC_PUT(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_STORE(rc, v) ((rc) = (size_t)(v))
+#define PERSIMM_RC_CAS(rc, expected, desired)                                          \
+    ((rc) == (expected) ? ((rc) = (size_t)(desired), true) : ((expected) = (rc), false))
+typedef void *persimm_atomic_ptr_t;
+#define PERSIMM_PTR_SET(p, v) ((p) = (void *)(v))
+#define PERSIMM_PTR_LOAD(p) (p)
+#define PERSIMM_PTR_CAS(p, expected, desired)                                          \
+    ((p) == (expected) ? ((p) = (void *)(desired), true) : ((expected) = (p), false))
+#define PERSIMM_FENCE() ((void)0)
+
+#endif
 
+/*
+ * Said once per turn of a loop that waits on another thread, so that a
+ * spinning core gives way to its hyperthread sibling and saves power. Where
+ * the compiler offers no hint the loop simply spins.
+ */
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define PERSIMM_RELAX() _mm_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define PERSIMM_RELAX() __builtin_ia32_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+#define PERSIMM_RELAX() __asm__ __volatile__("yield")
+#else
+#define PERSIMM_RELAX() ((void)0)
 #endif
 
+/*
+ * A count no real number of references can reach, marking storage that has
+ * been frozen. It is written once, before any other thread can see the
+ * storage, and never changes again, so a relaxed read of it is enough to
+ * skip the atomic that would otherwise follow.
+ */
+#define PERSIMM_RC_IMMORTAL SIZE_MAX
+
+/*
+ * The counts of a local collection's storage, which only ever moves between
+ * clones on one thread, step with a plain load and store where a shared one
+ * pays for a locked instruction. Both return the count as it was, as the
+ * macros do, and both leave an immortal count alone. Since that count is
+ * never 1, a caller that frees on 1 never frees frozen storage and a caller
+ * that updates in place on 1 always copies it.
+ */
+static inline size_t persimm_rc_inc(persimm_refcount_t *rc, bool local) {
+    size_t count = PERSIMM_RC_PEEK(*rc);
+    if (PERSIMM_RC_IMMORTAL == count) return count;
+    if (!local) return PERSIMM_RC_INC(*rc);
+    PERSIMM_RC_PUT(*rc, count + 1);
+    return count;
+}
+
+static inline size_t persimm_rc_dec(persimm_refcount_t *rc, bool local) {
+    size_t count = PERSIMM_RC_PEEK(*rc);
+    if (PERSIMM_RC_IMMORTAL == count) return count;
+    if (!local) return PERSIMM_RC_DEC(*rc);
+    PERSIMM_RC_PUT(*rc, count - 1);
+    return count;
+}
+
+/* Returns false if the count was already immortal, so walks can stop there. */
+static inline bool persimm_rc_freeze(persimm_refcount_t *rc) {
+    if (PERSIMM_RC_IMMORTAL == PERSIMM_RC_PEEK(*rc)) return false;
+    PERSIMM_RC_PUT(*rc, PERSIMM_RC_IMMORTAL);
+    return true;
+}
+
 /* Alignment */
 
 /*
@@ -164,6 +298,123 @@ static inline void persimm_elem_release(const persimm_elem_ops *ops, void *ctx,
     if (NULL != ops && NULL != ops->release) ops->release(slot, ctx);
 }
 
+static inline bool persimm_elem_hashes(const persimm_elem_ops *ops) {
+    return NULL != ops && NULL != ops->hash;
+}
+
+/* Tracing */
+
+/*
+ * Claims a node for tracing in `epoch`, returning false when it was already
+ * traced in that epoch. Epoch zero is tracing in full: it claims every node
+ * and records nothing, so a full trace never writes to a node.
+ */
+static inline bool persimm_trace_claim(uint32_t *traced, uint32_t epoch) {
+    if (0 == epoch) return true;
+    if (*traced == epoch) return false;
+    *traced = epoch;
+    return true;
+}
+
+/*
+ * A HAMT node's stamp sits in padding it already had, but a vector node's or
+ * list cell's would push its elements out by a whole alignment step, which a
+ * host that never traces should not pay for. Those record epochs only when
+ * PERSIMM_TRACE_EPOCHS is defined, and otherwise claim every node as a full
+ * trace does.
+ */
+#if defined(PERSIMM_TRACE_EPOCHS)
+#define PERSIMM_TRACE_CLAIM(node, epoch) persimm_trace_claim(&(node)->traced, (epoch))
+#else
+#define PERSIMM_TRACE_CLAIM(node, epoch) ((void)(node), (void)(epoch), true)
+#endif
+
+/* Executors */
+
+/* Runs `tasks` calls of `fn` through `executor`, or in order here when it is NULL. */
+void persimm_executor_run(const persimm_executor *executor, size_t tasks, persimm_task_fn fn,
+                          void *arg);
+
+/* Node Sets */
+
+/*
+ * The storage one version reaches, gathered so that a walk of another can tell
+ * which of its nodes the first already holds. Open addressing over pointers,
+ * doubling whenever it is half full. A zeroed set is empty and ready for use.
+ */
+typedef struct {
+    const void **slots;
+    size_t capacity;
+    size_t count;
+} persimm_node_set_t;
+
+persimm_status persimm_node_set_add(persimm_node_set_t *set, const void *node);
+bool persimm_node_set_has(const persimm_node_set_t *set, const void *node);
+void persimm_node_set_free(persimm_node_set_t *set);
+
+/* Operation Counters */
+
+/*
+ * The counters behind persimm_stats_snapshot, one set per thread. Every count
+ * goes through these macros so that a build without PERSIMM_STATS carries no
+ * trace of them. C99 has no thread-local storage of its own, so each compiler
+ * is asked for it in its own words.
+ */
+#if defined(PERSIMM_STATS)
+
+#if defined(_MSC_VER)
+#define PERSIMM_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define PERSIMM_THREAD_LOCAL _Thread_local
+#else
+#define PERSIMM_THREAD_LOCAL __thread
+#endif
+
+extern PERSIMM_THREAD_LOCAL persimm_op_stats persimm_stats_local;
+
+#define PERSIMM_COUNT(kind, field) ((void)(persimm_stats_local.kind.field++))
+#define PERSIMM_COUNT_N(kind, field, n) ((void)(persimm_stats_local.kind.field += (n)))
+
+#else
+
+#define PERSIMM_COUNT(kind, field) ((void)0)
+#define PERSIMM_COUNT_N(kind, field, n) ((void)0)
+
+#endif
+
+/* Hashing */
+
+/*
+ * The structural hashes cached in trie nodes are sums, so that a node's can be
+ * corrected by what one path copy changed rather than recomputed. Each term is
+ * put through this finaliser first (MurmurHash3's), which spreads a change in
+ * any input bit across the whole word and keeps sums of similar terms apart.
+ */
+static inline uint32_t persimm_hash_mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* FNV-1a over a run of bytes, the hash used wherever the host supplies none. */
+static inline uint32_t persimm_hash_bytes(const void *bytes, size_t size) {
+    const unsigned char *byte = (const unsigned char *)bytes;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= byte[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Folds a collection's count into its structural hash, so that sizes differ too. */
+static inline uint32_t persimm_hash_finish(uint32_t hash, size_t count) {
+    return persimm_hash_mix(hash ^ persimm_hash_mix((uint32_t)count + 0x9e3779b9u));
+}
+
 /* Hash Array Mapped Tries */
 
 /*
@@ -183,6 +434,8 @@ typedef struct {
     bool (*equals)(const void *key_a, const void *key_b, size_t key_size, void *ctx);
     void *value_ctx;
     void *key_ctx;
+    /* Counts references with plain arithmetic, as the collection's `local` says. */
+    bool local;
 } persimm_hamt_t;
 
 /*
@@ -191,14 +444,17 @@ typedef struct {
  */
 void persimm_hamt_config(persimm_hamt_t *hamt, const persimm_entry_layout *layout,
                          const persimm_elem_ops *value_ops, void *value_ctx,
-                         const persimm_key_ops *key_ops, void *key_ctx);
+                         const persimm_key_ops *key_ops, void *key_ctx, bool local);
 
 bool persimm_hamt_layout_valid(const persimm_entry_layout *layout);
 
-void persimm_hamt_retain(persimm_hamt_node_t *root);
+void persimm_hamt_retain(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
 
 void persimm_hamt_release(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
 
+/* Makes every node reachable from `root` immortal. */
+void persimm_hamt_freeze(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
+
 /*
  * Returns the entry whose key matches, or NULL. The key is the first
  * `key_size` bytes of an entry, so the result is also a pointer to the stored
@@ -218,6 +474,37 @@ persimm_status persimm_hamt_assoc(persimm_hamt_node_t **root, const void *entry,
 persimm_status persimm_hamt_dissoc(persimm_hamt_node_t **root, const void *key,
                                    const persimm_hamt_t *hamt, bool immutable, bool *removed);
 
+/*
+ * Builds a trie from `count` entries laid out `layout.entry_size` apart,
+ * allocating each node once at its final size. The result is the trie storing
+ * them one at a time would have produced: of a repeated key the first is kept
+ * and the last value wins. `*built` reports how many distinct keys it holds.
+ * On failure `*root` is NULL and nothing is left allocated.
+ */
+persimm_status persimm_hamt_build(persimm_hamt_node_t **root, const void *entries,
+                                  size_t count, const persimm_hamt_t *hamt, size_t *built);
+
+/* Builds as persimm_hamt_build does, the root's slots built as tasks on `executor`. */
+persimm_status persimm_hamt_parallel_build(persimm_hamt_node_t **root, const void *entries,
+                                           size_t count, const persimm_hamt_t *hamt,
+                                           const persimm_executor *executor, size_t *built);
+
+/*
+ * Stores `count` entries laid out `layout.entry_size` apart, or removes the
+ * entries for `count` keys laid out `layout.key_size` apart, as doing so one
+ * at a time would, but descending the trie once for the whole batch so that
+ * each node it reaches is copied at most once. Nodes are never changed in
+ * place. `*added` and `*removed` report how far the entry count moved. On
+ * failure `*root` is left as it was.
+ */
+persimm_status persimm_hamt_assoc_many(persimm_hamt_node_t **root, const void *entries,
+                                       size_t count, const persimm_hamt_t *hamt,
+                                       size_t *added);
+
+persimm_status persimm_hamt_dissoc_many(persimm_hamt_node_t **root, const void *keys,
+                                        size_t count, const persimm_hamt_t *hamt,
+                                        size_t *removed);
+
 /*
  * Walks the trie once, calling `fn` with each entry. persimm_hamt_next follows
  * the same order, so a host may drive iteration either way and see the same
@@ -226,6 +513,21 @@ persimm_status persimm_hamt_dissoc(persimm_hamt_node_t **root, const void *key,
 void persimm_hamt_foreach(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
                           persimm_visit_fn fn, void *ctx);
 
+/*
+ * Visits or folds every entry as foreach does, but split into tasks run
+ * through `executor`, each of which numbers its entries from zero. Without an
+ * executor they walk the trie in order on the calling thread.
+ */
+persimm_status persimm_hamt_parallel_foreach(persimm_hamt_node_t *root,
+                                             const persimm_hamt_t *hamt, persimm_visit_fn fn,
+                                             void *ctx, const persimm_executor *executor);
+
+persimm_status persimm_hamt_parallel_reduce(persimm_hamt_node_t *root,
+                                            const persimm_hamt_t *hamt, persimm_fold_fn fold,
+                                            persimm_combine_fn combine, const void *identity,
+                                            size_t acc_size, void *ctx,
+                                            const persimm_executor *executor, void *result);
+
 /*
  * Returns the entry after the one `key` belongs to, the first entry when `key`
  * is NULL, or NULL at the end. This descends by hash rather than resuming from
@@ -237,4 +539,49 @@ const void *persimm_hamt_next(persimm_hamt_node_t *root, const void *key,
 
 void persimm_hamt_trace(persimm_hamt_node_t *root, const persimm_hamt_t *hamt);
 
+/* Traces as persimm_hamt_trace does, skipping each node already traced in `epoch`. */
+void persimm_hamt_trace_epoch(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              uint32_t epoch);
+
+/*
+ * Splits a trie by the slot each key takes in the root, leaving in `roots[i]`
+ * a trie of the keys in slot `i`, or NULL, and in `counts[i]` how many it
+ * holds. Both arrays have PERSIMM_WIDTH places. Joining takes `count` roots,
+ * any of them NULL, and builds the one trie holding them all, returning
+ * PERSIMM_ERR_INVALID when two of them use the same slot in the root. Each
+ * copies the root alone and shares everything below it, though a split counts
+ * the keys under each slot. On failure nothing is left allocated.
+ */
+persimm_status persimm_hamt_split(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                  persimm_hamt_node_t **roots, size_t *counts);
+
+persimm_status persimm_hamt_join(persimm_hamt_node_t *const *roots, size_t count,
+                                 const persimm_hamt_t *hamt, persimm_hamt_node_t **dest);
+
+/*
+ * Returns the structural hash the root carries: a sum over every entry of its
+ * key's hash mixed with its value's, which any two tries holding equal entries
+ * agree on however they were built. Zero for an empty trie.
+ */
+uint32_t persimm_hamt_hash(persimm_hamt_node_t *root);
+
+/*
+ * Adds the trie's nodes to `stats` as persimm_map_memory_stats describes.
+ * Gathering puts every node reachable from `root` into `nodes`, and the delta
+ * adds to `bytes` the size of each node reachable from `root` that `nodes`
+ * does not hold, skipping whatever lies beneath a node it does.
+ */
+void persimm_hamt_memory_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               persimm_memory_stats *stats);
+
+persimm_status persimm_hamt_memory_gather(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                                          persimm_node_set_t *nodes);
+
+void persimm_hamt_memory_delta(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                               const persimm_node_set_t *nodes, size_t *bytes);
+
+/* Fills `stats` as persimm_map_shape_stats describes. */
+void persimm_hamt_shape_stats(persimm_hamt_node_t *root, const persimm_hamt_t *hamt,
+                              persimm_shape_stats *stats);
+
 #endif /* end of include guard */
@@ -13,6 +13,9 @@
 struct persimm_list_cell {
     persimm_refcount_t ref_count;
     persimm_list_cell_t *next;
+#if defined(PERSIMM_TRACE_EPOCHS)
+    uint32_t traced; // the last epoch the cell was traced in
+#endif
     persimm_align_t data[];
 };
 
@@ -30,19 +33,21 @@ static void *persimm_list_cell_slot(persimm_list_cell_t *cell) {
  * long before the list ran out of cells.
  */
 static void persimm_list_cell_release(persimm_list_cell_t *cell, const persimm_elem_ops *ops,
-                                      void *ctx) {
+                                      void *ctx, bool local) {
     while (NULL != cell) {
-        if (PERSIMM_RC_DEC(cell->ref_count) > 1) return;
+        if (persimm_rc_dec(&cell->ref_count, local) > 1) return;
 
         persimm_list_cell_t *next = cell->next;
+        PERSIMM_COUNT(list, releases);
         persimm_elem_release(ops, ctx, persimm_list_cell_slot(cell));
+        PERSIMM_COUNT(list, node_frees);
         free(cell);
         cell = next;
     }
 }
 
 void persimm_list_deinit(persimm_list_t *list) {
-    persimm_list_cell_release(list->head, list->ops, list->ctx);
+    persimm_list_cell_release(list->head, list->ops, list->ctx, list->local);
     list->head = NULL;
     list->count = 0;
 }
@@ -54,6 +59,7 @@ static persimm_list_cell_t *persimm_list_cell_new(size_t elem_size) {
     if (!persimm_size_add(offsetof(struct persimm_list_cell, data), elem_size, &bytes)) return NULL;
     persimm_list_cell_t *cell = calloc(1, bytes);
     if (NULL == cell) return NULL;
+    PERSIMM_COUNT(list, node_allocs);
     PERSIMM_RC_SET(cell->ref_count, 1);
     return cell;
 }
@@ -65,6 +71,7 @@ persimm_status persimm_list_init(persimm_list_t *list, size_t elem_size,
     list->elem_size = elem_size;
     list->ops = ops;
     list->ctx = ctx;
+    list->local = false;
     list->head = NULL;
 
     if (0 == elem_size) return PERSIMM_ERR_INVALID;
@@ -79,11 +86,39 @@ persimm_status persimm_list_clone(const persimm_list_t *src, persimm_list_t *des
     dest->elem_size = src->elem_size;
     dest->ops = src->ops;
     dest->ctx = src->ctx;
+    dest->local = src->local;
     dest->head = src->head;
-    if (NULL != dest->head) PERSIMM_RC_INC(dest->head->ref_count);
+    if (NULL != dest->head) persimm_rc_inc(&dest->head->ref_count, dest->local);
     return PERSIMM_OK;
 }
 
+/* Borrowing */
+
+void persimm_list_borrow(const persimm_list_t *src, persimm_list_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_list_t *persimm_list_view(const persimm_list_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_list_make_local(persimm_list_t *list) {
+    list->local = true;
+}
+
+void persimm_list_share(persimm_list_t *list) {
+    list->local = false;
+}
+
+/* Walks the chain for the reason release does, stopping where an earlier freeze did. */
+void persimm_list_freeze(persimm_list_t *list) {
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        if (!persimm_rc_freeze(&cell->ref_count)) return;
+    }
+}
+
 /* Accessing */
 
 const void *persimm_list_first(const persimm_list_t *list) {
@@ -149,6 +184,7 @@ static persimm_status persimm_list_cons_in_place(persimm_list_t *list, const voi
     if (NULL == cell) return PERSIMM_ERR_ALLOC;
 
     memcpy(persimm_list_cell_slot(cell), elem, list->elem_size);
+    PERSIMM_COUNT(list, retains);
     persimm_elem_retain(list->ops, list->ctx, persimm_list_cell_slot(cell));
 
     /* The list's reference to its old head becomes the new cell's. */
@@ -170,8 +206,8 @@ static persimm_status persimm_list_rest_in_place(persimm_list_t *list) {
 
     /* Take a reference to the new head before letting go of the old one, or
        releasing the old head could take the rest of the chain with it. */
-    if (NULL != next) PERSIMM_RC_INC(next->ref_count);
-    persimm_list_cell_release(head, list->ops, list->ctx);
+    if (NULL != next) persimm_rc_inc(&next->ref_count, list->local);
+    persimm_list_cell_release(head, list->ops, list->ctx, list->local);
 
     list->head = next;
     list->count--;
@@ -197,6 +233,14 @@ persimm_status persimm_list_rest(const persimm_list_t *src, persimm_list_t *dest
     return status;
 }
 
+persimm_status persimm_list_cons_owned(persimm_list_t *list, const void *elem) {
+    return persimm_list_cons_in_place(list, elem);
+}
+
+persimm_status persimm_list_rest_owned(persimm_list_t *list) {
+    return persimm_list_rest_in_place(list);
+}
+
 /* Traversing */
 
 void persimm_list_foreach(const persimm_list_t *list, persimm_visit_fn fn, void *ctx) {
@@ -207,13 +251,64 @@ void persimm_list_foreach(const persimm_list_t *list, persimm_visit_fn fn, void
     }
 }
 
-static void persimm_list_trace_visit(const void *slot, size_t index, void *ctx) {
-    (void) index;
-    const persimm_list_t *list = (const persimm_list_t *)ctx;
-    list->ops->trace(slot, list->ctx);
-}
+/* Tracing */
 
 void persimm_list_trace(const persimm_list_t *list) {
+    persimm_list_trace_epoch(list, 0);
+}
+
+/*
+ * A cell is only ever traced on the way down the chain from some head, so one
+ * already traced in this epoch had every cell after it traced too.
+ */
+void persimm_list_trace_epoch(const persimm_list_t *list, uint32_t epoch) {
     if (NULL == list->ops || NULL == list->ops->trace) return;
-    persimm_list_foreach(list, persimm_list_trace_visit, (void *)list);
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        if (!PERSIMM_TRACE_CLAIM(cell, epoch)) return;
+        list->ops->trace(persimm_list_cell_slot(cell), list->ctx);
+    }
+}
+
+/* Memory Statistics */
+
+void persimm_list_memory_stats(const persimm_list_t *list, persimm_memory_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    size_t bytes = offsetof(struct persimm_list_cell, data) + list->elem_size;
+
+    bool exclusive = true;
+    for (persimm_list_cell_t *cell = list->head; NULL != cell; cell = cell->next) {
+        exclusive = exclusive && 1 == PERSIMM_RC_PEEK(cell->ref_count);
+        if (exclusive) {
+            stats->exclusive_bytes += bytes;
+        } else {
+            stats->shared_bytes += bytes;
+        }
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+        stats->elem_bytes += list->elem_size;
+    }
+}
+
+/* The first cell of `b` that `a` holds starts the tail the two share. */
+persimm_status persimm_list_memory_delta(const persimm_list_t *a, const persimm_list_t *b,
+                                         size_t *bytes) {
+    *bytes = 0;
+
+    persimm_node_set_t cells = { NULL, 0, 0 };
+    persimm_status status = PERSIMM_OK;
+    for (persimm_list_cell_t *cell = a->head; NULL != cell && PERSIMM_OK == status;
+         cell = cell->next) {
+        status = persimm_node_set_add(&cells, cell);
+    }
+
+    if (PERSIMM_OK == status) {
+        size_t size = offsetof(struct persimm_list_cell, data) + b->elem_size;
+        for (persimm_list_cell_t *cell = b->head;
+             NULL != cell && !persimm_node_set_has(&cells, cell); cell = cell->next) {
+            *bytes += size;
+        }
+    }
+
+    persimm_node_set_free(&cells);
+    return status;
 }
@@ -12,7 +12,7 @@
 
 static void persimm_map_hamt(const persimm_map_t *map, persimm_hamt_t *hamt) {
     persimm_hamt_config(hamt, &map->layout, map->value_ops, map->value_ctx, map->key_ops,
-                        map->key_ctx);
+                        map->key_ctx, map->local);
 }
 
 static persimm_status persimm_map_assoc_in_place(persimm_map_t *map, const void *entry,
@@ -31,6 +31,7 @@ persimm_status persimm_map_init(persimm_map_t *map, const persimm_entry_layout *
     map->key_ops = key_ops;
     map->value_ctx = value_ctx;
     map->key_ctx = key_ctx;
+    map->local = false;
     map->root = NULL;
 
     if (!persimm_hamt_layout_valid(layout)) return PERSIMM_ERR_INVALID;
@@ -38,6 +39,33 @@ persimm_status persimm_map_init(persimm_map_t *map, const persimm_entry_layout *
     return PERSIMM_OK;
 }
 
+persimm_status persimm_map_from_entries(const void *entries, size_t count,
+                                        const persimm_entry_layout *layout,
+                                        const persimm_elem_ops *value_ops, void *value_ctx,
+                                        const persimm_key_ops *key_ops, void *key_ctx,
+                                        persimm_map_t *dest) {
+    return persimm_map_parallel_from_entries(entries, count, layout, value_ops, value_ctx,
+                                             key_ops, key_ctx, NULL, dest);
+}
+
+persimm_status persimm_map_parallel_from_entries(const void *entries, size_t count,
+                                                 const persimm_entry_layout *layout,
+                                                 const persimm_elem_ops *value_ops,
+                                                 void *value_ctx,
+                                                 const persimm_key_ops *key_ops, void *key_ctx,
+                                                 const persimm_executor *executor,
+                                                 persimm_map_t *dest) {
+    persimm_status status = persimm_map_init(dest, layout, value_ops, value_ctx, key_ops,
+                                             key_ctx);
+    if (PERSIMM_OK != status) return status;
+    if (0 != count && NULL == entries) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+    return persimm_hamt_parallel_build(&dest->root, entries, count, &hamt, executor,
+                                       &dest->count);
+}
+
 persimm_status persimm_map_clone(const persimm_map_t *src, persimm_map_t *dest) {
     if (src == dest) return PERSIMM_ERR_INVALID;
     dest->count = src->count;
@@ -46,11 +74,41 @@ persimm_status persimm_map_clone(const persimm_map_t *src, persimm_map_t *dest)
     dest->key_ops = src->key_ops;
     dest->value_ctx = src->value_ctx;
     dest->key_ctx = src->key_ctx;
+    dest->local = src->local;
     dest->root = src->root;
-    persimm_hamt_retain(dest->root);
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+    persimm_hamt_retain(dest->root, &hamt);
     return PERSIMM_OK;
 }
 
+/* Borrowing */
+
+void persimm_map_borrow(const persimm_map_t *src, persimm_map_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_map_t *persimm_map_view(const persimm_map_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_map_make_local(persimm_map_t *map) {
+    map->local = true;
+}
+
+void persimm_map_share(persimm_map_t *map) {
+    map->local = false;
+}
+
+void persimm_map_freeze(persimm_map_t *map) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_freeze(map->root, &hamt);
+}
+
 /* Transients */
 
 persimm_status persimm_map_to_transient(const persimm_map_t *src,
@@ -102,6 +160,102 @@ persimm_status persimm_map_transient_persist(persimm_map_transient_t *transient,
     return PERSIMM_OK;
 }
 
+/*
+ * Each slot is an ordinary transient whose trie holds only keys from that
+ * slot, which is what lets threads edit different slots without a lock: no
+ * node is reachable from two of them, and the counts on nodes still shared
+ * with the source are atomic.
+ */
+persimm_status persimm_map_to_sharded_transient(const persimm_map_t *src,
+                                                persimm_map_sharded_transient_t *transient) {
+    persimm_map_t shards[PERSIMM_WIDTH];
+    persimm_status status = src->local ? PERSIMM_ERR_INVALID : persimm_map_split(src, shards);
+    transient->shape = *src;
+    transient->shape.count = 0;
+    transient->shape.root = NULL;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_transient_t *slot = &transient->slots[i].transient;
+        slot->value = PERSIMM_OK == status ? shards[i] : transient->shape;
+        slot->active = PERSIMM_OK == status;
+    }
+    return status;
+}
+
+persimm_status persimm_map_sharded_transient_init(persimm_map_sharded_transient_t *transient,
+                                                  const persimm_entry_layout *layout,
+                                                  const persimm_elem_ops *value_ops,
+                                                  void *value_ctx,
+                                                  const persimm_key_ops *key_ops, void *key_ctx) {
+    persimm_status status = PERSIMM_OK;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_status slot = persimm_map_transient_init(&transient->slots[i].transient, layout,
+                                                         value_ops, value_ctx, key_ops, key_ctx);
+        if (PERSIMM_OK == status) status = slot;
+    }
+    transient->shape = transient->slots[0].transient.value;
+    return status;
+}
+
+void persimm_map_sharded_transient_deinit(persimm_map_sharded_transient_t *transient) {
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_map_transient_deinit(&transient->slots[i].transient);
+    }
+}
+
+size_t persimm_map_sharded_transient_slot(const persimm_map_sharded_transient_t *transient,
+                                          const void *key) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&transient->shape, &hamt);
+    PERSIMM_COUNT(hamt, hash_calls);
+    return hamt.hash(key, hamt.layout.key_size, hamt.key_ctx) & PERSIMM_MASK;
+}
+
+persimm_status persimm_map_sharded_transient_assoc(persimm_map_sharded_transient_t *transient,
+                                                   const void *entry) {
+    size_t slot = persimm_map_sharded_transient_slot(transient, entry);
+    return persimm_map_transient_assoc(&transient->slots[slot].transient, entry);
+}
+
+persimm_status persimm_map_sharded_transient_dissoc(persimm_map_sharded_transient_t *transient,
+                                                    const void *key) {
+    size_t slot = persimm_map_sharded_transient_slot(transient, key);
+    return persimm_map_transient_dissoc(&transient->slots[slot].transient, key);
+}
+
+persimm_status persimm_map_sharded_transient_persist(persimm_map_sharded_transient_t *transient,
+                                                     persimm_map_t *dest) {
+    /* A slot persisted or deinitialised on its own no longer owns what it points to. */
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        if (!transient->slots[i].transient.active) {
+            memset(dest, 0, sizeof(*dest));
+            return PERSIMM_ERR_INVALID;
+        }
+    }
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t count = 0;
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        roots[i] = transient->slots[i].transient.value.root;
+        count += transient->slots[i].transient.value.count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&transient->shape, &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, PERSIMM_WIDTH, &hamt, &root);
+    if (PERSIMM_OK != status) {
+        memset(dest, 0, sizeof(*dest));
+        return status;
+    }
+
+    *dest = transient->shape;
+    dest->count = count;
+    dest->root = root;
+    persimm_map_sharded_transient_deinit(transient);
+    return PERSIMM_OK;
+}
+
 /* Deinitialising */
 
 void persimm_map_deinit(persimm_map_t *map) {
@@ -185,6 +339,158 @@ persimm_status persimm_map_dissoc(const persimm_map_t *src, const void *key,
     return status;
 }
 
+/* As a transient does, edit in place every node nothing else holds. */
+persimm_status persimm_map_assoc_owned(persimm_map_t *map, const void *entry) {
+    return persimm_map_assoc_in_place(map, entry, false);
+}
+
+persimm_status persimm_map_dissoc_owned(persimm_map_t *map, const void *key) {
+    return persimm_map_dissoc_in_place(map, key, false);
+}
+
+persimm_status persimm_map_assoc_many(const persimm_map_t *src, const void *entries,
+                                      size_t count, persimm_map_t *dest) {
+    if (0 != count && NULL == entries) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+
+    size_t added = 0;
+    status = persimm_hamt_assoc_many(&dest->root, entries, count, &hamt, &added);
+    if (PERSIMM_OK != status) {
+        persimm_map_deinit(dest);
+        return status;
+    }
+
+    dest->count += added;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_dissoc_many(const persimm_map_t *src, const void *keys,
+                                       size_t count, persimm_map_t *dest) {
+    if (0 != count && NULL == keys) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_map_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(dest, &hamt);
+
+    size_t removed = 0;
+    status = persimm_hamt_dissoc_many(&dest->root, keys, count, &hamt, &removed);
+    if (PERSIMM_OK != status) {
+        persimm_map_deinit(dest);
+        return status;
+    }
+
+    dest->count -= removed;
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+persimm_status persimm_map_split(const persimm_map_t *map, persimm_map_t out[PERSIMM_SPLIT_WAYS]) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(map->root, &hamt, roots, counts);
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        out[i] = *map;
+        out[i].count = counts[i];
+        out[i].root = roots[i];
+    }
+    return status;
+}
+
+static bool persimm_map_matches(const persimm_map_t *a, const persimm_map_t *b) {
+    return a->layout.entry_size == b->layout.entry_size &&
+           a->layout.key_size == b->layout.key_size &&
+           a->layout.value_offset == b->layout.value_offset &&
+           a->layout.value_size == b->layout.value_size && a->value_ops == b->value_ops &&
+           a->value_ctx == b->value_ctx && a->key_ops == b->key_ops &&
+           a->key_ctx == b->key_ctx && a->local == b->local;
+}
+
+/*
+ * No more than 32 shards can hold anything without two of them meeting in a
+ * slot, so the roots fit on the stack however many empty shards come along.
+ */
+persimm_status persimm_map_join(const persimm_map_t *shards, size_t count,
+                                persimm_map_t *dest) {
+    if (0 == count) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t used = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!persimm_map_matches(&shards[0], &shards[i])) return PERSIMM_ERR_INVALID;
+        if (NULL == shards[i].root) continue;
+        if (PERSIMM_WIDTH == used) return PERSIMM_ERR_INVALID;
+        roots[used++] = shards[i].root;
+        total += shards[i].count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_map_hamt(&shards[0], &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, used, &hamt, &root);
+    if (PERSIMM_OK != status) return status;
+
+    *dest = shards[0];
+    dest->count = total;
+    dest->root = root;
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+uint32_t persimm_map_hash(const persimm_map_t *map) {
+    return persimm_hash_finish(persimm_hamt_hash(map->root), map->count);
+}
+
+/* Memory Statistics */
+
+void persimm_map_memory_stats(const persimm_map_t *map, persimm_memory_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    memset(stats, 0, sizeof(*stats));
+    persimm_hamt_memory_stats(map->root, &hamt, stats);
+}
+
+persimm_status persimm_map_memory_delta(const persimm_map_t *a, const persimm_map_t *b,
+                                        size_t *bytes) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(a, &hamt);
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_hamt_memory_gather(a->root, &hamt, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_map_hamt(b, &hamt);
+        persimm_hamt_memory_delta(b->root, &hamt, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
+}
+
+/* Shape Statistics */
+
+void persimm_map_shape_stats(const persimm_map_t *map, persimm_shape_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_shape_stats(map->root, &hamt, stats);
+}
+
 /* Traversing */
 
 void persimm_map_foreach(const persimm_map_t *map, persimm_visit_fn fn, void *ctx) {
@@ -193,6 +499,25 @@ void persimm_map_foreach(const persimm_map_t *map, persimm_visit_fn fn, void *ct
     persimm_hamt_foreach(map->root, &hamt, fn, ctx);
 }
 
+persimm_status persimm_map_parallel_foreach(const persimm_map_t *map, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor) {
+    if (map->local) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_parallel_foreach(map->root, &hamt, fn, ctx, executor);
+}
+
+persimm_status persimm_map_parallel_reduce(const persimm_map_t *map, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result) {
+    if (map->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    return persimm_hamt_parallel_reduce(map->root, &hamt, fold, combine, identity, acc_size,
+                                        ctx, executor, result);
+}
+
 const void *persimm_map_next(const persimm_map_t *map, const void *key) {
     persimm_hamt_t hamt;
     persimm_map_hamt(map, &hamt);
@@ -204,3 +529,9 @@ void persimm_map_trace(const persimm_map_t *map) {
     persimm_map_hamt(map, &hamt);
     persimm_hamt_trace(map->root, &hamt);
 }
+
+void persimm_map_trace_epoch(const persimm_map_t *map, uint32_t epoch) {
+    persimm_hamt_t hamt;
+    persimm_map_hamt(map, &hamt);
+    persimm_hamt_trace_epoch(map->root, &hamt, epoch);
+}
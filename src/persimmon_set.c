@@ -12,7 +12,7 @@
 /* Configuring */
 
 static void persimm_set_hamt(const persimm_set_t *set, persimm_hamt_t *hamt) {
-    persimm_hamt_config(hamt, &set->layout, NULL, NULL, set->key_ops, set->key_ctx);
+    persimm_hamt_config(hamt, &set->layout, NULL, NULL, set->key_ops, set->key_ctx, set->local);
 }
 
 static persimm_status persimm_set_conj_in_place(persimm_set_t *set, const void *elem,
@@ -31,6 +31,7 @@ persimm_status persimm_set_init(persimm_set_t *set, size_t elem_size,
     set->layout.value_size = 0;
     set->key_ops = key_ops;
     set->key_ctx = key_ctx;
+    set->local = false;
     set->root = NULL;
 
     if (0 == elem_size) return PERSIMM_ERR_INVALID;
@@ -38,17 +39,68 @@ persimm_status persimm_set_init(persimm_set_t *set, size_t elem_size,
     return PERSIMM_OK;
 }
 
+persimm_status persimm_set_from_elems(const void *elems, size_t count, size_t elem_size,
+                                      const persimm_key_ops *key_ops, void *key_ctx,
+                                      persimm_set_t *dest) {
+    return persimm_set_parallel_from_elems(elems, count, elem_size, key_ops, key_ctx, NULL,
+                                           dest);
+}
+
+persimm_status persimm_set_parallel_from_elems(const void *elems, size_t count,
+                                               size_t elem_size, const persimm_key_ops *key_ops,
+                                               void *key_ctx, const persimm_executor *executor,
+                                               persimm_set_t *dest) {
+    persimm_status status = persimm_set_init(dest, elem_size, key_ops, key_ctx);
+    if (PERSIMM_OK != status) return status;
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+    return persimm_hamt_parallel_build(&dest->root, elems, count, &hamt, executor,
+                                       &dest->count);
+}
+
 persimm_status persimm_set_clone(const persimm_set_t *src, persimm_set_t *dest) {
     if (src == dest) return PERSIMM_ERR_INVALID;
     dest->count = src->count;
     dest->layout = src->layout;
     dest->key_ops = src->key_ops;
     dest->key_ctx = src->key_ctx;
+    dest->local = src->local;
     dest->root = src->root;
-    persimm_hamt_retain(dest->root);
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+    persimm_hamt_retain(dest->root, &hamt);
     return PERSIMM_OK;
 }
 
+/* Borrowing */
+
+void persimm_set_borrow(const persimm_set_t *src, persimm_set_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_set_t *persimm_set_view(const persimm_set_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_set_make_local(persimm_set_t *set) {
+    set->local = true;
+}
+
+void persimm_set_share(persimm_set_t *set) {
+    set->local = false;
+}
+
+void persimm_set_freeze(persimm_set_t *set) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_freeze(set->root, &hamt);
+}
+
 /* Transients */
 
 persimm_status persimm_set_to_transient(const persimm_set_t *src,
@@ -172,6 +224,151 @@ persimm_status persimm_set_disj(const persimm_set_t *src, const void *elem,
     return status;
 }
 
+/* As a transient does, edit in place every node nothing else holds. */
+persimm_status persimm_set_conj_owned(persimm_set_t *set, const void *elem) {
+    return persimm_set_conj_in_place(set, elem, false);
+}
+
+persimm_status persimm_set_disj_owned(persimm_set_t *set, const void *elem) {
+    return persimm_set_disj_in_place(set, elem, false);
+}
+
+persimm_status persimm_set_conj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest) {
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+
+    size_t added = 0;
+    status = persimm_hamt_assoc_many(&dest->root, elems, count, &hamt, &added);
+    if (PERSIMM_OK != status) {
+        persimm_set_deinit(dest);
+        return status;
+    }
+
+    dest->count += added;
+
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_disj_many(const persimm_set_t *src, const void *elems,
+                                     size_t count, persimm_set_t *dest) {
+    if (0 != count && NULL == elems) return PERSIMM_ERR_INVALID;
+
+    persimm_status status = persimm_set_clone(src, dest);
+    if (PERSIMM_OK != status) return status;
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(dest, &hamt);
+
+    size_t removed = 0;
+    status = persimm_hamt_dissoc_many(&dest->root, elems, count, &hamt, &removed);
+    if (PERSIMM_OK != status) {
+        persimm_set_deinit(dest);
+        return status;
+    }
+
+    dest->count -= removed;
+
+    return PERSIMM_OK;
+}
+
+/* Splitting and Joining */
+
+persimm_status persimm_set_split(const persimm_set_t *set, persimm_set_t out[PERSIMM_SPLIT_WAYS]) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t counts[PERSIMM_WIDTH];
+    persimm_status status = persimm_hamt_split(set->root, &hamt, roots, counts);
+
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        out[i] = *set;
+        out[i].count = counts[i];
+        out[i].root = roots[i];
+    }
+    return status;
+}
+
+static bool persimm_set_matches(const persimm_set_t *a, const persimm_set_t *b) {
+    return a->layout.entry_size == b->layout.entry_size && a->key_ops == b->key_ops &&
+           a->key_ctx == b->key_ctx && a->local == b->local;
+}
+
+/* The roots fit on the stack as they do in persimm_map_join. */
+persimm_status persimm_set_join(const persimm_set_t *shards, size_t count,
+                                persimm_set_t *dest) {
+    if (0 == count) return PERSIMM_ERR_INVALID;
+
+    persimm_hamt_node_t *roots[PERSIMM_WIDTH];
+    size_t used = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!persimm_set_matches(&shards[0], &shards[i])) return PERSIMM_ERR_INVALID;
+        if (NULL == shards[i].root) continue;
+        if (PERSIMM_WIDTH == used) return PERSIMM_ERR_INVALID;
+        roots[used++] = shards[i].root;
+        total += shards[i].count;
+    }
+
+    persimm_hamt_t hamt;
+    persimm_set_hamt(&shards[0], &hamt);
+
+    persimm_hamt_node_t *root;
+    persimm_status status = persimm_hamt_join(roots, used, &hamt, &root);
+    if (PERSIMM_OK != status) return status;
+
+    *dest = shards[0];
+    dest->count = total;
+    dest->root = root;
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+uint32_t persimm_set_hash(const persimm_set_t *set) {
+    return persimm_hash_finish(persimm_hamt_hash(set->root), set->count);
+}
+
+/* Memory Statistics */
+
+void persimm_set_memory_stats(const persimm_set_t *set, persimm_memory_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    memset(stats, 0, sizeof(*stats));
+    persimm_hamt_memory_stats(set->root, &hamt, stats);
+}
+
+persimm_status persimm_set_memory_delta(const persimm_set_t *a, const persimm_set_t *b,
+                                        size_t *bytes) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(a, &hamt);
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_hamt_memory_gather(a->root, &hamt, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_set_hamt(b, &hamt);
+        persimm_hamt_memory_delta(b->root, &hamt, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
+}
+
+/* Shape Statistics */
+
+void persimm_set_shape_stats(const persimm_set_t *set, persimm_shape_stats *stats) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_shape_stats(set->root, &hamt, stats);
+}
+
 /* Traversing */
 
 void persimm_set_foreach(const persimm_set_t *set, persimm_visit_fn fn, void *ctx) {
@@ -180,6 +377,25 @@ void persimm_set_foreach(const persimm_set_t *set, persimm_visit_fn fn, void *ct
     persimm_hamt_foreach(set->root, &hamt, fn, ctx);
 }
 
+persimm_status persimm_set_parallel_foreach(const persimm_set_t *set, persimm_visit_fn fn,
+                                            void *ctx, const persimm_executor *executor) {
+    if (set->local) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_parallel_foreach(set->root, &hamt, fn, ctx, executor);
+}
+
+persimm_status persimm_set_parallel_reduce(const persimm_set_t *set, persimm_fold_fn fold,
+                                           persimm_combine_fn combine, const void *identity,
+                                           size_t acc_size, void *ctx,
+                                           const persimm_executor *executor, void *result) {
+    if (set->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    return persimm_hamt_parallel_reduce(set->root, &hamt, fold, combine, identity, acc_size,
+                                        ctx, executor, result);
+}
+
 const void *persimm_set_next(const persimm_set_t *set, const void *elem) {
     persimm_hamt_t hamt;
     persimm_set_hamt(set, &hamt);
@@ -191,3 +407,9 @@ void persimm_set_trace(const persimm_set_t *set) {
     persimm_set_hamt(set, &hamt);
     persimm_hamt_trace(set->root, &hamt);
 }
+
+void persimm_set_trace_epoch(const persimm_set_t *set, uint32_t epoch) {
+    persimm_hamt_t hamt;
+    persimm_set_hamt(set, &hamt);
+    persimm_hamt_trace_epoch(set->root, &hamt, epoch);
+}
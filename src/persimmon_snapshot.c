@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include "persimmon_internal.h"
+
+/*
+ * A published collection that many threads read at once. Cloning it from
+ * every thread would have each of them increment and decrement the count on
+ * one root node, and that one cache line bouncing between cores is what stops
+ * the reads from scaling. A snapshot instead spreads its readers over several
+ * counts, each on its own cache line, so that threads on different shards
+ * never write to the same memory.
+ *
+ * Every shard starts with one count held on the publisher's behalf, and the
+ * snapshot holds a single reference to the collection for all of them.
+ * Retiring drops the publisher's count from each shard. A shard whose count
+ * reaches zero is closed for good, and the last shard to close takes the
+ * collection and the snapshot with it.
+ */
+
+/* Geometry */
+
+/* Wide enough for the cache lines of every processor the core targets. */
+#define PERSIMM_CACHE_LINE 64
+
+typedef struct {
+    persimm_refcount_t count;
+    unsigned char padding[PERSIMM_CACHE_LINE - sizeof(persimm_refcount_t)];
+} persimm_snapshot_shard_t;
+
+typedef enum {
+    PERSIMM_SNAPSHOT_VECTOR,
+    PERSIMM_SNAPSHOT_LIST,
+    PERSIMM_SNAPSHOT_MAP,
+    PERSIMM_SNAPSHOT_SET
+} persimm_snapshot_kind;
+
+struct persimm_snapshot {
+    persimm_snapshot_kind kind;
+    union {
+        persimm_vector_t vector;
+        persimm_list_t list;
+        persimm_map_t map;
+        persimm_set_t set;
+    } value;
+    size_t shard_count;
+    /* Shards not yet closed. */
+    persimm_refcount_t open;
+    /* Keeps the fields above, which every reader reads, off the first shard's line. */
+    unsigned char padding[PERSIMM_CACHE_LINE];
+    persimm_snapshot_shard_t shards[];
+};
+
+/* Publishing */
+
+static persimm_snapshot_t *persimm_snapshot_new(persimm_snapshot_kind kind, size_t shards) {
+    size_t bytes;
+    if (0 == shards ||
+        !persimm_size_mul(shards, sizeof(persimm_snapshot_shard_t), &bytes) ||
+        !persimm_size_add(offsetof(struct persimm_snapshot, shards), bytes, &bytes)) {
+        return NULL;
+    }
+
+    persimm_snapshot_t *snapshot = calloc(1, bytes);
+    if (NULL == snapshot) return NULL;
+
+    snapshot->kind = kind;
+    snapshot->shard_count = shards;
+    PERSIMM_RC_SET(snapshot->open, shards);
+    for (size_t i = 0; i < shards; i++) PERSIMM_RC_SET(snapshot->shards[i].count, 1);
+
+    return snapshot;
+}
+
+/*
+ * A local source is refused rather than shared behind the caller's back: the
+ * snapshot's clone would be counted plainly on the publisher's thread and
+ * released atomically on whichever thread closed the last shard.
+ */
+
+persimm_status persimm_vector_snapshot(const persimm_vector_t *src, size_t shards,
+                                       persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_VECTOR, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_vector_clone(src, &snapshot->value.vector);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_list_snapshot(const persimm_list_t *src, size_t shards,
+                                     persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_LIST, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_list_clone(src, &snapshot->value.list);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_map_snapshot(const persimm_map_t *src, size_t shards,
+                                    persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_MAP, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_map_clone(src, &snapshot->value.map);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+persimm_status persimm_set_snapshot(const persimm_set_t *src, size_t shards,
+                                    persimm_snapshot_t **dest) {
+    *dest = NULL;
+    if (src->local || 0 == shards) return PERSIMM_ERR_INVALID;
+
+    persimm_snapshot_t *snapshot = persimm_snapshot_new(PERSIMM_SNAPSHOT_SET, shards);
+    if (NULL == snapshot) return PERSIMM_ERR_ALLOC;
+    persimm_set_clone(src, &snapshot->value.set);
+
+    *dest = snapshot;
+    return PERSIMM_OK;
+}
+
+/* Reading */
+
+/*
+ * Takes a count only while the shard is still open. Once a shard has closed,
+ * its count of zero must stay zero, or the shard would close a second time
+ * and close the snapshot before the others had.
+ */
+bool persimm_snapshot_acquire(persimm_snapshot_t *snapshot, size_t shard) {
+    persimm_snapshot_shard_t *slot = &snapshot->shards[shard % snapshot->shard_count];
+    size_t count = PERSIMM_RC_LOAD(slot->count);
+    do {
+        if (0 == count) return false;
+    } while (!PERSIMM_RC_CAS(slot->count, count, count + 1));
+    return true;
+}
+
+const persimm_vector_t *persimm_snapshot_vector(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_VECTOR == snapshot->kind ? &snapshot->value.vector : NULL;
+}
+
+const persimm_list_t *persimm_snapshot_list(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_LIST == snapshot->kind ? &snapshot->value.list : NULL;
+}
+
+const persimm_map_t *persimm_snapshot_map(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_MAP == snapshot->kind ? &snapshot->value.map : NULL;
+}
+
+const persimm_set_t *persimm_snapshot_set(const persimm_snapshot_t *snapshot) {
+    return PERSIMM_SNAPSHOT_SET == snapshot->kind ? &snapshot->value.set : NULL;
+}
+
+/* Releasing */
+
+static void persimm_snapshot_drop(persimm_snapshot_t *snapshot, persimm_snapshot_shard_t *slot) {
+    if (PERSIMM_RC_DEC(slot->count) > 1) return;
+    if (PERSIMM_RC_DEC(snapshot->open) > 1) return;
+
+    switch (snapshot->kind) {
+        case PERSIMM_SNAPSHOT_VECTOR: persimm_vector_deinit(&snapshot->value.vector); break;
+        case PERSIMM_SNAPSHOT_LIST: persimm_list_deinit(&snapshot->value.list); break;
+        case PERSIMM_SNAPSHOT_MAP: persimm_map_deinit(&snapshot->value.map); break;
+        case PERSIMM_SNAPSHOT_SET: persimm_set_deinit(&snapshot->value.set); break;
+    }
+    free(snapshot);
+}
+
+void persimm_snapshot_release(persimm_snapshot_t *snapshot, size_t shard) {
+    persimm_snapshot_drop(snapshot, &snapshot->shards[shard % snapshot->shard_count]);
+}
+
+/* Only the last shard can close the snapshot, so the loop never reads freed memory. */
+void persimm_snapshot_retire(persimm_snapshot_t *snapshot) {
+    size_t shards = snapshot->shard_count;
+    for (size_t i = 0; i < shards; i++) persimm_snapshot_drop(snapshot, &snapshot->shards[i]);
+}
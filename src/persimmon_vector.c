@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "persimmon_internal.h"
@@ -11,7 +12,11 @@ typedef enum {
 
 struct persimm_vector_node {
     persimm_vector_node_type kind;
+    uint32_t hash; // the elements beneath, weighted by position, when the ops can hash
     persimm_refcount_t ref_count;
+#if defined(PERSIMM_TRACE_EPOCHS)
+    uint32_t traced; // the last epoch the node was traced in
+#endif
     persimm_align_t data[];
 };
 
@@ -30,6 +35,46 @@ static void *persimm_vector_node_slot(persimm_vector_node_t *node, size_t index,
     return (unsigned char *)node->data + (index * elem_size);
 }
 
+/* Hashing */
+
+/*
+ * A vector's structural hash is a polynomial in its element hashes, the
+ * element at index i weighted by BASE^i. A leaf keeps the sum over its own
+ * slots and an inner node the sum of its children's, each weighted by where
+ * that child's span begins within the node's. Changing one element therefore
+ * moves every node on its path by the same difference times a known weight,
+ * which a path copy can apply on its way back without reading anything else.
+ * Arithmetic is modulo 2^32 and BASE is odd, so no weight is ever zero.
+ */
+#define PERSIMM_VECTOR_HASH_BASE 16777619u
+
+static bool persimm_vector_hashes(const persimm_vector_t *vector) {
+    return persimm_elem_hashes(vector->ops);
+}
+
+static uint32_t persimm_vector_elem_hash(const persimm_vector_t *vector, const void *slot) {
+    PERSIMM_COUNT(vector, hash_calls);
+    return vector->ops->hash(slot, vector->ctx);
+}
+
+static uint32_t persimm_vector_weight(size_t position) {
+    uint32_t weight = 1;
+    uint32_t base = PERSIMM_VECTOR_HASH_BASE;
+    while (position > 0) {
+        if (position & 1) weight *= base;
+        base *= base;
+        position >>= 1;
+    }
+    return weight;
+}
+
+/* Where `index` falls within the span of the node it passes through at `level`. */
+static size_t persimm_vector_span_offset(size_t index, size_t level) {
+    size_t bits = level + PERSIMM_BITS;
+    if (bits >= sizeof(size_t) * CHAR_BIT) return index;
+    return index & (((size_t)1 << bits) - 1);
+}
+
 /* Deinitialising */
 
 /*
@@ -38,32 +83,36 @@ static void *persimm_vector_node_slot(persimm_vector_node_t *node, size_t index,
  * knows how partial it is.
  */
 static void persimm_vector_node_release(persimm_vector_node_t *node, size_t live, size_t elem_size,
-                                 const persimm_elem_ops *ops, void *ctx) {
+                                 const persimm_elem_ops *ops, void *ctx, bool local) {
     if (NULL == node) return;
 
-    if (PERSIMM_RC_DEC(node->ref_count) > 1) return;
+    if (persimm_rc_dec(&node->ref_count, local) > 1) return;
 
     if (node->kind == PERSIMM_VECTOR_NODE_INNER) {
         persimm_vector_node_t **children = persimm_vector_node_children(node);
         for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
             if (NULL == children[i]) continue;
-            persimm_vector_node_release(children[i], PERSIMM_WIDTH, elem_size, ops, ctx);
+            persimm_vector_node_release(children[i], PERSIMM_WIDTH, elem_size, ops, ctx, local);
             children[i] = NULL;
         }
-    } else if (NULL != ops && NULL != ops->release) {
-        for (size_t i = 0; i < live; i++) {
-            ops->release(persimm_vector_node_slot(node, i, elem_size), ctx);
+    } else {
+        PERSIMM_COUNT_N(vector, releases, live);
+        if (NULL != ops && NULL != ops->release) {
+            for (size_t i = 0; i < live; i++) {
+                ops->release(persimm_vector_node_slot(node, i, elem_size), ctx);
+            }
         }
     }
 
+    PERSIMM_COUNT(vector, node_frees);
     free(node);
 }
 
 void persimm_vector_deinit(persimm_vector_t *vector) {
     persimm_vector_node_release(vector->root, PERSIMM_WIDTH, vector->elem_size, vector->ops,
-                                vector->ctx);
+                                vector->ctx, vector->local);
     persimm_vector_node_release(vector->tail, vector->tail_count, vector->elem_size, vector->ops,
-                                vector->ctx);
+                                vector->ctx, vector->local);
     vector->root = NULL;
     vector->tail = NULL;
     vector->count = 0;
@@ -72,18 +121,22 @@ void persimm_vector_deinit(persimm_vector_t *vector) {
 
 /* Initialising */
 
-static persimm_vector_node_t *persimm_vector_node_new(persimm_vector_node_type kind,
-                                                      size_t elem_size) {
+static bool persimm_vector_node_bytes(persimm_vector_node_type kind, size_t elem_size,
+                                      size_t *bytes) {
     size_t stride = (kind == PERSIMM_VECTOR_NODE_INNER) ? sizeof(persimm_vector_node_t *)
                                                         : elem_size;
     size_t data_bytes;
+    return persimm_size_mul(PERSIMM_WIDTH, stride, &data_bytes) &&
+           persimm_size_add(offsetof(struct persimm_vector_node, data), data_bytes, bytes);
+}
+
+static persimm_vector_node_t *persimm_vector_node_new(persimm_vector_node_type kind,
+                                                      size_t elem_size) {
     size_t bytes;
-    if (!persimm_size_mul(PERSIMM_WIDTH, stride, &data_bytes) ||
-        !persimm_size_add(offsetof(struct persimm_vector_node, data), data_bytes, &bytes)) {
-        return NULL;
-    }
+    if (!persimm_vector_node_bytes(kind, elem_size, &bytes)) return NULL;
     persimm_vector_node_t *node = calloc(1, bytes);
     if (NULL == node) return NULL;
+    PERSIMM_COUNT(vector, node_allocs);
     node->kind = kind;
     PERSIMM_RC_SET(node->ref_count, 1);
     return node;
@@ -94,30 +147,39 @@ static persimm_vector_node_t *persimm_vector_node_new(persimm_vector_node_type k
  * in. When that reference was already the only one the node is returned as-is.
  * Returns NULL, leaving `node` untouched, if the copy could not be allocated.
  */
-static persimm_vector_node_t *persimm_vector_node_make_unique(persimm_vector_node_t *node,
-                                                              size_t live, size_t elem_size,
-                                                              const persimm_elem_ops *ops,
-                                                              void *ctx) {
-    if (PERSIMM_RC_LOAD(node->ref_count) == 1) return node;
+static persimm_vector_node_t *persimm_vector_node_make_unique(const persimm_vector_t *vector,
+                                                              persimm_vector_node_t *node,
+                                                              size_t live) {
+    if (PERSIMM_RC_LOAD(node->ref_count) == 1) {
+        PERSIMM_COUNT(vector, in_place_edits);
+        return node;
+    }
+
+    size_t elem_size = vector->elem_size;
+    const persimm_elem_ops *ops = vector->ops;
+    void *ctx = vector->ctx;
 
     persimm_vector_node_t *copy = persimm_vector_node_new(node->kind, elem_size);
     if (NULL == copy) return NULL;
+    PERSIMM_COUNT(vector, path_copies);
+    copy->hash = node->hash;
 
     if (node->kind == PERSIMM_VECTOR_NODE_INNER) {
         persimm_vector_node_t **children = persimm_vector_node_children(node);
         persimm_vector_node_t **copies = persimm_vector_node_children(copy);
         for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
             copies[i] = children[i];
-            if (NULL != copies[i]) PERSIMM_RC_INC(copies[i]->ref_count);
+            if (NULL != copies[i]) persimm_rc_inc(&copies[i]->ref_count, vector->local);
         }
     } else {
         memcpy(copy->data, node->data, PERSIMM_WIDTH * elem_size);
+        PERSIMM_COUNT_N(vector, retains, live);
         for (size_t i = 0; i < live; i++) {
             persimm_elem_retain(ops, ctx, persimm_vector_node_slot(copy, i, elem_size));
         }
     }
 
-    persimm_vector_node_release(node, live, elem_size, ops, ctx);
+    persimm_vector_node_release(node, live, elem_size, ops, ctx, vector->local);
 
     return copy;
 }
@@ -130,6 +192,7 @@ persimm_status persimm_vector_init(persimm_vector_t *vector, size_t elem_size,
     vector->elem_size = elem_size;
     vector->ops = ops;
     vector->ctx = ctx;
+    vector->local = false;
     vector->root = NULL;
     vector->tail = NULL;
 
@@ -149,13 +212,48 @@ persimm_status persimm_vector_clone(const persimm_vector_t *src, persimm_vector_
     dest->elem_size = src->elem_size;
     dest->ops = src->ops;
     dest->ctx = src->ctx;
+    dest->local = src->local;
     dest->root = src->root;
-    if (NULL != dest->root) PERSIMM_RC_INC(dest->root->ref_count);
+    if (NULL != dest->root) persimm_rc_inc(&dest->root->ref_count, dest->local);
     dest->tail = src->tail;
-    if (NULL != dest->tail) PERSIMM_RC_INC(dest->tail->ref_count);
+    if (NULL != dest->tail) persimm_rc_inc(&dest->tail->ref_count, dest->local);
     return PERSIMM_OK;
 }
 
+/* Borrowing */
+
+void persimm_vector_borrow(const persimm_vector_t *src, persimm_vector_view_t *dest) {
+    dest->value = *src;
+}
+
+const persimm_vector_t *persimm_vector_view(const persimm_vector_view_t *view) {
+    return &view->value;
+}
+
+/* Reference Counting */
+
+void persimm_vector_make_local(persimm_vector_t *vector) {
+    vector->local = true;
+}
+
+void persimm_vector_share(persimm_vector_t *vector) {
+    vector->local = false;
+}
+
+/* Stops at a node already immortal, whose subtree an earlier freeze reached. */
+static void persimm_vector_node_freeze(persimm_vector_node_t *node) {
+    if (NULL == node || !persimm_rc_freeze(&node->ref_count)) return;
+    if (node->kind != PERSIMM_VECTOR_NODE_INNER) return;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) persimm_vector_node_freeze(children[i]);
+}
+
+void persimm_vector_freeze(persimm_vector_t *vector) {
+    persimm_vector_node_freeze(vector->root);
+    persimm_vector_node_freeze(vector->tail);
+}
+
 /* Transients */
 
 persimm_status persimm_vector_to_transient(const persimm_vector_t *src,
@@ -229,6 +327,7 @@ const void *persimm_vector_at(const persimm_vector_t *vector, size_t index) {
 
 static void persimm_elem_store(const persimm_vector_t *vector, void *slot, const void *elem) {
     memcpy(slot, elem, vector->elem_size);
+    PERSIMM_COUNT(vector, retains);
     persimm_elem_retain(vector->ops, vector->ctx, slot);
 }
 
@@ -249,12 +348,12 @@ static persimm_status persimm_vector_graft(persimm_vector_t *vector, persimm_vec
                                                               vector->elem_size);
         if (NULL == root) return PERSIMM_ERR_ALLOC;
         persimm_vector_node_children(root)[0] = vector->root;
+        root->hash = vector->root->hash;
         vector->root = root;
         vector->shift += PERSIMM_BITS;
     } else if (immutable) {
         persimm_vector_node_t *root =
-            persimm_vector_node_make_unique(vector->root, PERSIMM_WIDTH, vector->elem_size,
-                                            vector->ops, vector->ctx);
+            persimm_vector_node_make_unique(vector, vector->root, PERSIMM_WIDTH);
         if (NULL == root) return PERSIMM_ERR_ALLOC;
         vector->root = root;
     }
@@ -268,8 +367,7 @@ static persimm_status persimm_vector_graft(persimm_vector_t *vector, persimm_vec
             child = persimm_vector_node_new(PERSIMM_VECTOR_NODE_INNER, vector->elem_size);
             if (NULL == child) return PERSIMM_ERR_ALLOC;
         } else if (immutable) {
-            child = persimm_vector_node_make_unique(child, PERSIMM_WIDTH, vector->elem_size,
-                                                    vector->ops, vector->ctx);
+            child = persimm_vector_node_make_unique(vector, child, PERSIMM_WIDTH);
             if (NULL == child) return PERSIMM_ERR_ALLOC;
         }
         persimm_vector_node_children(node)[curr_index] = child;
@@ -277,6 +375,17 @@ static persimm_status persimm_vector_graft(persimm_vector_t *vector, persimm_vec
     }
     persimm_vector_node_children(node)[(index >> PERSIMM_BITS) & PERSIMM_MASK] = tail;
 
+    /* Hashes move only once the whole path is in place, so a failed graft
+       leaves every node's hash true to what is beneath it. */
+    if (persimm_vector_hashes(vector)) {
+        node = vector->root;
+        for (size_t level = vector->shift; level > 0; level -= PERSIMM_BITS) {
+            node->hash += tail->hash * persimm_vector_weight(persimm_vector_span_offset(index,
+                                                                                        level));
+            node = persimm_vector_node_children(node)[(index >> level) & PERSIMM_MASK];
+        }
+    }
+
     return PERSIMM_OK;
 }
 
@@ -287,13 +396,17 @@ static persimm_status persimm_vector_push_in_place(persimm_vector_t *vector, con
     if (vector->tail_count < PERSIMM_WIDTH) {
         if (immutable) {
             persimm_vector_node_t *tail =
-                persimm_vector_node_make_unique(vector->tail, vector->tail_count,
-                                                vector->elem_size, vector->ops, vector->ctx);
+                persimm_vector_node_make_unique(vector, vector->tail, vector->tail_count);
             if (NULL == tail) return PERSIMM_ERR_ALLOC;
             vector->tail = tail;
         }
-        persimm_elem_store(vector, persimm_vector_node_slot(vector->tail, vector->tail_count,
-                                                     vector->elem_size), elem);
+        void *slot = persimm_vector_node_slot(vector->tail, vector->tail_count,
+                                              vector->elem_size);
+        persimm_elem_store(vector, slot, elem);
+        if (persimm_vector_hashes(vector)) {
+            vector->tail->hash += persimm_vector_elem_hash(vector, slot) *
+                                  persimm_vector_weight(vector->tail_count);
+        }
         vector->tail_count++;
         vector->count++;
         return PERSIMM_OK;
@@ -306,6 +419,7 @@ static persimm_status persimm_vector_push_in_place(persimm_vector_t *vector, con
     persimm_vector_node_t *old_tail = vector->tail;
     persimm_status status = persimm_vector_graft(vector, old_tail, vector->count, immutable);
     if (PERSIMM_OK != status) {
+        PERSIMM_COUNT(vector, node_frees);
         free(tail);
         return status;
     }
@@ -313,6 +427,10 @@ static persimm_status persimm_vector_push_in_place(persimm_vector_t *vector, con
     vector->tail = tail;
     vector->tail_count = 0;
     persimm_elem_store(vector, persimm_vector_node_slot(tail, 0, vector->elem_size), elem);
+    if (persimm_vector_hashes(vector)) {
+        tail->hash = persimm_vector_elem_hash(vector, persimm_vector_node_slot(tail, 0,
+                                                                               vector->elem_size));
+    }
     vector->tail_count = 1;
     vector->count++;
 
@@ -327,15 +445,19 @@ static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, s
     if (index >= tail_offset) {
         if (immutable) {
             persimm_vector_node_t *tail =
-                persimm_vector_node_make_unique(vector->tail, vector->tail_count,
-                                                vector->elem_size, vector->ops, vector->ctx);
+                persimm_vector_node_make_unique(vector, vector->tail, vector->tail_count);
             if (NULL == tail) return PERSIMM_ERR_ALLOC;
             vector->tail = tail;
         }
         void *slot = persimm_vector_node_slot(vector->tail, index - tail_offset, vector->elem_size);
         if (elem == slot) return PERSIMM_OK;
+        uint32_t delta = persimm_vector_hashes(vector) ? persimm_vector_elem_hash(vector, elem) -
+                                                             persimm_vector_elem_hash(vector, slot)
+                                                       : 0;
+        PERSIMM_COUNT(vector, releases);
         persimm_elem_release(vector->ops, vector->ctx, slot);
         persimm_elem_store(vector, slot, elem);
+        vector->tail->hash += delta * persimm_vector_weight(index - tail_offset);
         return PERSIMM_OK;
     }
 
@@ -343,8 +465,7 @@ static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, s
 
     if (immutable) {
         persimm_vector_node_t *root =
-            persimm_vector_node_make_unique(vector->root, PERSIMM_WIDTH, vector->elem_size,
-                                            vector->ops, vector->ctx);
+            persimm_vector_node_make_unique(vector, vector->root, PERSIMM_WIDTH);
         if (NULL == root) return PERSIMM_ERR_ALLOC;
         vector->root = root;
     }
@@ -355,8 +476,7 @@ static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, s
         persimm_vector_node_t *child = persimm_vector_node_children(node)[curr_index];
         if (NULL == child) return PERSIMM_ERR_CORRUPT;
         if (immutable) {
-            child = persimm_vector_node_make_unique(child, PERSIMM_WIDTH, vector->elem_size,
-                                                    vector->ops, vector->ctx);
+            child = persimm_vector_node_make_unique(vector, child, PERSIMM_WIDTH);
             if (NULL == child) return PERSIMM_ERR_ALLOC;
             persimm_vector_node_children(node)[curr_index] = child;
         }
@@ -365,9 +485,22 @@ static persimm_status persimm_vector_update_in_place(persimm_vector_t *vector, s
 
     void *slot = persimm_vector_node_slot(node, index & PERSIMM_MASK, vector->elem_size);
     if (elem == slot) return PERSIMM_OK;
+    uint32_t delta = persimm_vector_hashes(vector) ? persimm_vector_elem_hash(vector, elem) -
+                                                         persimm_vector_elem_hash(vector, slot)
+                                                   : 0;
+    PERSIMM_COUNT(vector, releases);
     persimm_elem_release(vector->ops, vector->ctx, slot);
     persimm_elem_store(vector, slot, elem);
 
+    if (0 != delta) {
+        node = vector->root;
+        for (size_t level = vector->shift;; level -= PERSIMM_BITS) {
+            node->hash += delta * persimm_vector_weight(persimm_vector_span_offset(index, level));
+            if (0 == level) break;
+            node = persimm_vector_node_children(node)[(index >> level) & PERSIMM_MASK];
+        }
+    }
+
     return PERSIMM_OK;
 }
 
@@ -389,6 +522,17 @@ persimm_status persimm_vector_update(const persimm_vector_t *src, size_t index,
     return status;
 }
 
+/* Without a clone the vector's own references are the only ones, so the nodes
+   it alone reaches pass make_unique's check and are written where they are. */
+persimm_status persimm_vector_push_owned(persimm_vector_t *vector, const void *elem) {
+    return persimm_vector_push_in_place(vector, elem, true);
+}
+
+persimm_status persimm_vector_update_owned(persimm_vector_t *vector, size_t index,
+                                           const void *elem) {
+    return persimm_vector_update_in_place(vector, index, elem, true);
+}
+
 /* Traversing */
 
 static void persimm_vector_node_foreach(persimm_vector_node_t *node, size_t elem_size,
@@ -421,13 +565,545 @@ void persimm_vector_foreach(const persimm_vector_t *vector, persimm_visit_fn fn,
     }
 }
 
-static void persimm_trace_visit(const void *slot, size_t index, void *ctx) {
+/* Parallel Traversal */
+
+/*
+ * Work is split at inner-node boundaries, so that every task owns whole
+ * leaves and no two tasks touch one node. The split starts at the root's
+ * children and moves a level down while that leaves fewer tasks than a node
+ * has slots, which keeps a shallow vector from running on a handful of
+ * threads. The tail is short and handled on the calling thread.
+ */
+
+typedef struct {
+    const persimm_vector_t *src;
+    /* The level of the nodes each task takes, and how many elements precede the tail. */
+    size_t level;
+    size_t limit;
+    void *ctx;
+    /* Reducing: one accumulator per task. */
+    persimm_fold_fn fold;
+    unsigned char *accs;
+    size_t acc_size;
+    /* Mapping: one new subtree per task, and the vector the subtrees are for. */
+    persimm_transform_fn transform;
+    const persimm_vector_t *dest;
+    persimm_vector_node_t **nodes;
+    persimm_status *statuses;
+} persimm_vector_split_t;
+
+static size_t persimm_vector_split_tasks(size_t limit, size_t level) {
+    size_t span_bits = level + PERSIMM_BITS;
+    if (span_bits >= sizeof(size_t) * CHAR_BIT) return 1;
+    return (limit + ((size_t)1 << span_bits) - 1) >> span_bits;
+}
+
+/* Picks the level to split at and returns how many tasks that makes, zero with no trie. */
+static size_t persimm_vector_split_plan(const persimm_vector_t *vector, size_t *level) {
+    size_t limit = vector->count - vector->tail_count;
+    *level = vector->shift;
+    if (NULL == vector->root || 0 == limit) return 0;
+
+    size_t tasks = persimm_vector_split_tasks(limit, *level);
+    while (tasks < PERSIMM_WIDTH && *level > 0) {
+        *level -= PERSIMM_BITS;
+        tasks = persimm_vector_split_tasks(limit, *level);
+    }
+    return tasks;
+}
+
+static size_t persimm_vector_split_start(const persimm_vector_split_t *split, size_t task) {
+    return task << (split->level + PERSIMM_BITS);
+}
+
+static persimm_vector_node_t *persimm_vector_split_node(const persimm_vector_split_t *split,
+                                                        size_t start) {
+    persimm_vector_node_t *node = split->src->root;
+    for (size_t level = split->src->shift; level > split->level; level -= PERSIMM_BITS) {
+        node = persimm_vector_node_children(node)[(start >> level) & PERSIMM_MASK];
+    }
+    return node;
+}
+
+typedef struct {
+    persimm_fold_fn fold;
+    void *acc;
+    void *ctx;
+} persimm_vector_fold_t;
+
+static void persimm_vector_fold_visit(const void *slot, size_t index, void *ctx) {
+    persimm_vector_fold_t *fold = ctx;
+    fold->fold(fold->acc, slot, index, fold->ctx);
+}
+
+static void persimm_vector_reduce_task(void *arg, size_t task) {
+    persimm_vector_split_t *split = arg;
+    size_t start = persimm_vector_split_start(split, task);
+    persimm_vector_fold_t fold = { split->fold, split->accs + task * split->acc_size,
+                                   split->ctx };
+    size_t index = start;
+    persimm_vector_node_foreach(persimm_vector_split_node(split, start), split->src->elem_size,
+                                &index, split->limit, persimm_vector_fold_visit, &fold);
+}
+
+persimm_status persimm_vector_parallel_reduce(const persimm_vector_t *vector,
+                                              persimm_fold_fn fold, persimm_combine_fn combine,
+                                              const void *identity, size_t acc_size, void *ctx,
+                                              const persimm_executor *executor, void *result) {
+    if (vector->local || 0 == acc_size) return PERSIMM_ERR_INVALID;
+    memcpy(result, identity, acc_size);
+
+    persimm_vector_split_t split = { vector, 0, vector->count - vector->tail_count, ctx,
+                                     fold, NULL, acc_size, NULL, NULL, NULL, NULL };
+    size_t tasks = persimm_vector_split_plan(vector, &split.level);
+    persimm_vector_fold_t direct = { fold, result, ctx };
+
+    if (NULL == executor || tasks < 2) {
+        persimm_vector_foreach(vector, persimm_vector_fold_visit, &direct);
+        return PERSIMM_OK;
+    }
+
+    split.accs = calloc(tasks, acc_size);
+    if (NULL == split.accs) return PERSIMM_ERR_ALLOC;
+    for (size_t i = 0; i < tasks; i++) memcpy(split.accs + i * acc_size, identity, acc_size);
+
+    persimm_executor_run(executor, tasks, persimm_vector_reduce_task, &split);
+
+    for (size_t i = 0; i < tasks; i++) combine(result, split.accs + i * acc_size, ctx);
+    for (size_t i = 0; i < vector->tail_count; i++) {
+        fold(result, persimm_vector_node_slot(vector->tail, i, vector->elem_size),
+             split.limit + i, ctx);
+    }
+
+    free(split.accs);
+    return PERSIMM_OK;
+}
+
+/*
+ * Transforms `live` elements of a leaf into a fresh one for `dest`, hashing
+ * as it goes. Returns NULL with `*status` set if the transform failed or the
+ * leaf could not be allocated, leaving nothing behind.
+ */
+static persimm_vector_node_t *persimm_vector_leaf_map(const persimm_vector_split_t *split,
+                                                      persimm_vector_node_t *leaf, size_t start,
+                                                      size_t live, persimm_status *status) {
+    const persimm_vector_t *src = split->src;
+    const persimm_vector_t *dest = split->dest;
+    persimm_vector_node_t *node = persimm_vector_node_new(PERSIMM_VECTOR_NODE_LEAF,
+                                                          dest->elem_size);
+    if (NULL == node) {
+        *status = PERSIMM_ERR_ALLOC;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < live; i++) {
+        void *slot = persimm_vector_node_slot(node, i, dest->elem_size);
+        *status = split->transform(persimm_vector_node_slot(leaf, i, src->elem_size), start + i,
+                                   slot, split->ctx);
+        if (PERSIMM_OK != *status) {
+            persimm_vector_node_release(node, i, dest->elem_size, dest->ops, dest->ctx, false);
+            return NULL;
+        }
+        PERSIMM_COUNT(vector, retains);
+        persimm_elem_retain(dest->ops, dest->ctx, slot);
+        if (persimm_vector_hashes(dest)) {
+            node->hash += persimm_vector_elem_hash(dest, slot) * persimm_vector_weight(i);
+        }
+    }
+    return node;
+}
+
+/*
+ * Maps the subtree at `level` whose span starts at `start`. Above the split
+ * level it stitches in the subtrees the tasks made instead of descending, so
+ * the same walk serves a task and the calling thread that joins them.
+ */
+static persimm_vector_node_t *persimm_vector_node_map(persimm_vector_split_t *split,
+                                                      persimm_vector_node_t *node, size_t level,
+                                                      size_t start, bool joining,
+                                                      persimm_status *status) {
+    if (0 == level) return persimm_vector_leaf_map(split, node, start, PERSIMM_WIDTH, status);
+
+    const persimm_vector_t *dest = split->dest;
+    persimm_vector_node_t *copy = persimm_vector_node_new(PERSIMM_VECTOR_NODE_INNER,
+                                                          dest->elem_size);
+    if (NULL == copy) {
+        *status = PERSIMM_ERR_ALLOC;
+        return NULL;
+    }
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    persimm_vector_node_t **copies = persimm_vector_node_children(copy);
+    size_t step = (size_t)1 << level;
+    for (size_t i = 0; i < PERSIMM_WIDTH && start + i * step < split->limit; i++) {
+        size_t child_start = start + i * step;
+        persimm_vector_node_t *child;
+        if (joining && level - PERSIMM_BITS == split->level) {
+            size_t task = child_start >> level;
+            child = split->nodes[task];
+            split->nodes[task] = NULL;
+        } else {
+            child = persimm_vector_node_map(split, children[i], level - PERSIMM_BITS,
+                                            child_start, joining, status);
+            if (NULL == child) {
+                persimm_vector_node_release(copy, PERSIMM_WIDTH, dest->elem_size, dest->ops,
+                                            dest->ctx, false);
+                return NULL;
+            }
+        }
+        copies[i] = child;
+        copy->hash += child->hash * persimm_vector_weight(i * step);
+    }
+    return copy;
+}
+
+static void persimm_vector_map_task(void *arg, size_t task) {
+    persimm_vector_split_t *split = arg;
+    size_t start = persimm_vector_split_start(split, task);
+    split->nodes[task] = persimm_vector_node_map(split, persimm_vector_split_node(split, start),
+                                                 split->level, start, false,
+                                                 &split->statuses[task]);
+}
+
+persimm_status persimm_vector_parallel_map(const persimm_vector_t *src,
+                                           persimm_transform_fn transform, void *ctx,
+                                           size_t elem_size, const persimm_elem_ops *ops,
+                                           void *ops_ctx, const persimm_executor *executor,
+                                           persimm_vector_t *dest) {
+    if (src == dest) return PERSIMM_ERR_INVALID;
+    dest->shift = 0;
+    dest->count = 0;
+    dest->tail_count = 0;
+    dest->elem_size = elem_size;
+    dest->ops = ops;
+    dest->ctx = ops_ctx;
+    dest->local = false;
+    dest->root = NULL;
+    dest->tail = NULL;
+    if (src->local || 0 == elem_size) return PERSIMM_ERR_INVALID;
+
+    persimm_vector_split_t split = { src, 0, src->count - src->tail_count, ctx,
+                                     NULL, NULL, 0, transform, dest, NULL, NULL };
+    size_t tasks = persimm_vector_split_plan(src, &split.level);
+    persimm_status status = PERSIMM_OK;
+
+    persimm_vector_node_t *root = NULL;
+    if (tasks > 0) {
+        split.nodes = calloc(tasks, sizeof(persimm_vector_node_t *));
+        split.statuses = calloc(tasks, sizeof(persimm_status));
+        if (NULL == split.nodes || NULL == split.statuses) status = PERSIMM_ERR_ALLOC;
+    }
+    if (PERSIMM_OK == status && tasks > 0) {
+        persimm_executor_run(executor, tasks, persimm_vector_map_task, &split);
+        for (size_t i = 0; i < tasks && PERSIMM_OK == status; i++) status = split.statuses[i];
+        if (PERSIMM_OK == status && split.level == src->shift) {
+            root = split.nodes[0];
+            split.nodes[0] = NULL;
+        } else if (PERSIMM_OK == status) {
+            root = persimm_vector_node_map(&split, src->root, src->shift, 0, true, &status);
+        }
+    }
+    for (size_t i = 0; NULL != split.nodes && i < tasks; i++) {
+        persimm_vector_node_release(split.nodes[i], PERSIMM_WIDTH, elem_size, ops, ops_ctx,
+                                    false);
+    }
+    free(split.nodes);
+    free(split.statuses);
+
+    persimm_vector_node_t *tail = NULL;
+    if (PERSIMM_OK == status) {
+        tail = persimm_vector_leaf_map(&split, src->tail, split.limit, src->tail_count,
+                                       &status);
+    }
+    if (PERSIMM_OK != status) {
+        persimm_vector_node_release(root, PERSIMM_WIDTH, elem_size, ops, ops_ctx, false);
+        return status;
+    }
+
+    dest->shift = src->shift;
+    dest->count = src->count;
+    dest->tail_count = src->tail_count;
+    dest->root = root;
+    dest->tail = tail;
+    return PERSIMM_OK;
+}
+
+/* Comparing */
+
+/*
+ * One comparison of two vectors. A NULL `visit` is a question of whether
+ * anything differs at all, so the walk stops at the first difference rather
+ * than reporting it.
+ */
+typedef struct {
+    size_t elem_size;
+    persimm_elem_eq_fn equals;
+    persimm_diff_fn visit;
+    void *ctx;
+    bool differs;
+} persimm_vector_diff_t;
+
+/* Returns whether the walk should carry on. */
+static bool persimm_vector_diff_slots(persimm_vector_diff_t *diff, const void *slot_a,
+                                      const void *slot_b, size_t index) {
+    if (NULL != slot_a && NULL != slot_b) {
+        if (slot_a == slot_b) return true;
+        if (NULL == diff->equals) {
+            if (0 == memcmp(slot_a, slot_b, diff->elem_size)) return true;
+        } else {
+            PERSIMM_COUNT(vector, equals_calls);
+            if (diff->equals(slot_a, slot_b, diff->elem_size, diff->ctx)) return true;
+        }
+    }
+    diff->differs = true;
+    if (NULL == diff->visit) return false;
+    diff->visit(slot_a, slot_b, index, diff->ctx);
+    return true;
+}
+
+/*
+ * Compares two nodes standing at the same level over the same indices, below
+ * `limit`. Both tries hold every index under the limit, so neither side can
+ * run out of children before the other does.
+ */
+static bool persimm_vector_node_diff(persimm_vector_diff_t *diff, persimm_vector_node_t *a,
+                                     persimm_vector_node_t *b, size_t level, size_t base,
+                                     size_t limit) {
+    if (a == b || NULL == a || NULL == b) return true;
+
+    if (0 == level) {
+        for (size_t i = 0; i < PERSIMM_WIDTH && base + i < limit; i++) {
+            if (!persimm_vector_diff_slots(diff, persimm_vector_node_slot(a, i, diff->elem_size),
+                                           persimm_vector_node_slot(b, i, diff->elem_size),
+                                           base + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    persimm_vector_node_t **children_a = persimm_vector_node_children(a);
+    persimm_vector_node_t **children_b = persimm_vector_node_children(b);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        size_t child_base = base + (i << level);
+        if (child_base >= limit) break;
+        if (!persimm_vector_node_diff(diff, children_a[i], children_b[i], level - PERSIMM_BITS,
+                                      child_base, limit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The tries are compared node against node up to where the shorter one's tail
+ * begins. A vector's shape follows from its count alone, so below that point
+ * the two tries agree on where every index lives once the taller root has been
+ * walked down its leftmost edge to the height of the shorter. What remains is
+ * at most a tail's worth of elements plus whatever one vector has beyond the
+ * other, and those are read by index.
+ */
+static void persimm_vector_walk_diff(const persimm_vector_t *a, const persimm_vector_t *b,
+                                     persimm_vector_diff_t *diff) {
+    size_t tail_offset_a = a->count - a->tail_count;
+    size_t tail_offset_b = b->count - b->tail_count;
+    size_t limit = tail_offset_a < tail_offset_b ? tail_offset_a : tail_offset_b;
+
+    if (limit > 0) {
+        persimm_vector_node_t *root_a = a->root;
+        persimm_vector_node_t *root_b = b->root;
+        size_t level = a->shift < b->shift ? a->shift : b->shift;
+        for (size_t l = a->shift; l > level && NULL != root_a; l -= PERSIMM_BITS) {
+            root_a = persimm_vector_node_children(root_a)[0];
+        }
+        for (size_t l = b->shift; l > level && NULL != root_b; l -= PERSIMM_BITS) {
+            root_b = persimm_vector_node_children(root_b)[0];
+        }
+        if (!persimm_vector_node_diff(diff, root_a, root_b, level, 0, limit)) return;
+    }
+
+    size_t shorter = a->count < b->count ? a->count : b->count;
+    size_t longer = a->count < b->count ? b->count : a->count;
+    size_t index = limit;
+    if (tail_offset_a == tail_offset_b && a->tail == b->tail) index = shorter;
+
+    for (; index < longer; index++) {
+        if (!persimm_vector_diff_slots(diff, persimm_vector_at(a, index),
+                                       persimm_vector_at(b, index), index)) {
+            return;
+        }
+    }
+}
+
+bool persimm_vector_equals(const persimm_vector_t *a, const persimm_vector_t *b,
+                           persimm_elem_eq_fn elem_eq, void *ctx) {
+    if (a == b) return true;
+    if (a->elem_size != b->elem_size || a->count != b->count) return false;
+    if (persimm_vector_hashes(a) && a->ops == b->ops && a->ctx == b->ctx &&
+        persimm_vector_hash(a) != persimm_vector_hash(b)) {
+        return false;
+    }
+
+    persimm_vector_diff_t diff = { a->elem_size, elem_eq, NULL, ctx, false };
+    persimm_vector_walk_diff(a, b, &diff);
+    return !diff.differs;
+}
+
+persimm_status persimm_vector_diff(const persimm_vector_t *a, const persimm_vector_t *b,
+                                   persimm_elem_eq_fn elem_eq, persimm_diff_fn visit,
+                                   void *ctx) {
+    if (a->elem_size != b->elem_size || NULL == visit) return PERSIMM_ERR_INVALID;
+    if (a == b) return PERSIMM_OK;
+
+    persimm_vector_diff_t diff = { a->elem_size, elem_eq, visit, ctx, false };
+    persimm_vector_walk_diff(a, b, &diff);
+    return PERSIMM_OK;
+}
+
+/* Hashing */
+
+typedef struct {
+    size_t elem_size;
+    uint32_t hash;
+    uint32_t weight;
+} persimm_vector_hash_walk_t;
+
+static void persimm_vector_hash_visit(const void *slot, size_t index, void *ctx) {
     (void) index;
-    const persimm_vector_t *vector = (const persimm_vector_t *)ctx;
-    vector->ops->trace(slot, vector->ctx);
+    persimm_vector_hash_walk_t *walk = (persimm_vector_hash_walk_t *)ctx;
+    walk->hash += persimm_hash_bytes(slot, walk->elem_size) * walk->weight;
+    walk->weight *= PERSIMM_VECTOR_HASH_BASE;
+}
+
+uint32_t persimm_vector_hash(const persimm_vector_t *vector) {
+    if (persimm_vector_hashes(vector)) {
+        size_t tail_offset = vector->count - vector->tail_count;
+        uint32_t hash = (NULL != vector->root) ? vector->root->hash : 0;
+        if (NULL != vector->tail) {
+            hash += vector->tail->hash * persimm_vector_weight(tail_offset);
+        }
+        return persimm_hash_finish(hash, vector->count);
+    }
+
+    persimm_vector_hash_walk_t walk = { vector->elem_size, 0, 1 };
+    persimm_vector_foreach(vector, persimm_vector_hash_visit, &walk);
+    return persimm_hash_finish(walk.hash, vector->count);
+}
+
+/* Tracing */
+
+/*
+ * Every leaf in the trie is full, and an inner node's children past the last
+ * index it covers are NULL, so only the tail needs to be told how many of its
+ * slots are live.
+ */
+static void persimm_vector_node_trace(const persimm_vector_t *vector,
+                                      persimm_vector_node_t *node, size_t live,
+                                      uint32_t epoch) {
+    if (NULL == node || !PERSIMM_TRACE_CLAIM(node, epoch)) return;
+
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) {
+        for (size_t i = 0; i < live; i++) {
+            vector->ops->trace(persimm_vector_node_slot(node, i, vector->elem_size),
+                               vector->ctx);
+        }
+        return;
+    }
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_trace(vector, children[i], PERSIMM_WIDTH, epoch);
+    }
 }
 
 void persimm_vector_trace(const persimm_vector_t *vector) {
+    persimm_vector_trace_epoch(vector, 0);
+}
+
+void persimm_vector_trace_epoch(const persimm_vector_t *vector, uint32_t epoch) {
     if (NULL == vector->ops || NULL == vector->ops->trace) return;
-    persimm_vector_foreach(vector, persimm_trace_visit, (void *)vector);
+    persimm_vector_node_trace(vector, vector->root, PERSIMM_WIDTH, epoch);
+    persimm_vector_node_trace(vector, vector->tail, vector->tail_count, epoch);
+}
+
+/* Memory Statistics */
+
+static void persimm_vector_node_stats(persimm_vector_node_t *node, size_t live, size_t elem_size,
+                                      bool exclusive, persimm_memory_stats *stats) {
+    if (NULL == node) return;
+
+    size_t bytes = 0;
+    persimm_vector_node_bytes(node->kind, elem_size, &bytes);
+    exclusive = exclusive && 1 == PERSIMM_RC_PEEK(node->ref_count);
+    if (exclusive) {
+        stats->exclusive_bytes += bytes;
+    } else {
+        stats->shared_bytes += bytes;
+    }
+
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) {
+        stats->leaf_nodes++;
+        stats->leaf_bytes += bytes;
+        stats->elem_bytes += live * elem_size;
+        return;
+    }
+
+    stats->branch_nodes++;
+    stats->branch_bytes += bytes;
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_stats(children[i], PERSIMM_WIDTH, elem_size, exclusive, stats);
+    }
+}
+
+void persimm_vector_memory_stats(const persimm_vector_t *vector, persimm_memory_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    persimm_vector_node_stats(vector->root, PERSIMM_WIDTH, vector->elem_size, true, stats);
+    persimm_vector_node_stats(vector->tail, vector->tail_count, vector->elem_size, true, stats);
+}
+
+/* Whatever lies beneath a node already gathered has been gathered too. */
+static persimm_status persimm_vector_node_gather(persimm_vector_node_t *node,
+                                                persimm_node_set_t *nodes) {
+    if (NULL == node || persimm_node_set_has(nodes, node)) return PERSIMM_OK;
+
+    persimm_status status = persimm_node_set_add(nodes, node);
+    if (PERSIMM_OK != status || node->kind == PERSIMM_VECTOR_NODE_LEAF) return status;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH && PERSIMM_OK == status; i++) {
+        status = persimm_vector_node_gather(children[i], nodes);
+    }
+    return status;
+}
+
+static void persimm_vector_node_delta(persimm_vector_node_t *node, size_t elem_size,
+                                      const persimm_node_set_t *nodes, size_t *bytes) {
+    if (NULL == node || persimm_node_set_has(nodes, node)) return;
+
+    size_t size = 0;
+    persimm_vector_node_bytes(node->kind, elem_size, &size);
+    *bytes += size;
+    if (node->kind == PERSIMM_VECTOR_NODE_LEAF) return;
+
+    persimm_vector_node_t **children = persimm_vector_node_children(node);
+    for (size_t i = 0; i < PERSIMM_WIDTH; i++) {
+        persimm_vector_node_delta(children[i], elem_size, nodes, bytes);
+    }
+}
+
+persimm_status persimm_vector_memory_delta(const persimm_vector_t *a, const persimm_vector_t *b,
+                                           size_t *bytes) {
+    *bytes = 0;
+
+    persimm_node_set_t nodes = { NULL, 0, 0 };
+    persimm_status status = persimm_vector_node_gather(a->root, &nodes);
+    if (PERSIMM_OK == status) status = persimm_vector_node_gather(a->tail, &nodes);
+    if (PERSIMM_OK == status) {
+        persimm_vector_node_delta(b->root, b->elem_size, &nodes, bytes);
+        persimm_vector_node_delta(b->tail, b->elem_size, &nodes, bytes);
+    }
+
+    persimm_node_set_free(&nodes);
+    return status;
 }
@@ -121,6 +121,19 @@ static uint32_t zero_hash(const void *key, size_t key_size, void *ctx) {
 
 static const persimm_key_ops zero_hash_ops = { zero_hash, NULL, NULL, NULL, NULL };
 
+/*
+ * Three hashes that agree in the five bits the root reads, so a collision node
+ * sits one level down and a key with another of the three must reach it before
+ * the two can be told apart.
+ */
+static uint32_t shallow_hash(const void *key, size_t key_size, void *ctx) {
+    (void) key_size;
+    (void) ctx;
+    return ((uint32_t)(*(const int *)key) % 3u) << 5;
+}
+
+static const persimm_key_ops shallow_ops = { shallow_hash, int_equals, NULL, NULL, NULL };
+
 /* Test Construction Helpers */
 
 /* These helpers repeatedly advance a local value while keeping the operation
@@ -517,7 +530,12 @@ static void rc_release(const void *slot, void *ctx) {
     if (--live[*(const int *)slot] < 0) rc_underflows++;
 }
 
-static const persimm_elem_ops rc_ops = { rc_retain, rc_release, NULL };
+/* Values hash too, so that every trie these tests build keeps a structural hash. */
+static uint32_t rc_hash(const void *slot, void *ctx) {
+    return int_hash(slot, sizeof(int), ctx);
+}
+
+static const persimm_elem_ops rc_ops = { rc_retain, rc_release, NULL, rc_hash };
 
 static persimm_key_ops rc_key_ops(const persimm_key_ops *ops) {
     persimm_key_ops managed = *ops;
@@ -553,7 +571,7 @@ static void test_map_separates_key_and_value_lifecycles(void) {
     persimm_key_ops key_ops = {
         int_hash, int_equals, count_retain, count_release, count_trace
     };
-    persimm_elem_ops value_ops = { count_retain, count_release, count_trace };
+    persimm_elem_ops value_ops = { count_retain, count_release, count_trace, NULL };
 
     persimm_map_t map;
     CHECK(PERSIMM_OK ==
@@ -574,6 +592,92 @@ static void test_map_separates_key_and_value_lifecycles(void) {
           "lifecycles: map did not release key and value separately");
 }
 
+/*
+ * Versions traced in one epoch trace what they share once: a second version
+ * costs what sets it apart from the first. A new epoch traces everything
+ * again, and so does tracing outside any epoch. Vectors and lists only keep
+ * epochs in builds that ask for them, and otherwise trace every version in
+ * full.
+ */
+static void test_trace_epochs(void) {
+    lifecycle_counts counts = { 0, 0, 0 };
+    persimm_elem_ops ops = { NULL, NULL, count_trace, NULL };
+    persimm_key_ops key_ops = { int_hash, int_equals, NULL, NULL, count_trace };
+    int other = -1;
+
+    persimm_vector_t vector;
+    persimm_vector_t updated;
+    persimm_vector_init(&vector, sizeof(int), &ops, &counts);
+    for (int i = 0; i < 1000; i++) test_vector_transient_push(&vector, &i);
+    persimm_vector_update(&vector, 500, &other, &updated);
+
+    uint32_t epoch = persimm_trace_epoch_begin();
+    persimm_vector_trace_epoch(&vector, epoch);
+    CHECK(1000 == counts.traced, "trace epochs: a vector traced %d elements", counts.traced);
+    counts.traced = 0;
+    persimm_vector_trace_epoch(&updated, epoch);
+#if defined(PERSIMM_TRACE_EPOCHS)
+    CHECK(32 == counts.traced, "trace epochs: an updated vector traced %d, wanted one leaf",
+          counts.traced);
+    counts.traced = 0;
+    persimm_vector_trace_epoch(&vector, epoch);
+    CHECK(0 == counts.traced, "trace epochs: a vector traced twice traced %d again",
+          counts.traced);
+#else
+    CHECK(1000 == counts.traced, "trace epochs: an updated vector traced %d without stamps",
+          counts.traced);
+    counts.traced = 0;
+#endif
+    persimm_vector_trace(&vector);
+    CHECK(1000 == counts.traced, "trace epochs: a full trace skipped %d elements",
+          1000 - counts.traced);
+
+    persimm_map_t map;
+    persimm_map_t assoced;
+    persimm_map_init(&map, &map_layout, &ops, &counts, &key_ops, &counts);
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, i };
+        test_map_transient_assoc(&map, &entry);
+    }
+    entry_t entry = { 500, other };
+    persimm_map_assoc(&map, &entry, &assoced);
+
+    epoch = persimm_trace_epoch_begin();
+    counts.traced = 0;
+    persimm_map_trace_epoch(&map, epoch);
+    CHECK(2000 == counts.traced, "trace epochs: a map traced %d keys and values",
+          counts.traced);
+    counts.traced = 0;
+    persimm_map_trace_epoch(&assoced, epoch);
+    CHECK(counts.traced > 0 && counts.traced < 200,
+          "trace epochs: an updated map traced %d keys and values", counts.traced);
+
+    persimm_list_t list;
+    persimm_list_t consed;
+    persimm_list_init(&list, sizeof(int), &ops, &counts);
+    for (int i = 0; i < 100; i++) test_list_advance_cons(&list, &i);
+    persimm_list_cons(&list, &other, &consed);
+
+    epoch = persimm_trace_epoch_begin();
+    counts.traced = 0;
+    persimm_list_trace_epoch(&list, epoch);
+    persimm_list_trace_epoch(&consed, epoch);
+#if defined(PERSIMM_TRACE_EPOCHS)
+    CHECK(101 == counts.traced, "trace epochs: two lists sharing a tail traced %d",
+          counts.traced);
+#else
+    CHECK(201 == counts.traced, "trace epochs: two lists without stamps traced %d",
+          counts.traced);
+#endif
+
+    persimm_list_deinit(&consed);
+    persimm_list_deinit(&list);
+    persimm_map_deinit(&assoced);
+    persimm_map_deinit(&map);
+    persimm_vector_deinit(&updated);
+    persimm_vector_deinit(&vector);
+}
+
 static void check_live(const char *label, const char *when, int lo, int hi) {
     int wrong = 0;
     for (int i = 0; i < RC_SPACE; i++) {
@@ -664,6 +768,691 @@ static void test_set_refcounts(const persimm_key_ops *ops, const char *label, in
     CHECK(0 == rc_underflows, "%s: %d elements over-released", label, rc_underflows);
 }
 
+/* Building in Bulk */
+
+/*
+ * A bulk build must be indistinguishable from storing the same inputs one at
+ * a time: the same count, the same iteration order, the first of each key and
+ * the last of its values, and every element held exactly once. A third of the
+ * keys arrive twice so that the last-wins rule has something to decide.
+ */
+static void test_from_entries(const persimm_key_ops *ops, const char *label, int n) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_key_ops managed_keys = rc_key_ops(ops);
+    size_t total = (size_t)n + (size_t)(n + 2) / 3;
+    entry_t *entries = malloc(sizeof(entry_t) * (total + 1));
+    size_t at = 0;
+    for (int i = 0; i < n; i++) entries[at++] = (entry_t){ i, RC_VALUE_BASE + n + i };
+    for (int i = 0; i < n; i += 3) entries[at++] = (entry_t){ i, RC_VALUE_BASE + i };
+
+    persimm_map_t built;
+    CHECK(PERSIMM_OK == persimm_map_from_entries(entries, at, &map_layout, &rc_ops, NULL,
+                                                 &managed_keys, NULL, &built),
+          "%s: from entries failed", label);
+    CHECK(built.count == (size_t)n, "%s: built %zu entries, wanted %d", label, built.count, n);
+
+    persimm_map_t stored;
+    persimm_map_init(&stored, &map_layout, NULL, NULL, ops, NULL);
+    for (size_t i = 0; i < at; i++) test_map_transient_assoc(&stored, &entries[i]);
+
+    entry_t *a = malloc(sizeof(entry_t) * (size_t)(n + 1));
+    entry_t *b = malloc(sizeof(entry_t) * (size_t)(n + 1));
+    size_t na = drain(&built, a);
+    size_t nb = drain(&stored, b);
+    CHECK(na == nb, "%s: bulk build holds %zu, stored holds %zu", label, na, nb);
+    for (size_t i = 0; i < na && i < nb; i++) {
+        CHECK(a[i].key == b[i].key && a[i].value == b[i].value,
+              "%s: bulk build parted from storing at %zu", label, i);
+    }
+
+    int wrong = 0;
+    for (int i = 0; i < n; i++) {
+        int kept = (0 == i % 3) ? RC_VALUE_BASE + i : RC_VALUE_BASE + n + i;
+        int dropped = (0 == i % 3) ? RC_VALUE_BASE + n + i : -1;
+        if (1 != live[i] || 1 != live[kept] || (dropped >= 0 && 0 != live[dropped])) wrong++;
+    }
+    CHECK(0 == wrong, "%s: %d keys held at the wrong count once built", label, wrong);
+
+    persimm_set_t set;
+    persimm_set_t conjed;
+    int *elems = malloc(sizeof(int) * (total + 1));
+    for (size_t i = 0; i < at; i++) elems[i] = entries[i].key;
+    CHECK(PERSIMM_OK == persimm_set_from_elems(elems, at, sizeof(int), ops, NULL, &set),
+          "%s: from elems failed", label);
+    persimm_set_init(&conjed, sizeof(int), ops, NULL);
+    for (size_t i = 0; i < at; i++) test_set_transient_conj(&conjed, &elems[i]);
+    CHECK(set.count == conjed.count, "%s: set built %zu, conj built %zu", label, set.count,
+          conjed.count);
+    const void *x = persimm_set_next(&set, NULL);
+    const void *y = persimm_set_next(&conjed, NULL);
+    while (NULL != x && NULL != y && *(const int *)x == *(const int *)y) {
+        x = persimm_set_next(&set, x);
+        y = persimm_set_next(&conjed, y);
+    }
+    CHECK(NULL == x && NULL == y, "%s: the bulk set walks in another order", label);
+    CHECK(persimm_set_hash(&set) == persimm_set_hash(&conjed),
+          "%s: the bulk set hashes differently", label);
+
+    persimm_set_deinit(&conjed);
+    persimm_set_deinit(&set);
+    persimm_map_deinit(&stored);
+    persimm_map_deinit(&built);
+    check_live(label, "once the bulk map went", 0, 0);
+    CHECK(0 == rc_underflows, "%s: %d elements over-released", label, rc_underflows);
+
+    free(elems);
+    free(a);
+    free(b);
+    free(entries);
+}
+
+/* Updating in Bulk */
+
+static void check_same_maps(const char *label, const char *what, const persimm_map_t *a,
+                            const persimm_map_t *b, size_t room) {
+    entry_t *x = malloc(sizeof(entry_t) * room);
+    entry_t *y = malloc(sizeof(entry_t) * room);
+    size_t nx = drain(a, x);
+    size_t ny = drain(b, y);
+    CHECK(a->count == nx && b->count == ny, "%s: %s, a count disagrees with its walk", label,
+          what);
+    CHECK(nx == ny, "%s: %s holds %zu, one at a time holds %zu", label, what, nx, ny);
+    for (size_t i = 0; i < nx && i < ny; i++) {
+        CHECK(x[i].key == y[i].key && x[i].value == y[i].value,
+              "%s: %s parted from one at a time at %zu", label, what, i);
+    }
+    CHECK(persimm_map_hash(a) == persimm_map_hash(b), "%s: %s hashes differently", label, what);
+    free(x);
+    free(y);
+}
+
+static void check_same_sets(const char *label, const char *what, const persimm_set_t *a,
+                            const persimm_set_t *b) {
+    CHECK(a->count == b->count, "%s: %s holds %zu, one at a time holds %zu", label, what,
+          a->count, b->count);
+    const void *x = persimm_set_next(a, NULL);
+    const void *y = persimm_set_next(b, NULL);
+    while (NULL != x && NULL != y && *(const int *)x == *(const int *)y) {
+        x = persimm_set_next(a, x);
+        y = persimm_set_next(b, y);
+    }
+    CHECK(NULL == x && NULL == y, "%s: %s walks in another order", label, what);
+    CHECK(persimm_set_hash(a) == persimm_set_hash(b), "%s: %s hashes differently", label, what);
+}
+
+/*
+ * A batch must land exactly as its entries stored one after another would.
+ * Half the batch replaces what the map holds and half is new, every fourth key
+ * comes twice so that the last value has to win, and the removals take keys
+ * held, keys never held and keys named twice. The source is shared with the
+ * result throughout and must come out of it untouched.
+ */
+static void test_update_many(const persimm_key_ops *ops, const char *label, int n) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_key_ops managed_keys = rc_key_ops(ops);
+    int span = n + n / 2;
+    size_t room = (size_t)span + 2;
+
+    persimm_map_t base;
+    persimm_map_init(&base, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < n; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        test_map_transient_assoc(&base, &entry);
+    }
+
+    entry_t *batch = malloc(sizeof(entry_t) * room * 2);
+    size_t at = 0;
+    for (int i = n / 2; i < span; i++) batch[at++] = (entry_t){ i, RC_VALUE_BASE + 50000 + i };
+    for (int i = n / 2; i < span; i += 4) batch[at++] = (entry_t){ i, RC_VALUE_BASE + i };
+
+    persimm_map_t many;
+    CHECK(PERSIMM_OK == persimm_map_assoc_many(&base, batch, at, &many),
+          "%s: assoc many failed", label);
+    persimm_map_t stored;
+    persimm_map_clone(&base, &stored);
+    for (size_t i = 0; i < at; i++) test_map_transient_assoc(&stored, &batch[i]);
+    check_same_maps(label, "assoc many", &many, &stored, room);
+    size_t merged = many.count;
+    CHECK(base.count == (size_t)n, "%s: assoc many changed its source", label);
+    for (int i = 0; i < n; i++) {
+        const int *value = (const int *)persimm_map_find(&base, &i);
+        CHECK(NULL != value && RC_VALUE_BASE + i == *value,
+              "%s: assoc many changed the source's value for %d", label, i);
+    }
+
+    int *keys = malloc(sizeof(int) * room * 2);
+    size_t m = 0;
+    for (int i = 0; i < span + 7; i += 3) keys[m++] = i;
+    for (int i = 0; i < span; i += 9) keys[m++] = i;
+
+    persimm_map_t fewer;
+    CHECK(PERSIMM_OK == persimm_map_dissoc_many(&many, keys, m, &fewer),
+          "%s: dissoc many failed", label);
+    for (size_t i = 0; i < m; i++) test_map_transient_dissoc(&stored, &keys[i]);
+    check_same_maps(label, "dissoc many", &fewer, &stored, room);
+    CHECK(many.count == merged && (0 == n || persimm_map_has(&many, &keys[0])),
+          "%s: dissoc many changed its source", label);
+
+    for (int i = 0; i < span; i++) keys[i] = i;
+    persimm_map_t none;
+    CHECK(PERSIMM_OK == persimm_map_dissoc_many(&fewer, keys, (size_t)span, &none),
+          "%s: dissoc many of everything failed", label);
+    CHECK(0 == none.count && NULL == none.root, "%s: dissoc many left %zu behind", label,
+          none.count);
+
+    persimm_set_t set;
+    persimm_set_t conjed;
+    persimm_set_t disjed;
+    persimm_set_init(&set, sizeof(int), ops, NULL);
+    for (int i = 0; i < n; i++) test_set_transient_conj(&set, &i);
+    for (size_t i = 0; i < at; i++) keys[i] = batch[i].key;
+    CHECK(PERSIMM_OK == persimm_set_conj_many(&set, keys, at, &conjed),
+          "%s: conj many failed", label);
+    for (size_t i = 0; i < at; i++) test_set_transient_conj(&set, &keys[i]);
+    check_same_sets(label, "conj many", &conjed, &set);
+    for (size_t i = 0; i < m; i++) keys[i] = (int)(i * 2);
+    CHECK(PERSIMM_OK == persimm_set_disj_many(&conjed, keys, m, &disjed),
+          "%s: disj many failed", label);
+    for (size_t i = 0; i < m; i++) test_set_transient_disj(&set, &keys[i]);
+    check_same_sets(label, "disj many", &disjed, &set);
+
+    persimm_set_deinit(&disjed);
+    persimm_set_deinit(&conjed);
+    persimm_set_deinit(&set);
+    persimm_map_deinit(&none);
+    persimm_map_deinit(&fewer);
+    persimm_map_deinit(&stored);
+    persimm_map_deinit(&many);
+    persimm_map_deinit(&base);
+    check_live(label, "once the batched maps went", 0, 0);
+    CHECK(0 == rc_underflows, "%s: %d elements over-released", label, rc_underflows);
+
+    free(keys);
+    free(batch);
+}
+
+/* A batch that meets a collision node with a hash it does not share has to
+   give the node a parent, and one that empties it has to take the node away. */
+static void test_update_many_through_collisions(void) {
+    persimm_map_t base;
+    persimm_map_init(&base, &map_layout, NULL, NULL, &shallow_ops, NULL);
+    for (int i = 0; i < 9; i += 3) {
+        entry_t entry = { i, i };
+        test_map_transient_assoc(&base, &entry);
+    }
+
+    entry_t batch[] = { { 1, 10 }, { 3, 30 }, { 4, 40 }, { 12, 120 }, { 2, 20 }, { 1, 11 } };
+    size_t count = sizeof(batch) / sizeof(batch[0]);
+    persimm_map_t many;
+    persimm_map_t stored;
+    CHECK(PERSIMM_OK == persimm_map_assoc_many(&base, batch, count, &many),
+          "collisions: assoc many failed");
+    persimm_map_clone(&base, &stored);
+    for (size_t i = 0; i < count; i++) test_map_transient_assoc(&stored, &batch[i]);
+    check_same_maps("collisions", "assoc many", &many, &stored, 16);
+
+    int keys[] = { 0, 3, 12, 7, 3 };
+    persimm_map_t fewer;
+    CHECK(PERSIMM_OK == persimm_map_dissoc_many(&many, keys, sizeof(keys) / sizeof(keys[0]),
+                                                &fewer),
+          "collisions: dissoc many failed");
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        test_map_transient_dissoc(&stored, &keys[i]);
+    }
+    check_same_maps("collisions", "dissoc many", &fewer, &stored, 16);
+
+    persimm_map_deinit(&fewer);
+    persimm_map_deinit(&stored);
+    persimm_map_deinit(&many);
+    persimm_map_deinit(&base);
+}
+
+/* Hashing */
+
+/*
+ * Tries holding the same entries must agree on their hash however they got
+ * there: stored, built, batched, or grown past what they hold and cut back,
+ * and with colliding keys arriving in the opposite order. A changed value has
+ * to show.
+ */
+static void test_map_hashes(const persimm_key_ops *ops, const char *label, int n) {
+    persimm_map_t stored;
+    persimm_map_init(&stored, &map_layout, &rc_ops, NULL, ops, NULL);
+    for (int i = 0; i < n; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        test_map_transient_assoc(&stored, &entry);
+    }
+
+    entry_t *entries = malloc(sizeof(entry_t) * (size_t)(n + 1));
+    for (int i = 0; i < n; i++) entries[i] = (entry_t){ n - 1 - i, RC_VALUE_BASE + n - 1 - i };
+    persimm_map_t built;
+    persimm_map_from_entries(entries, (size_t)n, &map_layout, &rc_ops, NULL, ops, NULL, &built);
+    CHECK(persimm_map_hash(&stored) == persimm_map_hash(&built),
+          "%s: built in reverse, the map hashes differently", label);
+
+    persimm_map_t grown;
+    persimm_map_init(&grown, &map_layout, &rc_ops, NULL, ops, NULL);
+    for (int i = n + 50; i >= 0; i--) {
+        entry_t entry = { i, i };
+        persimm_map_t next;
+        persimm_map_assoc(&grown, &entry, &next);
+        persimm_map_deinit(&grown);
+        grown = next;
+    }
+    for (int i = n + 50; i >= 0; i--) {
+        persimm_map_t next;
+        if (i >= n) {
+            persimm_map_dissoc(&grown, &i, &next);
+        } else {
+            entry_t entry = { i, RC_VALUE_BASE + i };
+            persimm_map_assoc(&grown, &entry, &next);
+        }
+        persimm_map_deinit(&grown);
+        grown = next;
+    }
+    CHECK(persimm_map_hash(&stored) == persimm_map_hash(&grown),
+          "%s: grown and cut back, the map hashes differently", label);
+
+    if (n > 0) {
+        int key = n / 2;
+        entry_t changed = { key, RC_VALUE_BASE + n + 1 };
+        persimm_map_t other;
+        persimm_map_assoc(&stored, &changed, &other);
+        CHECK(persimm_map_hash(&stored) != persimm_map_hash(&other),
+              "%s: a changed value left the hash alone", label);
+        persimm_map_deinit(&other);
+    }
+
+    persimm_set_t set;
+    persimm_set_t reversed;
+    persimm_set_init(&set, sizeof(int), ops, NULL);
+    for (int i = 0; i < n; i++) test_set_transient_conj(&set, &i);
+    persimm_set_init(&reversed, sizeof(int), ops, NULL);
+    for (int i = n - 1; i >= 0; i--) test_set_transient_conj(&reversed, &i);
+    CHECK(persimm_set_hash(&set) == persimm_set_hash(&reversed),
+          "%s: built in reverse, the set hashes differently", label);
+
+    persimm_set_deinit(&reversed);
+    persimm_set_deinit(&set);
+    persimm_map_deinit(&grown);
+    persimm_map_deinit(&built);
+    persimm_map_deinit(&stored);
+    free(entries);
+}
+
+/*
+ * A vector's hash is kept through pushes that graft leaves and grow the root,
+ * and through updates in the tail and in the trie, so one that took a detour
+ * must land where a straight run of pushes does. Without a hash in the element
+ * table the vector is walked instead, to the same effect.
+ */
+static void test_vector_hashes(void) {
+    static const persimm_elem_ops hashed = { NULL, NULL, NULL, rc_hash };
+    int n = 2000;
+
+    persimm_vector_t pushed;
+    persimm_vector_init(&pushed, sizeof(int), &hashed, NULL);
+    for (int i = 0; i < n; i++) {
+        persimm_vector_t next;
+        persimm_vector_push(&pushed, &i, &next);
+        persimm_vector_deinit(&pushed);
+        pushed = next;
+    }
+
+    persimm_vector_t detour;
+    persimm_vector_init(&detour, sizeof(int), &hashed, NULL);
+    for (int i = 0; i < n; i++) {
+        int wrong = -i;
+        test_vector_transient_push(&detour, &wrong);
+        if (0 == i % 7) test_vector_transient_update(&detour, (size_t)i, &i);
+    }
+    for (int i = 0; i < n; i++) {
+        if (0 != i % 7) test_vector_transient_update(&detour, (size_t)i, &i);
+    }
+    CHECK(persimm_vector_hash(&pushed) == persimm_vector_hash(&detour),
+          "vector hash: a detour reached another hash");
+
+    persimm_vector_t changed;
+    int other = -1;
+    persimm_vector_update(&pushed, 700, &other, &changed);
+    CHECK(persimm_vector_hash(&pushed) != persimm_vector_hash(&changed),
+          "vector hash: an update left the hash alone");
+    CHECK(!persimm_vector_equals(&pushed, &changed, NULL, NULL),
+          "vector hash: vectors that hash apart compare equal");
+
+    persimm_vector_t swapped;
+    int first = 1;
+    int second = 0;
+    persimm_vector_deinit(&changed);
+    persimm_vector_update(&pushed, 0, &first, &changed);
+    persimm_vector_update(&changed, 1, &second, &swapped);
+    CHECK(persimm_vector_hash(&pushed) != persimm_vector_hash(&swapped),
+          "vector hash: swapping two elements left the hash alone");
+
+    persimm_vector_t walked;
+    persimm_vector_t walked_too;
+    persimm_vector_init(&walked, sizeof(int), NULL, NULL);
+    persimm_vector_init(&walked_too, sizeof(int), NULL, NULL);
+    for (int i = 0; i < n; i++) {
+        test_vector_transient_push(&walked, &i);
+        test_vector_transient_push(&walked_too, &i);
+    }
+    CHECK(persimm_vector_hash(&walked) == persimm_vector_hash(&walked_too),
+          "vector hash: equal vectors walked to different hashes");
+    test_vector_transient_update(&walked_too, 1999, &other);
+    CHECK(persimm_vector_hash(&walked) != persimm_vector_hash(&walked_too),
+          "vector hash: walking missed an update");
+
+    persimm_vector_deinit(&walked_too);
+    persimm_vector_deinit(&walked);
+    persimm_vector_deinit(&swapped);
+    persimm_vector_deinit(&changed);
+    persimm_vector_deinit(&detour);
+    persimm_vector_deinit(&pushed);
+}
+
+/* Runs every task on the calling thread, last first, so that nothing can lean on the order. */
+typedef struct {
+    size_t runs;
+    size_t tasks;
+} test_executor_t;
+
+static void test_executor_run(void *ctx, size_t tasks, persimm_task_fn fn, void *arg) {
+    test_executor_t *executor = ctx;
+    executor->runs++;
+    executor->tasks += tasks;
+    for (size_t i = tasks; i > 0; i--) fn(arg, i - 1);
+}
+
+/* An accumulator that notices when elements arrive out of order. */
+typedef struct {
+    size_t first;
+    size_t last;
+    size_t count;
+    long long sum;
+    bool ordered;
+} run_acc_t;
+
+static void run_fold(void *acc, const void *slot, size_t position, void *ctx) {
+    (void)ctx;
+    run_acc_t *run = acc;
+    if (0 == run->count) {
+        run->first = position;
+    } else if (position != run->last + 1) {
+        run->ordered = false;
+    }
+    run->last = position;
+    run->count++;
+    run->sum += *(const int *)slot;
+}
+
+static void run_combine(void *acc, const void *other, void *ctx) {
+    (void)ctx;
+    run_acc_t *run = acc;
+    const run_acc_t *next = other;
+    if (0 == next->count) return;
+    if (0 == run->count) {
+        *run = *next;
+        return;
+    }
+    if (next->first != run->last + 1) run->ordered = false;
+    run->last = next->last;
+    run->count += next->count;
+    run->sum += next->sum;
+    run->ordered = run->ordered && next->ordered;
+}
+
+static persimm_status shift_to_values(const void *slot, size_t position, void *out, void *ctx) {
+    const size_t *fail_at = ctx;
+    if (NULL != fail_at && position == *fail_at) return PERSIMM_ERR_INVALID;
+    *(int *)out = RC_VALUE_BASE + *(const int *)slot;
+    return PERSIMM_OK;
+}
+
+static void test_vector_parallel(void) {
+    static const int sizes[] = { 0, 5, 32, 33, 64, 65, 1000, 1056, 40000 };
+    test_executor_t counts = { 0, 0 };
+    persimm_executor executor = { test_executor_run, &counts };
+    const run_acc_t identity = { 0, 0, 0, 0, true };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        memset(live, 0, sizeof(live));
+        rc_underflows = 0;
+
+        persimm_vector_t vector;
+        persimm_vector_t expected;
+        persimm_vector_init(&vector, sizeof(int), &rc_ops, NULL);
+        persimm_vector_init(&expected, sizeof(int), &rc_ops, NULL);
+        for (int i = 0; i < n; i++) {
+            int shifted = RC_VALUE_BASE + i;
+            persimm_vector_push_owned(&vector, &i);
+            persimm_vector_push_owned(&expected, &shifted);
+        }
+
+        run_acc_t run;
+        CHECK(PERSIMM_OK == persimm_vector_parallel_reduce(&vector, run_fold, run_combine,
+                                                           &identity, sizeof(run_acc_t), NULL,
+                                                           &executor, &run) &&
+              (size_t)n == run.count && run.ordered &&
+              (long long)n * (n - 1) / 2 == run.sum,
+              "vector parallel/%d: the reduction went wrong", n);
+
+        persimm_vector_t mapped;
+        CHECK(PERSIMM_OK == persimm_vector_parallel_map(&vector, shift_to_values, NULL,
+                                                        sizeof(int), &rc_ops, NULL, &executor,
+                                                        &mapped) &&
+              persimm_vector_equals(&mapped, &expected, NULL, NULL) &&
+              persimm_vector_hash(&mapped) == persimm_vector_hash(&expected),
+              "vector parallel/%d: the mapped vector differs from one pushed", n);
+        persimm_vector_deinit(&expected);
+        check_live("vector parallel", "after mapping", 0, n);
+
+        size_t fail_at = (size_t)n / 2;
+        persimm_vector_t failed;
+        CHECK(0 == n || (PERSIMM_ERR_INVALID == persimm_vector_parallel_map(&vector,
+                                                                           shift_to_values,
+                                                                           &fail_at,
+                                                                           sizeof(int),
+                                                                           &rc_ops, NULL,
+                                                                           &executor, &failed) &&
+                         0 == failed.count),
+              "vector parallel/%d: a failed transform was not reported", n);
+        if (0 != n) persimm_vector_deinit(&failed);
+        check_live("vector parallel", "after a failed map", 0, n);
+
+        persimm_vector_deinit(&mapped);
+        persimm_vector_deinit(&vector);
+        check_live("vector parallel", "at the end", 0, 0);
+        CHECK(0 == rc_underflows, "vector parallel/%d: elements were released too often", n);
+    }
+    CHECK(counts.runs > 0 && counts.tasks > counts.runs,
+          "vector parallel: the executor was never given a split");
+
+    persimm_vector_t local;
+    persimm_vector_t mapped;
+    run_acc_t run;
+    persimm_vector_init(&local, sizeof(int), NULL, NULL);
+    persimm_vector_make_local(&local);
+    CHECK(PERSIMM_ERR_INVALID == persimm_vector_parallel_reduce(&local, run_fold, run_combine,
+                                                                &identity, sizeof(run_acc_t),
+                                                                NULL, NULL, &run) &&
+          PERSIMM_ERR_INVALID == persimm_vector_parallel_map(&local, shift_to_values, NULL,
+                                                             sizeof(int), NULL, NULL, NULL,
+                                                             &mapped),
+          "vector parallel: a local vector was accepted");
+    persimm_vector_deinit(&mapped);
+    persimm_vector_deinit(&local);
+}
+
+typedef struct {
+    size_t count;
+    long long keys;
+    long long values;
+} entry_sum_t;
+
+static void entry_fold(void *acc, const void *slot, size_t position, void *ctx) {
+    (void)position;
+    (void)ctx;
+    entry_sum_t *sum = acc;
+    const entry_t *entry = slot;
+    sum->count++;
+    sum->keys += entry->key;
+    sum->values += entry->value;
+}
+
+static void entry_combine(void *acc, const void *other, void *ctx) {
+    (void)ctx;
+    entry_sum_t *sum = acc;
+    const entry_sum_t *more = other;
+    sum->count += more->count;
+    sum->keys += more->keys;
+    sum->values += more->values;
+}
+
+/* Elements of a set are bare keys, which sit where an entry's key does. */
+static void key_fold(void *acc, const void *slot, size_t position, void *ctx) {
+    (void)position;
+    (void)ctx;
+    entry_sum_t *sum = acc;
+    sum->count++;
+    sum->keys += *(const int *)slot;
+}
+
+static void mark_visit(const void *slot, size_t position, void *ctx) {
+    (void)position;
+    int *visits = ctx;
+    visits[*(const int *)slot]++;
+}
+
+static void test_hamt_parallel(void) {
+    static const persimm_key_ops *const ops[] = { &spread_ops, &crowded_ops, &shallow_ops,
+                                                  &zero_hash_ops };
+    static const int sizes[] = { 0, 1, 20, 33, 5000 };
+    static int visits[5000];
+    test_executor_t counts = { 0, 0 };
+    persimm_executor executor = { test_executor_run, &counts };
+    const entry_sum_t zero = { 0, 0, 0 };
+
+    for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int n = sizes[s];
+            /* Colliding keys are searched linearly, so a crowded build stays small. */
+            if (o > 0 && n > 1000) continue;
+
+            persimm_map_t map;
+            persimm_set_t set;
+            persimm_map_init(&map, &map_layout, NULL, NULL, ops[o], NULL);
+            persimm_set_init(&set, sizeof(int), ops[o], NULL);
+            for (int i = 0; i < n; i++) {
+                entry_t entry = { i, 3 * i };
+                persimm_map_assoc_owned(&map, &entry);
+                persimm_set_conj_owned(&set, &i);
+            }
+
+            entry_sum_t sum;
+            long long keys = (long long)n * (n - 1) / 2;
+            CHECK(PERSIMM_OK == persimm_map_parallel_reduce(&map, entry_fold, entry_combine,
+                                                            &zero, sizeof(entry_sum_t), NULL,
+                                                            &executor, &sum) &&
+                  (size_t)n == sum.count && keys == sum.keys && 3 * keys == sum.values,
+                  "hamt parallel/%zu/%d: the map reduction went wrong", o, n);
+            CHECK(PERSIMM_OK == persimm_set_parallel_reduce(&set, key_fold, entry_combine, &zero,
+                                                            sizeof(entry_sum_t), NULL, &executor,
+                                                            &sum) &&
+                  (size_t)n == sum.count && keys == sum.keys,
+                  "hamt parallel/%zu/%d: the set reduction went wrong", o, n);
+
+            memset(visits, 0, sizeof(visits));
+            persimm_map_parallel_foreach(&map, mark_visit, visits, &executor);
+            persimm_set_parallel_foreach(&set, mark_visit, visits, &executor);
+            int wrong = 0;
+            for (int i = 0; i < n; i++) wrong += (2 != visits[i]);
+            CHECK(0 == wrong, "hamt parallel/%zu/%d: %d keys visited other than once each",
+                  o, n, wrong);
+
+            persimm_map_deinit(&map);
+            persimm_set_deinit(&set);
+        }
+    }
+    CHECK(counts.runs > 0 && counts.tasks > counts.runs,
+          "hamt parallel: the executor was never given a split");
+
+    persimm_map_t local;
+    entry_sum_t sum;
+    persimm_map_init(&local, &map_layout, NULL, NULL, &spread_ops, NULL);
+    persimm_map_make_local(&local);
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_parallel_foreach(&local, mark_visit, visits, NULL) &&
+          PERSIMM_ERR_INVALID == persimm_map_parallel_reduce(&local, entry_fold, entry_combine,
+                                                             &zero, sizeof(entry_sum_t), NULL,
+                                                             NULL, &sum),
+          "hamt parallel: a local map was accepted");
+    persimm_map_deinit(&local);
+}
+
+static void test_parallel_build(void) {
+    static const persimm_key_ops *const ops[] = { &spread_ops, &crowded_ops, &shallow_ops };
+    static const int sizes[] = { 0, 1, 40, 3000 };
+    test_executor_t counts = { 0, 0 };
+    persimm_executor executor = { test_executor_run, &counts };
+
+    for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int n = sizes[s];
+            if (o > 0 && n > 1000) continue;
+
+            /* Every third key comes round again with a new value. */
+            size_t total = (size_t)n + (size_t)(n + 2) / 3;
+            entry_t *entries = calloc(total + 1, sizeof(entry_t));
+            int *elems = calloc(total + 1, sizeof(int));
+            size_t at = 0;
+            for (int i = 0; i < n; i++) entries[at++] = (entry_t){ i, n + i };
+            for (int i = 0; i < n; i += 3) entries[at++] = (entry_t){ i, i };
+            for (size_t i = 0; i < at; i++) elems[i] = entries[i].key;
+
+            persimm_map_t serial;
+            persimm_map_t parallel;
+            persimm_map_from_entries(entries, at, &map_layout, NULL, NULL, ops[o], NULL, &serial);
+            CHECK(PERSIMM_OK == persimm_map_parallel_from_entries(entries, at, &map_layout, NULL,
+                                                                  NULL, ops[o], NULL, &executor,
+                                                                  &parallel) &&
+                  serial.count == parallel.count &&
+                  persimm_map_hash(&serial) == persimm_map_hash(&parallel),
+                  "parallel build/%zu/%d: the map differs from a serial build", o, n);
+            const void *a = NULL;
+            const void *b = NULL;
+            do {
+                a = persimm_map_next(&serial, a);
+                b = persimm_map_next(&parallel, b);
+            } while (NULL != a && NULL != b && 0 == memcmp(a, b, sizeof(entry_t)));
+            CHECK(NULL == a && NULL == b, "parallel build/%zu/%d: the map walks differently",
+                  o, n);
+
+            persimm_set_t serial_set;
+            persimm_set_t parallel_set;
+            persimm_set_from_elems(elems, at, sizeof(int), ops[o], NULL, &serial_set);
+            CHECK(PERSIMM_OK == persimm_set_parallel_from_elems(elems, at, sizeof(int), ops[o],
+                                                                NULL, &executor,
+                                                                &parallel_set) &&
+                  serial_set.count == parallel_set.count &&
+                  persimm_set_hash(&serial_set) == persimm_set_hash(&parallel_set),
+                  "parallel build/%zu/%d: the set differs from a serial build", o, n);
+
+            persimm_set_deinit(&serial_set);
+            persimm_set_deinit(&parallel_set);
+            persimm_map_deinit(&serial);
+            persimm_map_deinit(&parallel);
+            free(elems);
+            free(entries);
+        }
+    }
+    CHECK(counts.runs > 0, "parallel build: the executor was never used");
+}
+
 /* Defaults */
 
 /* What a host storing plain data gets without supplying anything: FNV-1a over
@@ -1022,6 +1811,103 @@ static void test_vector_transient(void) {
     persimm_vector_deinit(&base);
 }
 
+/* Comparing Vectors */
+
+typedef struct {
+    size_t calls;
+    size_t seen;
+    size_t indices[16];
+    bool one_sided;
+} vector_diff_log_t;
+
+static bool counted_int_equals(const void *slot_a, const void *slot_b, size_t elem_size,
+                               void *ctx) {
+    (void) elem_size;
+    ((vector_diff_log_t *)ctx)->calls++;
+    return *(const int *)slot_a == *(const int *)slot_b;
+}
+
+static void log_diff(const void *slot_a, const void *slot_b, size_t index, void *ctx) {
+    vector_diff_log_t *log = (vector_diff_log_t *)ctx;
+    if (NULL == slot_a || NULL == slot_b) log->one_sided = true;
+    if (log->seen < sizeof(log->indices) / sizeof(log->indices[0])) {
+        log->indices[log->seen] = index;
+    }
+    log->seen++;
+}
+
+/*
+ * A version derived by a few updates shares every leaf it did not touch, so
+ * comparing the two must open only the leaves the updates copied. The bound
+ * below is three leaves and a tail, which a comparison reading all 2000
+ * elements would blow through many times over.
+ */
+static void test_vector_equals_and_diff(void) {
+    persimm_vector_t base;
+    persimm_vector_init(&base, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 2000; i++) test_vector_transient_push(&base, &i);
+
+    persimm_vector_t derived;
+    persimm_vector_clone(&base, &derived);
+    static const size_t changed[] = { 5, 700, 1990 };
+    for (size_t i = 0; i < 3; i++) {
+        int value = -1;
+        test_vector_transient_update(&derived, changed[i], &value);
+    }
+
+    vector_diff_log_t log;
+    memset(&log, 0, sizeof(log));
+    CHECK(persimm_vector_equals(&base, &base, counted_int_equals, &log),
+          "vector equals: a vector differs from itself");
+    CHECK(!persimm_vector_equals(&base, &derived, counted_int_equals, &log),
+          "vector equals: missed an update");
+
+    memset(&log, 0, sizeof(log));
+    CHECK(PERSIMM_OK == persimm_vector_diff(&base, &derived, counted_int_equals, log_diff, &log),
+          "vector diff: failed");
+    CHECK(3 == log.seen, "vector diff: reported %zu changes, wanted 3", log.seen);
+    for (size_t i = 0; i < 3 && i < log.seen; i++) {
+        CHECK(log.indices[i] == changed[i], "vector diff: change %zu at %zu, wanted %zu", i,
+              log.indices[i], changed[i]);
+    }
+    CHECK(log.calls <= 4 * 32, "vector diff: compared %zu elements for 3 updates", log.calls);
+
+    /* Putting back an equal element copies a leaf but changes nothing. */
+    persimm_vector_t restored;
+    persimm_vector_clone(&derived, &restored);
+    for (size_t i = 0; i < 3; i++) {
+        int value = (int)changed[i];
+        test_vector_transient_update(&restored, changed[i], &value);
+    }
+    CHECK(persimm_vector_equals(&base, &restored, NULL, NULL),
+          "vector equals: restored elements still differ");
+
+    /* A vector built separately shares nothing, and one of another length has
+       differences only the longer can report. */
+    persimm_vector_t prefix;
+    persimm_vector_init(&prefix, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 1100; i++) test_vector_transient_push(&prefix, &i);
+    CHECK(!persimm_vector_equals(&base, &prefix, NULL, NULL),
+          "vector equals: vectors of different lengths compare equal");
+
+    memset(&log, 0, sizeof(log));
+    persimm_vector_diff(&prefix, &base, NULL, log_diff, &log);
+    CHECK(900 == log.seen && 1100 == log.indices[0] && log.one_sided,
+          "vector diff: a longer vector reported %zu changes from %zu", log.seen,
+          log.indices[0]);
+
+    persimm_vector_t bytes;
+    persimm_vector_init(&bytes, sizeof(char), NULL, NULL);
+    CHECK(PERSIMM_ERR_INVALID == persimm_vector_diff(&base, &bytes, NULL, log_diff, &log),
+          "vector diff: accepted vectors of different element sizes");
+
+    persimm_vector_deinit(&bytes);
+    persimm_vector_deinit(&prefix);
+    persimm_vector_deinit(&restored);
+    persimm_vector_deinit(&derived);
+    persimm_vector_deinit(&base);
+}
+
 static void test_map_transient(void) {
     memset(live, 0, sizeof(live));
     rc_underflows = 0;
@@ -1095,6 +1981,1044 @@ static void test_set_transient(void) {
     persimm_set_deinit(&base);
 }
 
+/* Owned Updates */
+
+/*
+ * An owned update writes straight into the nodes nothing else holds and copies
+ * the ones something else does. The first shows as a tail or root that stays
+ * where it was, the second as a clone taken beforehand that still reads as it
+ * did. Every element is counted, so consuming the old version must balance the
+ * books just as deinitialising it would.
+ */
+static void test_owned_updates(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_vector_t vector;
+    persimm_vector_init(&vector, sizeof(int), &rc_ops, NULL);
+    for (int i = 0; i < 100; i++) {
+        CHECK(PERSIMM_OK == persimm_vector_push_owned(&vector, &i),
+              "owned vector: push %d failed", i);
+    }
+    const void *tail = vector.tail;
+    int fresh = 100;
+    CHECK(PERSIMM_OK == persimm_vector_push_owned(&vector, &fresh),
+          "owned vector: push failed");
+    CHECK(tail == vector.tail, "owned vector: an unshared tail was copied");
+
+    persimm_vector_t kept;
+    CHECK(PERSIMM_OK == persimm_vector_clone(&vector, &kept), "owned vector: clone failed");
+    int replacement = 150;
+    fresh = 101;
+    CHECK(PERSIMM_OK == persimm_vector_update_owned(&vector, 10, &replacement) &&
+          PERSIMM_OK == persimm_vector_push_owned(&vector, &fresh),
+          "owned vector: update through a shared path failed");
+    CHECK(102 == vector.count && 150 == *(const int *)persimm_vector_at(&vector, 10) &&
+          101 == *(const int *)persimm_vector_at(&vector, 101),
+          "owned vector: result is wrong");
+    CHECK(101 == kept.count && 10 == *(const int *)persimm_vector_at(&kept, 10),
+          "owned vector: a clone saw the update");
+    CHECK(PERSIMM_ERR_BOUNDS == persimm_vector_update_owned(&vector, 102, &replacement),
+          "owned vector: accepted an index past the end");
+    persimm_vector_deinit(&kept);
+    persimm_vector_deinit(&vector);
+    check_live("owned vector", "once the vectors went", 0, 0);
+
+    persimm_list_t list;
+    persimm_list_init(&list, sizeof(int), &rc_ops, NULL);
+    for (int i = 0; i < 10; i++) {
+        CHECK(PERSIMM_OK == persimm_list_cons_owned(&list, &i),
+              "owned list: cons %d failed", i);
+    }
+    persimm_list_t shared;
+    CHECK(PERSIMM_OK == persimm_list_clone(&list, &shared), "owned list: clone failed");
+    CHECK(PERSIMM_OK == persimm_list_rest_owned(&list) &&
+          PERSIMM_OK == persimm_list_rest_owned(&list),
+          "owned list: rest failed");
+    CHECK(8 == list.count && 7 == *(const int *)persimm_list_first(&list) &&
+          10 == shared.count && 9 == *(const int *)persimm_list_first(&shared),
+          "owned list: dropping the head reached a clone");
+    persimm_list_deinit(&shared);
+    while (list.count > 0) {
+        CHECK(PERSIMM_OK == persimm_list_rest_owned(&list), "owned list: rest failed");
+    }
+    CHECK(PERSIMM_ERR_BOUNDS == persimm_list_rest_owned(&list),
+          "owned list: dropped the head of an empty list");
+    persimm_list_deinit(&list);
+    check_live("owned list", "once the lists went", 0, 0);
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 100; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        CHECK(PERSIMM_OK == persimm_map_assoc_owned(&map, &entry),
+              "owned map: assoc %d failed", i);
+    }
+    const void *root = map.root;
+    entry_t entry = { 11, RC_VALUE_BASE + 150 };
+    CHECK(PERSIMM_OK == persimm_map_assoc_owned(&map, &entry), "owned map: assoc failed");
+    CHECK(root == map.root, "owned map: an unshared root was copied");
+
+    persimm_map_t snapshot;
+    CHECK(PERSIMM_OK == persimm_map_clone(&map, &snapshot), "owned map: clone failed");
+    int victim = 10;
+    entry.value = RC_VALUE_BASE + 151;
+    CHECK(PERSIMM_OK == persimm_map_dissoc_owned(&map, &victim) &&
+          PERSIMM_OK == persimm_map_assoc_owned(&map, &entry),
+          "owned map: update through a shared path failed");
+    const int *value = (const int *)persimm_map_find(&map, &entry.key);
+    const int *earlier = (const int *)persimm_map_find(&snapshot, &entry.key);
+    CHECK(99 == map.count && !persimm_map_has(&map, &victim) &&
+          NULL != value && RC_VALUE_BASE + 151 == *value,
+          "owned map: result is wrong");
+    CHECK(100 == snapshot.count && persimm_map_has(&snapshot, &victim) &&
+          NULL != earlier && RC_VALUE_BASE + 150 == *earlier,
+          "owned map: a clone saw the update");
+    persimm_map_deinit(&snapshot);
+    persimm_map_deinit(&map);
+    check_live("owned map", "once the maps went", 0, 0);
+    CHECK(0 == rc_underflows, "owned updates: elements were released too often");
+
+    persimm_set_t set;
+    persimm_set_init(&set, sizeof(int), &spread_ops, NULL);
+    for (int i = 0; i < 100; i++) {
+        CHECK(PERSIMM_OK == persimm_set_conj_owned(&set, &i), "owned set: conj %d failed", i);
+    }
+    persimm_set_t before;
+    CHECK(PERSIMM_OK == persimm_set_clone(&set, &before), "owned set: clone failed");
+    CHECK(PERSIMM_OK == persimm_set_disj_owned(&set, &victim) &&
+          PERSIMM_OK == persimm_set_conj_owned(&set, &fresh),
+          "owned set: update failed");
+    CHECK(100 == set.count && !persimm_set_has(&set, &victim) && persimm_set_has(&set, &fresh),
+          "owned set: result is wrong");
+    CHECK(persimm_set_has(&before, &victim) && !persimm_set_has(&before, &fresh),
+          "owned set: a clone saw the update");
+    persimm_set_deinit(&before);
+    persimm_set_deinit(&set);
+}
+
+/*
+ * Counting locally changes how the counts move and not what they come to, so
+ * the same run of clones, copied paths and owned updates has to balance the
+ * books either way, including for versions shared partway through.
+ */
+static void test_local_refcounts(void) {
+    for (int local = 0; local < 2; local++) {
+        const char *label = local ? "local" : "shared";
+        memset(live, 0, sizeof(live));
+        rc_underflows = 0;
+
+        persimm_vector_t vector;
+        persimm_vector_init(&vector, sizeof(int), &rc_ops, NULL);
+        if (local) persimm_vector_make_local(&vector);
+        for (int i = 0; i < 200; i++) persimm_vector_push_owned(&vector, &i);
+        persimm_vector_t kept;
+        persimm_vector_t updated;
+        int replacement = 250;
+        persimm_vector_clone(&vector, &kept);
+        CHECK(PERSIMM_OK == persimm_vector_update(&vector, 50, &replacement, &updated),
+              "%s vector: update failed", label);
+        CHECK(updated.local == (local ? true : false), "%s vector: update changed how it counts",
+              label);
+        persimm_vector_share(&updated);
+        replacement = 251;
+        persimm_vector_push_owned(&updated, &replacement);
+        CHECK(50 == *(const int *)persimm_vector_at(&kept, 50) &&
+              250 == *(const int *)persimm_vector_at(&updated, 50) && 201 == updated.count,
+              "%s vector: versions disagree", label);
+        persimm_vector_deinit(&vector);
+        persimm_vector_deinit(&kept);
+        persimm_vector_deinit(&updated);
+        check_live(label, "once the vectors went", 0, 0);
+
+        persimm_list_t list;
+        persimm_list_t tail;
+        persimm_list_init(&list, sizeof(int), &rc_ops, NULL);
+        if (local) persimm_list_make_local(&list);
+        for (int i = 0; i < 50; i++) persimm_list_cons_owned(&list, &i);
+        persimm_list_rest(&list, &tail);
+        persimm_list_rest_owned(&list);
+        persimm_list_deinit(&list);
+        CHECK(49 == tail.count && 48 == *(const int *)persimm_list_first(&tail),
+              "%s list: the tail lost its cells", label);
+        persimm_list_deinit(&tail);
+        check_live(label, "once the lists went", 0, 0);
+
+        persimm_map_t map;
+        persimm_map_t assoced;
+        persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+        persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+        if (local) persimm_map_make_local(&map);
+        for (int i = 0; i < 1000; i++) {
+            entry_t entry = { i, RC_VALUE_BASE + i };
+            persimm_map_assoc_owned(&map, &entry);
+        }
+        entry_t entry = { 7, RC_VALUE_BASE + 1000 };
+        CHECK(PERSIMM_OK == persimm_map_assoc(&map, &entry, &assoced),
+              "%s map: assoc failed", label);
+        persimm_map_share(&map);
+        persimm_map_share(&assoced);
+        int victim = 8;
+        persimm_map_dissoc_owned(&assoced, &victim);
+        CHECK(999 == assoced.count && 1000 == map.count &&
+              RC_VALUE_BASE + 7 == *(const int *)persimm_map_find(&map, &entry.key),
+              "%s map: versions disagree", label);
+        persimm_map_deinit(&map);
+        persimm_map_deinit(&assoced);
+        check_live(label, "once the maps went", 0, 0);
+        CHECK(0 == rc_underflows, "%s: elements were released too often", label);
+    }
+}
+
+static void test_snapshots(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 100; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    persimm_snapshot_t *snapshot;
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_snapshot(&map, 0, &snapshot) && NULL == snapshot,
+          "snapshot: no shards were accepted");
+    CHECK(PERSIMM_OK == persimm_map_snapshot(&map, 4, &snapshot), "snapshot: publishing failed");
+    persimm_map_deinit(&map);
+    CHECK(NULL == persimm_snapshot_vector(snapshot) && NULL == persimm_snapshot_set(snapshot),
+          "snapshot: the wrong accessor answered");
+
+    for (size_t shard = 0; shard < 8; shard++) {
+        CHECK(persimm_snapshot_acquire(snapshot, shard), "snapshot: shard %zu refused", shard);
+        int key = (int)shard;
+        const persimm_map_t *seen = persimm_snapshot_map(snapshot);
+        CHECK(100 == seen->count &&
+              RC_VALUE_BASE + key == *(const int *)persimm_map_find(seen, &key),
+              "snapshot: shard %zu read the wrong map", shard);
+        persimm_snapshot_release(snapshot, shard);
+    }
+
+    /* A reader on shard 5, which is shard 1 of four, outlives the publisher. */
+    CHECK(persimm_snapshot_acquire(snapshot, 5), "snapshot: the reader was refused");
+    persimm_snapshot_retire(snapshot);
+    CHECK(!persimm_snapshot_acquire(snapshot, 2), "snapshot: a closed shard reopened");
+    CHECK(persimm_snapshot_acquire(snapshot, 1), "snapshot: a held shard closed early");
+    persimm_snapshot_release(snapshot, 1);
+    int key = 42;
+    const persimm_map_t *held = persimm_snapshot_map(snapshot);
+    CHECK(RC_VALUE_BASE + 42 == *(const int *)persimm_map_find(held, &key),
+          "snapshot: retiring freed the map under its reader");
+    check_live("snapshot", "while read after retiring", 0, 100);
+    persimm_snapshot_release(snapshot, 5);
+    check_live("snapshot", "once its last reader went", 0, 0);
+    CHECK(0 == rc_underflows, "snapshot: elements were released too often");
+
+    persimm_vector_t vector;
+    persimm_vector_init(&vector, sizeof(int), NULL, NULL);
+    persimm_vector_make_local(&vector);
+    CHECK(PERSIMM_ERR_INVALID == persimm_vector_snapshot(&vector, 1, &snapshot) &&
+          NULL == snapshot, "snapshot: a local source was accepted");
+    persimm_vector_share(&vector);
+    CHECK(PERSIMM_OK == persimm_vector_snapshot(&vector, 1, &snapshot) &&
+          0 == persimm_snapshot_vector(snapshot)->count, "snapshot: publishing a vector failed");
+    persimm_vector_deinit(&vector);
+    persimm_snapshot_retire(snapshot);
+}
+
+static persimm_status add_next_key(const persimm_map_t *current, void *ctx, persimm_map_t *next) {
+    int *calls = ctx;
+    (*calls)++;
+    entry_t entry = { (int)current->count, RC_VALUE_BASE + (int)current->count };
+    return persimm_map_assoc(current, &entry, next);
+}
+
+static persimm_status refuse_update(const persimm_map_t *current, void *ctx, persimm_map_t *next) {
+    (void)current;
+    (void)ctx;
+    (void)next;
+    return PERSIMM_ERR_INVALID;
+}
+
+static void test_atoms(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 10; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    persimm_map_atom_t *atom;
+    persimm_map_make_local(&map);
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_atom_new(&map, NULL, &atom) && NULL == atom,
+          "atom: a local initial version was accepted");
+    persimm_map_share(&map);
+    CHECK(PERSIMM_OK == persimm_map_atom_new(&map, NULL, &atom), "atom: creation failed");
+
+    persimm_map_t stale;
+    persimm_map_t loaded;
+    persimm_map_t published;
+    persimm_map_atom_load(atom, &stale);
+    int calls = 0;
+    CHECK(PERSIMM_OK == persimm_map_atom_swap(atom, add_next_key, &calls, &published) &&
+          1 == calls && 11 == published.count, "atom: swapping failed");
+    persimm_map_atom_load(atom, &loaded);
+    CHECK(11 == loaded.count && loaded.root == published.root,
+          "atom: a load missed the published version");
+
+    bool replaced = true;
+    CHECK(PERSIMM_OK == persimm_map_atom_compare_and_set(atom, &stale, &map, &replaced) &&
+          !replaced, "atom: a stale version was replaced");
+    CHECK(PERSIMM_OK == persimm_map_atom_compare_and_set(atom, &loaded, &map, &replaced) &&
+          replaced, "atom: the current version was not replaced");
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_atom_swap(atom, refuse_update, NULL, NULL),
+          "atom: an update's error was lost");
+    persimm_map_deinit(&loaded);
+    persimm_map_atom_load(atom, &loaded);
+    CHECK(10 == loaded.count && 11 == published.count && 10 == stale.count,
+          "atom: versions disagree");
+
+    persimm_map_deinit(&stale);
+    persimm_map_deinit(&loaded);
+    persimm_map_deinit(&published);
+    persimm_map_deinit(&map);
+    check_live("atom", "while it held the only version", 0, 10);
+    persimm_map_atom_free(atom);
+    check_live("atom", "once it was freed", 0, 0);
+    CHECK(0 == rc_underflows, "atom: elements were released too often");
+}
+
+static persimm_status replace_first(const persimm_map_t *current, void *ctx,
+                                    persimm_map_t *next) {
+    int *value = ctx;
+    entry_t entry = { 0, (*value)++ };
+    return persimm_map_assoc(current, &entry, next);
+}
+
+static void test_epoch_domains(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_epoch_domain_t *domain;
+    CHECK(PERSIMM_ERR_INVALID == persimm_epoch_domain_new(0, &domain) && NULL == domain,
+          "epochs: a domain for no readers was created");
+    CHECK(PERSIMM_OK == persimm_epoch_domain_new(4, &domain), "epochs: creation failed");
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 10; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+    persimm_map_atom_t *plain;
+    persimm_map_atom_t *atom;
+    CHECK(PERSIMM_OK == persimm_map_atom_new(&map, NULL, &plain) &&
+          NULL == persimm_map_atom_read(plain), "epochs: an atom outside a domain was read");
+    CHECK(PERSIMM_OK == persimm_map_atom_new(&map, domain, &atom), "epochs: atom creation failed");
+    persimm_map_atom_free(plain);
+    persimm_map_deinit(&map);
+
+    /* A reader inside its section keeps what it read through any number of swaps. */
+    int key = 0;
+    int next_value = RC_VALUE_BASE + 100;
+    persimm_epoch_enter(domain, 5);
+    const persimm_map_t *seen = persimm_map_atom_read(atom);
+    const int *first = persimm_map_find(seen, &key);
+    for (int i = 0; i < 5; i++) persimm_map_atom_swap(atom, replace_first, &next_value, NULL);
+    CHECK(RC_VALUE_BASE == *first && 1 == live[RC_VALUE_BASE],
+          "epochs: a version was freed under its reader");
+    persimm_epoch_exit(domain, 5);
+
+    for (int i = 0; i < 3; i++) persimm_map_atom_swap(atom, replace_first, &next_value, NULL);
+    persimm_epoch_enter(domain, 2);
+    seen = persimm_map_atom_read(atom);
+    CHECK(RC_VALUE_BASE + 107 == *(const int *)persimm_map_find(seen, &key) &&
+          0 == live[RC_VALUE_BASE] && 0 == live[RC_VALUE_BASE + 100],
+          "epochs: replaced versions outlived their readers");
+    persimm_epoch_exit(domain, 2);
+
+    persimm_map_atom_free(atom);
+    persimm_epoch_domain_free(domain);
+    check_live("epochs", "once the domain was freed", 0, 0);
+    CHECK(0 == rc_underflows, "epochs: elements were released too often");
+}
+
+static void test_concurrent_maps(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 100; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    persimm_concurrent_map_t *shared;
+    persimm_map_make_local(&map);
+    CHECK(PERSIMM_ERR_INVALID == persimm_concurrent_map_new(&map, NULL, &shared) &&
+          NULL == shared, "concurrent: a local initial map was accepted");
+    persimm_map_share(&map);
+    CHECK(PERSIMM_OK == persimm_concurrent_map_new(&map, NULL, &shared),
+          "concurrent: creation failed");
+
+    /* Joining the slots must give back the very shape the map was split from. */
+    persimm_map_t before;
+    CHECK(PERSIMM_OK == persimm_concurrent_map_snapshot(shared, &before) &&
+          100 == before.count && persimm_map_hash(&map) == persimm_map_hash(&before),
+          "concurrent: the first snapshot differs from the initial map");
+    const void *a = NULL;
+    const void *b = NULL;
+    do {
+        a = persimm_map_next(&map, a);
+        b = persimm_map_next(&before, b);
+    } while (NULL != a && NULL != b && 0 == memcmp(a, b, sizeof(entry_t)));
+    CHECK(NULL == a && NULL == b, "concurrent: the snapshot iterates in another order");
+
+    bool added = true;
+    bool removed = false;
+    entry_t entry = { 0, RC_VALUE_BASE };
+    CHECK(PERSIMM_OK == persimm_concurrent_map_assoc(shared, &entry, &added) && !added,
+          "concurrent: replacing a value added a key");
+    entry = (entry_t){ 100, RC_VALUE_BASE + 100 };
+    CHECK(PERSIMM_OK == persimm_concurrent_map_assoc(shared, &entry, &added) && added,
+          "concurrent: adding a key failed");
+    int key = 5;
+    CHECK(PERSIMM_OK == persimm_concurrent_map_dissoc(shared, &key, &removed) && removed,
+          "concurrent: removing a key failed");
+    CHECK(PERSIMM_OK == persimm_concurrent_map_dissoc(shared, &key, &removed) && !removed,
+          "concurrent: an absent key was removed");
+
+    persimm_map_t after;
+    CHECK(PERSIMM_OK == persimm_concurrent_map_snapshot(shared, &after) && 100 == after.count &&
+          !persimm_map_has(&after, &key) && persimm_map_has(&before, &key),
+          "concurrent: snapshots do not hold their moments");
+    key = 100;
+    entry_t got;
+    CHECK(persimm_concurrent_map_get(shared, &key, &got) && RC_VALUE_BASE + 100 == got.value &&
+          2 == live[RC_VALUE_BASE + 100], "concurrent: getting an entry failed");
+    managed_keys.release(&got, NULL);
+    rc_ops.release(&got.value, NULL);
+    key = 5;
+    CHECK(!persimm_concurrent_map_get(shared, &key, &got) &&
+          NULL == persimm_concurrent_map_find(shared, &key),
+          "concurrent: a missing entry was found");
+
+    persimm_concurrent_map_free(shared);
+    persimm_map_deinit(&after);
+    persimm_map_deinit(&before);
+
+    /* In a domain, entries are found in place. */
+    persimm_epoch_domain_t *domain;
+    persimm_epoch_domain_new(1, &domain);
+    CHECK(PERSIMM_OK == persimm_concurrent_map_new(&map, domain, &shared),
+          "concurrent: creation in a domain failed");
+    persimm_map_deinit(&map);
+    persimm_epoch_enter(domain, 0);
+    key = 42;
+    const entry_t *found = persimm_concurrent_map_find(shared, &key);
+    CHECK(NULL != found && RC_VALUE_BASE + 42 == found->value,
+          "concurrent: an entry was not found in place");
+    persimm_epoch_exit(domain, 0);
+    persimm_concurrent_map_free(shared);
+    persimm_epoch_domain_free(domain);
+
+    check_live("concurrent", "once every map was gone", 0, 0);
+    CHECK(0 == rc_underflows, "concurrent: elements were released too often");
+}
+
+static void test_split_join(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    persimm_map_t shards[PERSIMM_SPLIT_WAYS];
+    CHECK(PERSIMM_OK == persimm_map_split(&map, shards), "split: splitting a map failed");
+    size_t total = 0;
+    bool placed = true;
+    for (int i = 0; i < 1000; i++) {
+        uint32_t slot = managed_keys.hash(&i, sizeof(int), NULL) % PERSIMM_SPLIT_WAYS;
+        placed = placed && persimm_map_has(&shards[slot], &i) &&
+                 !persimm_map_has(&shards[(slot + 1) % PERSIMM_SPLIT_WAYS], &i);
+    }
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) total += shards[i].count;
+    CHECK(placed && 1000 == total, "split: keys landed in the wrong shards");
+
+    /* Shards come back together in any order, as the very map they left. */
+    persimm_map_t reversed[PERSIMM_SPLIT_WAYS];
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) {
+        reversed[i] = shards[PERSIMM_SPLIT_WAYS - 1 - i];
+    }
+    persimm_map_t joined;
+    CHECK(PERSIMM_OK == persimm_map_join(reversed, PERSIMM_SPLIT_WAYS, &joined) &&
+          1000 == joined.count && persimm_map_hash(&map) == persimm_map_hash(&joined),
+          "split: joining the shards did not restore the map");
+    const void *a = NULL;
+    const void *b = NULL;
+    do {
+        a = persimm_map_next(&map, a);
+        b = persimm_map_next(&joined, b);
+    } while (NULL != a && NULL != b && 0 == memcmp(a, b, sizeof(entry_t)));
+    CHECK(NULL == a && NULL == b, "split: the joined map iterates in another order");
+    persimm_map_deinit(&joined);
+
+    persimm_map_t overlapping[2] = { shards[3], shards[3] };
+    joined.root = NULL;
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_join(overlapping, 2, &joined) &&
+          NULL == joined.root, "split: shards sharing a slot were joined");
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_join(shards, 0, &joined),
+          "split: joining no shards succeeded");
+    persimm_map_t other;
+    persimm_map_init(&other, &map_layout, NULL, NULL, &managed_keys, NULL);
+    persimm_map_t mixed[2] = { shards[3], other };
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_join(mixed, 2, &joined),
+          "split: shards with different tables were joined");
+    persimm_map_deinit(&other);
+
+    /* A shard of one key joins back as an inline entry. */
+    int key = 7;
+    uint32_t slot = managed_keys.hash(&key, sizeof(int), NULL) % PERSIMM_SPLIT_WAYS;
+    persimm_map_t single;
+    persimm_map_clone(&shards[slot], &single);
+    for (int i = 0; i < 1000; i++) {
+        if (i != key && persimm_map_has(&single, &i)) persimm_map_dissoc_owned(&single, &i);
+    }
+    persimm_map_t pair[2] = { single, shards[(slot + 1) % PERSIMM_SPLIT_WAYS] };
+    CHECK(1 == single.count && PERSIMM_OK == persimm_map_join(pair, 2, &joined) &&
+          joined.count == 1 + pair[1].count && persimm_map_has(&joined, &key),
+          "split: a single-entry shard did not join");
+    persimm_map_t expected;
+    persimm_map_clone(&pair[1], &expected);
+    entry_t entry = { key, RC_VALUE_BASE + key };
+    persimm_map_assoc_owned(&expected, &entry);
+    CHECK(persimm_map_hash(&expected) == persimm_map_hash(&joined),
+          "split: a joined single-entry shard differs from storing its entry");
+    persimm_map_deinit(&expected);
+    persimm_map_deinit(&joined);
+    persimm_map_deinit(&single);
+
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) persimm_map_deinit(&shards[i]);
+    persimm_map_deinit(&map);
+
+    persimm_map_t empty;
+    persimm_map_init(&empty, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    CHECK(PERSIMM_OK == persimm_map_split(&empty, shards) && 0 == shards[0].count &&
+          NULL == shards[PERSIMM_SPLIT_WAYS - 1].root, "split: splitting an empty map failed");
+    CHECK(PERSIMM_OK == persimm_map_join(shards, PERSIMM_SPLIT_WAYS, &joined) &&
+          0 == joined.count && NULL == joined.root, "split: joining empty shards failed");
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) persimm_map_deinit(&shards[i]);
+    persimm_map_deinit(&joined);
+    persimm_map_deinit(&empty);
+
+    persimm_set_t set;
+    persimm_set_init(&set, sizeof(int), &managed_keys, NULL);
+    for (int i = 0; i < 300; i++) persimm_set_conj_owned(&set, &i);
+    persimm_set_t parts[PERSIMM_SPLIT_WAYS];
+    persimm_set_t whole;
+    CHECK(PERSIMM_OK == persimm_set_split(&set, parts) &&
+          PERSIMM_OK == persimm_set_join(parts, PERSIMM_SPLIT_WAYS, &whole) && 300 == whole.count &&
+          persimm_set_hash(&set) == persimm_set_hash(&whole),
+          "split: a set did not survive splitting and joining");
+    persimm_set_t twice[2] = { parts[0], parts[0] };
+    persimm_set_t rejoined;
+    CHECK(PERSIMM_ERR_INVALID == persimm_set_join(twice, 2, &rejoined),
+          "split: set shards sharing a slot were joined");
+    for (size_t i = 0; i < PERSIMM_SPLIT_WAYS; i++) persimm_set_deinit(&parts[i]);
+    persimm_set_deinit(&whole);
+    persimm_set_deinit(&set);
+
+    check_live("split", "once every shard was gone", 0, 0);
+    CHECK(0 == rc_underflows, "split: elements were released too often");
+}
+
+/* A worker that owns a quarter of the slots and edits only the keys that land in them. */
+typedef struct {
+    persimm_map_sharded_transient_t *transient;
+    persimm_status status;
+} sharded_work_t;
+
+static void sharded_worker(void *arg, size_t index) {
+    sharded_work_t *work = arg;
+    for (int i = 0; i < 2000; i++) {
+        size_t slot = persimm_map_sharded_transient_slot(work->transient, &i);
+        if (slot / 8 != index) continue;
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_status status = (i < 1000 && 0 == i % 5)
+                                    ? persimm_map_sharded_transient_dissoc(work->transient, &i)
+                                    : persimm_map_sharded_transient_assoc(work->transient, &entry);
+        if (PERSIMM_OK != status) work->status = status;
+    }
+}
+
+static void test_sharded_transient(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    /* The same edits made on one ordinary transient. */
+    persimm_map_transient_t serial;
+    persimm_map_to_transient(&map, &serial);
+    for (int i = 0; i < 2000; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        if (i < 1000 && 0 == i % 5) {
+            persimm_map_transient_dissoc(&serial, &i);
+        } else {
+            persimm_map_transient_assoc(&serial, &entry);
+        }
+    }
+    persimm_map_t expected;
+    persimm_map_transient_persist(&serial, &expected);
+
+    persimm_map_sharded_transient_t sharded;
+    persimm_map_make_local(&map);
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_to_sharded_transient(&map, &sharded),
+          "sharded: a local source was accepted");
+    persimm_map_share(&map);
+    CHECK(PERSIMM_OK == persimm_map_to_sharded_transient(&map, &sharded),
+          "sharded: starting from a map failed");
+
+    test_executor_t counts = { 0, 0 };
+    persimm_executor executor = { test_executor_run, &counts };
+    sharded_work_t work = { &sharded, PERSIMM_OK };
+    executor.run(executor.ctx, 4, sharded_worker, &work);
+
+    persimm_map_t persisted;
+    CHECK(PERSIMM_OK == work.status &&
+          PERSIMM_OK == persimm_map_sharded_transient_persist(&sharded, &persisted) &&
+          expected.count == persisted.count &&
+          persimm_map_hash(&expected) == persimm_map_hash(&persisted),
+          "sharded: the persisted map differs from a serial transient's");
+    const void *a = NULL;
+    const void *b = NULL;
+    do {
+        a = persimm_map_next(&expected, a);
+        b = persimm_map_next(&persisted, b);
+    } while (NULL != a && NULL != b && 0 == memcmp(a, b, sizeof(entry_t)));
+    CHECK(NULL == a && NULL == b, "sharded: the persisted map iterates in another order");
+    CHECK(1000 == map.count && persimm_map_has(&map, &(int){ 5 }),
+          "sharded: editing changed the source");
+
+    persimm_map_t again;
+    entry_t entry = { 1, RC_VALUE_BASE + 1 };
+    CHECK(PERSIMM_ERR_INVALID == persimm_map_sharded_transient_persist(&sharded, &again) &&
+          PERSIMM_ERR_INVALID == persimm_map_sharded_transient_assoc(&sharded, &entry),
+          "sharded: a persisted transient was used again");
+    persimm_map_sharded_transient_deinit(&sharded);
+
+    CHECK(PERSIMM_OK == persimm_map_sharded_transient_init(&sharded, &map_layout, &rc_ops, NULL,
+                                                           &managed_keys, NULL),
+          "sharded: starting empty failed");
+    CHECK(PERSIMM_OK == persimm_map_sharded_transient_assoc(&sharded, &entry),
+          "sharded: storing in an empty transient failed");
+    persimm_map_sharded_transient_deinit(&sharded);
+
+    /* A slot persisted on its own leaves the whole unable to persist. */
+    persimm_map_to_sharded_transient(&map, &sharded);
+    size_t slot = persimm_map_sharded_transient_slot(&sharded, &entry);
+    persimm_map_t part;
+    CHECK(PERSIMM_OK == persimm_map_transient_persist(&sharded.slots[slot].transient, &part) &&
+          PERSIMM_ERR_INVALID == persimm_map_sharded_transient_persist(&sharded, &again) &&
+          NULL == again.root, "sharded: a transient missing a slot was persisted");
+    persimm_map_sharded_transient_deinit(&sharded);
+    persimm_map_deinit(&part);
+
+    persimm_map_deinit(&persisted);
+    persimm_map_deinit(&expected);
+    persimm_map_deinit(&map);
+
+    check_live("sharded", "once every map was gone", 0, 0);
+    CHECK(0 == rc_underflows, "sharded: elements were released too often");
+}
+
+static void test_memory_stats(void) {
+    persimm_memory_stats stats;
+    size_t bytes;
+
+    persimm_vector_t vector;
+    persimm_vector_init(&vector, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 100; i++) persimm_vector_push_owned(&vector, &i);
+    persimm_vector_memory_stats(&vector, &stats);
+    CHECK(1 == stats.branch_nodes && 4 == stats.leaf_nodes &&
+          100 * sizeof(int) == stats.elem_bytes && 0 == stats.shared_bytes &&
+          stats.branch_bytes + stats.leaf_bytes == stats.exclusive_bytes,
+          "memory: a vector was measured wrongly");
+    size_t total = stats.exclusive_bytes;
+    size_t leaf = stats.leaf_bytes / stats.leaf_nodes;
+
+    /* Cloning shares everything, and an update owns only the path it copied. */
+    persimm_vector_t updated;
+    int value = -1;
+    persimm_vector_update(&vector, 0, &value, &updated);
+    persimm_vector_memory_stats(&updated, &stats);
+    CHECK(stats.branch_bytes + leaf == stats.exclusive_bytes &&
+          total - stats.exclusive_bytes == stats.shared_bytes,
+          "memory: an updated vector's sharing was measured wrongly");
+    CHECK(PERSIMM_OK == persimm_vector_memory_delta(&vector, &updated, &bytes) &&
+          stats.exclusive_bytes == bytes, "memory: a vector delta was wrong");
+    CHECK(PERSIMM_OK == persimm_vector_memory_delta(&vector, &vector, &bytes) && 0 == bytes,
+          "memory: a vector differs from itself");
+    persimm_vector_deinit(&updated);
+
+    persimm_list_t list;
+    persimm_list_t longer;
+    persimm_list_init(&list, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 10; i++) persimm_list_cons_owned(&list, &i);
+    persimm_list_cons(&list, &value, &longer);
+    persimm_list_memory_stats(&longer, &stats);
+    CHECK(11 == stats.leaf_nodes && 11 * sizeof(int) == stats.elem_bytes &&
+          stats.exclusive_bytes * 10 == stats.shared_bytes,
+          "memory: a list was measured wrongly");
+    CHECK(PERSIMM_OK == persimm_list_memory_delta(&list, &longer, &bytes) &&
+          stats.exclusive_bytes == bytes, "memory: a list delta was wrong");
+    persimm_list_deinit(&longer);
+
+    persimm_map_t map;
+    persimm_map_t changed;
+    persimm_map_init(&map, &map_layout, NULL, NULL, &spread_ops, NULL);
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+    persimm_map_memory_stats(&map, &stats);
+    CHECK(0 == stats.leaf_nodes && stats.branch_nodes > 32 &&
+          1000 * sizeof(entry_t) == stats.elem_bytes && stats.branch_bytes == stats.exclusive_bytes,
+          "memory: a map was measured wrongly");
+    total = stats.exclusive_bytes;
+    entry_t entry = { 5, -5 };
+    persimm_map_assoc(&map, &entry, &changed);
+    persimm_map_memory_stats(&changed, &stats);
+    CHECK(total == stats.exclusive_bytes + stats.shared_bytes && stats.exclusive_bytes < total &&
+          PERSIMM_OK == persimm_map_memory_delta(&map, &changed, &bytes) &&
+          stats.exclusive_bytes == bytes, "memory: a map delta was wrong");
+    persimm_map_deinit(&changed);
+
+    /* Keys that share every hash bit end up in collision nodes, counted as leaves. */
+    persimm_map_t crowded;
+    persimm_map_init(&crowded, &map_layout, NULL, NULL, &crowded_ops, NULL);
+    for (int i = 0; i < 40; i++) {
+        entry_t item = { i, i };
+        persimm_map_assoc_owned(&crowded, &item);
+    }
+    persimm_map_memory_stats(&crowded, &stats);
+    CHECK(stats.leaf_nodes > 0 && 40 * sizeof(entry_t) == stats.elem_bytes,
+          "memory: collision nodes were not counted");
+    persimm_map_deinit(&crowded);
+
+    persimm_set_t set;
+    persimm_set_t empty;
+    persimm_set_init(&set, sizeof(int), &spread_ops, NULL);
+    persimm_set_init(&empty, sizeof(int), &spread_ops, NULL);
+    for (int i = 0; i < 100; i++) persimm_set_conj_owned(&set, &i);
+    persimm_set_memory_stats(&set, &stats);
+    CHECK(100 * sizeof(int) == stats.elem_bytes &&
+          PERSIMM_OK == persimm_set_memory_delta(&empty, &set, &bytes) &&
+          stats.exclusive_bytes == bytes, "memory: a set was measured wrongly");
+
+#if defined(PERSIMM_TEST_ALLOC)
+    fail_allocation_after(0);
+    CHECK(PERSIMM_ERR_ALLOC == persimm_map_memory_delta(&map, &map, &bytes) && 0 == bytes &&
+          PERSIMM_ERR_ALLOC == persimm_vector_memory_delta(&vector, &vector, &bytes) &&
+          PERSIMM_ERR_ALLOC == persimm_list_memory_delta(&list, &list, &bytes),
+          "memory: a failed delta did not report it");
+    allow_allocations();
+#endif
+
+    persimm_set_deinit(&set);
+    persimm_map_deinit(&map);
+    persimm_list_deinit(&list);
+    persimm_vector_deinit(&vector);
+}
+
+static void test_shape_stats(void) {
+    persimm_shape_stats stats;
+
+    persimm_map_t map;
+    persimm_map_init(&map, &map_layout, NULL, NULL, &spread_ops, NULL);
+    persimm_map_shape_stats(&map, &stats);
+    CHECK(0 == stats.entries && 0 == stats.bitmap_nodes && 0.0 == stats.equals_per_hit,
+          "shape: an empty map has a shape");
+
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+    persimm_map_shape_stats(&map, &stats);
+    size_t placed = 0;
+    for (size_t i = 0; i <= stats.max_depth && i < 8; i++) placed += stats.depths[i];
+    CHECK(1000 == stats.entries && 1000 == placed && 0 == stats.collision_nodes &&
+          stats.max_depth >= 1 && 1.0 == stats.equals_per_hit && stats.equals_per_miss < 1.0 &&
+          stats.children_per_node > 0.0,
+          "shape: a well-hashed map has the wrong shape");
+    persimm_map_deinit(&map);
+
+    /* Four hashes for forty keys: four collision nodes of ten, each searched end to end. */
+    persimm_map_init(&map, &map_layout, NULL, NULL, &crowded_ops, NULL);
+    for (int i = 0; i < 40; i++) {
+        entry_t entry = { i, i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+    persimm_map_shape_stats(&map, &stats);
+    CHECK(4 == stats.collision_nodes && 40 == stats.collision_entries &&
+          10 == stats.largest_collision && 4 == stats.collision_sizes[2] &&
+          40 == stats.depths[1] && 5.5 == stats.equals_per_hit && stats.equals_per_miss < 0.001,
+          "shape: collisions were measured wrongly");
+    persimm_map_deinit(&map);
+
+    persimm_set_t set;
+    persimm_set_init(&set, sizeof(int), &crowded_ops, NULL);
+    for (int i = 0; i < 3; i++) persimm_set_conj_owned(&set, &i);
+    persimm_set_shape_stats(&set, &stats);
+    CHECK(3 == stats.entries && 0 == stats.collision_nodes && 3 == stats.depths[0] &&
+          1 == stats.bitmap_nodes && 3.0 == stats.entries_per_node,
+          "shape: a set was measured wrongly");
+    persimm_set_deinit(&set);
+}
+
+static bool op_counts_zero(const persimm_op_counts *counts) {
+    return 0 == counts->node_allocs && 0 == counts->node_frees && 0 == counts->path_copies &&
+           0 == counts->in_place_edits && 0 == counts->hash_calls && 0 == counts->equals_calls &&
+           0 == counts->retains && 0 == counts->releases && 0 == counts->collision_scans;
+}
+
+static void test_op_stats(void) {
+    persimm_op_stats stats;
+    persimm_stats_reset();
+    if (!persimm_stats_snapshot(&stats)) {
+        CHECK(op_counts_zero(&stats.vector) && op_counts_zero(&stats.list) &&
+              op_counts_zero(&stats.hamt),
+              "op stats: a build without counters reported some");
+        return;
+    }
+
+    persimm_vector_t vector;
+    persimm_vector_init(&vector, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 100; i++) persimm_vector_push_owned(&vector, &i);
+    persimm_stats_snapshot(&stats);
+    uint64_t allocs = stats.vector.node_allocs;
+    uint64_t edits = stats.vector.in_place_edits;
+    CHECK(allocs > 0 && 100 == stats.vector.retains && op_counts_zero(&stats.hamt),
+          "op stats: owned pushes were miscounted");
+
+    int value = -1;
+    persimm_vector_t updated;
+    persimm_vector_update(&vector, 50, &value, &updated);
+    persimm_stats_snapshot(&stats);
+    CHECK(stats.vector.path_copies > 0 && stats.vector.node_allocs > allocs &&
+          edits == stats.vector.in_place_edits,
+          "op stats: a persistent update copied nothing");
+    persimm_vector_deinit(&updated);
+    persimm_vector_deinit(&vector);
+    persimm_stats_snapshot(&stats);
+    CHECK(stats.vector.node_frees == stats.vector.node_allocs,
+          "op stats: vector nodes were not all freed");
+
+    persimm_list_t list;
+    persimm_list_t consed;
+    persimm_list_init(&list, sizeof(int), NULL, NULL);
+    persimm_list_cons(&list, &value, &consed);
+    persimm_list_deinit(&consed);
+    persimm_list_deinit(&list);
+    persimm_stats_snapshot(&stats);
+    CHECK(1 == stats.list.node_allocs && 1 == stats.list.node_frees &&
+          1 == stats.list.retains && 1 == stats.list.releases,
+          "op stats: a cons was miscounted");
+
+    /* Every key of a crowded map lands in one of four collision nodes. */
+    persimm_stats_reset();
+    persimm_map_t map;
+    persimm_map_init(&map, &map_layout, NULL, NULL, &crowded_ops, NULL);
+    for (int i = 0; i < 40; i++) {
+        entry_t entry = { i, i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+    persimm_stats_snapshot(&stats);
+    uint64_t hashes = stats.hamt.hash_calls;
+    uint64_t scans = stats.hamt.collision_scans;
+    CHECK(hashes >= 40 && stats.hamt.equals_calls > 0 && scans > 0 &&
+          stats.hamt.in_place_edits > 0 && stats.hamt.path_copies > 0 &&
+          stats.hamt.retains >= 40 && op_counts_zero(&stats.vector),
+          "op stats: crowded inserts were miscounted");
+
+    int key = 7;
+    persimm_map_find(&map, &key);
+    persimm_stats_snapshot(&stats);
+    CHECK(hashes + 1 == stats.hamt.hash_calls && scans + 1 == stats.hamt.collision_scans,
+          "op stats: a lookup was miscounted");
+    persimm_map_deinit(&map);
+    persimm_stats_snapshot(&stats);
+    CHECK(stats.hamt.node_frees == stats.hamt.node_allocs &&
+          stats.hamt.releases == stats.hamt.retains,
+          "op stats: map nodes were not all freed");
+
+    persimm_stats_reset();
+    persimm_stats_snapshot(&stats);
+    CHECK(op_counts_zero(&stats.hamt), "op stats: a reset kept counts");
+}
+
+static void test_borrowed_views(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_map_t map;
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 500; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&map, &entry);
+    }
+
+    persimm_map_view_t view;
+    persimm_map_borrow(&map, &view);
+    const persimm_map_t *seen = persimm_map_view(&view);
+    size_t visited = 0;
+    const void *at = NULL;
+    while (NULL != (at = persimm_map_next(seen, at))) visited++;
+    int key = 99;
+    persimm_map_t assoced;
+    entry_t entry = { 500, RC_VALUE_BASE + 500 };
+    CHECK(500 == visited && RC_VALUE_BASE + 99 == *(const int *)persimm_map_find(seen, &key),
+          "map view: reads disagree with the owner");
+    CHECK(PERSIMM_OK == persimm_map_assoc(seen, &entry, &assoced) && 501 == assoced.count,
+          "map view: a persistent update failed");
+    persimm_map_deinit(&assoced);
+    check_live("map view", "after a derived version went", 0, 500);
+
+    persimm_vector_t vector;
+    persimm_vector_init(&vector, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 100; i++) persimm_vector_push_owned(&vector, &i);
+    persimm_vector_view_t vector_view;
+    persimm_vector_borrow(&vector, &vector_view);
+    CHECK(persimm_vector_equals(persimm_vector_view(&vector_view), &vector, NULL, NULL),
+          "vector view: differs from its owner");
+
+    persimm_list_t list;
+    persimm_list_init(&list, sizeof(int), NULL, NULL);
+    for (int i = 0; i < 10; i++) persimm_list_cons_owned(&list, &i);
+    persimm_list_view_t list_view;
+    persimm_list_borrow(&list, &list_view);
+    persimm_list_cursor_t cursor;
+    persimm_list_cursor_reset(&cursor);
+    int sum = 0;
+    for (size_t i = 0; i < 10; i++) {
+        sum += *(const int *)persimm_list_at_from(persimm_list_view(&list_view), &cursor, i);
+    }
+    CHECK(45 == sum, "list view: walked the wrong cells");
+
+#if defined(PERSIMM_TEST_ALLOC)
+    /* Having taken no reference, the view leaves the owner free to update in place. */
+    int replacement = -1;
+    fail_allocation_after(0);
+    CHECK(PERSIMM_OK == persimm_vector_update_owned(&vector, 3, &replacement),
+          "vector view: borrowing forced a copy");
+    allow_allocations();
+#endif
+
+    persimm_vector_deinit(&vector);
+    persimm_list_deinit(&list);
+    persimm_map_deinit(&map);
+    check_live("map view", "once the owner went", 0, 0);
+    CHECK(0 == rc_underflows, "views: elements were released too often");
+}
+
+/* Frozen storage is never freed, so it stays reachable from here for the leak checker. */
+static persimm_vector_t frozen_vector;
+static persimm_list_t frozen_list;
+static persimm_map_t frozen_map;
+
+/* check_live for vectors and lists, whose elements have no value half. */
+static void check_elements_live(const char *label, const char *when, int n) {
+    int wrong = 0;
+    for (int i = 0; i < RC_SPACE; i++) {
+        if (live[i] != (i < n ? 1 : 0)) wrong++;
+    }
+    CHECK(0 == wrong, "%s: %s, %d elements at the wrong count", label, when, wrong);
+}
+
+static void test_frozen_collections(void) {
+    memset(live, 0, sizeof(live));
+    rc_underflows = 0;
+
+    persimm_key_ops managed_keys = rc_key_ops(&spread_ops);
+    persimm_map_init(&frozen_map, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+    for (int i = 0; i < 1000; i++) {
+        entry_t entry = { i, RC_VALUE_BASE + i };
+        persimm_map_assoc_owned(&frozen_map, &entry);
+    }
+    persimm_map_freeze(&frozen_map);
+    persimm_map_freeze(&frozen_map);
+
+    persimm_map_t clone;
+    persimm_map_t updated;
+    persimm_map_clone(&frozen_map, &clone);
+    entry_t entry = { 1000, RC_VALUE_BASE + 1000 };
+    CHECK(PERSIMM_OK == persimm_map_assoc(&clone, &entry, &updated), "frozen map: assoc failed");
+    persimm_map_deinit(&clone);
+    int victim = 10;
+    persimm_map_dissoc_owned(&updated, &victim);
+    CHECK(1000 == updated.count && NULL == persimm_map_find(&updated, &victim) &&
+          RC_VALUE_BASE + 10 == *(const int *)persimm_map_find(&frozen_map, &victim),
+          "frozen map: versions disagree");
+    persimm_map_deinit(&updated);
+    check_live("frozen map", "once its versions went", 0, 1000);
+
+    /* Updated in place, a copy must still leave the frozen nodes intact. */
+    persimm_map_t thinned;
+    persimm_map_clone(&frozen_map, &thinned);
+    for (int i = 0; i < 1000; i += 2) persimm_map_dissoc_owned(&thinned, &i);
+    persimm_map_deinit(&thinned);
+    check_live("frozen map", "once a thinned copy went", 0, 1000);
+    CHECK(1000 == frozen_map.count && 0 == rc_underflows, "frozen map: its storage changed");
+
+    memset(live, 0, sizeof(live));
+    persimm_vector_init(&frozen_vector, sizeof(int), &rc_ops, NULL);
+    persimm_vector_make_local(&frozen_vector);
+    for (int i = 0; i < 1100; i++) persimm_vector_push_owned(&frozen_vector, &i);
+    persimm_vector_freeze(&frozen_vector);
+    persimm_vector_t pushed;
+    persimm_vector_clone(&frozen_vector, &pushed);
+    int replacement = 1100;
+    persimm_vector_update_owned(&pushed, 3, &replacement);
+    persimm_vector_push_owned(&pushed, &replacement);
+    CHECK(3 == *(const int *)persimm_vector_at(&frozen_vector, 3) &&
+          1100 == *(const int *)persimm_vector_at(&pushed, 3) && 1101 == pushed.count,
+          "frozen vector: versions disagree");
+    persimm_vector_deinit(&pushed);
+    check_elements_live("frozen vector", "once its versions went", 1100);
+
+    memset(live, 0, sizeof(live));
+    persimm_list_init(&frozen_list, sizeof(int), &rc_ops, NULL);
+    for (int i = 0; i < 100; i++) persimm_list_cons_owned(&frozen_list, &i);
+    persimm_list_t rest;
+    persimm_list_clone(&frozen_list, &rest);
+    persimm_list_freeze(&rest);
+    persimm_list_rest_owned(&rest);
+    persimm_list_deinit(&rest);
+    check_elements_live("frozen list", "once its versions went", 100);
+    CHECK(0 == rc_underflows, "frozen: elements were released too often");
+}
+
 #if defined(PERSIMM_TEST_ALLOC)
 static void test_persistent_failure_contracts(void) {
     int value = 1;
@@ -1212,6 +3136,75 @@ static void build_fault_map(persimm_map_t *map, const persimm_key_ops *ops) {
     }
 }
 
+/*
+ * A failed owned update must leave the collection it was handed as it was,
+ * whether the path it failed on was its own or shared with a clone.
+ */
+static void test_owned_allocation_failures(void) {
+    for (int shared = 0; shared < 2; shared++) {
+        bool reached_success = false;
+        for (int fail = 0; fail < 16 && !reached_success; fail++) {
+            persimm_vector_t vector;
+            persimm_vector_t kept;
+            persimm_vector_init(&vector, sizeof(int), NULL, NULL);
+            for (int i = 0; i < 64; i++) persimm_vector_push_owned(&vector, &i);
+            if (shared) persimm_vector_clone(&vector, &kept);
+
+            int fresh = 64;
+            fail_allocation_after(fail);
+            persimm_status status = persimm_vector_push_owned(&vector, &fresh);
+            allow_allocations();
+
+            if (PERSIMM_ERR_ALLOC == status) {
+                bool intact = 64 == vector.count;
+                for (int i = 0; intact && i < 64; i++) {
+                    intact = i == *(const int *)persimm_vector_at(&vector, (size_t)i);
+                }
+                CHECK(intact, "owned allocation: failed vector push changed the vector");
+            } else {
+                CHECK(PERSIMM_OK == status && 65 == vector.count,
+                      "owned allocation: vector push returned an unexpected status");
+                reached_success = true;
+            }
+
+            if (shared) persimm_vector_deinit(&kept);
+            persimm_vector_deinit(&vector);
+            CHECK(0 == allocated_blocks, "owned allocation: vector leaked %zu blocks",
+                  allocated_blocks);
+        }
+        CHECK(reached_success, "owned allocation: vector push never succeeded");
+
+        reached_success = false;
+        for (int fail = 0; fail < 16 && !reached_success; fail++) {
+            persimm_map_t map;
+            persimm_map_t kept;
+            build_fault_map(&map, &spread_ops);
+            if (shared) persimm_map_clone(&map, &kept);
+
+            entry_t fresh = { 1000, 1000 };
+            fail_allocation_after(fail);
+            persimm_status status = persimm_map_assoc_owned(&map, &fresh);
+            allow_allocations();
+
+            if (PERSIMM_ERR_ALLOC == status) {
+                bool intact = 64 == map.count && !persimm_map_has(&map, &fresh.key);
+                for (int i = 0; intact && i < 64; i++) intact = persimm_map_has(&map, &i);
+                CHECK(intact, "owned allocation: failed map assoc changed the map");
+            } else {
+                CHECK(PERSIMM_OK == status && 65 == map.count,
+                      "owned allocation: map assoc returned an unexpected status");
+                reached_success = true;
+            }
+
+            if (shared) persimm_map_deinit(&kept);
+            persimm_map_deinit(&map);
+            CHECK(0 == allocated_blocks, "owned allocation: map leaked %zu blocks",
+                  allocated_blocks);
+        }
+        CHECK(reached_success, "owned allocation: map assoc never succeeded");
+    }
+}
+
 static void test_assoc_allocation_failures(void) {
     bool reached_success = false;
     for (int fail = 0; fail < 32 && !reached_success; fail++) {
@@ -1305,6 +3298,102 @@ static void test_collision_reparent_allocation_failures(void) {
     }
     CHECK(reached_success, "allocation: collision assoc never reached success");
 }
+
+/* Every allocation a bulk build makes can fail, and each failure must leave an
+   empty map and nothing allocated, with the key and value counts balanced. */
+static void test_from_entries_allocation_failures(void) {
+    entry_t entries[300];
+    for (int i = 0; i < 300; i++) entries[i] = (entry_t){ i % 250, RC_VALUE_BASE + i };
+    persimm_key_ops managed_keys = rc_key_ops(&crowded_ops);
+    test_executor_t counts = { 0, 0 };
+    persimm_executor executor = { test_executor_run, &counts };
+
+    for (int pass = 0; pass < 2; pass++) {
+        bool reached_success = false;
+        for (int fail = 0; fail < 64 && !reached_success; fail++) {
+            memset(live, 0, sizeof(live));
+            rc_underflows = 0;
+
+            persimm_map_t map;
+            fail_allocation_after(fail);
+            const persimm_executor *through = (0 == pass) ? NULL : &executor;
+            persimm_status status = persimm_map_parallel_from_entries(entries, 300, &map_layout,
+                                                                      &rc_ops, NULL,
+                                                                      &managed_keys, NULL,
+                                                                      through, &map);
+            allow_allocations();
+
+            if (PERSIMM_ERR_ALLOC == status) {
+                CHECK(0 == map.count && NULL == map.root,
+                      "allocation: a failed bulk build left entries behind");
+            } else {
+                CHECK(PERSIMM_OK == status && 250 == map.count,
+                      "allocation: bulk build returned a bad status or count");
+                reached_success = true;
+            }
+
+            persimm_map_deinit(&map);
+            check_live("allocation", "after a bulk build", 0, 0);
+            CHECK(0 == rc_underflows, "allocation: bulk build over-released");
+            CHECK(0 == allocated_blocks, "allocation: bulk build leaked %zu blocks",
+                  allocated_blocks);
+        }
+        CHECK(reached_success, "allocation: bulk build never reached success");
+    }
+}
+/* Every allocation a batch makes can fail, including the parent lent to a
+   collision node, and each failure must leave the source as it was and the
+   destination empty, with nothing allocated beyond the source. */
+static void test_update_many_allocation_failures(void) {
+    entry_t batch[40];
+    int keys[40];
+    for (int i = 0; i < 40; i++) {
+        batch[i] = (entry_t){ i * 2, RC_VALUE_BASE + i };
+        keys[i] = i * 3;
+    }
+    persimm_key_ops managed_keys = rc_key_ops(&shallow_ops);
+
+    for (int pass = 0; pass < 2; pass++) {
+        const char *what = (0 == pass) ? "assoc many" : "dissoc many";
+        bool reached_success = false;
+        for (int fail = 0; fail < 64 && !reached_success; fail++) {
+            memset(live, 0, sizeof(live));
+            rc_underflows = 0;
+
+            persimm_map_t base;
+            persimm_map_init(&base, &map_layout, &rc_ops, NULL, &managed_keys, NULL);
+            for (int i = 0; i < 60; i += 2) {
+                entry_t entry = { i, RC_VALUE_BASE + 50 + i };
+                test_map_transient_assoc(&base, &entry);
+            }
+
+            persimm_map_t result;
+            fail_allocation_after(fail);
+            persimm_status status = (0 == pass)
+                                        ? persimm_map_assoc_many(&base, batch, 40, &result)
+                                        : persimm_map_dissoc_many(&base, keys, 40, &result);
+            allow_allocations();
+
+            if (PERSIMM_ERR_ALLOC == status) {
+                CHECK(0 == result.count && NULL == result.root,
+                      "allocation: a failed %s left entries behind", what);
+            } else {
+                CHECK(PERSIMM_OK == status, "allocation: %s returned a bad status", what);
+                reached_success = true;
+            }
+            CHECK(30 == base.count && persimm_map_has(&base, &keys[2]),
+                  "allocation: %s changed its source", what);
+
+            persimm_map_deinit(&result);
+            persimm_map_deinit(&base);
+            check_live("allocation", what, 0, 0);
+            CHECK(0 == rc_underflows, "allocation: %s over-released", what);
+            CHECK(0 == allocated_blocks, "allocation: %s leaked %zu blocks", what,
+                  allocated_blocks);
+        }
+        CHECK(reached_success, "allocation: %s never reached success", what);
+    }
+}
 #endif
 
 /* Running */
@@ -1327,6 +3416,9 @@ int main(void) {
         test_set(&spread_ops, label, n);
         test_map_refcounts(&spread_ops, label, n);
         test_set_refcounts(&spread_ops, label, n);
+        test_from_entries(&spread_ops, label, n);
+        test_update_many(&spread_ops, label, n);
+        test_map_hashes(&spread_ops, label, n);
 
         /* The same again with every key crowded into one of four hashes. The
            largest size is left out because a collision node is a flat run of
@@ -1341,10 +3433,14 @@ int main(void) {
         test_set(&crowded_ops, label, n);
         test_map_refcounts(&crowded_ops, label, n);
         test_set_refcounts(&crowded_ops, label, n);
+        test_from_entries(&crowded_ops, label, n);
+        test_update_many(&crowded_ops, label, n);
+        test_map_hashes(&crowded_ops, label, n);
     }
 
     test_byte_defaults();
     test_map_separates_key_and_value_lifecycles();
+    test_trace_epochs();
     test_rejects_a_bad_layout();
     test_persistent_operation_contracts();
     test_empty_transient_initialisers();
@@ -1352,15 +3448,38 @@ int main(void) {
     test_replacement_may_alias_storage();
     test_rejects_overflowing_allocations();
     test_vector_transient();
+    test_vector_equals_and_diff();
+    test_update_many_through_collisions();
+    test_vector_hashes();
+    test_vector_parallel();
+    test_hamt_parallel();
+    test_parallel_build();
     test_map_transient();
     test_set_transient();
+    test_owned_updates();
+    test_local_refcounts();
+    test_snapshots();
+    test_atoms();
+    test_epoch_domains();
+    test_concurrent_maps();
+    test_split_join();
+    test_sharded_transient();
+    test_memory_stats();
+    test_shape_stats();
+    test_op_stats();
+    test_borrowed_views();
 #if defined(PERSIMM_TEST_ALLOC)
     test_persistent_failure_contracts();
     test_transient_allocation_failures();
+    test_owned_allocation_failures();
     test_assoc_allocation_failures();
     test_dissoc_allocation_failures();
     test_collision_reparent_allocation_failures();
+    test_from_entries_allocation_failures();
+    test_update_many_allocation_failures();
 #endif
+    /* Last, because frozen storage would count against every leak check after it. */
+    test_frozen_collections();
 
     if (failures > 0) {
         printf("%d checks failed\n", failures);
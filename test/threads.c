@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "persimmon.h"
+
+/*
+ * Checks that need threads of their own, and so cannot live in test/core.c,
+ * which builds anywhere a C99 compiler does. These want POSIX threads.
+ *
+ * The concurrent map's snapshot races its writers a few times and then holds
+ * them back. Racing almost always succeeds in a test, so this is built with
+ * PERSIMM_CONCURRENT_TRIES at 0 and every snapshot takes the second path
+ * while writers run. Each writer bumps a pair of keys, the first and then the
+ * second, so a snapshot of one moment sees the pair equal or the first one
+ * ahead by one, and never sees either go backwards.
+ */
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do {                     \
+    if (!(cond)) {                                \
+        printf("  FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__);                      \
+        printf("\n");                             \
+        failures++;                               \
+    }                                             \
+} while (0)
+
+#define WRITERS 4
+#define ROUNDS 20000
+
+typedef struct {
+    int key;
+    int value;
+} entry_t;
+
+static const persimm_entry_layout layout = {
+    sizeof(entry_t),            /* Entry Size */
+    sizeof(int),                /* Key Size */
+    offsetof(entry_t, value),   /* Value Offset */
+    sizeof(int)                 /* Value Size */
+};
+
+typedef struct {
+    persimm_concurrent_map_t *map;
+    int writer;
+    persimm_status status;
+} writer_t;
+
+static pthread_mutex_t finished_lock = PTHREAD_MUTEX_INITIALIZER;
+static int finished = 0;
+
+static void *write_pairs(void *arg) {
+    writer_t *writer = arg;
+    writer->status = PERSIMM_OK;
+    for (int round = 1; round <= ROUNDS && PERSIMM_OK == writer->status; round++) {
+        entry_t first = { 2 * writer->writer, round };
+        entry_t second = { 2 * writer->writer + 1, round };
+        writer->status = persimm_concurrent_map_assoc(writer->map, &first, NULL);
+        if (PERSIMM_OK == writer->status) {
+            writer->status = persimm_concurrent_map_assoc(writer->map, &second, NULL);
+        }
+    }
+    pthread_mutex_lock(&finished_lock);
+    finished++;
+    pthread_mutex_unlock(&finished_lock);
+    return NULL;
+}
+
+static bool writing(void) {
+    pthread_mutex_lock(&finished_lock);
+    bool running = finished < WRITERS;
+    pthread_mutex_unlock(&finished_lock);
+    return running;
+}
+
+static int value_of(const persimm_map_t *map, int key) {
+    const entry_t *found = persimm_map_find_entry(map, &key);
+    return NULL == found ? -1 : found->value;
+}
+
+static void test_snapshots_hold_writers_back(void) {
+    persimm_map_t initial;
+    persimm_map_init(&initial, &layout, NULL, NULL, NULL, NULL);
+    for (int key = 0; key < 2 * WRITERS; key++) {
+        entry_t entry = { key, 0 };
+        persimm_map_assoc_owned(&initial, &entry);
+    }
+    persimm_concurrent_map_t *map;
+    CHECK(PERSIMM_OK == persimm_concurrent_map_new(&initial, NULL, &map),
+          "snapshots: creation failed");
+    persimm_map_deinit(&initial);
+
+    pthread_t ids[WRITERS];
+    writer_t writers[WRITERS];
+    for (int w = 0; w < WRITERS; w++) {
+        writers[w] = (writer_t){ map, w, PERSIMM_OK };
+        if (0 != pthread_create(&ids[w], NULL, write_pairs, &writers[w])) {
+            fprintf(stderr, "could not start writer %d\n", w);
+            exit(1);
+        }
+    }
+
+    int seen[2 * WRITERS] = { 0 };
+    size_t snapshots = 0;
+    do {
+        persimm_map_t snapshot;
+        persimm_status status = persimm_concurrent_map_snapshot(map, &snapshot);
+        CHECK(PERSIMM_OK == status && 2 * WRITERS == snapshot.count,
+              "snapshots: snapshot %zu failed or lost keys", snapshots);
+        for (int w = 0; w < WRITERS && PERSIMM_OK == status; w++) {
+            int first = value_of(&snapshot, 2 * w);
+            int second = value_of(&snapshot, 2 * w + 1);
+            CHECK(first == second || first == second + 1,
+                  "snapshots: writer %d's pair was torn at %d and %d", w, first, second);
+            CHECK(first >= seen[2 * w] && second >= seen[2 * w + 1],
+                  "snapshots: writer %d's pair went backwards", w);
+            seen[2 * w] = first;
+            seen[2 * w + 1] = second;
+        }
+        persimm_map_deinit(&snapshot);
+        snapshots++;
+    } while (writing());
+
+    for (int w = 0; w < WRITERS; w++) {
+        pthread_join(ids[w], NULL);
+        CHECK(PERSIMM_OK == writers[w].status, "snapshots: writer %d failed", w);
+    }
+
+    persimm_map_t last;
+    CHECK(PERSIMM_OK == persimm_concurrent_map_snapshot(map, &last),
+          "snapshots: the last snapshot failed");
+    for (int key = 0; key < 2 * WRITERS; key++) {
+        CHECK(ROUNDS == value_of(&last, key), "snapshots: writes to key %d were lost", key);
+    }
+    persimm_map_deinit(&last);
+    persimm_concurrent_map_free(map);
+}
+
+int main(void) {
+    if (!persimm_has_atomic_refcounts()) {
+        printf("thread checks skipped: this build counts references without atomics\n");
+        return 0;
+    }
+
+    test_snapshots_hold_writers_back();
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("thread checks passed\n");
+    return 0;
+}